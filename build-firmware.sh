@@ -134,15 +134,24 @@ if [ ! -e $FSOUT ]; then
 	exit 1
 fi
 
-# Append the new file system to the first part of the original firmware file
-cp $HEADER_IMAGE $FWOUT
-$SUDO cat $FSOUT >> $FWOUT
+# Assemble the header image, the new file system, any filler and the footer in one pass,
+# calculating new checksum values for the firmware header(s) as the image is written.
+# trx, dlob, uimage
+# Buffalo and some other post-processors obfuscate these images
+# so we must always do this prior to vendor processing below
+FWBUILD_ARGS="-l $BINLOG"
+if [ "$NEXT_PARAM" == "-nopad" ]; then
+	FWBUILD_ARGS="$FWBUILD_ARGS -n"
+fi
+if [ "$FOOTER_SIZE" -gt "0" ]; then
+	FWBUILD_ARGS="$FWBUILD_ARGS -f $FOOTER_IMAGE"
+fi
 
-# Calculate and create any filler bytes required between the end of the file system and the footer / EOF.
-CUR_SIZE=$(ls -l $FWOUT | awk '{print $5}')
-((FILLER_SIZE=$FW_SIZE-$CUR_SIZE-$FOOTER_SIZE))
+FWBUILD_OUT=$(./src/crcalc/fwbuild $FWBUILD_ARGS "$FWOUT" "$HEADER_IMAGE" "$FSOUT" "$FW_SIZE")
+FWBUILD_STATUS=$?
+eval $FWBUILD_OUT
 
-if [ "$FILLER_SIZE" -lt 0 ]; then
+if [ "$FWBUILD_STATUS" -eq 2 ]; then
 	echo "ERROR: New firmware image will be larger than original image!"
 	echo "       Building firmware images larger than the original can brick your device!"
 	echo "       Try re-running with the -min option, or remove any unnecessary files."
@@ -154,29 +163,23 @@ if [ "$FILLER_SIZE" -lt 0 ]; then
 	echo "       Quitting..."
 #	rm -f "$FWOUT" "$FSOUT"
 	exit 1
+elif [ "$FWBUILD_STATUS" -ne 0 ] && [ "$FWBUILD_STATUS" -ne 3 ]; then
+	echo "Failed to assemble the new firmware image! Quitting..."
+	exit 1
+fi
+
+if [ "$NEXT_PARAM" != "-nopad" ]; then
+	echo "Remaining free bytes in firmware image: $FILLER_SIZE"
 else
-	if [ "$NEXT_PARAM" != "-nopad" ]; then
-		echo "Remaining free bytes in firmware image: $FILLER_SIZE"
-		perl -e "print \"\xFF\"x$FILLER_SIZE" >> "$FWOUT"
-	else
-		echo "Padding of firmware image disabled via -nopad"
-	fi	
+	echo "Padding of firmware image disabled via -nopad"
 fi
 
-# Append the footer to the new firmware image, if there is any footer
 if [ "$FOOTER_SIZE" -gt "0" ]; then
-	echo "Appending ${FOOTER_SIZE} byte footer at offset ${FOOTER_OFFSET}"
-	cat $FOOTER_IMAGE >> "$FWOUT"
+	echo "Appended ${FOOTER_SIZE} byte footer at offset ${FOOTER_OFFSET}"
 fi
 
 CHECKSUM_ERROR=0
-
-# Calculate new checksum values for the firmware header
-# trx, dlob, uimage
-# Buffalo and some other post-processors obfuscate these images
-# so we must akways try prior to vendor processing below
-./src/crcalc/crcalc "$FWOUT" "$BINLOG"
-if [ $? -ne 0 ]; then		
+if [ "$FWBUILD_STATUS" -ne 0 ]; then
 	CHECKSUM_ERROR=1
 fi
 
@@ -123,45 +123,34 @@ done
 # Header image size is everything from the header image offset (0) up to the file system
 HEADER_IMAGE_SIZE=$((${FS_OFFSET}-${HEADER_IMAGE_OFFSET}))
 
-# Extract the header + image up to the file system
-echo "Extracting ${HEADER_IMAGE_SIZE} bytes of ${HEADER_TYPE} header image at offset ${HEADER_IMAGE_OFFSET}"
-dd if="${IMG}" bs=${HEADER_IMAGE_SIZE} skip=${HEADER_IMAGE_OFFSET} count=1 of="${HEADER_IMAGE}" 2>/dev/null
-
-FOOTER_SIZE=0
-FOOTER_OFFSET=0
-
-# Get Hex + ASCII output of image file, filter for header between preceding repeating lines which show up as * in terminal. Dump into footer.txt
-hexdump -C "$IMG" | tail -11 | sed -n '/^*/,$p' > footer.txt
-# Get first line after *, most likely start of header, get hex address and convert to decimal
-FOOTER_FIRST=$((16#$(head -2 footer.txt | tail -1 | awk '{print $1}')))
-echo "$FOOTER_FIRST"
-
-# Get last address, most likely end of header, get hex address and convert to decimal
-FOOTER_LAST=$((16#$(tail -1 footer.txt)))
-echo "$FOOTER_LAST"
-
-FOOTER_SIZE=$(($FOOTER_LAST - $FOOTER_FIRST))
-echo "$FOOTER_SIZE"
+if [ "${FS_OFFSET}" = "" ]; then
+	echo "ERROR: No supported file system found! Aborting..."
+	rm -rf "${DIR}"
+	exit 1
+fi
 
-#If a footer was found, dump it out
-if [ "${FOOTER_SIZE}" != "0" ]; then
-	FOOTER_OFFSET=$((${FW_SIZE}-${FOOTER_SIZE}))
-	echo "Extracting ${FOOTER_SIZE} byte footer from offset ${FOOTER_FIRST}"
-	dd if="${IMG}" bs=1 skip=${FOOTER_FIRST} count=${FOOTER_SIZE} of="${FOOTER_IMAGE}" 2>/dev/null
-else
-	FOOTER_OFFSET=${FW_SIZE}
+# Split the image into the header image, the file system and the footer that
+# follows any trailing fill, and pick up the part offsets in the CONFLOG format
+echo "Extracting ${HEADER_IMAGE_SIZE} bytes of ${HEADER_TYPE} header image at offset ${HEADER_IMAGE_OFFSET}"
+echo "Extracting ${FS_TYPE} file system at offset ${FS_OFFSET}"
+FWCARVE=$(./src/fwcarve "${IMG}" ${FS_OFFSET} "${HEADER_IMAGE}" "${FSIMG}" "${FOOTER_IMAGE}")
+if [ $? -ne 0 ]; then
+	echo "ERROR: Failed to split ${IMG}! Aborting..."
+	rm -rf "${DIR}"
+	exit 1
 fi
+eval "${FWCARVE}"
 
-# Extract filesystem, which is everything from $FS_OFFSET to $FOOTER_OFFSET.
-if [ "${FS_OFFSET}" != "" ]; then
-	echo "Extracting ${FS_TYPE} file system at offset ${FS_OFFSET}"
-	dd if="${IMG}" skip=1 bs=${FS_OFFSET} 2>/dev/null | dd count=$(($FOOTER_OFFSET - $FS_OFFSET)) of="${FSIMG}" iflag=count_bytes 2>/dev/null
-else
-	echo "ERROR: No supported file system found! Aborting..."
+if [ "${FOOTER_SIZE}" = "" ] || [ "${FOOTER_OFFSET}" = "" ]; then
+	echo "ERROR: fwcarve did not report the image layout! Aborting..."
 	rm -rf "${DIR}"
 	exit 1
 fi
 
+if [ "${FOOTER_SIZE}" != "0" ]; then
+	echo "Extracted ${FOOTER_SIZE} byte footer from offset ${FOOTER_OFFSET}"
+fi
+
 # Try to determine if there is a footer at the end of the firmware image.
 # Grab the last 10 lines of a hexdump of the firmware image, excluding the
 # last line in the hexdump. Reverse the line order and replace any lines
@@ -196,7 +196,7 @@ class CleanCommand(Command):
 
 # The data files to install along with the module
 install_data_files = []
-for data_dir in ["magic", "config", "plugins", "modules", "core"]:
+for data_dir in ["magic", "config", "plugins", "modules", "core", "libs"]:
         install_data_files.append("%s%s*" % (data_dir, os.path.sep))
 
 # Install the module, script, and support files
@@ -0,0 +1,303 @@
+/*
+ * Block entropy engine for binwalk's Entropy module.
+ *
+ * Computes the normalised Shannon entropy (0.0 - 1.0) and, optionally, the byte
+ * histogram of every block_size window of a buffer or a memory mapped file, with
+ * windows starting every step bytes; a step smaller than the block size gives
+ * overlapping windows. The windows are split across threads, and within a thread
+ * an overlapping window is derived from the previous one by only counting the
+ * bytes that slide in and out of it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "entropy.h"
+
+#define MIN_WINDOWS_PER_THREAD 16
+
+struct entropy_job
+{
+	const unsigned char *data;
+	long long length;
+	int block_size;
+	int step;
+	const double *clog;	/* clog[c] = c * log2(c) */
+	double *entropy;
+	unsigned int *histograms;
+	int first;
+	int last;
+};
+
+/* Byte histogram of len bytes; four interleaved tables break the store to load dependency on runs of equal bytes */
+static void histogram(const unsigned char *p, long long len, unsigned int hist[256])
+{
+	unsigned int h[4][256];
+	long long i = 0;
+	int c = 0;
+
+	memset(h, 0, sizeof(h));
+
+	for(i=0; i+4<=len; i+=4)
+	{
+		h[0][p[i]]++;
+		h[1][p[i+1]]++;
+		h[2][p[i+2]]++;
+		h[3][p[i+3]]++;
+	}
+	for(; i<len; i++)
+	{
+		h[0][p[i]]++;
+	}
+
+	for(c=0; c<256; c++)
+	{
+		hist[c] = h[0][c] + h[1][c] + h[2][c] + h[3][c];
+	}
+}
+
+static double clog_sum(const unsigned int hist[256], const double *clog)
+{
+	double sum = 0;
+	int c = 0;
+
+	for(c=0; c<256; c++)
+	{
+		sum += clog[hist[c]];
+	}
+
+	return sum;
+}
+
+/* H = log2(n) - sum(c * log2(c)) / n, normalised to bits per bit */
+static double shannon(double sum, long long n)
+{
+	double e = 0;
+
+	if(n > 0)
+	{
+		e = (log2((double) n) - sum / n) / 8;
+	}
+
+	return (e < 0) ? 0 : e;
+}
+
+static void *entropy_worker(void *arg)
+{
+	struct entropy_job *job = arg;
+	const unsigned char *data = job->data;
+	unsigned int hist[256];
+	long long start = 0, end = 0, prev_start = 0, prev_end = 0, i = 0;
+	double sum = 0;
+	int k = 0, c = 0, sliding = 0;
+
+	for(k=job->first; k<job->last; k++)
+	{
+		start = (long long) k * job->step;
+		end = start + job->block_size;
+		if(end > job->length)
+		{
+			end = job->length;
+		}
+
+		if(sliding)
+		{
+			/* Bytes leaving the window */
+			for(i=prev_start; i<start; i++)
+			{
+				c = data[i];
+				sum += job->clog[hist[c] - 1] - job->clog[hist[c]];
+				hist[c]--;
+			}
+			/* Bytes entering it */
+			for(i=prev_end; i<end; i++)
+			{
+				c = data[i];
+				sum += job->clog[hist[c] + 1] - job->clog[hist[c]];
+				hist[c]++;
+			}
+		}
+		else
+		{
+			histogram(data + start, end - start, hist);
+			sum = clog_sum(hist, job->clog);
+			sliding = (job->step < job->block_size);
+		}
+
+		job->entropy[k] = shannon(sum, end - start);
+		if(job->histograms)
+		{
+			memcpy(job->histograms + (size_t) k * 256, hist, sizeof(hist));
+		}
+
+		prev_start = start;
+		prev_end = end;
+	}
+
+	return NULL;
+}
+
+/* Number of windows entropy_buffer/entropy_file will return for length bytes */
+int entropy_windows(long long length, int block_size, int step)
+{
+	if(length <= 0 || block_size <= 0)
+	{
+		return 0;
+	}
+
+	if(step <= 0)
+	{
+		step = block_size;
+	}
+
+	return (int) ((length + step - 1) / step);
+}
+
+/*
+ * Calculates the entropy of every window of length bytes of data into the entropy
+ * array, and their histograms (256 counts per window) into histograms if it isn't
+ * NULL. A step of 0 means non-overlapping windows, and threads of 0 means one per CPU.
+ * Returns the number of windows, which is at most count, or -1 on error.
+ */
+int entropy_buffer(const unsigned char *data, long long length, int block_size, int step,
+		   double *entropy, unsigned int *histograms, int count, int threads)
+{
+	struct entropy_job *jobs = NULL;
+	pthread_t *tids = NULL;
+	double *clog = NULL;
+	int windows = 0, per_thread = 0, i = 0, retval = -1;
+
+	if(step <= 0)
+	{
+		step = block_size;
+	}
+
+	windows = entropy_windows(length, block_size, step);
+	if(windows > count)
+	{
+		windows = count;
+	}
+	if(windows <= 0)
+	{
+		return 0;
+	}
+
+	if(threads <= 0)
+	{
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if(threads > windows / MIN_WINDOWS_PER_THREAD)
+	{
+		threads = windows / MIN_WINDOWS_PER_THREAD;
+	}
+	if(threads < 1)
+	{
+		threads = 1;
+	}
+
+	clog = malloc((block_size + 1) * sizeof(double));
+	jobs = calloc(threads, sizeof(struct entropy_job));
+	tids = calloc(threads, sizeof(pthread_t));
+	if(!clog || !jobs || !tids)
+	{
+		goto end;
+	}
+
+	clog[0] = 0;
+	for(i=1; i<=block_size; i++)
+	{
+		clog[i] = i * log2((double) i);
+	}
+
+	per_thread = (windows + threads - 1) / threads;
+	for(i=0; i<threads; i++)
+	{
+		jobs[i].data = data;
+		jobs[i].length = length;
+		jobs[i].block_size = block_size;
+		jobs[i].step = step;
+		jobs[i].clog = clog;
+		jobs[i].entropy = entropy;
+		jobs[i].histograms = histograms;
+		jobs[i].first = i * per_thread;
+		jobs[i].last = (i + 1) * per_thread;
+		if(jobs[i].last > windows)
+		{
+			jobs[i].last = windows;
+		}
+	}
+
+	/* The calling thread takes the first share */
+	for(i=1; i<threads; i++)
+	{
+		if(pthread_create(&tids[i], NULL, entropy_worker, &jobs[i]) != 0)
+		{
+			entropy_worker(&jobs[i]);
+			tids[i] = 0;
+		}
+	}
+	entropy_worker(&jobs[0]);
+	for(i=1; i<threads; i++)
+	{
+		if(tids[i])
+		{
+			pthread_join(tids[i], NULL);
+		}
+	}
+
+	retval = windows;
+
+end:
+	free(clog);
+	free(jobs);
+	free(tids);
+	return retval;
+}
+
+/* As entropy_buffer, for length bytes of the file at path starting at offset */
+int entropy_file(const char *path, long long offset, long long length, int block_size, int step,
+		 double *entropy, unsigned int *histograms, int count, int threads)
+{
+	struct stat st;
+	unsigned char *map = NULL;
+	long long page = sysconf(_SC_PAGESIZE), delta = 0;
+	int fd = -1, retval = -1;
+
+	fd = open(path, O_RDONLY);
+	if(fd == -1 || fstat(fd, &st) == -1 || offset < 0 || offset > st.st_size)
+	{
+		goto end;
+	}
+
+	if(length <= 0 || length > st.st_size - offset)
+	{
+		length = st.st_size - offset;
+	}
+	if(length == 0)
+	{
+		retval = 0;
+		goto end;
+	}
+
+	/* mmap offsets must be page aligned */
+	delta = offset % page;
+	map = mmap(NULL, length + delta, PROT_READ, MAP_PRIVATE, fd, offset - delta);
+	if(map == MAP_FAILED)
+	{
+		map = NULL;
+		goto end;
+	}
+	madvise(map, length + delta, MADV_SEQUENTIAL);
+
+	retval = entropy_buffer(map + delta, length, block_size, step, entropy, histograms, count, threads);
+
+end:
+	if(map) munmap(map, length + delta);
+	if(fd != -1) close(fd);
+	return retval;
+}
@@ -0,0 +1,10 @@
+#ifndef _ENTROPY_H_
+#define _ENTROPY_H_
+
+int entropy_windows(long long length, int block_size, int step);
+int entropy_buffer(const unsigned char *data, long long length, int block_size, int step,
+		   double *entropy, unsigned int *histograms, int count, int threads);
+int entropy_file(const char *path, long long offset, long long length, int block_size, int step,
+		 double *entropy, unsigned int *histograms, int count, int threads);
+
+#endif
@@ -0,0 +1,358 @@
+/*
+ * Multi-pattern prefilter for binwalk's Magic.scan.
+ *
+ * The magic bytes of the first line of every signature are compiled into one
+ * Aho-Corasick automaton, expanded to a full 256-way DFA, so that a single pass
+ * over a data block yields every candidate offset for every signature. Python
+ * then only runs _analyze on those candidates instead of running one regex per
+ * signature over the whole block.
+ *
+ * Matches of any one pattern are reported non-overlapping, leftmost first, which
+ * is what re.finditer returned for the literal regexes this replaces.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "magicscan.h"
+
+#define ROOT		0
+#define NONE		-1
+#define STATES_MIN	256
+#define HITS_MIN	1024
+
+struct pattern
+{
+	int id;			/* Caller's signature id */
+	int len;
+	int same;		/* Next pattern ending at the same state, or NONE */
+	long long last_end;	/* End of this pattern's previous match in the current scan */
+};
+
+struct magicscan
+{
+	int32_t *next;		/* Transitions, nstates * 256; entries are premultiplied by 256 */
+	int32_t *fail;
+	int32_t *out;		/* First pattern ending at this state, or NONE */
+	int32_t *dict;		/* Nearest state on the fail chain with an output, or NONE */
+	uint8_t *emit;		/* Set if a match ends at this state */
+	int nstates;
+	int max_states;
+	int compiled;
+
+	struct pattern *patterns;
+	int npatterns;
+	int max_patterns;
+
+	long long *hit_offsets;
+	int *hit_ids;
+	int nhits;
+	int max_hits;
+};
+
+static int grow_states(struct magicscan *ms)
+{
+	int n = ms->max_states ? ms->max_states * 2 : STATES_MIN;
+	int32_t *next = NULL, *fail = NULL, *out = NULL, *dict = NULL;
+	uint8_t *emit = NULL;
+
+	next = realloc(ms->next, (size_t) n * 256 * sizeof(int32_t));
+	if(next) ms->next = next;
+	fail = realloc(ms->fail, n * sizeof(int32_t));
+	if(fail) ms->fail = fail;
+	out = realloc(ms->out, n * sizeof(int32_t));
+	if(out) ms->out = out;
+	dict = realloc(ms->dict, n * sizeof(int32_t));
+	if(dict) ms->dict = dict;
+	emit = realloc(ms->emit, n);
+	if(emit) ms->emit = emit;
+
+	if(!next || !fail || !out || !dict || !emit)
+	{
+		return 0;
+	}
+
+	ms->max_states = n;
+	return 1;
+}
+
+static int new_state(struct magicscan *ms)
+{
+	int s = 0;
+
+	if(ms->nstates == ms->max_states && !grow_states(ms))
+	{
+		return NONE;
+	}
+
+	s = ms->nstates++;
+	memset(ms->next + (size_t) s * 256, 0xFF, 256 * sizeof(int32_t));
+	ms->fail[s] = ROOT;
+	ms->out[s] = NONE;
+	ms->dict[s] = NONE;
+	ms->emit[s] = 0;
+
+	return s;
+}
+
+void *magicscan_new(void)
+{
+	struct magicscan *ms = NULL;
+
+	ms = calloc(1, sizeof(struct magicscan));
+	if(ms && new_state(ms) != ROOT)
+	{
+		magicscan_free(ms);
+		ms = NULL;
+	}
+
+	return ms;
+}
+
+void magicscan_free(void *handle)
+{
+	struct magicscan *ms = handle;
+
+	if(ms)
+	{
+		free(ms->next);
+		free(ms->fail);
+		free(ms->out);
+		free(ms->dict);
+		free(ms->emit);
+		free(ms->patterns);
+		free(ms->hit_offsets);
+		free(ms->hit_ids);
+		free(ms);
+	}
+}
+
+/* Adds len bytes of magic for signature id; patterns can't be added once compiled */
+int magicscan_add(void *handle, const unsigned char *pattern, int len, int id)
+{
+	struct magicscan *ms = handle;
+	struct pattern *p = NULL;
+	int s = ROOT, t = 0, i = 0;
+
+	if(!ms || ms->compiled || !pattern || len < 1)
+	{
+		return 0;
+	}
+
+	if(ms->npatterns == ms->max_patterns)
+	{
+		i = ms->max_patterns ? ms->max_patterns * 2 : 64;
+		p = realloc(ms->patterns, i * sizeof(struct pattern));
+		if(!p)
+		{
+			return 0;
+		}
+		ms->patterns = p;
+		ms->max_patterns = i;
+	}
+
+	for(i=0; i<len; i++)
+	{
+		t = ms->next[(size_t) s * 256 + pattern[i]];
+		if(t == NONE)
+		{
+			t = new_state(ms);
+			if(t == NONE)
+			{
+				return 0;
+			}
+			ms->next[(size_t) s * 256 + pattern[i]] = t;
+		}
+		s = t;
+	}
+
+	p = &ms->patterns[ms->npatterns];
+	p->id = id;
+	p->len = len;
+	p->same = ms->out[s];
+	ms->out[s] = ms->npatterns++;
+
+	return 1;
+}
+
+/* Builds the fail links and turns the trie into a DFA */
+int magicscan_compile(void *handle)
+{
+	struct magicscan *ms = handle;
+	int32_t *queue = NULL;
+	int head = 0, tail = 0, s = 0, t = 0, f = 0, c = 0;
+
+	if(!ms)
+	{
+		return 0;
+	}
+
+	if(ms->compiled)
+	{
+		return 1;
+	}
+
+	queue = malloc(ms->nstates * sizeof(int32_t));
+	if(!queue)
+	{
+		return 0;
+	}
+
+	for(c=0; c<256; c++)
+	{
+		t = ms->next[ROOT * 256 + c];
+		if(t == NONE)
+		{
+			ms->next[ROOT * 256 + c] = ROOT;
+		}
+		else
+		{
+			ms->fail[t] = ROOT;
+			queue[tail++] = t;
+		}
+	}
+
+	/* Breadth first, so every fail target is complete before it is used */
+	while(head < tail)
+	{
+		s = queue[head++];
+
+		f = ms->fail[s];
+		ms->dict[s] = (ms->out[f] != NONE) ? f : ms->dict[f];
+		ms->emit[s] = (ms->out[s] != NONE || ms->dict[s] != NONE);
+
+		for(c=0; c<256; c++)
+		{
+			t = ms->next[(size_t) s * 256 + c];
+			if(t == NONE)
+			{
+				ms->next[(size_t) s * 256 + c] = ms->next[(size_t) f * 256 + c];
+			}
+			else
+			{
+				ms->fail[t] = ms->next[(size_t) f * 256 + c];
+				queue[tail++] = t;
+			}
+		}
+	}
+
+	free(queue);
+
+	/* Premultiply the transitions so the scan loop doesn't have to */
+	for(s=0; s<ms->nstates * 256; s++)
+	{
+		ms->next[s] *= 256;
+	}
+
+	ms->compiled = 1;
+	return 1;
+}
+
+static int add_hit(struct magicscan *ms, long long offset, int id)
+{
+	long long *offsets = NULL;
+	int *ids = NULL, n = 0;
+
+	if(ms->nhits == ms->max_hits)
+	{
+		n = ms->max_hits ? ms->max_hits * 2 : HITS_MIN;
+		offsets = realloc(ms->hit_offsets, n * sizeof(long long));
+		if(offsets) ms->hit_offsets = offsets;
+		ids = realloc(ms->hit_ids, n * sizeof(int));
+		if(ids) ms->hit_ids = ids;
+		if(!offsets || !ids)
+		{
+			return 0;
+		}
+		ms->max_hits = n;
+	}
+
+	ms->hit_offsets[ms->nhits] = offset;
+	ms->hit_ids[ms->nhits] = id;
+	ms->nhits++;
+
+	return 1;
+}
+
+/*
+ * Scans len bytes of data and returns the number of candidate matches, which
+ * are then fetched with magicscan_hits. Returns -1 on error.
+ */
+int magicscan_scan(void *handle, const unsigned char *data, long long len)
+{
+	struct magicscan *ms = handle;
+	const int32_t *next = NULL;
+	const uint8_t *emit = NULL;
+	struct pattern *p = NULL;
+	long long i = 0;
+	int32_t state = ROOT;
+	int s = 0, n = 0;
+
+	if(!ms || !data || len < 0 || !magicscan_compile(ms))
+	{
+		return -1;
+	}
+
+	ms->nhits = 0;
+	for(n=0; n<ms->npatterns; n++)
+	{
+		ms->patterns[n].last_end = 0;
+	}
+
+	next = ms->next;
+	emit = ms->emit;
+
+	for(i=0; i<len; i++)
+	{
+		state = next[state + data[i]];
+
+		if(emit[state >> 8])
+		{
+			s = state >> 8;
+			if(ms->out[s] == NONE)
+			{
+				s = ms->dict[s];
+			}
+
+			while(s != NONE)
+			{
+				for(n=ms->out[s]; n != NONE; n=p->same)
+				{
+					p = &ms->patterns[n];
+					if(i + 1 - p->len >= p->last_end)
+					{
+						if(!add_hit(ms, i + 1 - p->len, p->id))
+						{
+							return -1;
+						}
+						p->last_end = i + 1;
+					}
+				}
+				s = ms->dict[s];
+			}
+		}
+	}
+
+	return ms->nhits;
+}
+
+/* Copies up to count hits from the last scan, in the order they were found */
+int magicscan_hits(void *handle, long long *offsets, int *ids, int count)
+{
+	struct magicscan *ms = handle;
+
+	if(!ms)
+	{
+		return 0;
+	}
+
+	if(count > ms->nhits)
+	{
+		count = ms->nhits;
+	}
+
+	memcpy(offsets, ms->hit_offsets, count * sizeof(long long));
+	memcpy(ids, ms->hit_ids, count * sizeof(int));
+
+	return count;
+}
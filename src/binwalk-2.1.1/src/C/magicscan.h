@@ -0,0 +1,11 @@
+#ifndef _MAGICSCAN_H_
+#define _MAGICSCAN_H_
+
+void *magicscan_new(void);
+void magicscan_free(void *handle);
+int magicscan_add(void *handle, const unsigned char *pattern, int len, int id);
+int magicscan_compile(void *handle);
+int magicscan_scan(void *handle, const unsigned char *data, long long len);
+int magicscan_hits(void *handle, long long *offsets, int *ids, int count);
+
+#endif
@@ -0,0 +1,72 @@
+#!/usr/bin/env python
+# Compares the throughput of the native (libmagicscan) and the pure Python
+# signature scans over a file, and checks that both produce the same results.
+#
+# Usage: magicscan_bench.py <file> [block size]
+
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+
+import binwalk.core.magic
+import binwalk.core.compat
+import binwalk.core.settings
+
+def load(native):
+    settings = binwalk.core.settings.Settings()
+    magic = binwalk.core.magic.Magic(native=native)
+    for f in settings.user.magic + settings.system.magic:
+        magic.load(f)
+    return magic
+
+def run(magic, fname, block_size):
+    results = []
+    size = 0
+
+    start = time.time()
+    fp = open(fname, "rb")
+    while True:
+        data = fp.read(block_size)
+        if not data:
+            break
+        for r in magic.scan(binwalk.core.compat.bytes2str(data)):
+            results.append((size + r.offset, r.description))
+        size += len(data)
+    fp.close()
+    elapsed = time.time() - start
+
+    return (results, size, elapsed)
+
+def main():
+    if len(sys.argv) < 2:
+        sys.stderr.write("Usage: %s <file> [block size]\n" % sys.argv[0])
+        return 1
+
+    fname = sys.argv[1]
+    block_size = 1024 * 1024
+    if len(sys.argv) > 2:
+        block_size = int(sys.argv[2], 0)
+
+    native = load(True)
+    python = load(False)
+
+    (native_results, size, native_time) = run(native, fname, block_size)
+    if not native.prefilter:
+        sys.stderr.write("libmagicscan could not be loaded, run make first\n")
+        return 1
+    (python_results, size, python_time) = run(python, fname, block_size)
+
+    print("%-8s %8.2f MB/s  %d results" % ("native", size / native_time / 1e6, len(native_results)))
+    print("%-8s %8.2f MB/s  %d results" % ("python", size / python_time / 1e6, len(python_results)))
+
+    if native_results != python_results:
+        print("MISMATCH between the native and python results")
+        return 1
+
+    print("speedup  %8.2fx" % (python_time / native_time))
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
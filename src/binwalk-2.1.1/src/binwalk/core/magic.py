@@ -6,7 +6,9 @@ __all__ = ['Magic']
 
 import re
 import struct
+import ctypes
 import datetime
+import binwalk.core.C
 import binwalk.core.common
 import binwalk.core.compat
 
@@ -275,6 +277,10 @@ class Signature(object):
         self.lines = [first_line]
         self.title = first_line.format
         self.offset = first_line.offset
+        # The literal magic bytes matched by self.regex, if any; set by self._generate_regex
+        self.magic = None
+        # Set by Magic if self.magic is matched by the native prefilter instead of self.regex
+        self.native = False
         self.regex = self._generate_regex(first_line)
         try:
             self.confidence = first_line.tags['confidence']
@@ -354,6 +360,8 @@ class Signature(object):
                     binwalk.core.common.warning("Signature '%s' is a self-overlapping signature!" % line.text)
                     break
 
+        self.magic = restr
+
         return re.compile(re.escape(restr))
 
     def append(self, line):
@@ -373,13 +381,27 @@ class Magic(object):
     blocks of arbitrary data for matching signatures.
     '''
 
-    def __init__(self, exclude=[], include=[], invalid=False):
+    # Native multi-pattern prefilter (see src/C/magicscan.c). It finds the magic bytes of
+    # every signature in a single pass over the data; if it can't be loaded, each signature's
+    # regex is run over the data instead.
+    LIBRARY_NAME = "magicscan"
+    LIBRARY_FUNCTIONS = [
+            binwalk.core.C.Function(name="magicscan_new", type=ctypes.c_void_p),
+            binwalk.core.C.Function(name="magicscan_free", type=None),
+            binwalk.core.C.Function(name="magicscan_add", type=int),
+            binwalk.core.C.Function(name="magicscan_compile", type=int),
+            binwalk.core.C.Function(name="magicscan_scan", type=int),
+            binwalk.core.C.Function(name="magicscan_hits", type=int),
+    ]
+
+    def __init__(self, exclude=[], include=[], invalid=False, native=True):
         '''
         Class constructor.
 
         @include - A list of regex strings describing which signatures should be included in the scan results.
         @exclude - A list of regex strings describing which signatures should not be included in the scan results.
         @invalid - If set to True, invalid results will not be ignored.
+        @native  - If set to False, the native signature prefilter will not be used.
 
         Returns None.
         '''
@@ -391,6 +413,11 @@ class Magic(object):
         self.display_once = set()
         self.dirty = True
 
+        # The native prefilter library and the automaton built from self.signatures (see self._native_compile)
+        self.native = native
+        self.lib = None
+        self.prefilter = None
+
         self.show_invalid = invalid
         self.includes = [re.compile(x) for x in include]
         self.excludes = [re.compile(x) for x in exclude]
@@ -713,6 +740,96 @@ class Magic(object):
 
         return tags
 
+    def _native_compile(self):
+        '''
+        Builds the native prefilter automaton from the magic bytes of the loaded signatures.
+        Signatures without literal magic bytes (i.e., regex signatures) are left to their regex.
+
+        Returns None.
+        '''
+        self.dirty = False
+        self._native_free()
+
+        if not self.native:
+            return
+
+        if self.lib is None:
+            try:
+                self.lib = binwalk.core.C.Library(self.LIBRARY_NAME, self.LIBRARY_FUNCTIONS)
+            except KeyboardInterrupt as e:
+                raise e
+            except Exception as e:
+                binwalk.core.common.debug("Native signature scan disabled: %s" % str(e))
+                self.native = False
+                return
+
+        self.prefilter = self.lib.magicscan_new()
+        if not self.prefilter:
+            return
+
+        for signature in self.signatures:
+            signature.native = False
+            if signature.magic:
+                try:
+                    magic = bytes(bytearray([ord(c) for c in signature.magic]))
+                except ValueError as e:
+                    continue
+
+                signature.native = bool(self.lib.magicscan_add(ctypes.c_void_p(self.prefilter),
+                                                               magic,
+                                                               len(magic),
+                                                               signature.id))
+
+        if not self.lib.magicscan_compile(ctypes.c_void_p(self.prefilter)):
+            self._native_free()
+
+    def _native_free(self):
+        '''
+        Frees the native prefilter automaton, if any.
+
+        Returns None.
+        '''
+        if self.prefilter:
+            self.lib.magicscan_free(ctypes.c_void_p(self.prefilter))
+            self.prefilter = None
+
+        for signature in self.signatures:
+            signature.native = False
+
+    def _native_scan(self, data):
+        '''
+        Runs the native prefilter over a data block.
+
+        @data - A string of data to scan.
+
+        Returns a dictionary of candidate start offsets, in ascending order, keyed by signature ID.
+        Returns None on error.
+        '''
+        hits = {}
+        data = binwalk.core.compat.str2bytes(data)
+
+        count = self.lib.magicscan_scan(ctypes.c_void_p(self.prefilter), data, ctypes.c_longlong(len(data)))
+        if count < 0:
+            return None
+
+        offsets = (ctypes.c_longlong * count)()
+        ids = (ctypes.c_int * count)()
+        self.lib.magicscan_hits(ctypes.c_void_p(self.prefilter), offsets, ids, count)
+
+        for i in range(0, count):
+            try:
+                hits[ids[i]].append(offsets[i])
+            except KeyError as e:
+                hits[ids[i]] = [offsets[i]]
+
+        return hits
+
+    def __del__(self):
+        try:
+            self._native_free()
+        except Exception as e:
+            pass
+
     def match(self, data):
         '''
         Match the beginning of a data buffer to a signature.
@@ -744,11 +861,24 @@ class Magic(object):
         if dlen is None:
             dlen = len(data)
 
+        # Find the magic bytes of all signatures in one pass with the native prefilter, if available
+        if self.dirty:
+            self._native_compile()
+
+        hits = None
+        if self.prefilter:
+            hits = self._native_scan(data)
+
         for signature in self.signatures:
+            if hits is not None and signature.native:
+                starts = hits.get(signature.id, [])
             # Use regex to search the data block for potential signature matches (fast)
-            for match in signature.regex.finditer(data):
+            else:
+                starts = (match.start() for match in signature.regex.finditer(data))
+
+            for start in starts:
                 # Take the offset of the start of the signature into account
-                offset = match.start() - signature.offset
+                offset = start - signature.offset
 
                 # Signatures are ordered based on the length of their magic bytes (largest first).
                 # If this offset has already been matched to a previous signature, ignore it unless
@@ -841,3 +971,6 @@ class Magic(object):
         # Sort signatures by confidence (aka, length of their magic bytes), largest first
         self.signatures.sort(key=lambda x: x.confidence, reverse=True)
 
+        # The native prefilter needs to be rebuilt with the new signatures
+        self.dirty = True
+
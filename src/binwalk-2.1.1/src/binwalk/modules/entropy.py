@@ -3,6 +3,8 @@
 import os
 import math
 import zlib
+import ctypes
+import binwalk.core.C
 import binwalk.core.common
 from binwalk.core.compat import *
 from binwalk.core.module import Module, Option, Kwarg
@@ -29,6 +31,13 @@ class Entropy(Module):
     TITLE = "Entropy Analysis"
     ORDER = 8
 
+    # Native block entropy engine (see src/C/entropy.c), used for Shannon entropy if available
+    LIBRARY_NAME = "entropy"
+    LIBRARY_FUNCTIONS = [
+            binwalk.core.C.Function(name="entropy_windows", type=int),
+            binwalk.core.C.Function(name="entropy_file", type=int),
+    ]
+
     # TODO: Add --dpoints option to set the number of data points?
     CLI = [
             Option(short='E',
@@ -61,6 +70,10 @@ class Entropy(Module):
                    type=float,
                    kwargs={'trigger_low' : DEFAULT_TRIGGER_LOW},
                    description='Set the falling edge entropy trigger threshold (default: %.2f)' % DEFAULT_TRIGGER_LOW),
+            Option(long='step',
+                   type=int,
+                   kwargs={'step' : 0},
+                   description='Set the entropy window step, below the block size for overlapping windows (default: block size)'),
     ]
 
     KWARGS = [
@@ -73,6 +86,8 @@ class Entropy(Module):
             Kwarg(name='do_plot', default=True),
             Kwarg(name='show_legend', default=True),
             Kwarg(name='block_size', default=0),
+            Kwarg(name='step', default=0),
+            Kwarg(name='native', default=True),
     ]
 
     # Run this module last so that it can process all other module's results and overlay them on the entropy graph
@@ -88,6 +103,16 @@ class Entropy(Module):
         else:
             self.algorithm = self.shannon
 
+        # The native engine only implements Shannon entropy
+        self.lib = None
+        if self.native and not self.use_zlib:
+            try:
+                self.lib = binwalk.core.C.Library(self.LIBRARY_NAME, self.LIBRARY_FUNCTIONS)
+            except KeyboardInterrupt as e:
+                raise e
+            except Exception as e:
+                binwalk.core.common.debug("Native entropy engine disabled: %s" % str(e))
+
         # Get a list of all other module's results to mark on the entropy graph
         for (module, obj) in iterator(self.modules):
             for result in obj.results:
@@ -167,7 +192,61 @@ class Entropy(Module):
         if block_size <= 0:
             block_size = self.DEFAULT_BLOCK_SIZE
 
-        binwalk.core.common.debug("Entropy block size (%d data points): %d" % (self.DEFAULT_DATA_POINTS, block_size))
+        # Windows start every step bytes, so a step below the block size overlaps them
+        step = self.step
+        if step <= 0:
+            step = block_size
+
+        binwalk.core.common.debug("Entropy block size (%d data points): %d, step: %d" % (self.DEFAULT_DATA_POINTS, block_size, step))
+
+        blocks = None
+        if self.lib and not fp.swap_size:
+            blocks = self._native_file_entropy(fp, block_size, step)
+        if blocks is None:
+            blocks = self._python_file_entropy(fp, block_size, step)
+
+        for (offset, entropy) in blocks:
+            display = self.display_results
+            description = "%f" % entropy
+
+            if not self.config.verbose:
+                if last_edge in [None, 0] and entropy > self.trigger_low:
+                    trigger_reset = True
+                elif last_edge in [None, 1] and entropy < self.trigger_high:
+                    trigger_reset = True
+
+                if trigger_reset and entropy >= self.trigger_high:
+                    description = "Rising entropy edge (%f)" % entropy
+                    display = self.display_results
+                    last_edge = 1
+                    trigger_reset = False
+                elif trigger_reset and entropy <= self.trigger_low:
+                    description = "Falling entropy edge (%f)" % entropy
+                    display = self.display_results
+                    last_edge = 0
+                    trigger_reset = False
+                else:
+                    display = False
+                    description = "%f" % entropy
+
+            r = self.result(offset=offset,
+                            file=fp,
+                            entropy=entropy,
+                            description=description,
+                            display=display)
+
+        if self.do_plot:
+            self.plot_entropy(fp.name)
+
+    def _python_file_entropy(self, fp, block_size, step=0):
+        '''
+        Calculates the entropy of each block of a file with self.algorithm. Blocks start every
+        step bytes (default block_size); a block may run into the peek data after each read.
+
+        Yields (file offset, entropy) tuples.
+        '''
+        if not step:
+            step = block_size
 
         while True:
             file_offset = fp.tell()
@@ -178,40 +257,37 @@ class Entropy(Module):
 
             i = 0
             while i < dlen:
-                entropy = self.algorithm(data[i:i+block_size])
-                display = self.display_results
-                description = "%f" % entropy
-
-                if not self.config.verbose:
-                    if last_edge in [None, 0] and entropy > self.trigger_low:
-                        trigger_reset = True
-                    elif last_edge in [None, 1] and entropy < self.trigger_high:
-                        trigger_reset = True
-
-                    if trigger_reset and entropy >= self.trigger_high:
-                        description = "Rising entropy edge (%f)" % entropy
-                        display = self.display_results
-                        last_edge = 1
-                        trigger_reset = False
-                    elif trigger_reset and entropy <= self.trigger_low:
-                        description = "Falling entropy edge (%f)" % entropy
-                        display = self.display_results
-                        last_edge = 0
-                        trigger_reset = False
-                    else:
-                        display = False
-                        description = "%f" % entropy
-
-                r = self.result(offset=(file_offset + i),
-                                file=fp,
-                                entropy=entropy,
-                                description=description,
-                                display=display)
-
-                i += block_size
+                yield (file_offset + i, self.algorithm(data[i:i+block_size]))
+                i += step
 
-        if self.do_plot:
-            self.plot_entropy(fp.name)
+    def _native_file_entropy(self, fp, block_size, step=0):
+        '''
+        Calculates the Shannon entropy of each block of a file in one call to the native engine,
+        which memory maps the file and spreads the blocks across all CPUs. If step is smaller
+        than block_size, blocks overlap.
+
+        Returns a list of (file offset, entropy) tuples, or None on error.
+        '''
+        if not step:
+            step = block_size
+
+        count = self.lib.entropy_windows(ctypes.c_longlong(fp.length), block_size, step)
+        entropy = (ctypes.c_double * max(count, 1))()
+
+        count = self.lib.entropy_file(fp.path,
+                                      ctypes.c_longlong(fp.offset),
+                                      ctypes.c_longlong(fp.length),
+                                      block_size,
+                                      step,
+                                      entropy,
+                                      None,
+                                      count,
+                                      0)
+        if count < 0:
+            binwalk.core.common.debug("Native entropy engine failed on '%s'" % fp.path)
+            return None
+
+        return [(fp.offset + (i * step), entropy[i]) for i in range(0, count)]
 
     def shannon(self, data):
         '''
@@ -33,6 +33,7 @@
 #include <errno.h>
 #include <string.h>
 #include <stdarg.h>
+#include <pthread.h>
 #include <linux/cramfs_fs.h>
 #include <zlib.h>
 
@@ -93,6 +94,7 @@ static int opt_pad = 0;
 static int opt_verbose = 0;
 static char *opt_image = NULL;
 static char *opt_name = NULL;
+static int opt_threads = 0;
 
 static int warn_dev, warn_gid, warn_namelen, warn_skip, warn_size, warn_uid;
 
@@ -104,10 +106,14 @@ struct entry {
 
 	/* these are only used for non-empty files */
 	char *path;		/* always null except non-empty files */
-	int fd;			/* temporarily open files while mmapped */
 
 	/* FS data */
 	void *uncompressed;
+	/* compressed blocks, filled in by the compression threads */
+	struct block *blocks;
+	/* content hash, and next file with the same hash bucket */
+	u32 hash;
+	struct entry *hash_next;
 	/* points to other identical file */
 	struct entry *same;
 	unsigned int offset;		/* pointer to compressed data in archive */
@@ -118,16 +124,41 @@ struct entry {
 	struct entry *next;
 };
 
+/* One compressed block; data is null for a hole. */
+struct block {
+	char *data;
+	unsigned long len;
+};
+
+/*
+ * The blocks of a file are compressed in runs of up to JOB_BLOCKS, so a
+ * large file is spread across the compression threads.
+ */
+#define JOB_BLOCKS 64
+
+struct job {
+	struct entry *entry;
+	unsigned int first, count;
+};
+
+static struct job *jobs;
+static int job_count, job_next;
+static pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define HASH_SIZE 4096
+static struct entry *hash_table[HASH_SIZE];
+
 /* Input status of 0 to print help and exit without an error. */
 static void usage(int status)
 {
 	FILE *stream = status ? stderr : stdout;
 
-	fprintf(stream, "usage: %s [-h] [-e edition] [-i file] [-n name] dirname outfile\n"
+	fprintf(stream, "usage: %s [-h] [-e edition] [-i file] [-j threads] [-n name] dirname outfile\n"
 		" -h         print this help\n"
 		" -E         make all warnings errors (non-zero exit status)\n"
 		" -e edition set edition number (part of fsid)\n"
 		" -i file    insert a file image into the filesystem (requires >= 2.4.0)\n"
+		" -j threads compress with this many threads (default: one per CPU)\n"
 		" -n name    set name of cramfs filesystem\n"
 		" -p         pad by %d bytes for boot code\n"
 		" -s         sort directory entries (old option, ignored)\n"
@@ -156,17 +187,22 @@ static void die(int status, int syserr, const char *fmt, ...)
 	exit(status);
 }
 
+/*
+ * The file is only open while it is being mapped, so any number of files
+ * can be mapped at once.
+ */
 static void map_entry(struct entry *entry)
 {
 	if (entry->path) {
-		entry->fd = open(entry->path, O_RDONLY);
-		if (entry->fd < 0) {
+		int fd = open(entry->path, O_RDONLY);
+		if (fd < 0) {
 			die(MKFS_ERROR, 1, "open failed: %s", entry->path);
 		}
-		entry->uncompressed = mmap(NULL, entry->size, PROT_READ, MAP_PRIVATE, entry->fd, 0);
+		entry->uncompressed = mmap(NULL, entry->size, PROT_READ, MAP_PRIVATE, fd, 0);
 		if (entry->uncompressed == MAP_FAILED) {
 			die(MKFS_ERROR, 1, "mmap failed: %s", entry->path);
 		}
+		close(fd);
 	}
 }
 
@@ -176,40 +212,51 @@ static void unmap_entry(struct entry *entry)
 		if (munmap(entry->uncompressed, entry->size) < 0) {
 			die(MKFS_ERROR, 1, "munmap failed: %s", entry->path);
 		}
-		close(entry->fd);
 	}
 }
 
-static int find_identical_file(struct entry *orig, struct entry *newfile)
+static int identical_file(struct entry *orig, struct entry *newfile)
 {
-	if (orig == newfile)
-		return 1;
-	if (!orig)
+	int same;
+
+	if (orig->size != newfile->size || orig->hash != newfile->hash)
 		return 0;
-	if (orig->size == newfile->size && (orig->path || orig->uncompressed))
-	{
-		map_entry(orig);
-		map_entry(newfile);
-		if (!memcmp(orig->uncompressed, newfile->uncompressed, orig->size))
-		{
-			newfile->same = orig;
-			unmap_entry(newfile);
-			unmap_entry(orig);
-			return 1;
-		}
-		unmap_entry(newfile);
-		unmap_entry(orig);
-	}
-	return (find_identical_file(orig->child, newfile) ||
-		find_identical_file(orig->next, newfile));
+	map_entry(orig);
+	map_entry(newfile);
+	same = !memcmp(orig->uncompressed, newfile->uncompressed, orig->size);
+	unmap_entry(newfile);
+	unmap_entry(orig);
+	return same;
 }
 
-static void eliminate_doubles(struct entry *root, struct entry *orig) {
-	if (orig) {
-		if (orig->size && (orig->path || orig->uncompressed))
-			find_identical_file(root, orig);
-		eliminate_doubles(root, orig->child);
-		eliminate_doubles(root, orig->next);
+/*
+ * Each file's contents are hashed once, and compared only against the
+ * earlier files with the same size and hash.  A file is pointed at the
+ * first identical file in tree order, as the old pairwise search did.
+ */
+static void eliminate_doubles(struct entry *orig)
+{
+	for (; orig; orig = orig->next) {
+		if (orig->size && (orig->path || orig->uncompressed)) {
+			struct entry **bucket, *e;
+
+			map_entry(orig);
+			orig->hash = crc32(crc32(0L, Z_NULL, 0), orig->uncompressed, orig->size);
+			unmap_entry(orig);
+
+			bucket = &hash_table[(orig->hash ^ orig->size) & (HASH_SIZE - 1)];
+			for (e = *bucket; e; e = e->hash_next) {
+				if (identical_file(e, orig)) {
+					orig->same = e;
+					break;
+				}
+			}
+			if (!e) {
+				orig->hash_next = *bucket;
+				*bucket = orig;
+			}
+		}
+		eliminate_doubles(orig->child);
 	}
 }
 
@@ -575,7 +622,138 @@ static int is_zero(char const *begin, unsigned len)
  * Note that size > 0, as a zero-sized file wouldn't ever
  * have gotten here in the first place.
  */
-static unsigned int do_compress(char *base, unsigned int offset, char const *name, char *uncompressed, unsigned int size)
+static void compress_blocks(struct job *job)
+{
+	struct entry *entry = job->entry;
+	char *buf = malloc(2 * blksize);
+	unsigned int i;
+
+	if (!buf) {
+		die(MKFS_ERROR, 1, "malloc failed");
+	}
+
+	for (i = job->first; i < job->first + job->count; i++) {
+		struct block *block = &entry->blocks[i];
+		char *uncompressed = (char *) entry->uncompressed + i * blksize;
+		unsigned long len = 2 * blksize;
+		unsigned int input = entry->size - i * blksize;
+		int err;
+
+		if (input > blksize)
+			input = blksize;
+		if (opt_holes && is_zero (uncompressed, input))
+			continue;
+
+		err = compress2((unsigned char *) buf, &len, (unsigned char *) uncompressed, input, Z_BEST_COMPRESSION);
+		if (err != Z_OK) {
+			die(MKFS_ERROR, 0, "compression error: %s", zError(err));
+		}
+		if (len > blksize*2) {
+			/* (I don't think this can happen with zlib.) */
+			die(MKFS_ERROR, 0, "AIEEE: block \"compressed\" to > 2*blocklength (%ld)", len);
+		}
+
+		block->data = malloc(len);
+		if (!block->data) {
+			die(MKFS_ERROR, 1, "malloc failed");
+		}
+		memcpy(block->data, buf, len);
+		block->len = len;
+	}
+	free(buf);
+}
+
+static void *compress_thread(void *arg)
+{
+	(void) arg;
+
+	for (;;) {
+		struct job *job = NULL;
+
+		pthread_mutex_lock(&job_mutex);
+		if (job_next < job_count)
+			job = &jobs[job_next++];
+		pthread_mutex_unlock(&job_mutex);
+
+		if (!job)
+			break;
+		compress_blocks(job);
+	}
+	return NULL;
+}
+
+/*
+ * Queue the blocks of every file write_data() will compress, mapping the
+ * files until write_data() has copied their blocks out.
+ */
+static void add_jobs(struct entry *entry, int *size)
+{
+	for (; entry; entry = entry->next) {
+		if (entry->path || entry->uncompressed) {
+			unsigned int blocks, first;
+
+			if (entry->same)
+				continue;
+
+			blocks = (entry->size - 1) / blksize + 1;
+			entry->blocks = calloc(blocks, sizeof(struct block));
+			if (!entry->blocks) {
+				die(MKFS_ERROR, 1, "calloc failed");
+			}
+			map_entry(entry);
+
+			for (first = 0; first < blocks; first += JOB_BLOCKS) {
+				if (job_count == *size) {
+					*size = *size ? *size * 2 : 256;
+					jobs = realloc(jobs, *size * sizeof(struct job));
+					if (!jobs) {
+						die(MKFS_ERROR, 1, "realloc failed");
+					}
+				}
+				jobs[job_count].entry = entry;
+				jobs[job_count].first = first;
+				jobs[job_count].count = blocks - first < JOB_BLOCKS ? blocks - first : JOB_BLOCKS;
+				job_count++;
+			}
+		}
+		else if (entry->child)
+			add_jobs(entry->child, size);
+	}
+}
+
+/*
+ * The blocks are independent zlib streams, so they are all compressed up
+ * front on opt_threads threads and write_data() only lays them out.
+ */
+static void compress_data(struct entry *root)
+{
+	pthread_t *threads;
+	int i, size = 0, count = opt_threads;
+
+	add_jobs(root, &size);
+
+	if (count > job_count)
+		count = job_count;
+	threads = malloc((count ? count : 1) * sizeof(pthread_t));
+	if (!threads) {
+		die(MKFS_ERROR, 1, "malloc failed");
+	}
+
+	/* The main thread takes a share of the jobs too */
+	for (i = 1; i < count; i++) {
+		if (pthread_create(&threads[i], NULL, compress_thread, NULL)) {
+			die(MKFS_ERROR, 0, "failed to create compression thread");
+		}
+	}
+	compress_thread(NULL);
+	for (i = 1; i < count; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	free(jobs);
+}
+
+static unsigned int do_compress(char *base, unsigned int offset, char const *name, struct block *block, unsigned int size)
 {
 	unsigned long original_size = size;
 	unsigned long original_offset = offset;
@@ -587,26 +765,17 @@ static unsigned int do_compress(char *base, unsigned int offset, char const *nam
 	total_blocks += blocks;
 
 	do {
-		unsigned long len = 2 * blksize;
 		unsigned int input = size;
-		int err;
 
 		if (input > blksize)
 			input = blksize;
 		size -= input;
-		if (!(opt_holes && is_zero (uncompressed, input))) {
-			err = compress2(base + curr, &len, uncompressed, input, Z_BEST_COMPRESSION);
-			if (err != Z_OK) {
-				die(MKFS_ERROR, 0, "compression error: %s", zError(err));
-			}
-			curr += len;
-		}
-		uncompressed += input;
-
-		if (len > blksize*2) {
-			/* (I don't think this can happen with zlib.) */
-			die(MKFS_ERROR, 0, "AIEEE: block \"compressed\" to > 2*blocklength (%ld)", len);
+		if (block->data) {
+			memcpy(base + curr, block->data, block->len);
+			curr += block->len;
+			free(block->data);
 		}
+		block++;
 
 		*(u32 *) (base + offset) = curr;
 		offset += 4;
@@ -643,8 +812,8 @@ static unsigned int write_data(struct entry *entry, char *base, unsigned int off
 			else {
 				set_data_offset(entry, base, offset);
 				entry->offset = offset;
-				map_entry(entry);
-				offset = do_compress(base, offset, entry->name, entry->uncompressed, entry->size);
+				offset = do_compress(base, offset, entry->name, entry->blocks, entry->size);
+				free(entry->blocks);
 				unmap_entry(entry);
 			}
 		}
@@ -699,7 +868,7 @@ int main(int argc, char **argv)
 		progname = argv[0];
 
 	/* command line options */
-	while ((c = getopt(argc, argv, "hEe:i:n:psvz")) != EOF) {
+	while ((c = getopt(argc, argv, "hEe:i:j:n:psvz")) != EOF) {
 		switch (c) {
 		case 'h':
 			usage(MKFS_OK);
@@ -720,6 +889,12 @@ int main(int argc, char **argv)
 			image_length = st.st_size; /* may be padded later */
 			fslen_ub += (image_length + 3); /* 3 is for padding */
 			break;
+		case 'j':
+			errno = 0;
+			opt_threads = strtoul(optarg, &ep, 10);
+			if (errno || optarg[0] == '\0' || *ep != '\0' || opt_threads < 1)
+				usage(MKFS_USAGE);
+			break;
 		case 'n':
 			opt_name = optarg;
 			break;
@@ -741,6 +916,11 @@ int main(int argc, char **argv)
 
 	if ((argc - optind) != 2)
 		usage(MKFS_USAGE);
+	if (!opt_threads) {
+		opt_threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (opt_threads < 1)
+			opt_threads = 1;
+	}
 	dirname = argv[optind];
 	outfile = argv[optind + 1];
 
@@ -774,9 +954,8 @@ int main(int argc, char **argv)
 		fslen_ub = MAXFSLEN;
 	}
 
-	/* find duplicate files. TODO: uses the most inefficient algorithm
-	   possible. */
-	eliminate_doubles(root_entry, root_entry);
+	/* find duplicate files */
+	eliminate_doubles(root_entry->child);
 
 	/* TODO: Why do we use a private/anonymous mapping here
 	   followed by a write below, instead of just a shared mapping
@@ -809,6 +988,7 @@ int main(int argc, char **argv)
 	offset = write_directory_structure(root_entry->child, rom_image, offset);
 	printf("Directory data: %d bytes\n", offset);
 
+	compress_data(root_entry);
 	offset = write_data(root_entry, rom_image, offset);
 
 	/* We always write a multiple of blksize bytes, so that
@@ -5,6 +5,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include "common.h"
 #include "patch.h"
 
@@ -71,78 +72,83 @@ int is_whitespace(char *string)
 	return retval;
 }
 
-/* Reads in and returns the contents and size of a given file */
-char *file_read(char *file, size_t *fsize)
+/*
+ * Maps the given file read/write and returns it and its size. Checksums are
+ * patched directly in the mapping, so only the pages holding the header fields
+ * that actually change are ever written back to disk.
+ */
+char *file_map(char *file, size_t *fsize)
 {
-        int fd = 0;
-        struct stat _fstat = { 0 };
-        char *buffer = NULL;
-
-        if(stat(file, &_fstat) == -1)
-        {
-                perror(file);
-                goto end;
-        }
-
-        if(_fstat.st_size == 0)
-        {
-                fprintf(stderr, "%s: zero size file\n", file);
-                goto end;
-        }
-
-        fd = open(file,O_RDONLY);
-        if(!fd)
-        {
-                perror(file);
-                goto end;
-        }
-
-        buffer = malloc(_fstat.st_size);
-        if(!buffer)
-        {
-                perror("malloc");
+	int fd = -1;
+	struct stat _fstat = { 0 };
+	char *buffer = NULL;
+
+	fd = open(file, O_RDWR);
+	if(fd == -1)
+	{
+		perror(file);
+		goto end;
+	}
+
+	if(fstat(fd, &_fstat) == -1)
+	{
+		perror(file);
 		goto end;
-        }
-        memset(buffer, 0 ,_fstat.st_size);
-
-        if(read(fd, buffer, _fstat.st_size) != _fstat.st_size)
-        {
-                perror(file);
-                if(buffer) free(buffer);
-                buffer = NULL;
-        }
-        else
-        {
-                *fsize = _fstat.st_size;
-        }
+	}
+
+	if(_fstat.st_size == 0)
+	{
+		fprintf(stderr, "%s: zero size file\n", file);
+		goto end;
+	}
+
+	buffer = mmap(NULL, _fstat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(buffer == MAP_FAILED)
+	{
+		perror("mmap");
+		buffer = NULL;
+		goto end;
+	}
+
+	/* The checksummed data is read front to back */
+	madvise(buffer, _fstat.st_size, MADV_SEQUENTIAL);
+	*fsize = _fstat.st_size;
 
 end:
-        if(fd) close(fd);
-        return buffer;
+	if(fd != -1) close(fd);
+	return buffer;
 }
 
-/* Write size bytes from buf to file fname */
-int file_write(char *fname, char *buf, size_t size)
+/* Flushes any patched header fields to disk and unmaps the file */
+int file_unmap(char *buf, size_t size)
 {
-	FILE *fp = NULL;
-	int retval = 0;
+	int retval = 1;
 
-	fp = fopen(fname, "w");
-	if(fp)
+	if(msync(buf, size, MS_SYNC) == -1)
 	{
-		if(fwrite(buf, 1, size, fp) == size)
-		{
-			retval = 1;
-		}
-		
-		fclose(fp);
+		perror("msync");
+		retval = 0;
 	}
-	else
+
+	munmap(buf, size);
+	return retval;
+}
+
+/* Stores a 32 bit header field, leaving the page clean if the value is unchanged */
+void set_field(uint32_t *field, uint32_t value)
+{
+	if(*field != value)
 	{
-		perror("fopen");
+		*field = value;
 	}
+}
 
-	return retval;
+/* Sorts header offsets in descending order */
+int offset_compare(const void *a, const void *b)
+{
+	int x = *(const int *) a, y = *(const int *) b;
+
+	return (x < y) - (x > y);
 }
 
 /* Identifies the header type used in the supplied file */
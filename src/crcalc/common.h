@@ -21,8 +21,10 @@ enum header_type
 
 int parse_log(char *file, int offsets[MAX_HEAD_SIZE]);
 int is_whitespace(char *string);
-char *file_read(char *file, size_t *fsize);
-int file_write(char *fname, char *buf, size_t size);
+char *file_map(char *file, size_t *fsize);
+int file_unmap(char *buf, size_t size);
+void set_field(uint32_t *field, uint32_t value);
+int offset_compare(const void *a, const void *b);
 enum header_type identify_header(char *buf);
 
 #endif
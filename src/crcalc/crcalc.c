@@ -36,14 +36,20 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	/* Read in target file */
-	buf = file_read(fname, &size);
+	/* Map in target file */
+	buf = file_map(fname, &size);
 
 	if(buf && size > MIN_FILE_SIZE)
 	{
 		/* Parse in the log file, if any */
 		n = parse_log(log, offsets);
 
+		/* 
+		 * Patch the headers back to front, so that the checksum of a header which contains
+		 * other headers (e.g., a TRX wrapping a uImage) covers their updated checksums.
+		 */
+		qsort(offsets, n, sizeof(int), offset_compare);
+
 		fprintf(stderr, "Processing %d header(s) from %s...\n", n, fname);
 
 		/* Loop through each offset in the integer array */
@@ -51,11 +57,18 @@ int main(int argc, char *argv[])
 		{
 			ok = 0;
 			offset = offsets[i];
-			nsize = size - offset;
-			ptr = (buf + offset);
 
 			fprintf(stderr, "Processing header at offset %d...", offset);
 
+			if(offset < 0 || (size_t) offset + MIN_FILE_SIZE > size)
+			{
+				fprintf(stderr, "offset is outside of the file!\n");
+				continue;
+			}
+
+			nsize = size - offset;
+			ptr = (buf + offset);
+
 			/* Identify and patch the header at each offset */
 			switch(identify_header(ptr))
 			{
@@ -85,17 +98,15 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if(!fail)
+	/* Patched fields are already in the mapping, unmapping writes them back */
+	if(buf && !file_unmap(buf, size))
 	{
-		if(!file_write(fname, buf, size))
-		{
-			fprintf(stderr, "Failed to save data to file '%s'\n", fname);
-		}
-		else
-		{
-			fprintf(stderr, "CRC(s) updated successfully.\n");
-			retval = EXIT_SUCCESS;
-		}
+		fprintf(stderr, "Failed to save data to file '%s'\n", fname);
+	}
+	else if(!fail)
+	{
+		fprintf(stderr, "CRC(s) updated successfully.\n");
+		retval = EXIT_SUCCESS;
 	}
 	else
 	{
@@ -103,7 +114,6 @@ int main(int argc, char *argv[])
 	}
 
 end:
-	if(buf) free(buf);
 	return retval;
 }
 
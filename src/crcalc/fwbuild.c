@@ -0,0 +1,552 @@
+/*
+ * Assembles a firmware image from the parts extract-firmware.sh carved out
+ * (header image, new file system, filler and footer) and updates the header
+ * checksums as the bytes are written, instead of copying the parts together
+ * and running crcalc over the result afterwards.
+ *
+ * Every header listed in the binwalk log becomes a job that picks its own
+ * header fields out of the stream, works out the range it checksums, and
+ * folds each chunk in that range into its CRC or MD5. Once the image is
+ * written the jobs are finished back to front, as crcalc does, and each one
+ * seeks back to patch its fields. A header nested inside another's checksum
+ * range changes bytes the outer CRC has already covered; CRCs are linear, so
+ * the outer CRC is corrected with crc32_shift() rather than by re-reading the
+ * data. Only an MD5 covering a patched field has to re-read its range.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "libcrc32.h"
+#include "common.h"
+#include "patch.h"
+#include "libhash.h"
+#include "fwbuild.h"
+
+#define TRX_PREFIX_SIZE		12
+#define DLOB_CKSUM_SIZE		(sizeof(struct dlob_header) + MD5_DIGEST_SIZE)
+
+enum job_state
+{
+	HEAD,		/* capturing the first bytes of the header */
+	CKSUM,		/* DLOB only: capturing the checksum header */
+	SUM,		/* checksumming start to end */
+	FAILED,
+};
+
+struct job
+{
+	off_t offset;
+	enum header_type type;
+	enum job_state state;
+
+	/* The bytes currently being captured */
+	off_t want_offset;
+	size_t want_size;
+	unsigned char *want;
+
+	unsigned char head[sizeof(struct uimage_header)];
+	off_t cksum_offset;
+	unsigned char cksum[DLOB_CKSUM_SIZE];
+
+	off_t start;
+	off_t end;
+	uint32_t crc;
+	struct hash_ctx md5;
+	int reread;
+};
+
+static struct job *jobs = NULL;
+static int njobs = 0;
+static off_t total_size = 0;
+
+/* Copies the part of a chunk at pos that overlaps [offset, offset + size) into dst */
+static void capture(unsigned char *dst, off_t offset, size_t size, off_t pos, const unsigned char *buf, size_t len)
+{
+	off_t from = pos > offset ? pos : offset;
+	off_t to = pos + (off_t) len < offset + (off_t) size ? pos + (off_t) len : offset + (off_t) size;
+
+	if(from < to)
+	{
+		memcpy(dst + (from - offset), buf + (from - pos), to - from);
+	}
+}
+
+static void want(struct job *job, unsigned char *dst, off_t offset, size_t size)
+{
+	job->want = dst;
+	job->want_offset = offset;
+	job->want_size = size;
+}
+
+static void start_sum(struct job *job, off_t start, off_t end)
+{
+	job->start = start;
+	job->end = end;
+	job->crc = 0xFFFFFFFF;
+	if(job->type == DLOB)
+	{
+		hash_init(&job->md5, HASH_MD5);
+	}
+	job->state = SUM;
+}
+
+/* Works out what a job does next once its captured bytes are complete, with the same checks as patch.c */
+static void advance(struct job *job)
+{
+	off_t size = total_size - job->offset;
+	struct trx_header *trx = (struct trx_header *) job->head;
+	struct uimage_header *uimage = (struct uimage_header *) job->head;
+	struct dlob_header *dlob = (struct dlob_header *) job->head;
+	struct dlob_header *cksum = (struct dlob_header *) job->cksum;
+	off_t data_offset = 0;
+	uint32_t data_size = 0;
+
+	if(job->state == HEAD && job->type == UNKNOWN)
+	{
+		job->type = identify_header((char *) job->head);
+		switch(job->type)
+		{
+			case TRX:
+				if(size >= (off_t) sizeof(struct trx_header) && trx->len >= sizeof(struct trx_header) && trx->len <= size)
+				{
+					start_sum(job, job->offset + TRX_PREFIX_SIZE, job->offset + trx->len);
+					return;
+				}
+				break;
+			case UIMAGE:
+				/* The whole header goes into the header CRC */
+				if(size >= (off_t) sizeof(struct uimage_header))
+				{
+					want(job, job->head, job->offset, sizeof(struct uimage_header));
+					return;
+				}
+				break;
+			case DLOB:
+				job->cksum_offset = job->offset + sizeof(struct dlob_header) + ntohl(dlob->header_size) + ntohl(dlob->data_size);
+				if(job->cksum_offset + (off_t) DLOB_CKSUM_SIZE <= total_size)
+				{
+					job->state = CKSUM;
+					want(job, job->cksum, job->cksum_offset, DLOB_CKSUM_SIZE);
+					return;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	else if(job->state == HEAD && job->type == UIMAGE)
+	{
+		if(ntohl(uimage->ih_size) <= size - sizeof(struct uimage_header))
+		{
+			start_sum(job, job->offset + sizeof(struct uimage_header),
+				job->offset + sizeof(struct uimage_header) + ntohl(uimage->ih_size));
+			return;
+		}
+	}
+	else if(job->state == CKSUM)
+	{
+		data_size = ntohl(cksum->data_size);
+		data_offset = job->cksum_offset + sizeof(struct dlob_header) + ntohl(cksum->header_size) + DLOB_TYPE_STRING_LENGTH;
+		if(data_size < size && data_offset + data_size <= total_size)
+		{
+			start_sum(job, data_offset, data_offset + data_size);
+			return;
+		}
+	}
+
+	job->state = FAILED;
+}
+
+/* Feeds a chunk of the output, which starts at offset pos, to every job */
+static void feed(off_t pos, const unsigned char *buf, size_t len)
+{
+	struct job *job = NULL;
+	off_t from = 0, to = 0;
+	int i = 0;
+
+	for(i=0; i<njobs; i++)
+	{
+		job = &jobs[i];
+
+		/* A job can finish capturing and start summing within the same chunk */
+		while((job->state == HEAD || job->state == CKSUM) && pos + (off_t) len > job->want_offset)
+		{
+			capture(job->want, job->want_offset, job->want_size, pos, buf, len);
+			if(pos + (off_t) len < job->want_offset + (off_t) job->want_size)
+			{
+				break;
+			}
+			advance(job);
+		}
+
+		if(job->state == SUM)
+		{
+			from = pos > job->start ? pos : job->start;
+			to = pos + (off_t) len < job->end ? pos + (off_t) len : job->end;
+			if(from < to)
+			{
+				if(job->type == DLOB)
+				{
+					hash_update(&job->md5, buf + (from - pos), to - from);
+				}
+				else
+				{
+					job->crc = crc32_update(job->crc, buf + (from - pos), to - from);
+				}
+			}
+		}
+	}
+}
+
+static int emit(int fd, off_t *pos, const unsigned char *buf, size_t len, const char *out)
+{
+	feed(*pos, buf, len);
+
+	if(write(fd, buf, len) != (ssize_t) len)
+	{
+		perror(out);
+		return 0;
+	}
+
+	*pos += len;
+	return 1;
+}
+
+static int emit_file(int fd, off_t *pos, const char *file, unsigned char *buf, const char *out)
+{
+	int in = 0, retval = 1;
+	ssize_t n = 0;
+
+	in = open(file, O_RDONLY);
+	if(in < 0)
+	{
+		perror(file);
+		return 0;
+	}
+
+	while((n = read(in, buf, COPY_BUFFER_SIZE)) > 0)
+	{
+		if(!emit(fd, pos, buf, n, out))
+		{
+			retval = 0;
+			break;
+		}
+	}
+
+	if(n < 0)
+	{
+		perror(file);
+		retval = 0;
+	}
+
+	close(in);
+	return retval;
+}
+
+/*
+ * Tells the unfinished jobs that size bytes at pos changed from old to new:
+ * CRCs covering them are corrected in place, MD5s are marked for a re-read,
+ * and captured header copies are updated.
+ */
+static void patched(struct job *done, off_t pos, const unsigned char *old, const unsigned char *new, size_t size)
+{
+	unsigned char delta[sizeof(struct uimage_header)];
+	struct job *job = NULL;
+	off_t from = 0, to = 0, i = 0;
+	int j = 0;
+
+	for(j=0; j<njobs; j++)
+	{
+		job = &jobs[j];
+		if(job == done || job->offset > done->offset || job->state != SUM)
+		{
+			continue;
+		}
+
+		capture(job->head, job->offset, sizeof(job->head), pos, new, size);
+		if(job->type == DLOB)
+		{
+			capture(job->cksum, job->cksum_offset, sizeof(job->cksum), pos, new, size);
+		}
+
+		from = pos > job->start ? pos : job->start;
+		to = pos + (off_t) size < job->end ? pos + (off_t) size : job->end;
+		if(from >= to)
+		{
+			continue;
+		}
+
+		if(job->type == DLOB)
+		{
+			job->reread = 1;
+		}
+		else
+		{
+			for(i=from; i<to; i++)
+			{
+				delta[i - from] = old[i - pos] ^ new[i - pos];
+			}
+			job->crc ^= crc32_shift(crc32_update(0, delta, to - from), job->end - to);
+		}
+	}
+}
+
+/* Computes and writes back one header's fields; returns 1 on success */
+static int finish(int fd, struct job *job)
+{
+	struct uimage_header copy;
+	unsigned char old[sizeof(struct uimage_header)], new[sizeof(struct uimage_header)];
+	uint32_t value = 0;
+	unsigned char digest[MD5_DIGEST_SIZE];
+	off_t pos = 0;
+	size_t size = 0;
+
+	switch(job->type)
+	{
+		case TRX:
+			if(job->crc == 0)
+			{
+				return 0;
+			}
+			pos = job->offset + 8;
+			size = sizeof(uint32_t);
+			memcpy(old, job->head + 8, size);
+			memcpy(new, &job->crc, size);
+			break;
+		case UIMAGE:
+			memcpy(&copy, job->head, sizeof(copy));
+			copy.ih_hcrc = 0;
+			copy.ih_dcrc = htonl(job->crc ^ 0xFFFFFFFFL);
+			value = crc32_update(0xFFFFFFFF, &copy, sizeof(copy)) ^ 0xFFFFFFFFL;
+			copy.ih_hcrc = htonl(value);
+			if(copy.ih_dcrc == 0 || copy.ih_hcrc == 0)
+			{
+				return 0;
+			}
+			pos = job->offset;
+			size = sizeof(copy);
+			memcpy(old, job->head, size);
+			memcpy(new, &copy, size);
+			break;
+		case DLOB:
+			/* Headers inside its range were patched: hash it again from the output */
+			if(job->reread)
+			{
+				if(hash_region(HASH_MD5, fd, job->start, job->end - job->start, digest) != 0)
+				{
+					return 0;
+				}
+			}
+			else
+			{
+				hash_final(&job->md5, digest);
+			}
+			pos = job->cksum_offset + sizeof(struct dlob_header);
+			size = MD5_DIGEST_SIZE;
+			memcpy(old, job->cksum + sizeof(struct dlob_header), size);
+			memcpy(new, digest, size);
+			break;
+		default:
+			return 0;
+	}
+
+	if(memcmp(old, new, size) != 0)
+	{
+		if(pwrite(fd, new, size, pos) != (ssize_t) size)
+		{
+			return 0;
+		}
+		patched(job, pos, old, new, size);
+	}
+
+	return 1;
+}
+
+static off_t file_size(const char *file)
+{
+	struct stat st;
+
+	if(stat(file, &st) != 0)
+	{
+		perror(file);
+		return -1;
+	}
+
+	return st.st_size;
+}
+
+int main(int argc, char *argv[])
+{
+	int retval = EXIT_FAILURE, fail = 1, nopad = 0, fd = -1, c = 0, i = 0, n = 0;
+	int offsets[MAX_HEAD_SIZE] = { 0 };
+	char *out = NULL, *header = NULL, *fs = NULL, *footer = NULL, *log = NULL;
+	off_t fw_size = 0, header_size = 0, fs_size = 0, footer_size = 0, filler_size = 0, pos = 0, chunk = 0;
+	unsigned char *buf = NULL;
+
+	while((c = getopt(argc, argv, "nf:l:h")) != -1)
+	{
+		switch(c)
+		{
+			case 'n':
+				nopad = 1;
+				break;
+			case 'f':
+				footer = optarg;
+				break;
+			case 'l':
+				log = optarg;
+				break;
+			default:
+				fprintf(stderr, USAGE, argv[0]);
+				goto end;
+		}
+	}
+
+	if(argc - optind != 4)
+	{
+		fprintf(stderr, USAGE, argv[0]);
+		goto end;
+	}
+
+	out = argv[optind];
+	header = argv[optind + 1];
+	fs = argv[optind + 2];
+	fw_size = strtoll(argv[optind + 3], NULL, 0);
+
+	if((header_size = file_size(header)) < 0 || (fs_size = file_size(fs)) < 0 ||
+	   (footer && (footer_size = file_size(footer)) < 0))
+	{
+		goto end;
+	}
+
+	filler_size = fw_size - header_size - fs_size - footer_size;
+	printf("CUR_SIZE='%lld'\n", (long long) (header_size + fs_size));
+	printf("FILLER_SIZE='%lld'\n", (long long) filler_size);
+	fflush(stdout);
+
+	if(filler_size < 0)
+	{
+		retval = EXIT_TOO_LARGE;
+		goto end;
+	}
+	if(nopad)
+	{
+		filler_size = 0;
+	}
+	total_size = header_size + fs_size + filler_size + footer_size;
+
+	/* Set up a job for each header, highest offset first */
+	n = parse_log(log, offsets);
+	qsort(offsets, n, sizeof(int), offset_compare);
+	jobs = calloc(n ? n : 1, sizeof(struct job));
+	buf = malloc(COPY_BUFFER_SIZE);
+	if(jobs == NULL || buf == NULL)
+	{
+		perror("malloc");
+		goto end;
+	}
+
+	for(i=0; i<n; i++)
+	{
+		if(offsets[i] < 0 || (off_t) offsets[i] + MIN_FILE_SIZE > total_size)
+		{
+			fprintf(stderr, "Header at offset %d is outside of the file!\n", offsets[i]);
+			continue;
+		}
+
+		jobs[njobs].offset = offsets[i];
+		jobs[njobs].type = UNKNOWN;
+		jobs[njobs].state = HEAD;
+		want(&jobs[njobs], jobs[njobs].head, offsets[i], TRX_PREFIX_SIZE < total_size - offsets[i] ? TRX_PREFIX_SIZE : total_size - offsets[i]);
+		njobs++;
+	}
+
+	fd = open(out, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+	{
+		perror(out);
+		goto end;
+	}
+
+	/* Write the image out, checksumming as it goes */
+	if(!emit_file(fd, &pos, header, buf, out) || !emit_file(fd, &pos, fs, buf, out))
+	{
+		goto end;
+	}
+
+	memset(buf, FILLER_BYTE, COPY_BUFFER_SIZE);
+	while(filler_size > 0)
+	{
+		chunk = filler_size < COPY_BUFFER_SIZE ? filler_size : COPY_BUFFER_SIZE;
+		if(!emit(fd, &pos, buf, chunk, out))
+		{
+			goto end;
+		}
+		filler_size -= chunk;
+	}
+
+	if(footer && !emit_file(fd, &pos, footer, buf, out))
+	{
+		goto end;
+	}
+
+	if(pos != total_size)
+	{
+		fprintf(stderr, "%s: a part changed size while being copied\n", out);
+		goto end;
+	}
+
+	fprintf(stderr, "Processing %d header(s) from %s...\n", njobs, out);
+
+	/* Then go back and patch the headers, innermost first */
+	for(i=0; i<njobs; i++)
+	{
+		fprintf(stderr, "Processing header at offset %lld...", (long long) jobs[i].offset);
+
+		if(jobs[i].state == FAILED && jobs[i].type == UNKNOWN)
+		{
+			fprintf(stderr, "sorry, this file type is not supported.\n");
+		}
+		else if(jobs[i].state == SUM && finish(fd, &jobs[i]))
+		{
+			fail = 0;
+			fprintf(stderr, "checksum(s) updated OK.\n");
+		}
+		else
+		{
+			fprintf(stderr, "checksum update(s) failed!\n");
+		}
+	}
+
+	if(close(fd) != 0)
+	{
+		perror(out);
+		fd = -1;
+		goto end;
+	}
+	fd = -1;
+
+	if(!fail)
+	{
+		fprintf(stderr, "CRC(s) updated successfully.\n");
+		retval = EXIT_SUCCESS;
+	}
+	else
+	{
+		fprintf(stderr, "CRC update failed.\n");
+		retval = EXIT_NO_CHECKSUM;
+	}
+
+end:
+	if(fd != -1) close(fd);
+	free(jobs);
+	free(buf);
+	return retval;
+}
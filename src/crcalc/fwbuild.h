@@ -0,0 +1,23 @@
+#ifndef _FWBUILD_H_
+#define _FWBUILD_H_
+
+#define USAGE "\n\
+fwbuild - assembles a firmware image and updates its TRX, uImage and DLOB header checksums in one pass.\n\
+\n\
+Usage: %s [-n] [-f footer] [-l binwalk log file] <output> <header image> <file system> <firmware size>\n\
+\n\
+\t-n  Don't pad the image out to the firmware size with 0xFF filler\n\
+\t-f  Footer to append after the filler\n\
+\t-l  binwalk log or offset list of the headers to update (default: one header at offset 0)\n\
+\n\
+Prints CUR_SIZE and FILLER_SIZE. Exits with 2, writing nothing, if the image would be\n\
+larger than the firmware size, and with 3 if no header checksum could be updated.\n\
+\n"
+
+#define EXIT_TOO_LARGE		2
+#define EXIT_NO_CHECKSUM	3
+
+#define COPY_BUFFER_SIZE	(1024 * 1024)
+#define FILLER_BYTE		0xFF
+
+#endif
@@ -2,25 +2,27 @@
 #include <arpa/inet.h>
 #include "patch.h"
 #include "crc.h"
-#include "md5.h"
+#include "libhash.h"
+#include "common.h"
 
 /* Update the CRC for a TRX file */
 int patch_trx(char *buf, size_t size)
 {
         int retval = 0;
+	uint32_t crc = 0;
         struct trx_header *header = NULL;
 
         header = (struct trx_header *) buf;
-        header->crc32 = 0;
 
 	/* Sanity check on the header length field */
-	if(header->len <= size)
+	if(size >= sizeof(struct trx_header) && header->len >= sizeof(struct trx_header) && header->len <= size)
 	{
         	/* Checksum is calculated over the image, plus the header offsets (12 bytes into the TRX header) */
-        	header->crc32 = crc32(buf+12, (header->len-12));
+        	crc = crc32(buf+12, (header->len-12));
 
-        	if(header->crc32 != 0)
+        	if(crc != 0)
         	{
+			set_field(&header->crc32, crc);
         	        retval = 1;
         	}
 	}
@@ -33,24 +35,33 @@ int patch_uimage(char *buf, size_t size)
 {
         int retval = 0;
 	uint32_t hlen = 0;
-        struct uimage_header *header = NULL;
+        struct uimage_header *header = NULL, copy;
 
         header = (struct uimage_header *) buf;
+
+	if(size < sizeof(struct uimage_header))
+	{
+		return retval;
+	}
+
 	hlen = ntohl(header->ih_size);
 
-	if(hlen <= size)
+	if(hlen <= size - sizeof(struct uimage_header))
 	{
-        	header->ih_hcrc = 0;
-        	header->ih_dcrc = 0;
+		/* Work on a copy so the mapped header is only touched if a CRC changes */
+		memcpy(&copy, header, sizeof(copy));
+        	copy.ih_hcrc = 0;
 
-        	header->ih_dcrc = crc32(buf+sizeof(struct uimage_header), hlen) ^ 0xFFFFFFFFL;
-        	header->ih_dcrc = htonl(header->ih_dcrc);
+        	copy.ih_dcrc = crc32(buf+sizeof(struct uimage_header), hlen) ^ 0xFFFFFFFFL;
+        	copy.ih_dcrc = htonl(copy.ih_dcrc);
 
-        	header->ih_hcrc = crc32(buf, sizeof(struct uimage_header)) ^ 0xFFFFFFFFL;
-        	header->ih_hcrc = htonl(header->ih_hcrc);
+        	copy.ih_hcrc = crc32((char *) &copy, sizeof(struct uimage_header)) ^ 0xFFFFFFFFL;
+        	copy.ih_hcrc = htonl(copy.ih_hcrc);
 
-        	if(header->ih_dcrc != 0 && header->ih_hcrc != 0)
+        	if(copy.ih_dcrc != 0 && copy.ih_hcrc != 0)
         	{
+			set_field(&header->ih_dcrc, copy.ih_dcrc);
+			set_field(&header->ih_hcrc, copy.ih_hcrc);
         	        retval = 1;
         	}
 	}
@@ -61,16 +72,20 @@ int patch_uimage(char *buf, size_t size)
 /* Update the MD5 checksum in the DLOB header */
 int patch_dlob(char *buf, size_t size)
 {
-	md5_state_t state;
-        md5_byte_t digest[16];
-	int i = 0, retval = 0;
+	unsigned char digest[MD5_DIGEST_SIZE];
+	int retval = 0;
 	uint32_t cksum_header_offset = 0, data_size = 0, data_offset = 0;
 	struct dlob_header *sig_header = NULL, *cksum_header = NULL;
 
+	if(size < sizeof(struct dlob_header))
+	{
+		return retval;
+	}
+
 	sig_header = (struct dlob_header *) buf;
 	cksum_header_offset = sizeof(struct dlob_header) + ntohl(sig_header->header_size) + ntohl(sig_header->data_size);
 	
-	if(cksum_header_offset < size)
+	if(cksum_header_offset + sizeof(struct dlob_header) + sizeof(digest) <= size)
 	{
 		cksum_header = (struct dlob_header *) (buf + cksum_header_offset);
 		data_size = ntohl(cksum_header->data_size);
@@ -78,13 +93,11 @@ int patch_dlob(char *buf, size_t size)
 
 		if(data_size < size && (data_size + data_offset) <= size)
 		{
-			md5_init(&state);
-			md5_append(&state, (const md5_byte_t *) (buf + data_offset), data_size);
-			md5_finish(&state, digest);
+			hash_buffer(HASH_MD5, buf + data_offset, data_size, digest);
 
-			for(i=0; i<16; i++)
+			if(memcmp(buf+cksum_header_offset+sizeof(struct dlob_header), digest, sizeof(digest)) != 0)
 			{
-				buf[cksum_header_offset+sizeof(struct dlob_header)+i] = digest[i];
+				memcpy(buf+cksum_header_offset+sizeof(struct dlob_header), digest, sizeof(digest));
 			}
 		
 			retval = 1;
@@ -54,10 +54,15 @@ struct bcm_tag {
 	char dualImage[DUALFLAG_LEN];          // 138-139: Unused at present
 	char inactiveFlag[INACTIVEFLAG_LEN];   // 140-141: Unused at present
         char rsa_signature[RSASIG_LEN];        // 142-161: RSA Signature (unused at present; some vendors may use this)
-	char information1[TAGINFO1_LEN];       // 162-191: Compilation and related information (not generated/used by OpenWRT)
-        char flashLayoutVer[FLASHLAYOUTVER_LEN];// 192-195: Version flash layout
-        char fskernelCRC[CRC_LEN];             // 196-199: kernel+rootfs CRC32
-	char information2[TAGINFO2_LEN];       // 200-215: Unused at present except Alice Gate where is is information
+	union {
+		struct {
+			char information1[TAGINFO1_LEN];       // 162-191: Compilation and related information (not generated/used by OpenWRT)
+			char flashLayoutVer[FLASHLAYOUTVER_LEN];// 192-195: Version flash layout
+			char fskernelCRC[CRC_LEN];             // 196-199: kernel+rootfs CRC32
+			char information2[TAGINFO2_LEN];       // 200-215: Unused at present except Alice Gate where is is information
+		};
+		char altInfo[ALTTAGINFO_LEN];          // 162-215: Pirelli vendor information, overlaying the four fields above
+	};
 	char imageCRC[CRC_LEN];                // 216-219: CRC32 of image less imagetag (kernel for Alice Gate)
         char rootfsCRC[CRC_LEN];               // 220-223: CRC32 of rootfs partition
         char kernelCRC[CRC_LEN];               // 224-227: CRC32 of kernel partition
@@ -15,6 +15,7 @@
 #include <sys/stat.h>
 
 #include "buffalo-lib.h"
+#include "xor-lib.h"
 
 static uint32_t crc32_table[256] =
 {
@@ -116,27 +117,56 @@ int bcrypt_init(struct bcrypt_ctx *ctx, void *key, int keylen,
 	return 0;
 }
 
+/*
+ * Generates the keystream a chunk at a time and XORs it in bulk. i and j
+ * are bytes, so with 256 state entries every reduction is a byte wrap and
+ * with more than 510 none of them changes anything; only the odd sizes
+ * in between pay for divisions.
+ */
 int bcrypt_process(struct bcrypt_ctx *ctx, unsigned char *src,
 		   unsigned char *dst, unsigned long len)
 {
+	unsigned char ks[BCRYPT_CHUNK_LEN] __attribute__((aligned(XOR_ALIGN)));
 	unsigned char *state = ctx->state;
 	unsigned long state_len = ctx->state_len;
 	unsigned char i, j;
-	unsigned long k;
+	unsigned long k, n, done;
+	unsigned int mask;
 
 	i = ctx->i;
 	j = ctx->j;
-
-	for (k = 0; k < len; k++) {
-		unsigned char t;
-
-		i = (i + 1) % state_len;
-		j = (j + state[i]) % state_len;
-		t = state[j];
-		state[j] = state[i];
-		state[i] = t;
-
-		dst[k] = src[k] ^ state[(state[i] + state[j]) % state_len];
+	mask = (state_len == 256) ? 0xff : 0x1ff;
+
+	for (done = 0; done < len; done += n) {
+		n = (len - done < sizeof(ks)) ? len - done : sizeof(ks);
+
+		if (state_len == 256 || state_len > 510) {
+			for (k = 0; k < n; k++) {
+				unsigned char t;
+
+				i++;
+				j += state[i];
+				t = state[j];
+				state[j] = state[i];
+				state[i] = t;
+
+				ks[k] = state[(state[i] + state[j]) & mask];
+			}
+		} else {
+			for (k = 0; k < n; k++) {
+				unsigned char t;
+
+				i = (i + 1) % state_len;
+				j = (j + state[i]) % state_len;
+				t = state[j];
+				state[j] = state[i];
+				state[i] = t;
+
+				ks[k] = state[(state[i] + state[j]) % state_len];
+			}
+		}
+
+		xor_buf(dst + done, src + done, ks, n);
 	}
 
 	ctx->i = i;
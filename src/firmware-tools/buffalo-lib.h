@@ -95,6 +95,7 @@ int decrypt_buf(struct enc_param *ep, unsigned char *data,
 
 #define BCRYPT_DEFAULT_STATE_LEN	256
 #define BCRYPT_MAX_KEYLEN		254
+#define BCRYPT_CHUNK_LEN		4096
 
 struct bcrypt_ctx {
 	unsigned long i;
@@ -27,33 +27,11 @@
 #include <string.h>
 #include <netinet/in.h>
 #include <inttypes.h>
-
-#define BPB 8 /* bits/byte */
-
-static uint32_t crc32[1<<BPB];
-
-static void init_crc32()
-{
-	const uint32_t poly = ntohl(0x2083b8ed);
-	int n;
-
-	for (n = 0; n < 1<<BPB; n++) {
-		uint32_t crc = n;
-		int bit;
-
-		for (bit = 0; bit < BPB; bit++)
-			crc = (crc & 1) ? (poly ^ (crc >> 1)) : (crc >> 1);
-		crc32[n] = crc;
-	}
-}
+#include "libcrc32.h"
 
 static uint32_t crc32buf(unsigned char *buf, size_t len)
 {
-	uint32_t crc = 0xFFFFFFFF;
-
-	for (; len; len--, buf++)
-		crc = crc32[(uint8_t)crc ^ *buf] ^ (crc >> BPB);
-	return ~crc;
+	return crc32_calc(buf, len);
 }
 
 static void usage(const char *) __attribute__ (( __noreturn__ ));
@@ -127,8 +105,7 @@ static void appendfile(int outfd, char *path, int kernel) {
 		exit(1);
 	}
 
-	init_crc32();
-	crc = crc32buf(input_file, len);
+	crc = crc32buf((unsigned char *) input_file, len);
 	fprintf(stderr, "crc32 for '%s' is %08x.\n", path, crc);
 
 	// write the file
@@ -136,7 +113,7 @@ static void appendfile(int outfd, char *path, int kernel) {
 
 	// write padding
 	padded_len = ((len + sizeof(footer) + sizeof(padding) - 1) & ~(sizeof(padding) - 1)) - sizeof(footer);
-	fprintf(stderr, "len=%08x padded_len=%08x\n", len, padded_len);
+	fprintf(stderr, "len=%08zx padded_len=%08zx\n", len, padded_len);
 	write(outfd, padding, padded_len - len);
 
 	// write footer
@@ -17,7 +17,7 @@
 #include <errno.h>
 #include <arpa/inet.h>
 #include <unistd.h>
-#include "md5.h"
+#include "libhash.h"
 
 #define HDR_LEN 		0x60
 #define BUF_SIZE 		0x200
@@ -99,26 +99,7 @@ static int header_checksum(void *data, int len)
 
 static int md5_file(const char *filename, uint8_t *dst)
 {
-	FILE *fp_src;
-	MD5_CTX ctx;
-	char buf[BUF_SIZE];
-	size_t bytes_read;
-
-	MD5_Init(&ctx);
-
-	fp_src = fopen(filename, "r+b");
-	if (!fp_src) {
-		return -1;
-	}
-	while (!feof(fp_src)) {
-		bytes_read = fread(&buf, 1, BUF_SIZE, fp_src);
-		MD5_Update(&ctx, &buf, bytes_read);
-	}
-	fclose(fp_src);
-
-	MD5_Final(dst, &ctx);
-
-	return 0;
+	return hash_file(HASH_MD5, filename, dst);
 }
 
 static int encode_image(const char *input_file_name,
@@ -199,7 +180,7 @@ static int encode_image(const char *input_file_name,
 		}
 
 		for (i = 0; i < bytes_read; i++)
-			buf[i] ^= magic >> ((((i >> 60) + i) & 7) - (i >> 60));
+			buf[i] ^= magic >> (i & 7);
 		fwrite(&buf, bytes_read, 1, fp_output);
 	}
 
@@ -254,7 +235,7 @@ int decode_image(const char *input_file_name, const char *output_file_name)
 
 		bytes_read = fread(&buf, 1, BUF_SIZE, fp_input);
 		for (i = 0; i < bytes_read; i++)
-			buf[i] ^= header.magic >> ((((i >> 60) + i) & 7) - (i >> 60));
+			buf[i] ^= header.magic >> (i & 7);
 
 		/*
 		 * Handle padded source file
@@ -306,7 +287,7 @@ static void usage(const char *progname, int status)
 int main(int argc, char *argv[])
 {
 	int opt;
-	char *input_file, *output_file, *progname = NULL;
+	char *input_file = NULL, *output_file = NULL, *progname = NULL;
 	op_mode mode = NONE;
 	int tmp, i, pad = 0;
 	int block_size;
@@ -16,9 +16,10 @@
 #include <getopt.h>     /* for getopt() */
 #include <stdarg.h>
 #include <errno.h>
+#include <byteswap.h>
 #include <sys/stat.h>
 
-#include "sha1.h"
+#include "libhash.h"
 
 #if (__BYTE_ORDER == __BIG_ENDIAN)
 #  define HOST_TO_BE32(x)	(x)
@@ -82,7 +83,7 @@ static struct board_info boards[] = {
 #define ERRS(fmt, ...) do { \
 	int save = errno; \
 	fflush(0); \
-	fprintf(stderr, "[%s] *** error: " fmt "\n", \
+	fprintf(stderr, "[%s] *** error: " fmt ": %s\n", \
 			progname, ## __VA_ARGS__, strerror(save)); \
 } while (0)
 
@@ -105,7 +106,6 @@ static struct board_info *find_board(char *id)
 void usage(int status)
 {
 	FILE *stream = (status != EXIT_SUCCESS) ? stderr : stdout;
-	struct board_info *board;
 
 	fprintf(stream, "Usage: %s [OPTIONS...]\n", progname);
 	fprintf(stream,
@@ -129,7 +129,7 @@ int main(int argc, char *argv[])
 	struct stat st;
 	char *buf;
 	struct planex_hdr *hdr;
-	sha1_context ctx;
+	struct hash_ctx ctx;
 	uint32_t seed;
 
 	FILE *outfile, *infile;
@@ -228,10 +228,10 @@ int main(int argc, char *argv[])
 	}
 
 	seed = HOST_TO_BE32(board->seed);
-	sha1_starts(&ctx);
-	sha1_update(&ctx, (uchar *) &seed, sizeof(seed));
-	sha1_update(&ctx, buf + sizeof(*hdr), board->datalen);
-	sha1_finish(&ctx, hdr->sha1sum);
+	hash_init(&ctx, HASH_SHA1);
+	hash_update(&ctx, &seed, sizeof(seed));
+	hash_update(&ctx, buf + sizeof(*hdr), board->datalen);
+	hash_final(&ctx, hdr->sha1sum);
 
 	outfile = fopen(ofname, "w");
 	if (outfile == NULL) {
@@ -248,7 +248,6 @@ int main(int argc, char *argv[])
 
 	res = EXIT_SUCCESS;
 
- out_flush:
 	fflush(outfile);
 
  err_close_out:
@@ -25,7 +25,7 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 
-#include "md5.h"
+#include "libhash.h"
 
 #define ALIGN(x,a) ({ typeof(a) __a = (a); (((x) + __a - 1) & ~(__a - 1)); })
 
@@ -305,7 +305,7 @@ static struct board_info boards[] = {
 #define ERRS(fmt, ...) do { \
 	int save = errno; \
 	fflush(0); \
-	fprintf(stderr, "[%s] *** error: " fmt "\n", \
+	fprintf(stderr, "[%s] *** error: " fmt ": %s\n", \
 			progname, ## __VA_ARGS__, strerror(save)); \
 } while (0)
 
@@ -360,7 +360,6 @@ static struct flash_layout *find_layout(char *id)
 static void usage(int status)
 {
 	FILE *stream = (status != EXIT_SUCCESS) ? stderr : stdout;
-	struct board_info *board;
 
 	fprintf(stream, "Usage: %s [OPTIONS...]\n", progname);
 	fprintf(stream,
@@ -390,13 +389,9 @@ static void usage(int status)
 	exit(status);
 }
 
-static int get_md5(char *data, int size, char *md5)
+static void get_md5(char *data, int size, uint8_t *md5)
 {
-	MD5_CTX ctx;
-
-	MD5_Init(&ctx);
-	MD5_Update(&ctx, data, size);
-	MD5_Final(md5, &ctx);
+	hash_buffer(HASH_MD5, data, size, md5);
 }
 
 static int get_file_stat(struct file_info *fdata)
@@ -575,8 +570,10 @@ static void fill_header(char *buf, int len)
 	memset(hdr, 0, sizeof(struct fw_header));
 
 	hdr->version = htonl(HEADER_VERSION_V1);
-	strncpy(hdr->vendor_name, vendor, sizeof(hdr->vendor_name));
-	strncpy(hdr->fw_version, version, sizeof(hdr->fw_version));
+	memcpy(hdr->vendor_name, vendor,
+	       strnlen(vendor, sizeof(hdr->vendor_name)));
+	memcpy(hdr->fw_version, version,
+	       strnlen(version, sizeof(hdr->fw_version)));
 	hdr->hw_id = htonl(hw_id);
 	hdr->hw_rev = htonl(hw_rev);
 
@@ -941,9 +938,6 @@ static int inspect_fw(void)
 int main(int argc, char *argv[])
 {
 	int ret = EXIT_FAILURE;
-	int err;
-
-	FILE *outfile;
 
 	progname = basename(argv[0]);
 
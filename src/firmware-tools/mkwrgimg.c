@@ -18,7 +18,7 @@
 #include <errno.h>
 #include <sys/stat.h>
 
-#include "md5.h"
+#include "libhash.h"
 
 #define ERR(fmt, ...) do { \
 	fflush(0); \
@@ -92,15 +92,15 @@ static void put_u32(void *data, uint32_t val)
 
 static void get_digest(struct wrg_header *header, char *data, int size)
 {
-	MD5_CTX ctx;
+	struct hash_ctx ctx;
 
-	MD5_Init(&ctx);
+	hash_init(&ctx, HASH_MD5);
 
-	MD5_Update(&ctx, (char *)&header->offset, sizeof(header->offset));
-	MD5_Update(&ctx, (char *)&header->devname, sizeof(header->devname));
-	MD5_Update(&ctx, data, size);
+	hash_update(&ctx, &header->offset, sizeof(header->offset));
+	hash_update(&ctx, &header->devname, sizeof(header->devname));
+	hash_update(&ctx, data, size);
 
-	MD5_Final(header->digest, &ctx);
+	hash_final(&ctx, (unsigned char *) header->digest);
 }
 
 int main(int argc, char *argv[])
@@ -201,8 +201,10 @@ int main(int argc, char *argv[])
 	header = (struct wrg_header *) buf;
 	memset(header, '\0', sizeof(struct wrg_header));
 
-	strncpy(header->signature, signature, sizeof(header->signature));
-	strncpy(header->devname, dev_name, sizeof(header->signature));
+	memcpy(header->signature, signature,
+	       strnlen(signature, sizeof(header->signature)));
+	memcpy(header->devname, dev_name,
+	       strnlen(dev_name, sizeof(header->devname)));
 	put_u32(&header->magic1, WRG_MAGIC);
 	put_u32(&header->magic2, WRG_MAGIC);
 	put_u32(&header->size, st.st_size);
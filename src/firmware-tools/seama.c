@@ -44,11 +44,13 @@
 #include <stdarg.h>
 #include <sys/sysmacros.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
 #include <arpa/inet.h>
 
-#include "md5.h"
+#include "libhash.h"
 #include "seama.h"
 
 #define PROGNAME			"seama"
@@ -141,26 +143,41 @@ static int parse_args(int argc, char * argv[])
 
 static size_t calculate_digest(FILE * fh, size_t size, uint8_t * digest)
 {
-	MD5_CTX ctx;
+	struct hash_ctx ctx;
+	struct stat st;
 	size_t bytes_left, bytes_read, i;
 	uint8_t buf[MAX_SEAMA_META_SIZE];
+	off_t pos;
+
+	/* Regular files are hashed in place from a mapping of the range */
+	pos = ftello(fh);
+	if (pos >= 0 && fstat(fileno(fh), &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= pos)
+	{
+		bytes_read = st.st_size - pos;
+		if (size && size < bytes_read) bytes_read = size;
+		if (hash_region(HASH_MD5, fileno(fh), pos, bytes_read, digest) == 0)
+		{
+			fseeko(fh, pos + bytes_read, SEEK_SET);
+			return bytes_read;
+		}
+	}
 
 	bytes_left = size ? size : sizeof(buf);
 	bytes_read = 0;
 
-	MD5_Init(&ctx);
+	hash_init(&ctx, HASH_MD5);
 	while (!feof(fh) && !ferror(fh) && bytes_left > 0)
 	{
 		i = bytes_left < sizeof(buf) ? bytes_left : sizeof(buf);
 		i = fread(buf, sizeof(char), i, fh);
 		if (i > 0)
 		{
-			MD5_Update(&ctx, buf, i);
+			hash_update(&ctx, buf, i);
 			bytes_read += i;
 		}
 		if (size) bytes_left -= i;
 	}
-	MD5_Final(digest, &ctx);
+	hash_final(&ctx, digest);
 	return bytes_read;
 }
 
@@ -235,10 +252,10 @@ static int verify_seama(const char * fname, int msg)
 			{
 				printf("SEAMA ==========================================\n");
 				printf("  magic      : %08x\n", ntohl(shdr.magic));
-				printf("  meta size  : %d bytes\n", msize);
+				printf("  meta size  : %zu bytes\n", msize);
 				for (i=0; i<msize; i+=(strlen((const char *)&buf[i])+1))
 					printf("  meta data  : %s\n", &buf[i]);
-				printf("  image size : %d bytes\n", isize);
+				printf("  image size : %zu bytes\n", isize);
 			}
 
 			/* verify checksum */
@@ -370,6 +387,33 @@ static void pack_files(void)
 	size_t i, fsize;
 	char filename[512];
 	uint8_t digest[16];
+	uint8_t * sum;
+	struct hash_job jobs[MAX_IMAGE];
+	int job[MAX_IMAGE], njobs = 0, fd;
+	struct stat st;
+	void * map;
+
+	/* Map the images and digest them all at once, one image per lane of
+	 * the multi-buffer MD5 kernel. Anything that can't be mapped is
+	 * digested when it is packed below. */
+	for (i=0; i<o_isize; i++)
+	{
+		job[i] = -1;
+		fd = open(o_images[i], O_RDONLY);
+		if (fd < 0) continue;
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+		{
+			map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			if (map != MAP_FAILED)
+			{
+				jobs[njobs].data = map;
+				jobs[njobs].len = st.st_size;
+				job[i] = njobs++;
+			}
+		}
+		close(fd);
+	}
+	hash_batch(HASH_MD5, jobs, njobs);
 
 	for (i=0; i<o_isize; i++)
 	{
@@ -377,9 +421,18 @@ static void pack_files(void)
 		ifh = fopen(o_images[i], "r+");
 		if (ifh)
 		{
-			fsize = calculate_digest(ifh, 0, digest);
-			verbose("file size (%s) : %d\n", o_images[i], fsize);
-			rewind(ifh);
+			if (job[i] >= 0)
+			{
+				sum = jobs[job[i]].digest;
+				fsize = jobs[job[i]].len;
+			}
+			else
+			{
+				sum = digest;
+				fsize = calculate_digest(ifh, 0, digest);
+				rewind(ifh);
+			}
+			verbose("file size (%s) : %zu\n", o_images[i], fsize);
 
 			/* Open the output file. */
 			sprintf(filename, "%s.seama", o_images[i]);
@@ -387,7 +440,7 @@ static void pack_files(void)
 			if (fh)
 			{
 				write_seama_header(fh, o_meta, o_msize, fsize);
-				write_checksum(fh, digest);
+				write_checksum(fh, sum);
 				write_meta_data(fh, o_meta, o_msize);
 				copy_file(fh, ifh);
 				fclose(fh);
@@ -399,6 +452,9 @@ static void pack_files(void)
 			printf("Unable to open image file '%s'\n",o_images[i]);
 		}
 	}
+
+	for (i=0; i<njobs; i++)
+		munmap((void *)jobs[i].data, jobs[i].len);
 }
 
 /**************************************************************************/
@@ -473,7 +529,7 @@ static void extract_file(const char * output)
 				fread(buf, sizeof(char), msize, ifh);
 				if (match_meta((const char *)buf, msize))
 				{
-					printf("SEAMA: found image @ '%s', image size: %d\n", o_images[i], isize);
+					printf("SEAMA: found image @ '%s', image size: %zu\n", o_images[i], isize);
 					/* open output file */
 					ofh = fopen(output, "w");
 					if (!ofh) printf("SEAMA: unable to open '%s' for writting.\n",output);
@@ -0,0 +1,220 @@
+/*
+ * Bulk XOR kernels.
+ *
+ *   generic    eight bytes at a time, portable
+ *   avx2       x86 AVX2, 128 bytes per iteration
+ *   neon       AArch64 Advanced SIMD, 64 bytes per iteration
+ *
+ * Every kernel loads a whole iteration before storing it and walks
+ * forwards, so dst may overlap src as long as it does not lie after it.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xor-lib.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define XOR_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define XOR_NEON
+#include <arm_neon.h>
+#endif
+
+static int xor_always(void)
+{
+	return 1;
+}
+
+static void xor_generic(unsigned char *dst, const unsigned char *src,
+			const unsigned char *key, size_t len)
+{
+	uint64_t s, k;
+
+	for (; len >= sizeof(s); len -= sizeof(s)) {
+		memcpy(&s, src, sizeof(s));
+		memcpy(&k, key, sizeof(k));
+		s ^= k;
+		memcpy(dst, &s, sizeof(s));
+		dst += sizeof(s);
+		src += sizeof(s);
+		key += sizeof(k);
+	}
+
+	while (len--)
+		*dst++ = *src++ ^ *key++;
+}
+
+#ifdef XOR_X86
+static int xor_avx2_supported(void)
+{
+	unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) ||
+	    !(ecx & bit_OSXSAVE) || !(ecx & bit_AVX))
+		return 0;
+
+	/* the OS has to save the YMM registers too */
+	__asm__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+	if ((eax & 6) != 6)
+		return 0;
+
+	return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) &&
+	       (ebx & bit_AVX2);
+}
+
+__attribute__((target("avx2")))
+static void xor_avx2(unsigned char *dst, const unsigned char *src,
+		     const unsigned char *key, size_t len)
+{
+	__m256i s0, s1, s2, s3;
+
+	for (; len >= 128; len -= 128) {
+		s0 = _mm256_loadu_si256((const __m256i *) (src + 0));
+		s1 = _mm256_loadu_si256((const __m256i *) (src + 32));
+		s2 = _mm256_loadu_si256((const __m256i *) (src + 64));
+		s3 = _mm256_loadu_si256((const __m256i *) (src + 96));
+		s0 = _mm256_xor_si256(s0, _mm256_loadu_si256((const __m256i *) (key + 0)));
+		s1 = _mm256_xor_si256(s1, _mm256_loadu_si256((const __m256i *) (key + 32)));
+		s2 = _mm256_xor_si256(s2, _mm256_loadu_si256((const __m256i *) (key + 64)));
+		s3 = _mm256_xor_si256(s3, _mm256_loadu_si256((const __m256i *) (key + 96)));
+		_mm256_storeu_si256((__m256i *) (dst + 0), s0);
+		_mm256_storeu_si256((__m256i *) (dst + 32), s1);
+		_mm256_storeu_si256((__m256i *) (dst + 64), s2);
+		_mm256_storeu_si256((__m256i *) (dst + 96), s3);
+		dst += 128;
+		src += 128;
+		key += 128;
+	}
+
+	for (; len >= 32; len -= 32) {
+		s0 = _mm256_loadu_si256((const __m256i *) src);
+		s0 = _mm256_xor_si256(s0, _mm256_loadu_si256((const __m256i *) key));
+		_mm256_storeu_si256((__m256i *) dst, s0);
+		dst += 32;
+		src += 32;
+		key += 32;
+	}
+
+	xor_generic(dst, src, key, len);
+}
+#endif
+
+#ifdef XOR_NEON
+static void xor_neon(unsigned char *dst, const unsigned char *src,
+		     const unsigned char *key, size_t len)
+{
+	uint8x16_t s0, s1, s2, s3;
+
+	for (; len >= 64; len -= 64) {
+		s0 = vld1q_u8(src + 0);
+		s1 = vld1q_u8(src + 16);
+		s2 = vld1q_u8(src + 32);
+		s3 = vld1q_u8(src + 48);
+		vst1q_u8(dst + 0, veorq_u8(s0, vld1q_u8(key + 0)));
+		vst1q_u8(dst + 16, veorq_u8(s1, vld1q_u8(key + 16)));
+		vst1q_u8(dst + 32, veorq_u8(s2, vld1q_u8(key + 32)));
+		vst1q_u8(dst + 48, veorq_u8(s3, vld1q_u8(key + 48)));
+		dst += 64;
+		src += 64;
+		key += 64;
+	}
+
+	xor_generic(dst, src, key, len);
+}
+#endif
+
+const struct xor_kernel xor_kernels[] = {
+	{ "generic", xor_generic, xor_always },
+#ifdef XOR_X86
+	{ "avx2", xor_avx2, xor_avx2_supported },
+#endif
+#ifdef XOR_NEON
+	{ "neon", xor_neon, xor_always },
+#endif
+	{ NULL, NULL, NULL }
+};
+
+static const struct xor_kernel *xor_best = NULL;
+
+static const struct xor_kernel *xor_select(void)
+{
+	const struct xor_kernel *k;
+
+	if (xor_best == NULL) {
+		for (k = xor_kernels; k->name; k++)
+			if (k->supported())
+				xor_best = k;
+	}
+
+	return xor_best;
+}
+
+void xor_buf(void *dst, const void *src, const void *key, size_t len)
+{
+	xor_select()->xor(dst, src, key, len);
+}
+
+const char *xor_kernel_name(void)
+{
+	return xor_select()->name;
+}
+
+int xor_stream_init(struct xor_stream *xs, const void *pattern, size_t p_len,
+		    size_t p_off)
+{
+	size_t i;
+
+	/* the smallest whole number of patterns and cache lines that is long enough */
+	xs->key_len = p_len * XOR_ALIGN;
+	xs->key_len *= (XOR_KEYSTREAM_MIN + xs->key_len - 1) / xs->key_len;
+	xs->pos = p_off % p_len;
+
+	if (posix_memalign((void **) &xs->key, XOR_ALIGN, xs->key_len))
+		return -1;
+
+	for (i = 0; i < xs->key_len; i += p_len)
+		memcpy(xs->key + i, pattern, p_len);
+
+	return 0;
+}
+
+void xor_stream_process(struct xor_stream *xs, void *dst, const void *src,
+			size_t len)
+{
+	const struct xor_kernel *k = xor_select();
+	unsigned char *d = dst;
+	const unsigned char *s = src;
+	size_t n;
+
+	while (len) {
+		n = xs->key_len - xs->pos;
+		if (n > len)
+			n = len;
+
+		k->xor(d, s, xs->key + xs->pos, n);
+		d += n;
+		s += n;
+		len -= n;
+
+		xs->pos += n;
+		if (xs->pos == xs->key_len)
+			xs->pos = 0;
+	}
+}
+
+void xor_stream_free(struct xor_stream *xs)
+{
+	free(xs->key);
+	xs->key = NULL;
+}
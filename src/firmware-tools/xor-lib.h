@@ -0,0 +1,53 @@
+/*
+ * Bulk XOR for the obfuscated image formats: xorimage's repeating
+ * pattern and the keystream of the Buffalo bcrypt cipher.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ */
+
+#ifndef _XOR_LIB_H
+#define _XOR_LIB_H
+
+#include <stddef.h>
+
+/* Keystreams are cache line aligned and at least this long */
+#define XOR_ALIGN		64
+#define XOR_KEYSTREAM_MIN	4096
+
+struct xor_kernel {
+	const char *name;
+	void (*xor)(unsigned char *dst, const unsigned char *src,
+		    const unsigned char *key, size_t len);
+	int (*supported)(void);
+};
+
+/* All kernels built in, fastest last; terminated by a NULL name */
+extern const struct xor_kernel xor_kernels[];
+
+/*
+ * A repeating pattern expanded to key_len bytes (a whole number of
+ * patterns and of cache lines), so the hot loop never wraps mid-vector.
+ */
+struct xor_stream {
+	unsigned char *key;
+	size_t key_len;
+	size_t pos;
+};
+
+/*
+ * dst = src ^ key over len bytes. dst may be src or lie before it, as
+ * when a header is decrypted over itself.
+ */
+void xor_buf(void *dst, const void *src, const void *key, size_t len);
+const char *xor_kernel_name(void);
+
+int xor_stream_init(struct xor_stream *xs, const void *pattern, size_t p_len,
+		    size_t p_off);
+void xor_stream_process(struct xor_stream *xs, void *dst, const void *src,
+			size_t len);
+void xor_stream_free(struct xor_stream *xs);
+
+#endif /* _XOR_LIB_H */
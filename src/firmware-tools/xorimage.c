@@ -25,19 +25,12 @@
 #include <unistd.h>
 #include <sys/stat.h>
 
-static char default_pattern[] = "12345678";
+#include "xor-lib.h"
 
+/* large enough that the XOR runs at memory speed, not per fread() */
+#define BUF_SIZE	(1024 * 1024)
 
-int xor_data(uint8_t *data, size_t len, const uint8_t *pattern, int p_len, int p_off)
-{
-	int offset = p_off;
-	while (len--) {
-		*data ^= pattern[offset];
-		data++;
-		offset = (offset + 1) % p_len;
-	}
-	return offset;
-}
+static char default_pattern[] = "12345678";
 
 
 void usage(void) __attribute__ (( __noreturn__ ));
@@ -51,16 +44,16 @@ void usage(void)
 
 int main(int argc, char **argv)
 {
-	char buf[1024];	/* keep this at 1k or adjust garbage calc below */
+	unsigned char *buf;
+	struct xor_stream xs;
 	FILE *in = stdin;
 	FILE *out = stdout;
 	char *ifn = NULL;
 	char *ofn = NULL;
 	const char *pattern = default_pattern;
 	int c;
-	int v0, v1, v2;
 	size_t n;
-	int p_len, p_off = 0;
+	int p_len;
 
 	while ((c = getopt(argc, argv, "i:o:p:h")) != -1) {
 		switch (c) {
@@ -101,9 +94,14 @@ int main(int argc, char **argv)
 		usage();
 	}
 
+	buf = malloc(BUF_SIZE);
+	if (!buf || xor_stream_init(&xs, pattern, p_len, 0)) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
 
-	while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
-		if (n < sizeof(buf)) {
+	while ((n = fread(buf, 1, BUF_SIZE, in)) > 0) {
+		if (n < BUF_SIZE) {
 			if (ferror(in)) {
 			FREAD_ERROR:
 				fprintf(stderr, "fread error\n");
@@ -111,7 +109,7 @@ int main(int argc, char **argv)
 			}
 		}
 
-		p_off = xor_data(buf, n, pattern, p_len, p_off);
+		xor_stream_process(&xs, buf, buf, n);
 
 		if (!fwrite(buf, n, 1, out)) {
 		FWRITE_ERROR:
@@ -128,6 +126,8 @@ int main(int argc, char **argv)
 		goto FWRITE_ERROR;
 	}
 
+	xor_stream_free(&xs);
+	free(buf);
 	fclose(in);
 	fclose(out);
 
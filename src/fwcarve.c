@@ -0,0 +1,227 @@
+/*
+ * fwcarve.c
+ *
+ * Splits a firmware image into its header image, file system and footer for
+ * extract-firmware.sh, and prints the offsets in the CONFLOG format.
+ *
+ * The footer is whatever follows the trailing run of fill (16 byte lines that
+ * repeat the line before them, as hexdump -C collapses into '*') when it is
+ * no bigger than the maximum footer size. The fill stays in the file system
+ * part, and only the tail of the image is ever read. The parts are copied
+ * with copy_file_range() so the kernel can share or copy the data without it
+ * passing through userspace.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define LINE_SIZE		16
+#define DEFAULT_MAX_FOOTER	(10 * LINE_SIZE)
+#define COPY_BUFFER		(1024 * 1024)
+
+void usage(void) __attribute__ (( __noreturn__ ));
+
+void usage(void)
+{
+	fprintf(stderr, "Usage: fwcarve [-m max_footer] <image> <fs offset> <header out> <fs out> [footer out]\n\n");
+	fprintf(stderr, "Prints FW_SIZE, HEADER_IMAGE_OFFSET, HEADER_IMAGE_SIZE, FOOTER_SIZE and FOOTER_OFFSET\n");
+	fprintf(stderr, "in the CONFLOG format. The default maximum footer size is %d bytes.\n", DEFAULT_MAX_FOOTER);
+	exit(1);
+}
+
+/* Is the line at offset a repeat of the one before it? */
+static int repeated(const unsigned char *img, off_t size, off_t offset)
+{
+	return offset >= LINE_SIZE && offset + LINE_SIZE <= size &&
+		memcmp(img + offset - LINE_SIZE, img + offset, LINE_SIZE) == 0;
+}
+
+static ssize_t copy_range(int in, off_t *offset, int out, size_t len)
+{
+#ifdef SYS_copy_file_range
+	loff_t off_in = *offset;
+	ssize_t n = syscall(SYS_copy_file_range, in, &off_in, out, NULL, len, 0);
+
+	if(n >= 0)
+	{
+		*offset = off_in;
+	}
+	return n;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static int carve(int in, off_t offset, off_t len, const char *path)
+{
+	char *buf = NULL;
+	int out = 0, fallback = 0;
+	ssize_t n = 0;
+
+	out = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(out < 0)
+	{
+		perror(path);
+		return -1;
+	}
+
+	while(len > 0)
+	{
+		if(!fallback)
+		{
+			n = copy_range(in, &offset, out, len);
+			if(n < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+				errno == EOPNOTSUPP || errno == EPERM))
+			{
+				/* Old kernel or a cross filesystem copy, do it by hand */
+				fallback = 1;
+				continue;
+			}
+		}
+		else
+		{
+			if(buf == NULL && (buf = malloc(COPY_BUFFER)) == NULL)
+			{
+				perror("malloc");
+				break;
+			}
+			n = pread(in, buf, len < COPY_BUFFER ? len : COPY_BUFFER, offset);
+			if(n > 0 && write(out, buf, n) != n)
+			{
+				n = -1;
+			}
+			if(n > 0)
+			{
+				offset += n;
+			}
+		}
+
+		if(n <= 0)
+		{
+			if(n == 0)
+			{
+				errno = EIO;
+			}
+			perror(path);
+			break;
+		}
+		len -= n;
+	}
+
+	free(buf);
+	if(close(out) != 0)
+	{
+		perror(path);
+		return -1;
+	}
+
+	return len == 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+	const unsigned char *img = NULL;
+	off_t size = 0, fs_offset = 0, footer_offset = 0, max_footer = DEFAULT_MAX_FOOTER;
+	off_t line = 0, low = 0;
+	struct stat st;
+	int fd = 0, c = 0, retval = 0;
+
+	while((c = getopt(argc, argv, "m:h")) != -1)
+	{
+		switch(c)
+		{
+			case 'm':
+				max_footer = strtoll(optarg, NULL, 0);
+				break;
+			default:
+				usage();
+		}
+	}
+
+	if(argc - optind < 4 || argc - optind > 5 || max_footer < 0)
+	{
+		usage();
+	}
+
+	fd = open(argv[optind], O_RDONLY);
+	if(fd < 0 || fstat(fd, &st) != 0)
+	{
+		perror(argv[optind]);
+		return 1;
+	}
+	size = st.st_size;
+
+	fs_offset = strtoll(argv[optind + 1], NULL, 0);
+	if(fs_offset < 0 || fs_offset > size)
+	{
+		fprintf(stderr, "File system offset %lld is outside the %lld byte image\n",
+			(long long) fs_offset, (long long) size);
+		return 1;
+	}
+
+	footer_offset = size;
+	if(size >= 2 * LINE_SIZE)
+	{
+		img = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		if(img == MAP_FAILED)
+		{
+			perror(argv[optind]);
+			return 1;
+		}
+
+		/* The footer must start on a line after the file system starts */
+		low = size - max_footer;
+		if(low < fs_offset)
+		{
+			low = fs_offset;
+		}
+		low = (low + LINE_SIZE - 1) & ~((off_t) LINE_SIZE - 1);
+
+		/* Walk back from the last complete line to the end of the last fill run */
+		for(line = (size & ~((off_t) LINE_SIZE - 1)) - LINE_SIZE; line + LINE_SIZE >= low && line > 0; line -= LINE_SIZE)
+		{
+			if(repeated(img, size, line))
+			{
+				footer_offset = line + LINE_SIZE;
+				break;
+			}
+		}
+
+		munmap((void *) img, size);
+	}
+
+	if(carve(fd, 0, fs_offset, argv[optind + 2]) != 0 ||
+		carve(fd, fs_offset, footer_offset - fs_offset, argv[optind + 3]) != 0 ||
+		(footer_offset < size && argc - optind == 5 &&
+		 carve(fd, footer_offset, size - footer_offset, argv[optind + 4]) != 0))
+	{
+		retval = 1;
+	}
+	close(fd);
+
+	printf("FW_SIZE='%lld'\n", (long long) size);
+	printf("HEADER_IMAGE_OFFSET='0'\n");
+	printf("HEADER_IMAGE_SIZE='%lld'\n", (long long) fs_offset);
+	printf("FOOTER_SIZE='%lld'\n", (long long) (size - footer_offset));
+	printf("FOOTER_OFFSET='%lld'\n", (long long) footer_offset);
+
+	return retval;
+}
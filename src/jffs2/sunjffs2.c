@@ -1,104 +1,952 @@
 /*
- * This is a horrible hack.
- * An executable shell script that can be setuid root so that root privs are not required for mounting jffs2 images.
- * Since this is intended to be a setuid root binary, be very careful what you do here. Don't take in user-supplied content.
+ * Userspace JFFS2 extractor.
+ *
+ * Maps a JFFS2 image, scans it for nodes, keeps the latest version of each
+ * inode and directory entry in hash tables, decompresses the data nodes on a
+ * pool of threads and writes the resulting tree out directly. No kernel
+ * modules, mtd devices, mounts or root privileges are needed, so any number of
+ * extractions can run at once.
+ *
+ * Both little and big endian images are supported, with none, zero, rtime,
+ * zlib and lzma (OpenWrt) compressed data nodes.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/stat.h>
-#include <sys/sysmacros.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <utime.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/sysmacros.h>
+#include <zlib.h>
+#include <lzma.h>
+
+#define DEFAULT_IMAGE		"jffs2.img"
+#define DEFAULT_OUTDIR		"rootfs"
+
+#define JFFS2_MAGIC		0x1985
+#define JFFS2_MAGIC_SWAPPED	0x8519
+
+#define JFFS2_NODE_ACCURATE	0x2000
+#define JFFS2_NODETYPE_DIRENT	0xE001
+#define JFFS2_NODETYPE_INODE	0xE002
+
+#define JFFS2_COMPR_NONE	0x00
+#define JFFS2_COMPR_ZERO	0x01
+#define JFFS2_COMPR_RTIME	0x02
+#define JFFS2_COMPR_ZLIB	0x06
+#define JFFS2_COMPR_LZMA	0x08
+
+#define HEADER_SIZE		12
+#define INODE_SIZE		68
+#define DIRENT_SIZE		40
+
+/* OpenWrt's jffs2 lzma uses raw lzma1 with these properties */
+#define LZMA_LC			0
+#define LZMA_LP			0
+#define LZMA_PB			0
+
+#define HASH_SIZE		4096
+
+/* A data node never holds more than one page; allow for 64K page kernels */
+#define MAX_DSIZE		65536
+
+struct data_node
+{
+	const unsigned char *data;
+	uint32_t version;
+	uint32_t offset;
+	uint32_t csize;
+	uint32_t dsize;
+	uint32_t isize;
+	uint32_t data_crc;
+	int compr;
+	unsigned char *out;	/* decompressed data, filled in by the workers */
+	int error;
+};
+
+struct inode
+{
+	uint32_t ino;
+	uint32_t version;	/* version of the latest node, whose attributes are kept */
+	uint32_t mode;
+	uint32_t uid;
+	uint32_t gid;
+	uint32_t isize;
+	uint32_t mtime;
+	struct data_node **nodes;
+	int count;
+	int size;
+	char *path;		/* where it was first written, for hard links */
+	struct dirent *children;
+	int visited;
+	struct inode *next;
+};
+
+struct dirent
+{
+	uint32_t pino;
+	uint32_t ino;
+	uint32_t version;
+	char *name;
+	struct dirent *next;
+	struct dirent *sibling;
+};
+
+static const unsigned char *image = NULL;
+static size_t image_size = 0;
+static int swapped = 0;
+
+static struct inode *inodes[HASH_SIZE];
+static struct dirent *dirents[HASH_SIZE];
+static struct data_node **jobs = NULL;
+static int job_count = 0, job_size = 0, job_next = 0;
+static pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int nodes = 0, bad_nodes = 0, bad_data = 0, files = 0, errors = 0;
+
+static uint16_t get16(const unsigned char *p)
+{
+	return swapped ? (p[0] << 8) | p[1] : p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+	if(swapped)
+	{
+		return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+	}
+
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/* JFFS2's crc32 starts from 0 and isn't inverted, unlike zlib's */
+static uint32_t jffs2_crc(const unsigned char *p, uint32_t len)
+{
+	return crc32(0xFFFFFFFF, p, len) ^ 0xFFFFFFFF;
+}
+
+static void *xmalloc(size_t size)
+{
+	void *p = malloc(size ? size : 1);
+
+	if(p == NULL)
+	{
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	return p;
+}
+
+static struct inode *get_inode(uint32_t ino, int create)
+{
+	struct inode *inode = inodes[ino % HASH_SIZE];
+
+	while(inode && inode->ino != ino)
+	{
+		inode = inode->next;
+	}
+
+	if(inode == NULL && create)
+	{
+		inode = xmalloc(sizeof(struct inode));
+		memset(inode, 0, sizeof(struct inode));
+		inode->ino = ino;
+		inode->next = inodes[ino % HASH_SIZE];
+		inodes[ino % HASH_SIZE] = inode;
+	}
+
+	return inode;
+}
+
+static unsigned int dirent_hash(uint32_t pino, const unsigned char *name, int len)
+{
+	unsigned int hash = pino;
+	int i = 0;
+
+	for(i=0; i<len; i++)
+	{
+		hash = hash * 31 + name[i];
+	}
+
+	return hash % HASH_SIZE;
+}
+
+static void add_inode_node(const unsigned char *p, uint32_t totlen)
+{
+	struct data_node *node = NULL;
+	struct inode *inode = NULL;
+	uint32_t version = get32(p + 16);
+
+	if(get32(p + 64) != jffs2_crc(p, INODE_SIZE - 8))
+	{
+		bad_nodes++;
+		return;
+	}
+
+	node = xmalloc(sizeof(struct data_node));
+	node->version = version;
+	node->offset = get32(p + 44);
+	node->csize = get32(p + 48);
+	node->dsize = get32(p + 52);
+	node->isize = get32(p + 28);
+	node->compr = p[56];
+	node->data_crc = get32(p + 60);
+	node->data = p + INODE_SIZE;
+	node->out = NULL;
+	node->error = 0;
+
+	if(totlen < INODE_SIZE || node->csize > totlen - INODE_SIZE ||
+	   node->dsize > MAX_DSIZE || node->offset > UINT32_MAX - node->dsize)
+	{
+		bad_nodes++;
+		free(node);
+		return;
+	}
+
+	inode = get_inode(get32(p + 12), 1);
+	if(inode->count == 0 || version > inode->version)
+	{
+		inode->version = version;
+		inode->mode = get32(p + 20);
+		inode->uid = get16(p + 24);
+		inode->gid = get16(p + 26);
+		inode->isize = node->isize;
+		inode->mtime = get32(p + 36);
+	}
+
+	if(inode->count == inode->size)
+	{
+		inode->size = inode->size ? inode->size * 2 : 4;
+		inode->nodes = realloc(inode->nodes, inode->size * sizeof(struct data_node *));
+		if(inode->nodes == NULL)
+		{
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	inode->nodes[inode->count++] = node;
+}
+
+static void add_dirent_node(const unsigned char *p, uint32_t totlen)
+{
+	struct dirent *dirent = NULL;
+	uint32_t pino = get32(p + 12);
+	uint32_t version = get32(p + 16);
+	int nsize = p[28];
+	unsigned int hash = 0;
+
+	if(DIRENT_SIZE + nsize > totlen || get32(p + 32) != jffs2_crc(p, DIRENT_SIZE - 8) ||
+	   get32(p + 36) != jffs2_crc(p + DIRENT_SIZE, nsize) || nsize == 0)
+	{
+		bad_nodes++;
+		return;
+	}
+
+	hash = dirent_hash(pino, p + DIRENT_SIZE, nsize);
+	for(dirent=dirents[hash]; dirent; dirent=dirent->next)
+	{
+		if(dirent->pino == pino && (int) strlen(dirent->name) == nsize &&
+		   memcmp(dirent->name, p + DIRENT_SIZE, nsize) == 0)
+		{
+			break;
+		}
+	}
+
+	if(dirent == NULL)
+	{
+		dirent = xmalloc(sizeof(struct dirent));
+		dirent->pino = pino;
+		dirent->version = 0;
+		dirent->name = xmalloc(nsize + 1);
+		memcpy(dirent->name, p + DIRENT_SIZE, nsize);
+		dirent->name[nsize] = '\0';
+		dirent->next = dirents[hash];
+		dirents[hash] = dirent;
+	}
+	else if(version < dirent->version)
+	{
+		return;
+	}
+
+	/* An ino of 0 is an unlink */
+	dirent->version = version;
+	dirent->ino = get32(p + 20);
+}
+
+/* Walks the image in 4 byte steps, picking up every node with a good header crc */
+static void scan_image(void)
+{
+	size_t offset = 0;
+
+	while(offset + HEADER_SIZE <= image_size)
+	{
+		const unsigned char *p = image + offset;
+		uint16_t magic = p[0] | (p[1] << 8);
+		uint32_t totlen = 0;
+		uint16_t type = 0;
+
+		if(magic != JFFS2_MAGIC && magic != JFFS2_MAGIC_SWAPPED)
+		{
+			offset += 4;
+			continue;
+		}
+
+		if(nodes == 0 && bad_nodes == 0)
+		{
+			swapped = (magic == JFFS2_MAGIC_SWAPPED);
+		}
+
+		type = get16(p + 2);
+		totlen = get32(p + 4);
+		if(get16(p) != JFFS2_MAGIC || get32(p + 8) != jffs2_crc(p, HEADER_SIZE - 4) ||
+		   totlen < HEADER_SIZE || totlen > image_size - offset)
+		{
+			offset += 4;
+			continue;
+		}
+
+		nodes++;
+
+		/* Obsolete nodes have the accurate bit cleared */
+		if(type == JFFS2_NODETYPE_INODE && totlen >= INODE_SIZE)
+		{
+			add_inode_node(p, totlen);
+		}
+		else if(type == JFFS2_NODETYPE_DIRENT && totlen >= DIRENT_SIZE)
+		{
+			add_dirent_node(p, totlen);
+		}
+
+		offset += (totlen + 3) & ~3;
+	}
+}
+
+static int rtime_decompress(const unsigned char *in, unsigned char *out, uint32_t srclen, uint32_t destlen)
+{
+	uint32_t positions[256];
+	uint32_t outpos = 0, pos = 0;
 
-int openfile(void)
+	memset(positions, 0, sizeof(positions));
+
+	while(outpos < destlen)
+	{
+		unsigned char value = 0;
+		uint32_t backoffs = 0, repeat = 0;
+
+		if(pos + 2 > srclen)
+		{
+			return -1;
+		}
+
+		value = in[pos++];
+		out[outpos++] = value;
+		repeat = in[pos++];
+		backoffs = positions[value];
+		positions[value] = outpos;
+
+		if(repeat > destlen - outpos)
+		{
+			return -1;
+		}
+
+		/* The copy may overlap its source */
+		while(repeat--)
+		{
+			out[outpos++] = out[backoffs++];
+		}
+	}
+
+	return 0;
+}
+
+static int zlib_decompress(const unsigned char *in, unsigned char *out, uint32_t srclen, uint32_t destlen)
+{
+	z_stream strm;
+	int bits = MAX_WBITS, ret = 0;
+
+	memset(&strm, 0, sizeof(strm));
+
+	/* As the kernel does, skip a plain zlib header and don't check the adler32 */
+	if(srclen > 2 && (in[0] & 0x0f) == Z_DEFLATED && !(in[1] & 0x20) &&
+	   ((in[0] << 8) + in[1]) % 31 == 0)
+	{
+		in += 2;
+		srclen -= 2;
+		bits = -MAX_WBITS;
+	}
+
+	if(inflateInit2(&strm, bits) != Z_OK)
+	{
+		return -1;
+	}
+
+	strm.next_in = (unsigned char *) in;
+	strm.avail_in = srclen;
+	strm.next_out = out;
+	strm.avail_out = destlen;
+
+	ret = inflate(&strm, Z_FINISH);
+	inflateEnd(&strm);
+
+	return ((ret == Z_STREAM_END || ret == Z_OK || ret == Z_BUF_ERROR) && strm.total_out == destlen) ? 0 : -1;
+}
+
+static int lzma_decompress(const unsigned char *in, unsigned char *out, uint32_t srclen, uint32_t destlen)
 {
-	int fd = 0, retval = 0;
+	lzma_stream strm = LZMA_STREAM_INIT;
+	lzma_options_lzma opt;
+	lzma_filter filters[2];
+	int ret = 0;
+
+	memset(&opt, 0, sizeof(opt));
+	opt.dict_size = destlen < LZMA_DICT_SIZE_MIN ? LZMA_DICT_SIZE_MIN : destlen;
+	opt.lc = LZMA_LC;
+	opt.lp = LZMA_LP;
+	opt.pb = LZMA_PB;
+	filters[0].id = LZMA_FILTER_LZMA1;
+	filters[0].options = &opt;
+	filters[1].id = LZMA_VLI_UNKNOWN;
 
-	/* Validate that the jffs2.img file exists. */
-	fd = open("jffs2.img", 0);
-	if(fd < 0)
+	if(lzma_raw_decoder(&strm, filters) != LZMA_OK)
 	{
-		perror("jffs2.img");
-		retval = -1;
+		return -1;
 	}
-	else
+
+	strm.next_in = in;
+	strm.avail_in = srclen;
+	strm.next_out = out;
+	strm.avail_out = destlen;
+
+	/* There is no end marker, decoding stops when the output is full */
+	ret = lzma_code(&strm, LZMA_RUN);
+	lzma_end(&strm);
+
+	return ((ret == LZMA_OK || ret == LZMA_STREAM_END) && strm.total_out == destlen) ? 0 : -1;
+}
+
+static void decompress_node(struct data_node *node)
+{
+	int ret = 0;
+
+	node->out = xmalloc(node->dsize);
+
+	if(node->compr == JFFS2_COMPR_ZERO)
+	{
+		memset(node->out, 0, node->dsize);
+		return;
+	}
+
+	if(jffs2_crc(node->data, node->csize) != node->data_crc)
+	{
+		node->error = 1;
+		return;
+	}
+
+	switch(node->compr)
+	{
+		case JFFS2_COMPR_NONE:
+			if(node->csize < node->dsize)
+			{
+				ret = -1;
+			}
+			else
+			{
+				memcpy(node->out, node->data, node->dsize);
+			}
+			break;
+		case JFFS2_COMPR_RTIME:
+			ret = rtime_decompress(node->data, node->out, node->csize, node->dsize);
+			break;
+		case JFFS2_COMPR_ZLIB:
+			ret = zlib_decompress(node->data, node->out, node->csize, node->dsize);
+			break;
+		case JFFS2_COMPR_LZMA:
+			ret = lzma_decompress(node->data, node->out, node->csize, node->dsize);
+			break;
+		default:
+			ret = -1;
+			break;
+	}
+
+	node->error = (ret != 0);
+}
+
+static void *worker(void *arg)
+{
+	int i = 0;
+
+	while(1)
+	{
+		pthread_mutex_lock(&job_mutex);
+		i = job_next++;
+		pthread_mutex_unlock(&job_mutex);
+
+		if(i >= job_count)
+		{
+			break;
+		}
+
+		decompress_node(jobs[i]);
+	}
+
+	return NULL;
+}
+
+/* Queues the data nodes of every regular file, symlink and device for the workers */
+static void queue_nodes(void)
+{
+	struct inode *inode = NULL;
+	int i = 0, j = 0;
+
+	for(i=0; i<HASH_SIZE; i++)
+	{
+		for(inode=inodes[i]; inode; inode=inode->next)
+		{
+			if(!S_ISREG(inode->mode) && !S_ISLNK(inode->mode) &&
+			   !S_ISCHR(inode->mode) && !S_ISBLK(inode->mode))
+			{
+				continue;
+			}
+
+			for(j=0; j<inode->count; j++)
+			{
+				if(inode->nodes[j]->dsize == 0)
+				{
+					continue;
+				}
+
+				if(job_count == job_size)
+				{
+					job_size = job_size ? job_size * 2 : 1024;
+					jobs = realloc(jobs, job_size * sizeof(struct data_node *));
+					if(jobs == NULL)
+					{
+						perror("realloc");
+						exit(EXIT_FAILURE);
+					}
+				}
+				jobs[job_count++] = inode->nodes[j];
+			}
+		}
+	}
+}
+
+static void decompress_nodes(int threads)
+{
+	pthread_t *tids = NULL;
+	int i = 0;
+
+	queue_nodes();
+
+	if(threads > job_count)
+	{
+		threads = job_count;
+	}
+	if(threads < 1)
+	{
+		threads = 1;
+	}
+
+	tids = xmalloc(threads * sizeof(pthread_t));
+
+	/* The main thread takes a share of the jobs too */
+	for(i=1; i<threads; i++)
+	{
+		if(pthread_create(&tids[i], NULL, worker, NULL) != 0)
+		{
+			perror("pthread_create");
+			exit(EXIT_FAILURE);
+		}
+	}
+	worker(NULL);
+	for(i=1; i<threads; i++)
+	{
+		pthread_join(tids[i], NULL);
+	}
+
+	free(tids);
+	free(jobs);
+}
+
+static int compare_version(const void *a, const void *b)
+{
+	const struct data_node *x = *(const struct data_node **) a;
+	const struct data_node *y = *(const struct data_node **) b;
+
+	return (x->version > y->version) - (x->version < y->version);
+}
+
+/*
+ * Replays an inode's data nodes in version order: each overwrites its range,
+ * and a node whose isize is below the current size truncates the file.
+ */
+static unsigned char *assemble(struct inode *inode, uint32_t *size)
+{
+	unsigned char *buf = NULL;
+	uint64_t extent = 0, length = 0;
+	int i = 0;
+
+	qsort(inode->nodes, inode->count, sizeof(struct data_node *), compare_version);
+
+	for(i=0; i<inode->count; i++)
+	{
+		struct data_node *node = inode->nodes[i];
+
+		if(node->dsize && (uint64_t) node->offset + node->dsize > extent)
+		{
+			extent = (uint64_t) node->offset + node->dsize;
+		}
+	}
+	if(inode->isize > extent)
+	{
+		extent = inode->isize;
+	}
+
+	buf = xmalloc(extent);
+	memset(buf, 0, extent);
+
+	for(i=0; i<inode->count; i++)
+	{
+		struct data_node *node = inode->nodes[i];
+
+		if(node->dsize)
+		{
+			if(node->error || node->out == NULL)
+			{
+				bad_data++;
+			}
+			else
+			{
+				memcpy(buf + node->offset, node->out, node->dsize);
+			}
+			if((uint64_t) node->offset + node->dsize > length)
+			{
+				length = (uint64_t) node->offset + node->dsize;
+			}
+		}
+
+		if(node->isize < length)
+		{
+			memset(buf + node->isize, 0, length - node->isize);
+			length = node->isize;
+		}
+	}
+
+	*size = inode->isize;
+	return buf;
+}
+
+static void set_attributes(const char *path, struct inode *inode)
+{
+	struct utimbuf times;
+
+	if(geteuid() == 0 && lchown(path, inode->uid, inode->gid) != 0)
+	{
+		perror(path);
+	}
+
+	if(!S_ISLNK(inode->mode))
+	{
+		times.actime = times.modtime = inode->mtime;
+		utime(path, &times);
+
+		if(chmod(path, inode->mode & 07777) != 0)
+		{
+			perror(path);
+		}
+	}
+}
+
+static void write_file(const char *path, struct inode *inode)
+{
+	unsigned char *buf = NULL;
+	uint32_t size = 0;
+	int fd = 0;
+
+	buf = assemble(inode, &size);
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if(fd < 0 || write(fd, buf, size) != (ssize_t) size)
+	{
+		perror(path);
+		errors++;
+	}
+	if(fd >= 0)
 	{
 		close(fd);
 	}
 
-	return retval;
+	free(buf);
 }
 
-int mkdirs(void)
+static void write_symlink(const char *path, struct inode *inode)
 {
-	int retval = 0;
+	unsigned char *buf = NULL;
+	uint32_t size = 0;
 
-	/* Create the mount and output directories. */
-	if(mkdir("jffs2-root", 0777) != 0)
+	buf = assemble(inode, &size);
+	buf = realloc(buf, size + 1);
+	if(buf == NULL)
 	{
-		perror("jffs2-root");
-		retval = -1;
+		perror("realloc");
+		exit(EXIT_FAILURE);
 	}
+	buf[size] = '\0';
 
-	if(mkdir("rootfs", 0777) != 0)
+	if(symlink((char *) buf, path) != 0)
 	{
-		perror("rootfs");
-		retval = -1;
+		perror(path);
+		errors++;
 	}
 
-	return retval;
+	free(buf);
 }
 
-void modprobe(void)
+static void write_device(const char *path, struct inode *inode)
 {
-	system("modprobe mtdblock");
-	system("modprobe mtdchar");
-	system("modprobe mtd");
-	system("modprobe mtdram");
-	system("rmmod mtdram");
-	system("modprobe mtdram total_size=65536");
+	unsigned char *buf = NULL;
+	uint32_t size = 0;
+	dev_t dev = 0;
+
+	buf = assemble(inode, &size);
+
+	/* Devices hold either a 16 bit old style or a 32 bit new style number */
+	if(inode->count && inode->nodes[inode->count - 1]->dsize == 2)
+	{
+		uint16_t old = get16(inode->nodes[inode->count - 1]->out);
+		dev = makedev(old >> 8, old & 0xff);
+	}
+	else if(inode->count && inode->nodes[inode->count - 1]->dsize == 4)
+	{
+		uint32_t new = get32(inode->nodes[inode->count - 1]->out);
+		dev = makedev((new & 0xfff00) >> 8, (new & 0xff) | ((new >> 12) & 0xfff00));
+	}
+
+	if(mknod(path, inode->mode, dev) != 0)
+	{
+		perror(path);
+		errors++;
+	}
+
+	free(buf);
 }
 
-void mount(void)
+static void build_children(void)
 {
-	system("mknod /dev/mtdblock1 b 31 0");
-	system("dd if=jffs2.img of=/dev/mtdblock1");
-	system("mount -t jffs2 /dev/mtdblock1 jffs2-root");
+	struct dirent *dirent = NULL, *next = NULL;
+	int i = 0;
+
+	/* Thread the live entries onto their parent's sibling list */
+	for(i=0; i<HASH_SIZE; i++)
+	{
+		for(dirent=dirents[i]; dirent; dirent=next)
+		{
+			struct inode *parent = NULL;
+
+			next = dirent->next;
+			dirent->sibling = NULL;
+			if(dirent->ino)
+			{
+				/* The root directory, inode 1, has no inode node of its own */
+				parent = get_inode(dirent->pino, 1);
+				dirent->sibling = parent->children;
+				parent->children = dirent;
+			}
+		}
+	}
 }
 
-void copy(void)
+static void write_tree(const char *dir, struct inode *parent)
 {
-	system("cp -R jffs2-root/* rootfs/");
+	struct dirent *dirent = NULL;
+
+	parent->visited = 1;
+
+	for(dirent=parent->children; dirent; dirent=dirent->sibling)
+	{
+		struct inode *inode = get_inode(dirent->ino, 0);
+		char *path = NULL;
+
+		if(strchr(dirent->name, '/') || strcmp(dirent->name, ".") == 0 || strcmp(dirent->name, "..") == 0)
+		{
+			fprintf(stderr, "Skipping bad name '%s'\n", dirent->name);
+			continue;
+		}
+
+		if(inode == NULL || inode->count == 0)
+		{
+			fprintf(stderr, "Skipping %s/%s: no inode %u\n", dir, dirent->name, dirent->ino);
+			errors++;
+			continue;
+		}
+
+		path = xmalloc(strlen(dir) + strlen(dirent->name) + 2);
+		sprintf(path, "%s/%s", dir, dirent->name);
+
+		if(S_ISDIR(inode->mode))
+		{
+			if(inode->visited)
+			{
+				/* A directory seen twice would loop */
+				fprintf(stderr, "Skipping %s: directory loop\n", path);
+				free(path);
+				continue;
+			}
+			if(mkdir(path, 0700) != 0 && errno != EEXIST)
+			{
+				perror(path);
+				errors++;
+				free(path);
+				continue;
+			}
+			write_tree(path, inode);
+			set_attributes(path, inode);
+			free(path);
+			continue;
+		}
+
+		if(inode->path)
+		{
+			/* Another name for an inode already written */
+			if(link(inode->path, path) != 0)
+			{
+				perror(path);
+				errors++;
+			}
+			free(path);
+			continue;
+		}
+
+		if(S_ISREG(inode->mode))
+		{
+			write_file(path, inode);
+		}
+		else if(S_ISLNK(inode->mode))
+		{
+			write_symlink(path, inode);
+		}
+		else if(S_ISCHR(inode->mode) || S_ISBLK(inode->mode))
+		{
+			write_device(path, inode);
+		}
+		else if(S_ISFIFO(inode->mode) || S_ISSOCK(inode->mode))
+		{
+			if(mknod(path, inode->mode, 0) != 0)
+			{
+				perror(path);
+				errors++;
+			}
+		}
+
+		set_attributes(path, inode);
+		inode->path = path;
+		files++;
+	}
 }
 
-void umount(void)
+static int map_image(const char *path)
 {
-	system("umount jffs2-root");
-	system("rm -rf jffs2-root");
+	struct stat st;
+	int fd = 0;
+
+	fd = open(path, O_RDONLY);
+	if(fd < 0 || fstat(fd, &st) != 0)
+	{
+		perror(path);
+		return -1;
+	}
+
+	image_size = st.st_size;
+	image = mmap(NULL, image_size ? image_size : 1, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(image == MAP_FAILED)
+	{
+		perror(path);
+		return -1;
+	}
+	madvise((void *) image, image_size, MADV_SEQUENTIAL);
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "\nExtracts a JFFS2 image (default '%s') to a directory (default '%s').\n", DEFAULT_IMAGE, DEFAULT_OUTDIR);
+	fprintf(stderr, "Usage: %s [-j threads] [image [directory]]\n\n", name);
 }
 
 int main(int argc, char *argv[])
 {
-	if(argc > 1)
+	const char *img = DEFAULT_IMAGE, *outdir = DEFAULT_OUTDIR;
+	int threads = 0, c = 0;
+
+	while((c = getopt(argc, argv, "j:h")) != -1)
+	{
+		switch(c)
+		{
+			case 'j':
+				threads = atoi(optarg);
+				if(threads > 0)
+				{
+					break;
+				}
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if(argc - optind > 2)
 	{
-		fprintf(stderr, "\nLooks for a file name 'jffs2.img' and extracts its contents to a directory named 'rootfs'.\n");
-		fprintf(stderr, "Usage: %s\n\n", argv[0]);
+		usage(argv[0]);
 		return EXIT_FAILURE;
 	}
-	
-	if(openfile() != 0 || mkdirs() != 0)
+	if(optind < argc)
 	{
+		img = argv[optind++];
+	}
+	if(optind < argc)
+	{
+		outdir = argv[optind++];
+	}
+	if(threads == 0)
+	{
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+
+	if(map_image(img) != 0)
+	{
+		return EXIT_FAILURE;
+	}
+
+	scan_image();
+	if(nodes == 0)
+	{
+		fprintf(stderr, "%s: no JFFS2 nodes found\n", img);
 		return EXIT_FAILURE;
 	}
-	else
+
+	decompress_nodes(threads);
+	build_children();
+
+	if(mkdir(outdir, 0777) != 0 && errno != EEXIST)
 	{
-		setuid(0);
-		modprobe();
-		mount();
-		copy();
-		umount();
+		perror(outdir);
+		return EXIT_FAILURE;
 	}
 
-	return EXIT_SUCCESS;
+	write_tree(outdir, get_inode(1, 1));
+
+	printf("%s: %d nodes (%d bad), %d files written, %d data nodes failed to decompress (%s endian, %d threads)\n",
+	       img, nodes, bad_nodes, files, bad_data, swapped ? "big" : "little", threads);
+
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,382 @@
+/*
+ * CRC-32 kernels shared by crcalc, asustrx, motorola-bin and the firmware
+ * tools, which each used to carry their own byte-at-a-time table loop.
+ *
+ *   bytewise    the classic one table, one byte per step loop
+ *   slice-by-8  eight tables, eight bytes per step, portable
+ *   pclmul      x86 carry-less multiply folding (PCLMULQDQ + SSE4.1)
+ *   armv8-crc   AArch64 CRC32 instructions
+ *
+ * The folding constants and the Barrett reduction are those from Intel's
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ * Instruction" white paper, for the reflected 0xedb88320 polynomial.
+ */
+
+#include <string.h>
+#include "libcrc32.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CRC32_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define CRC32_ARMV8
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#define CRC32_POLY 0xedb88320
+
+static uint32_t crc_table[8][256];
+static int crc_table_ready = 0;
+
+static void crc32_init_tables(void)
+{
+	uint32_t crc = 0;
+	int n = 0, bit = 0, k = 0;
+
+	if(crc_table_ready)
+	{
+		return;
+	}
+
+	for(n=0; n<256; n++)
+	{
+		crc = n;
+		for(bit=0; bit<8; bit++)
+		{
+			crc = (crc & 1) ? (CRC32_POLY ^ (crc >> 1)) : (crc >> 1);
+		}
+		crc_table[0][n] = crc;
+	}
+
+	/* crc_table[k][n] is the CRC of byte n followed by k zero bytes */
+	for(n=0; n<256; n++)
+	{
+		crc = crc_table[0][n];
+		for(k=1; k<8; k++)
+		{
+			crc = crc_table[0][crc & 0xff] ^ (crc >> 8);
+			crc_table[k][n] = crc;
+		}
+	}
+
+	crc_table_ready = 1;
+}
+
+static int crc32_always(void)
+{
+	return 1;
+}
+
+static uint32_t crc32_bytewise(uint32_t crc, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+
+	crc32_init_tables();
+
+	while(len--)
+	{
+		crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	}
+
+	return crc;
+}
+
+static uint32_t crc32_slice8(uint32_t crc, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	uint32_t one = 0, two = 0;
+
+	crc32_init_tables();
+
+	/* Little endian word loads, assembled bytewise so big endian hosts work too */
+	while(len >= 8)
+	{
+		one = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24));
+		two = p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32_t) p[7] << 24);
+
+		crc = crc_table[7][one & 0xff] ^
+		      crc_table[6][(one >> 8) & 0xff] ^
+		      crc_table[5][(one >> 16) & 0xff] ^
+		      crc_table[4][one >> 24] ^
+		      crc_table[3][two & 0xff] ^
+		      crc_table[2][(two >> 8) & 0xff] ^
+		      crc_table[1][(two >> 16) & 0xff] ^
+		      crc_table[0][two >> 24];
+
+		p += 8;
+		len -= 8;
+	}
+
+	while(len--)
+	{
+		crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	}
+
+	return crc;
+}
+
+#ifdef CRC32_X86
+static int crc32_pclmul_supported(void)
+{
+	unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+	if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+	{
+		return 0;
+	}
+
+	return (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+}
+
+/* Folds 64 bytes at a time in four lanes, needs len >= 64 and a multiple of 16 */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul_fold(uint32_t crc, const unsigned char *p, size_t len)
+{
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+	const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+	const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) p), _mm_cvtsi32_si128(crc));
+	x2 = _mm_loadu_si128((const __m128i *) (p + 16));
+	x3 = _mm_loadu_si128((const __m128i *) (p + 32));
+	x4 = _mm_loadu_si128((const __m128i *) (p + 48));
+	p += 64;
+	len -= 64;
+
+	while(len >= 64)
+	{
+		x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *) p));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *) (p + 16)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *) (p + 32)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *) (p + 48)));
+
+		p += 64;
+		len -= 64;
+	}
+
+	/* Fold the four lanes into one */
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	while(len >= 16)
+	{
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *) p)), x5);
+		p += 16;
+		len -= 16;
+	}
+
+	/* 128 bits down to 64 */
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask);
+	x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 bits */
+	x2 = _mm_and_si128(x1, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return _mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32_pclmul(uint32_t crc, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	size_t fold = len & ~(size_t) 15;
+
+	if(fold >= 64)
+	{
+		crc = crc32_pclmul_fold(crc, p, fold);
+		p += fold;
+		len -= fold;
+	}
+
+	return crc32_slice8(crc, p, len);
+}
+#endif
+
+#ifdef CRC32_ARMV8
+static int crc32_armv8_supported(void)
+{
+	return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+
+__attribute__((target("+crc")))
+static uint32_t crc32_armv8(uint32_t crc, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	uint64_t word = 0;
+
+	while(len >= 8)
+	{
+		memcpy(&word, p, sizeof(word));
+		crc = __crc32d(crc, word);
+		p += 8;
+		len -= 8;
+	}
+
+	while(len--)
+	{
+		crc = __crc32b(crc, *p++);
+	}
+
+	return crc;
+}
+#endif
+
+const struct crc32_kernel crc32_kernels[] = {
+	{ "bytewise", crc32_bytewise, crc32_always },
+	{ "slice-by-8", crc32_slice8, crc32_always },
+#ifdef CRC32_X86
+	{ "pclmul", crc32_pclmul, crc32_pclmul_supported },
+#endif
+#ifdef CRC32_ARMV8
+	{ "armv8-crc", crc32_armv8, crc32_armv8_supported },
+#endif
+	{ NULL, NULL, NULL }
+};
+
+static const struct crc32_kernel *crc32_best = NULL;
+
+static const struct crc32_kernel *crc32_select(void)
+{
+	const struct crc32_kernel *k = NULL;
+
+	if(crc32_best == NULL)
+	{
+		for(k=crc32_kernels; k->name; k++)
+		{
+			if(k->supported())
+			{
+				crc32_best = k;
+			}
+		}
+	}
+
+	return crc32_best;
+}
+
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t len)
+{
+	return crc32_select()->update(crc, buf, len);
+}
+
+uint32_t crc32_calc(const void *buf, size_t len)
+{
+	return ~crc32_update(0xFFFFFFFF, buf, len);
+}
+
+const char *crc32_kernel_name(void)
+{
+	return crc32_select()->name;
+}
+
+static uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec)
+{
+	uint32_t sum = 0;
+
+	while(vec)
+	{
+		if(vec & 1)
+		{
+			sum ^= *mat;
+		}
+		vec >>= 1;
+		mat++;
+	}
+
+	return sum;
+}
+
+static void gf2_matrix_square(uint32_t *square, const uint32_t *mat)
+{
+	int n = 0;
+
+	for(n=0; n<32; n++)
+	{
+		square[n] = gf2_matrix_times(mat, mat[n]);
+	}
+}
+
+/*
+ * Advances a raw CRC register over len zero bytes in O(log len) steps, by
+ * repeatedly squaring the one zero bit operator (as zlib's crc32_combine()).
+ */
+uint32_t crc32_shift(uint32_t crc, uint64_t len)
+{
+	uint32_t even[32], odd[32], row = 1;
+	int n = 0;
+
+	if(len == 0 || crc == 0)
+	{
+		return crc;
+	}
+
+	odd[0] = CRC32_POLY;
+	for(n=1; n<32; n++)
+	{
+		odd[n] = row;
+		row <<= 1;
+	}
+
+	/* Two, then four zero bits */
+	gf2_matrix_square(even, odd);
+	gf2_matrix_square(odd, even);
+
+	/* Each pass squares up to the next power of two bytes, applying it if that bit of len is set */
+	do
+	{
+		gf2_matrix_square(even, odd);
+		if(len & 1)
+		{
+			crc = gf2_matrix_times(even, crc);
+		}
+		len >>= 1;
+		if(len == 0)
+		{
+			break;
+		}
+
+		gf2_matrix_square(odd, even);
+		if(len & 1)
+		{
+			crc = gf2_matrix_times(odd, crc);
+		}
+		len >>= 1;
+	} while(len);
+
+	return crc;
+}
@@ -0,0 +1,137 @@
+/*
+ * Checks every CRC-32 kernel supported by this CPU against zlib's crc32()
+ * and reports its throughput, and checks crc32_shift() against the CRC of
+ * concatenated buffers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+#include "libcrc32.h"
+
+#define USAGE "Usage: %s [size in MB] [iterations]\n"
+#define SHIFT_CHECKS	200
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * The register after A then B is the register after A advanced over |B| zero
+ * bytes, xored with the register B alone gives from zero. Lengths are drawn
+ * from 0 up to a few MB so both the short and the long shift paths are hit.
+ */
+static int check_shift(const unsigned char *buf, size_t size)
+{
+	static const size_t limits[] = { 1, 64, 4096, 1 << 20, 4 << 20 };
+	size_t a = 0, b = 0, limit = 0;
+	uint32_t whole = 0, shifted = 0;
+	int i = 0;
+
+	for(i=0; i<SHIFT_CHECKS; i++)
+	{
+		limit = limits[i % (sizeof(limits) / sizeof(limits[0]))];
+		limit = limit < size / 2 ? limit : size / 2;
+		a = rand() % (limit + 1);
+		b = rand() % (limit + 1);
+
+		whole = crc32_update(0xFFFFFFFF, buf, a + b);
+		shifted = crc32_shift(crc32_update(0xFFFFFFFF, buf, a), b) ^ crc32_update(0, buf + a, b);
+		if(shifted != whole)
+		{
+			printf("%-12s MISMATCH for lengths %zu + %zu: 0x%.8X != 0x%.8X\n", "crc32_shift", a, b, shifted, whole);
+			return 0;
+		}
+	}
+
+	printf("%-12s ok (%d random splits)\n", "crc32_shift", SHIFT_CHECKS);
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	const struct crc32_kernel *k = NULL;
+	unsigned char *buf = NULL;
+	size_t size = 64, i = 0, len = 0;
+	int iterations = 4, n = 0, retval = EXIT_FAILURE;
+	uint32_t crc = 0, ref = 0;
+	double start = 0, elapsed = 0;
+
+	if(argc > 1)
+	{
+		size = strtoul(argv[1], NULL, 0);
+	}
+	if(argc > 2)
+	{
+		iterations = atoi(argv[2]);
+	}
+	if(size == 0 || iterations < 1)
+	{
+		fprintf(stderr, USAGE, argv[0]);
+		goto end;
+	}
+
+	size <<= 20;
+	buf = malloc(size);
+	if(!buf)
+	{
+		perror("malloc");
+		goto end;
+	}
+
+	srand(1);
+	for(i=0; i<size; i++)
+	{
+		buf[i] = rand();
+	}
+
+	retval = check_shift(buf, size) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	for(k=crc32_kernels; k->name; k++)
+	{
+		if(!k->supported())
+		{
+			printf("%-12s not supported by this CPU\n", k->name);
+			continue;
+		}
+
+		/* Odd lengths and offsets exercise the head and tail handling */
+		for(len=0; len<300; len++)
+		{
+			ref = crc32(0, buf + (len & 7), len);
+			crc = ~k->update(0xFFFFFFFF, buf + (len & 7), len);
+			if(crc != ref)
+			{
+				printf("%-12s MISMATCH at length %zu: 0x%.8X != 0x%.8X\n", k->name, len, crc, ref);
+				retval = EXIT_FAILURE;
+				break;
+			}
+		}
+
+		start = now();
+		for(n=0; n<iterations; n++)
+		{
+			crc = k->update(0xFFFFFFFF, buf, size);
+		}
+		elapsed = now() - start;
+
+		if(~crc != crc32(0, buf, size))
+		{
+			printf("%-12s MISMATCH on %zu MB buffer\n", k->name, size >> 20);
+			retval = EXIT_FAILURE;
+		}
+
+		printf("%-12s %8.2f GB/s%s\n", k->name, (double) size * iterations / elapsed / 1e9,
+		       (strcmp(k->name, crc32_kernel_name()) == 0) ? "  (selected)" : "");
+	}
+
+end:
+	if(buf) free(buf);
+	return retval;
+}
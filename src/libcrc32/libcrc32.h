@@ -0,0 +1,49 @@
+#ifndef _LIBCRC32_H_
+#define _LIBCRC32_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * CRC-32 (IEEE 802.3, reflected polynomial 0xedb88320) shared by the header
+ * tools. crc32_update() advances a raw CRC register: it does no pre or post
+ * inversion, so the trx/uImage style "start with 0xFFFFFFFF, don't invert the
+ * result" checksums are crc32_update(0xFFFFFFFF, buf, len) and a standard
+ * (zlib compatible) CRC-32 is crc32_calc(). The fastest kernel supported by
+ * the CPU is picked on first use.
+ */
+
+typedef uint32_t (*crc32_fn)(uint32_t crc, const void *buf, size_t len);
+
+struct crc32_kernel
+{
+	const char *name;
+	crc32_fn update;
+	int (*supported)(void);
+};
+
+/* All kernels built in, fastest last; terminated by a NULL name */
+extern const struct crc32_kernel crc32_kernels[];
+
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t len);
+uint32_t crc32_calc(const void *buf, size_t len);
+const char *crc32_kernel_name(void);
+
+/*
+ * Advances a raw CRC register over len zero bytes without touching them.
+ * As the CRC is linear, this lets a checksum be corrected after bytes it
+ * already covered change: crc ^= crc32_shift(crc32_update(0, delta, n), tail)
+ * where delta is the old bytes xored with the new and tail the number of
+ * checksummed bytes after them.
+ */
+uint32_t crc32_shift(uint32_t crc, uint64_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
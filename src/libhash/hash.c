@@ -0,0 +1,428 @@
+/*
+ * Streaming, region and batch front ends over the MD5 and SHA-1 kernels.
+ *
+ * The kernels only ever see whole 64 byte blocks; padding, the length
+ * field and the digest byte order (little endian for MD5, big endian for
+ * SHA-1) are handled here.
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "libhash.h"
+#include "hash_internal.h"
+
+static const uint32_t hash_iv[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+
+/* Per lane position in a batch */
+struct hash_lane
+{
+	struct hash_job *job;
+	const unsigned char *data;
+	size_t nblocks;
+	int in_tail;
+	int ntail;
+	unsigned char tail[2 * HASH_BLOCK_SIZE];
+};
+
+static const struct hash_kernel *hash_best[2] = { NULL, NULL };
+static const struct hash_mb_kernel *hash_mb_best[2] = { NULL, NULL };
+static int hash_mb_selected[2] = { 0, 0 };
+
+#ifdef HASH_X86
+int hash_avx2_supported(void)
+{
+	unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+	if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE) || !(ecx & bit_AVX))
+	{
+		return 0;
+	}
+
+	/* The OS has to save the YMM registers too */
+	__asm__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+	if((eax & 6) != 6)
+	{
+		return 0;
+	}
+
+	return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_AVX2);
+}
+#endif
+
+static const struct hash_kernel *hash_select(enum hash_alg alg)
+{
+	const struct hash_kernel *k = NULL;
+
+	if(hash_best[alg] == NULL)
+	{
+		for(k=(alg == HASH_MD5) ? md5_kernels : sha1_kernels; k->name; k++)
+		{
+			if(k->supported())
+			{
+				hash_best[alg] = k;
+			}
+		}
+	}
+
+	return hash_best[alg];
+}
+
+/* NULL when no multi-buffer kernel runs on this CPU */
+static const struct hash_mb_kernel *hash_mb_select(enum hash_alg alg)
+{
+	const struct hash_mb_kernel *k = NULL;
+
+	if(!hash_mb_selected[alg])
+	{
+		for(k=(alg == HASH_MD5) ? md5_mb_kernels : sha1_mb_kernels; k->name; k++)
+		{
+			if(k->supported())
+			{
+				hash_mb_best[alg] = k;
+			}
+		}
+		hash_mb_selected[alg] = 1;
+	}
+
+	return hash_mb_best[alg];
+}
+
+static void hash_state_init(enum hash_alg alg, uint32_t *state)
+{
+	memcpy(state, hash_iv, sizeof(uint32_t) * ((alg == HASH_MD5) ? 4 : 5));
+}
+
+/*
+ * Pads the last len (< 64) bytes of a message of total bytes into one or
+ * two blocks at out and returns how many.
+ */
+static int hash_pad(enum hash_alg alg, const unsigned char *tail, size_t len, uint64_t total, unsigned char *out)
+{
+	int nblocks = (len < HASH_BLOCK_SIZE - 8) ? 1 : 2;
+	unsigned char *lenp = out + nblocks * HASH_BLOCK_SIZE - 8;
+	uint64_t bits = total << 3;
+	int i = 0;
+
+	memcpy(out, tail, len);
+	out[len] = 0x80;
+	memset(out + len + 1, 0, nblocks * HASH_BLOCK_SIZE - len - 1);
+
+	for(i=0; i<8; i++)
+	{
+		lenp[(alg == HASH_MD5) ? i : 7 - i] = bits >> (i * 8);
+	}
+
+	return nblocks;
+}
+
+static void hash_output(enum hash_alg alg, const uint32_t *state, unsigned char *digest)
+{
+	int i = 0;
+
+	if(alg == HASH_MD5)
+	{
+		for(i=0; i<MD5_DIGEST_SIZE; i++)
+		{
+			digest[i] = state[i / 4] >> ((i & 3) * 8);
+		}
+	}
+	else
+	{
+		for(i=0; i<SHA1_DIGEST_SIZE; i++)
+		{
+			digest[i] = state[i / 4] >> ((3 - (i & 3)) * 8);
+		}
+	}
+}
+
+size_t hash_digest_size(enum hash_alg alg)
+{
+	return (alg == HASH_MD5) ? MD5_DIGEST_SIZE : SHA1_DIGEST_SIZE;
+}
+
+void hash_init(struct hash_ctx *ctx, enum hash_alg alg)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->alg = alg;
+	hash_state_init(alg, ctx->state);
+}
+
+void hash_update(struct hash_ctx *ctx, const void *data, size_t len)
+{
+	const struct hash_kernel *k = hash_select(ctx->alg);
+	const unsigned char *p = data;
+	size_t n = 0;
+
+	ctx->length += len;
+
+	if(ctx->fill)
+	{
+		n = HASH_BLOCK_SIZE - ctx->fill;
+		if(n > len)
+		{
+			n = len;
+		}
+		memcpy(ctx->block + ctx->fill, p, n);
+		ctx->fill += n;
+		p += n;
+		len -= n;
+
+		if(ctx->fill < HASH_BLOCK_SIZE)
+		{
+			return;
+		}
+		k->blocks(ctx->state, ctx->block, 1);
+		ctx->fill = 0;
+	}
+
+	/* Whole blocks straight from the caller's buffer */
+	n = len / HASH_BLOCK_SIZE;
+	if(n)
+	{
+		k->blocks(ctx->state, p, n);
+		p += n * HASH_BLOCK_SIZE;
+		len -= n * HASH_BLOCK_SIZE;
+	}
+
+	memcpy(ctx->block, p, len);
+	ctx->fill = len;
+}
+
+void hash_final(struct hash_ctx *ctx, unsigned char *digest)
+{
+	unsigned char pad[2 * HASH_BLOCK_SIZE];
+	int n = hash_pad(ctx->alg, ctx->block, ctx->fill, ctx->length, pad);
+
+	hash_select(ctx->alg)->blocks(ctx->state, pad, n);
+	hash_output(ctx->alg, ctx->state, digest);
+	memset(ctx, 0, sizeof(*ctx));
+}
+
+void hash_buffer_with(enum hash_alg alg, const struct hash_kernel *kernel, const void *data, size_t len, unsigned char *digest)
+{
+	unsigned char pad[2 * HASH_BLOCK_SIZE];
+	uint32_t state[5];
+	size_t nblocks = len / HASH_BLOCK_SIZE;
+	int n = 0;
+
+	hash_state_init(alg, state);
+	if(nblocks)
+	{
+		kernel->blocks(state, data, nblocks);
+	}
+	n = hash_pad(alg, (const unsigned char *) data + nblocks * HASH_BLOCK_SIZE, len % HASH_BLOCK_SIZE, len, pad);
+	kernel->blocks(state, pad, n);
+	hash_output(alg, state, digest);
+}
+
+void hash_buffer(enum hash_alg alg, const void *data, size_t len, unsigned char *digest)
+{
+	hash_buffer_with(alg, hash_select(alg), data, len, digest);
+}
+
+/* Hashes len bytes of fd from offset, mapping rather than reading them */
+int hash_region(enum hash_alg alg, int fd, off_t offset, off_t len, unsigned char *digest)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	off_t base = offset - (offset % page);
+	size_t map_len = (size_t) (offset - base + len);
+	unsigned char *map = NULL;
+
+	if(len == 0)
+	{
+		hash_buffer(alg, NULL, 0, digest);
+		return 0;
+	}
+
+	map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, base);
+	if(map == MAP_FAILED)
+	{
+		return -1;
+	}
+	madvise(map, map_len, MADV_SEQUENTIAL);
+
+	hash_buffer(alg, map + (offset - base), len, digest);
+
+	munmap(map, map_len);
+	return 0;
+}
+
+int hash_file(enum hash_alg alg, const char *file, unsigned char *digest)
+{
+	struct stat st;
+	int fd = 0, retval = -1;
+
+	fd = open(file, O_RDONLY);
+	if(fd == -1)
+	{
+		return -1;
+	}
+
+	if(fstat(fd, &st) == 0)
+	{
+		retval = hash_region(alg, fd, 0, st.st_size, digest);
+	}
+
+	close(fd);
+	return retval;
+}
+
+static void hash_lane_load(enum hash_alg alg, struct hash_lane *lane, struct hash_job *job)
+{
+	size_t full = job->len / HASH_BLOCK_SIZE;
+
+	lane->job = job;
+	lane->ntail = hash_pad(alg, (const unsigned char *) job->data + full * HASH_BLOCK_SIZE, job->len % HASH_BLOCK_SIZE, job->len, lane->tail);
+	lane->in_tail = (full == 0);
+	lane->data = lane->in_tail ? lane->tail : job->data;
+	lane->nblocks = lane->in_tail ? (size_t) lane->ntail : full;
+}
+
+/* Runs what is left of a lane through the single buffer kernel */
+static void hash_lane_finish(enum hash_alg alg, const struct hash_kernel *kernel, struct hash_lane *lane, uint32_t *state)
+{
+	kernel->blocks(state, lane->data, lane->nblocks);
+	if(!lane->in_tail)
+	{
+		kernel->blocks(state, lane->tail, lane->ntail);
+	}
+	hash_output(alg, state, lane->job->digest);
+	lane->job = NULL;
+}
+
+/*
+ * Keeps every lane busy with its own message: each run compresses as many
+ * blocks as the shortest remaining lane needs, then finished lanes output
+ * their digest and take the next job. Once the queue is empty and fewer than
+ * half the lanes are busy, the rest finish on the single buffer kernel.
+ */
+void hash_batch_with(enum hash_alg alg, const struct hash_mb_kernel *kernel, struct hash_job *jobs, int njobs)
+{
+	const struct hash_kernel *single = hash_select(alg);
+	struct hash_lane lane[HASH_MAX_LANES];
+	const unsigned char *data[HASH_MAX_LANES];
+	uint32_t state[5 * HASH_MAX_LANES], lane_state[5];
+	int lanes = kernel->lanes, words = (alg == HASH_MD5) ? 4 : 5;
+	int next = 0, active = 0, busy = 0, l = 0, i = 0;
+	size_t n = 0;
+
+	memset(lane, 0, sizeof(lane));
+
+	while(1)
+	{
+		for(l=0; l<lanes && next<njobs; l++)
+		{
+			if(!lane[l].job)
+			{
+				hash_lane_load(alg, &lane[l], &jobs[next++]);
+				for(i=0; i<words; i++)
+				{
+					state[i * lanes + l] = hash_iv[i];
+				}
+				active++;
+			}
+		}
+
+		if(active == 0)
+		{
+			break;
+		}
+
+		if(next == njobs && active < lanes / 2)
+		{
+			for(l=0; l<lanes; l++)
+			{
+				if(lane[l].job)
+				{
+					for(i=0; i<words; i++)
+					{
+						lane_state[i] = state[i * lanes + l];
+					}
+					hash_lane_finish(alg, single, &lane[l], lane_state);
+				}
+			}
+			break;
+		}
+
+		n = 0;
+		for(l=0; l<lanes; l++)
+		{
+			if(lane[l].job && (n == 0 || lane[l].nblocks < n))
+			{
+				n = lane[l].nblocks;
+				busy = l;
+			}
+		}
+
+		/* Idle lanes read along with a busy one; their state is thrown away */
+		for(l=0; l<lanes; l++)
+		{
+			data[l] = lane[l].job ? lane[l].data : lane[busy].data;
+		}
+
+		kernel->blocks(state, data, n);
+
+		for(l=0; l<lanes; l++)
+		{
+			if(!lane[l].job)
+			{
+				continue;
+			}
+
+			lane[l].data = data[l];
+			lane[l].nblocks -= n;
+			if(lane[l].nblocks)
+			{
+				continue;
+			}
+
+			if(!lane[l].in_tail)
+			{
+				lane[l].in_tail = 1;
+				lane[l].data = lane[l].tail;
+				lane[l].nblocks = lane[l].ntail;
+				continue;
+			}
+
+			for(i=0; i<words; i++)
+			{
+				lane_state[i] = state[i * lanes + l];
+			}
+			hash_output(alg, lane_state, lane[l].job->digest);
+			lane[l].job = NULL;
+			active--;
+		}
+	}
+}
+
+void hash_batch(enum hash_alg alg, struct hash_job *jobs, int njobs)
+{
+	const struct hash_mb_kernel *kernel = hash_mb_select(alg);
+	int i = 0;
+
+	if(kernel)
+	{
+		hash_batch_with(alg, kernel, jobs, njobs);
+		return;
+	}
+
+	for(i=0; i<njobs; i++)
+	{
+		hash_buffer(alg, jobs[i].data, jobs[i].len, jobs[i].digest);
+	}
+}
+
+const char *hash_kernel_name(enum hash_alg alg)
+{
+	return hash_select(alg)->name;
+}
+
+const char *hash_mb_kernel_name(enum hash_alg alg)
+{
+	const struct hash_mb_kernel *kernel = hash_mb_select(alg);
+
+	return kernel ? kernel->name : "none";
+}
@@ -0,0 +1,228 @@
+/*
+ * Checks every MD5 and SHA-1 kernel supported by this CPU against known
+ * digests and the generic kernel, and reports its throughput for a single
+ * large buffer and for a batch of small ones.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "libhash.h"
+
+#define USAGE "Usage: %s [size in MB] [iterations]\n"
+#define BATCH_JOBS	4096
+#define BATCH_LEN	4096
+
+struct vector
+{
+	enum hash_alg alg;
+	const char *msg;
+	const char *digest;
+};
+
+/* RFC 1321 and FIPS 180 examples */
+static const struct vector vectors[] = {
+	{ HASH_MD5, "", "d41d8cd98f00b204e9800998ecf8427e" },
+	{ HASH_MD5, "abc", "900150983cd24fb0d6963f7d28e17f72" },
+	{ HASH_MD5, "12345678901234567890123456789012345678901234567890123456789012345678901234567890", "57edf4a22be3c955ac49da2e2107b67a" },
+	{ HASH_SHA1, "", "da39a3ee5e6b4b0d3255bfef95601890afd80709" },
+	{ HASH_SHA1, "abc", "a9993e364706816aba3e25717850c26c9cd0d89d" },
+	{ HASH_SHA1, "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "84983e441c3bd26ebaae4aa1f95129e5e54670f1" },
+};
+
+static const char *alg_name[] = { "md5", "sha1" };
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void hex(const unsigned char *digest, size_t len, char *out)
+{
+	size_t i = 0;
+
+	for(i=0; i<len; i++)
+	{
+		sprintf(out + i * 2, "%.2x", digest[i]);
+	}
+}
+
+static int check_single(enum hash_alg alg, const struct hash_kernel *k, const unsigned char *buf)
+{
+	const struct hash_kernel *generic = (alg == HASH_MD5) ? md5_kernels : sha1_kernels;
+	unsigned char digest[HASH_MAX_DIGEST_SIZE], ref[HASH_MAX_DIGEST_SIZE];
+	char text[HASH_MAX_DIGEST_SIZE * 2 + 1];
+	size_t i = 0, len = 0;
+
+	for(i=0; i<sizeof(vectors) / sizeof(vectors[0]); i++)
+	{
+		if(vectors[i].alg != alg)
+		{
+			continue;
+		}
+		hash_buffer_with(alg, k, vectors[i].msg, strlen(vectors[i].msg), digest);
+		hex(digest, hash_digest_size(alg), text);
+		if(strcmp(text, vectors[i].digest) != 0)
+		{
+			printf("%-5s %-10s MISMATCH on \"%s\": %s\n", alg_name[alg], k->name, vectors[i].msg, text);
+			return 0;
+		}
+	}
+
+	/* Every length around the one and two block padding boundaries */
+	for(len=0; len<300; len++)
+	{
+		hash_buffer_with(alg, generic, buf + (len & 7), len, ref);
+		hash_buffer_with(alg, k, buf + (len & 7), len, digest);
+		if(memcmp(digest, ref, hash_digest_size(alg)) != 0)
+		{
+			printf("%-5s %-10s MISMATCH at length %zu\n", alg_name[alg], k->name, len);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int check_batch(enum hash_alg alg, const struct hash_mb_kernel *k, const unsigned char *buf)
+{
+	struct hash_job jobs[100];
+	unsigned char ref[HASH_MAX_DIGEST_SIZE];
+	int i = 0, n = 0;
+
+	/* Uneven lengths so lanes finish and refill at different times */
+	for(n=1; n<=100; n+=33)
+	{
+		for(i=0; i<n; i++)
+		{
+			jobs[i].data = buf + i;
+			jobs[i].len = (i * 131) % 1000;
+		}
+		hash_batch_with(alg, k, jobs, n);
+		for(i=0; i<n; i++)
+		{
+			hash_buffer_with(alg, (alg == HASH_MD5) ? md5_kernels : sha1_kernels, jobs[i].data, jobs[i].len, ref);
+			if(memcmp(jobs[i].digest, ref, hash_digest_size(alg)) != 0)
+			{
+				printf("%-5s %-10s MISMATCH on job %d of %d\n", alg_name[alg], k->name, i, n);
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	const struct hash_kernel *k = NULL;
+	const struct hash_mb_kernel *mb = NULL;
+	struct hash_job *jobs = NULL;
+	unsigned char *buf = NULL, digest[HASH_MAX_DIGEST_SIZE];
+	size_t size = 64, i = 0;
+	int iterations = 4, n = 0, retval = EXIT_FAILURE;
+	enum hash_alg alg = HASH_MD5;
+	double start = 0, elapsed = 0;
+
+	if(argc > 1)
+	{
+		size = strtoul(argv[1], NULL, 0);
+	}
+	if(argc > 2)
+	{
+		iterations = atoi(argv[2]);
+	}
+	if(size == 0 || iterations < 1)
+	{
+		fprintf(stderr, USAGE, argv[0]);
+		goto end;
+	}
+
+	size <<= 20;
+	if(size < BATCH_JOBS * BATCH_LEN)
+	{
+		size = BATCH_JOBS * BATCH_LEN;
+	}
+	buf = malloc(size);
+	jobs = malloc(BATCH_JOBS * sizeof(*jobs));
+	if(!buf || !jobs)
+	{
+		perror("malloc");
+		goto end;
+	}
+
+	srand(1);
+	for(i=0; i<size; i++)
+	{
+		buf[i] = rand();
+	}
+
+	retval = EXIT_SUCCESS;
+
+	for(alg=HASH_MD5; alg<=HASH_SHA1; alg++)
+	{
+		for(k=(alg == HASH_MD5) ? md5_kernels : sha1_kernels; k->name; k++)
+		{
+			if(!k->supported())
+			{
+				printf("%-5s %-10s not supported by this CPU\n", alg_name[alg], k->name);
+				continue;
+			}
+			if(!check_single(alg, k, buf))
+			{
+				retval = EXIT_FAILURE;
+				continue;
+			}
+
+			start = now();
+			for(n=0; n<iterations; n++)
+			{
+				hash_buffer_with(alg, k, buf, size, digest);
+			}
+			elapsed = now() - start;
+
+			printf("%-5s %-10s %8.1f MB/s%s\n", alg_name[alg], k->name, (double) size * iterations / elapsed / 1e6,
+			       (strcmp(k->name, hash_kernel_name(alg)) == 0) ? "  (selected)" : "");
+		}
+
+		for(mb=(alg == HASH_MD5) ? md5_mb_kernels : sha1_mb_kernels; mb->name; mb++)
+		{
+			if(!mb->supported())
+			{
+				printf("%-5s %-10s not supported by this CPU\n", alg_name[alg], mb->name);
+				continue;
+			}
+			if(!check_batch(alg, mb, buf))
+			{
+				retval = EXIT_FAILURE;
+				continue;
+			}
+
+			for(i=0; i<BATCH_JOBS; i++)
+			{
+				jobs[i].data = buf + i * BATCH_LEN;
+				jobs[i].len = BATCH_LEN;
+			}
+
+			start = now();
+			for(n=0; n<iterations; n++)
+			{
+				hash_batch_with(alg, mb, jobs, BATCH_JOBS);
+			}
+			elapsed = now() - start;
+
+			printf("%-5s %-10s %8.1f MB/s  (%d x %d byte batch)%s\n", alg_name[alg], mb->name,
+			       (double) BATCH_JOBS * BATCH_LEN * iterations / elapsed / 1e6, BATCH_JOBS, BATCH_LEN,
+			       (strcmp(mb->name, hash_mb_kernel_name(alg)) == 0) ? "  (selected)" : "");
+		}
+	}
+
+end:
+	if(jobs) free(jobs);
+	if(buf) free(buf);
+	return retval;
+}
@@ -0,0 +1,60 @@
+#ifndef _HASH_INTERNAL_H_
+#define _HASH_INTERNAL_H_
+
+/* Helpers shared by the MD5 and SHA-1 kernels */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HASH_X86
+#include <cpuid.h>
+#include <immintrin.h>
+
+int hash_avx2_supported(void);
+
+/*
+ * Loads the same 32 bytes of eight blocks and transposes them, so out[i]
+ * holds word i of every lane.
+ */
+__attribute__((target("avx2")))
+static inline void hash_transpose8(__m256i *out, const unsigned char **data, int offset)
+{
+	__m256i r0, r1, r2, r3, r4, r5, r6, r7, t0, t1, t2, t3, t4, t5, t6, t7;
+
+	r0 = _mm256_loadu_si256((const __m256i *) (data[0] + offset));
+	r1 = _mm256_loadu_si256((const __m256i *) (data[1] + offset));
+	r2 = _mm256_loadu_si256((const __m256i *) (data[2] + offset));
+	r3 = _mm256_loadu_si256((const __m256i *) (data[3] + offset));
+	r4 = _mm256_loadu_si256((const __m256i *) (data[4] + offset));
+	r5 = _mm256_loadu_si256((const __m256i *) (data[5] + offset));
+	r6 = _mm256_loadu_si256((const __m256i *) (data[6] + offset));
+	r7 = _mm256_loadu_si256((const __m256i *) (data[7] + offset));
+
+	t0 = _mm256_unpacklo_epi32(r0, r1);
+	t1 = _mm256_unpackhi_epi32(r0, r1);
+	t2 = _mm256_unpacklo_epi32(r2, r3);
+	t3 = _mm256_unpackhi_epi32(r2, r3);
+	t4 = _mm256_unpacklo_epi32(r4, r5);
+	t5 = _mm256_unpackhi_epi32(r4, r5);
+	t6 = _mm256_unpacklo_epi32(r6, r7);
+	t7 = _mm256_unpackhi_epi32(r6, r7);
+
+	r0 = _mm256_unpacklo_epi64(t0, t2);
+	r1 = _mm256_unpackhi_epi64(t0, t2);
+	r2 = _mm256_unpacklo_epi64(t1, t3);
+	r3 = _mm256_unpackhi_epi64(t1, t3);
+	r4 = _mm256_unpacklo_epi64(t4, t6);
+	r5 = _mm256_unpackhi_epi64(t4, t6);
+	r6 = _mm256_unpacklo_epi64(t5, t7);
+	r7 = _mm256_unpackhi_epi64(t5, t7);
+
+	out[0] = _mm256_permute2x128_si256(r0, r4, 0x20);
+	out[1] = _mm256_permute2x128_si256(r1, r5, 0x20);
+	out[2] = _mm256_permute2x128_si256(r2, r6, 0x20);
+	out[3] = _mm256_permute2x128_si256(r3, r7, 0x20);
+	out[4] = _mm256_permute2x128_si256(r0, r4, 0x31);
+	out[5] = _mm256_permute2x128_si256(r1, r5, 0x31);
+	out[6] = _mm256_permute2x128_si256(r2, r6, 0x31);
+	out[7] = _mm256_permute2x128_si256(r3, r7, 0x31);
+}
+#endif
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef _LIBHASH_H_
+#define _LIBHASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * MD5 and SHA-1 shared by crcalc, tpl-tool and the firmware tools, which
+ * each used to carry their own byte oriented implementation.
+ *
+ * hash_init/update/final stream a message through the fastest single buffer
+ * kernel the CPU supports, hash_region() does the same over a mapped range
+ * of a file, and hash_batch() hashes many independent buffers at once with
+ * a multi-buffer kernel that runs one message per SIMD lane. seama digests
+ * all the images it packs in one MD5 batch. Nothing batches SHA-1, so it
+ * has no multi-buffer kernel and hash_batch() falls back to hashing one
+ * buffer after another.
+ */
+
+#define MD5_DIGEST_SIZE		16
+#define SHA1_DIGEST_SIZE	20
+#define HASH_MAX_DIGEST_SIZE	SHA1_DIGEST_SIZE
+#define HASH_BLOCK_SIZE		64
+#define HASH_MAX_LANES		8
+
+enum hash_alg
+{
+	HASH_MD5,
+	HASH_SHA1,
+};
+
+struct hash_ctx
+{
+	enum hash_alg alg;
+	uint32_t state[5];
+	uint64_t length;
+	unsigned char block[HASH_BLOCK_SIZE];
+	size_t fill;
+};
+
+struct hash_job
+{
+	const void *data;
+	size_t len;
+	unsigned char digest[HASH_MAX_DIGEST_SIZE];
+};
+
+/* Compresses nblocks 64 byte blocks into state */
+typedef void (*hash_blocks_fn)(uint32_t *state, const unsigned char *data, size_t nblocks);
+
+/*
+ * Compresses nblocks blocks from each of lanes messages at once. state holds
+ * word i of lane l at state[i * lanes + l]; data[l] is advanced past the
+ * blocks consumed.
+ */
+typedef void (*hash_lanes_fn)(uint32_t *state, const unsigned char **data, size_t nblocks);
+
+struct hash_kernel
+{
+	const char *name;
+	hash_blocks_fn blocks;
+	int (*supported)(void);
+};
+
+struct hash_mb_kernel
+{
+	const char *name;
+	int lanes;
+	hash_lanes_fn blocks;
+	int (*supported)(void);
+};
+
+/* All kernels built in, fastest last; terminated by a NULL name */
+extern const struct hash_kernel md5_kernels[];
+extern const struct hash_kernel sha1_kernels[];
+extern const struct hash_mb_kernel md5_mb_kernels[];
+extern const struct hash_mb_kernel sha1_mb_kernels[];
+
+size_t hash_digest_size(enum hash_alg alg);
+void hash_init(struct hash_ctx *ctx, enum hash_alg alg);
+void hash_update(struct hash_ctx *ctx, const void *data, size_t len);
+void hash_final(struct hash_ctx *ctx, unsigned char *digest);
+void hash_buffer(enum hash_alg alg, const void *data, size_t len, unsigned char *digest);
+int hash_region(enum hash_alg alg, int fd, off_t offset, off_t len, unsigned char *digest);
+int hash_file(enum hash_alg alg, const char *file, unsigned char *digest);
+void hash_batch(enum hash_alg alg, struct hash_job *jobs, int njobs);
+const char *hash_kernel_name(enum hash_alg alg);
+const char *hash_mb_kernel_name(enum hash_alg alg);
+
+/* For the benchmark: the same, through a given kernel */
+void hash_buffer_with(enum hash_alg alg, const struct hash_kernel *kernel, const void *data, size_t len, unsigned char *digest);
+void hash_batch_with(enum hash_alg alg, const struct hash_mb_kernel *kernel, struct hash_job *jobs, int njobs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
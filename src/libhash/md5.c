@@ -0,0 +1,216 @@
+/*
+ * MD5 (RFC 1321) kernels.
+ *
+ *   generic    one block at a time, the reference round structure
+ *   avx2-x8    eight independent messages at once, one per 32 bit lane
+ *
+ * MD5 has no parallelism within a message to speak of, so SIMD only pays
+ * when there are several messages to hash; single streams always use the
+ * generic kernel.
+ */
+
+#include <string.h>
+#include "libhash.h"
+#include "hash_internal.h"
+
+static const uint32_t md5_k[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static const int md5_r[64] = {
+	7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+	5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+	4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+	6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+};
+
+/* Message word used by each step */
+static const int md5_g[64] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	1, 6, 11, 0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12,
+	5, 8, 11, 14, 1, 4, 7, 10, 13, 0, 3, 6, 9, 12, 15, 2,
+	0, 7, 14, 5, 12, 3, 10, 1, 8, 15, 6, 13, 4, 11, 2, 9,
+};
+
+static int md5_always(void)
+{
+	return 1;
+}
+
+#define ROTL(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+
+#define MD5_STEP(f, a, b, c, d, i) \
+	a += f(b, c, d) + w[md5_g[i]] + md5_k[i]; \
+	a = b + ROTL(a, md5_r[i])
+
+#define MD5_F(x, y, z)	((z) ^ ((x) & ((y) ^ (z))))
+#define MD5_G(x, y, z)	((y) ^ ((z) & ((x) ^ (y))))
+#define MD5_H(x, y, z)	((x) ^ (y) ^ (z))
+#define MD5_I(x, y, z)	((y) ^ ((x) | ~(z)))
+
+static void md5_generic(uint32_t *state, const unsigned char *data, size_t nblocks)
+{
+	uint32_t a = 0, b = 0, c = 0, d = 0, w[16];
+	int i = 0;
+
+	while(nblocks--)
+	{
+		for(i=0; i<16; i++)
+		{
+			w[i] = data[i * 4] | (data[i * 4 + 1] << 8) | (data[i * 4 + 2] << 16) | ((uint32_t) data[i * 4 + 3] << 24);
+		}
+
+		a = state[0];
+		b = state[1];
+		c = state[2];
+		d = state[3];
+
+		/*
+		 * Four steps per pass so the a, b, c, d rotation needs no moves;
+		 * fully unrolled so the shifts and word indices become constants.
+		 */
+		#pragma GCC unroll 4
+		for(i=0; i<16; i+=4)
+		{
+			MD5_STEP(MD5_F, a, b, c, d, i);
+			MD5_STEP(MD5_F, d, a, b, c, i + 1);
+			MD5_STEP(MD5_F, c, d, a, b, i + 2);
+			MD5_STEP(MD5_F, b, c, d, a, i + 3);
+		}
+		#pragma GCC unroll 4
+		for(; i<32; i+=4)
+		{
+			MD5_STEP(MD5_G, a, b, c, d, i);
+			MD5_STEP(MD5_G, d, a, b, c, i + 1);
+			MD5_STEP(MD5_G, c, d, a, b, i + 2);
+			MD5_STEP(MD5_G, b, c, d, a, i + 3);
+		}
+		#pragma GCC unroll 4
+		for(; i<48; i+=4)
+		{
+			MD5_STEP(MD5_H, a, b, c, d, i);
+			MD5_STEP(MD5_H, d, a, b, c, i + 1);
+			MD5_STEP(MD5_H, c, d, a, b, i + 2);
+			MD5_STEP(MD5_H, b, c, d, a, i + 3);
+		}
+		#pragma GCC unroll 4
+		for(; i<64; i+=4)
+		{
+			MD5_STEP(MD5_I, a, b, c, d, i);
+			MD5_STEP(MD5_I, d, a, b, c, i + 1);
+			MD5_STEP(MD5_I, c, d, a, b, i + 2);
+			MD5_STEP(MD5_I, b, c, d, a, i + 3);
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		data += HASH_BLOCK_SIZE;
+	}
+}
+
+#ifdef HASH_X86
+#define VROTL(x, n)	_mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+#define VF(x, y, z)	_mm256_xor_si256(z, _mm256_and_si256(x, _mm256_xor_si256(y, z)))
+#define VG(x, y, z)	_mm256_xor_si256(y, _mm256_and_si256(z, _mm256_xor_si256(x, y)))
+#define VH(x, y, z)	_mm256_xor_si256(_mm256_xor_si256(x, y), z)
+#define VI(x, y, z)	_mm256_xor_si256(y, _mm256_or_si256(x, _mm256_xor_si256(z, ones)))
+
+#define VSTEP(f, a, b, c, d, i) \
+	a = _mm256_add_epi32(a, _mm256_add_epi32(f(b, c, d), \
+		_mm256_add_epi32(w[md5_g[i]], _mm256_set1_epi32(md5_k[i])))); \
+	a = _mm256_add_epi32(b, VROTL(a, md5_r[i]))
+
+__attribute__((target("avx2")))
+static void md5_avx2_x8(uint32_t *state, const unsigned char **data, size_t nblocks)
+{
+	const __m256i ones = _mm256_set1_epi32(-1);
+	__m256i a, b, c, d, aa, bb, cc, dd, w[16];
+	int i = 0;
+
+	a = _mm256_loadu_si256((const __m256i *) (state + 0));
+	b = _mm256_loadu_si256((const __m256i *) (state + 8));
+	c = _mm256_loadu_si256((const __m256i *) (state + 16));
+	d = _mm256_loadu_si256((const __m256i *) (state + 24));
+
+	while(nblocks--)
+	{
+		hash_transpose8(w, data, 0);
+		hash_transpose8(w + 8, data, 32);
+
+		aa = a;
+		bb = b;
+		cc = c;
+		dd = d;
+
+		/* Unrolled as in md5_generic, so the shift counts are immediates */
+		#pragma GCC unroll 4
+		for(i=0; i<16; i+=4)
+		{
+			VSTEP(VF, a, b, c, d, i);
+			VSTEP(VF, d, a, b, c, i + 1);
+			VSTEP(VF, c, d, a, b, i + 2);
+			VSTEP(VF, b, c, d, a, i + 3);
+		}
+		#pragma GCC unroll 4
+		for(; i<32; i+=4)
+		{
+			VSTEP(VG, a, b, c, d, i);
+			VSTEP(VG, d, a, b, c, i + 1);
+			VSTEP(VG, c, d, a, b, i + 2);
+			VSTEP(VG, b, c, d, a, i + 3);
+		}
+		#pragma GCC unroll 4
+		for(; i<48; i+=4)
+		{
+			VSTEP(VH, a, b, c, d, i);
+			VSTEP(VH, d, a, b, c, i + 1);
+			VSTEP(VH, c, d, a, b, i + 2);
+			VSTEP(VH, b, c, d, a, i + 3);
+		}
+		#pragma GCC unroll 4
+		for(; i<64; i+=4)
+		{
+			VSTEP(VI, a, b, c, d, i);
+			VSTEP(VI, d, a, b, c, i + 1);
+			VSTEP(VI, c, d, a, b, i + 2);
+			VSTEP(VI, b, c, d, a, i + 3);
+		}
+
+		a = _mm256_add_epi32(a, aa);
+		b = _mm256_add_epi32(b, bb);
+		c = _mm256_add_epi32(c, cc);
+		d = _mm256_add_epi32(d, dd);
+
+		for(i=0; i<8; i++)
+		{
+			data[i] += HASH_BLOCK_SIZE;
+		}
+	}
+
+	_mm256_storeu_si256((__m256i *) (state + 0), a);
+	_mm256_storeu_si256((__m256i *) (state + 8), b);
+	_mm256_storeu_si256((__m256i *) (state + 16), c);
+	_mm256_storeu_si256((__m256i *) (state + 24), d);
+}
+#endif
+
+const struct hash_kernel md5_kernels[] = {
+	{ "generic", md5_generic, md5_always },
+	{ NULL, NULL, NULL }
+};
+
+const struct hash_mb_kernel md5_mb_kernels[] = {
+#ifdef HASH_X86
+	{ "avx2-x8", 8, md5_avx2_x8, hash_avx2_supported },
+#endif
+	{ NULL, 0, NULL, NULL }
+};
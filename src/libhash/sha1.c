@@ -0,0 +1,184 @@
+/*
+ * SHA-1 (FIPS 180-4) kernels.
+ *
+ *   generic    one block at a time, 16 word rolling message schedule
+ *   sha-ni     x86 SHA extensions (SHA1RNDS4 and friends), four rounds per
+ *              instruction
+ *
+ * The SHA-NI round sequence follows Intel's "New Instructions Supporting
+ * the Secure Hash Algorithm on Intel Architecture Processors" paper.
+ */
+
+#include <string.h>
+#include "libhash.h"
+#include "hash_internal.h"
+
+#define SHA1_K0		0x5a827999
+#define SHA1_K1		0x6ed9eba1
+#define SHA1_K2		0x8f1bbcdc
+#define SHA1_K3		0xca62c1d6
+
+static int sha1_always(void)
+{
+	return 1;
+}
+
+#define ROTL(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+
+static void sha1_generic(uint32_t *state, const unsigned char *data, size_t nblocks)
+{
+	uint32_t a = 0, b = 0, c = 0, d = 0, e = 0, f = 0, k = 0, t = 0, w[16];
+	int i = 0;
+
+	while(nblocks--)
+	{
+		for(i=0; i<16; i++)
+		{
+			w[i] = ((uint32_t) data[i * 4] << 24) | (data[i * 4 + 1] << 16) | (data[i * 4 + 2] << 8) | data[i * 4 + 3];
+		}
+
+		a = state[0];
+		b = state[1];
+		c = state[2];
+		d = state[3];
+		e = state[4];
+
+		/* Unrolled so the round function and constant are picked at compile time */
+		#pragma GCC unroll 80
+		for(i=0; i<80; i++)
+		{
+			if(i >= 16)
+			{
+				w[i & 15] = ROTL(w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15], 1);
+			}
+
+			if(i < 20)
+			{
+				f = d ^ (b & (c ^ d));
+				k = SHA1_K0;
+			}
+			else if(i < 40)
+			{
+				f = b ^ c ^ d;
+				k = SHA1_K1;
+			}
+			else if(i < 60)
+			{
+				f = (b & c) | (d & (b | c));
+				k = SHA1_K2;
+			}
+			else
+			{
+				f = b ^ c ^ d;
+				k = SHA1_K3;
+			}
+
+			t = ROTL(a, 5) + f + e + k + w[i & 15];
+			e = d;
+			d = c;
+			c = ROTL(b, 30);
+			b = a;
+			a = t;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		data += HASH_BLOCK_SIZE;
+	}
+}
+
+#ifdef HASH_X86
+static int sha1_ni_supported(void)
+{
+	unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+	if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+	{
+		return 0;
+	}
+
+	return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA);
+}
+
+/*
+ * Four rounds on the message vector of group g. While they run, the schedule
+ * for group g + 4 is advanced: sha1msg1 for g + 3, the xor for g + 2 and
+ * sha1msg2 for g + 1, each only while there is a later group to feed.
+ */
+#define SHA1_NI_GROUP(g, e_cur, e_next) \
+	e_cur = _mm_sha1nexte_epu32(e_cur, msg[(g) & 3]); \
+	e_next = abcd; \
+	if((g) >= 3 && (g) <= 18) msg[((g) + 1) & 3] = _mm_sha1msg2_epu32(msg[((g) + 1) & 3], msg[(g) & 3]); \
+	abcd = _mm_sha1rnds4_epu32(abcd, e_cur, (g) / 5); \
+	if((g) >= 1 && (g) <= 16) msg[((g) + 3) & 3] = _mm_sha1msg1_epu32(msg[((g) + 3) & 3], msg[(g) & 3]); \
+	if((g) >= 2 && (g) <= 17) msg[((g) + 2) & 3] = _mm_xor_si128(msg[((g) + 2) & 3], msg[(g) & 3])
+
+__attribute__((target("sha,sse4.1")))
+static void sha1_ni(uint32_t *state, const unsigned char *data, size_t nblocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+	__m128i abcd, abcd_save, e0, e0_save, e1, msg[4];
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) state), 0x1b);
+	e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+	while(nblocks--)
+	{
+		abcd_save = abcd;
+		e0_save = e0;
+
+		msg[0] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 0)), mask);
+		msg[1] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16)), mask);
+		msg[2] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 32)), mask);
+		msg[3] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 48)), mask);
+
+		/* Rounds 0-3 add e directly, every later group gets it from sha1nexte */
+		e0 = _mm_add_epi32(e0, msg[0]);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		SHA1_NI_GROUP(1, e1, e0);
+		SHA1_NI_GROUP(2, e0, e1);
+		SHA1_NI_GROUP(3, e1, e0);
+		SHA1_NI_GROUP(4, e0, e1);
+		SHA1_NI_GROUP(5, e1, e0);
+		SHA1_NI_GROUP(6, e0, e1);
+		SHA1_NI_GROUP(7, e1, e0);
+		SHA1_NI_GROUP(8, e0, e1);
+		SHA1_NI_GROUP(9, e1, e0);
+		SHA1_NI_GROUP(10, e0, e1);
+		SHA1_NI_GROUP(11, e1, e0);
+		SHA1_NI_GROUP(12, e0, e1);
+		SHA1_NI_GROUP(13, e1, e0);
+		SHA1_NI_GROUP(14, e0, e1);
+		SHA1_NI_GROUP(15, e1, e0);
+		SHA1_NI_GROUP(16, e0, e1);
+		SHA1_NI_GROUP(17, e1, e0);
+		SHA1_NI_GROUP(18, e0, e1);
+		SHA1_NI_GROUP(19, e1, e0);
+
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+		data += HASH_BLOCK_SIZE;
+	}
+
+	_mm_storeu_si128((__m128i *) state, _mm_shuffle_epi32(abcd, 0x1b));
+	state[4] = _mm_extract_epi32(e0, 3);
+}
+#endif
+
+const struct hash_kernel sha1_kernels[] = {
+	{ "generic", sha1_generic, sha1_always },
+#ifdef HASH_X86
+	{ "sha-ni", sha1_ni, sha1_ni_supported },
+#endif
+	{ NULL, NULL, NULL }
+};
+
+/* Nothing batches SHA-1, so hash_batch() uses the single buffer kernel */
+const struct hash_mb_kernel sha1_mb_kernels[] = {
+	{ NULL, 0, NULL, NULL }
+};
@@ -0,0 +1,802 @@
+/*
+ * Parallel data block pipeline for the single threaded unsquashfs variants.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * unsquash.c
+ *
+ * The reader -> deflator -> writer thread design of unsquashfs 4.2, with the
+ * on-disk format left to the caller.  The caller's directory scan queues
+ * each regular file as a list of (start, compressed size) data blocks and
+ * an optional fragment block, and the variant's block decoder is plugged in
+ * through struct unsquash_decoder.  Blocks are decompressed by one deflator
+ * thread per processor into a data and a fragment cache, and a single writer
+ * thread writes the files out in order, so the caller's metadata handling
+ * stays single threaded.  As in 4.2 the file and then each of its blocks
+ * are queued to the writer as they are looked up, so a file larger than the
+ * data cache is written while its later blocks are still being queued.
+ *
+ * The reader uses pread() so it doesn't disturb the file position used by
+ * the caller's own lseek()/read() metadata reads on the same descriptor.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "unsquash.h"
+
+#define TRUE 1
+#define FALSE 0
+
+#define ERROR(s, args...)		do { \
+						fprintf(stderr, s, ## args); \
+					} while(0)
+
+#define EXIT_UNSQUASH(s, args...)	do { \
+						fprintf(stderr, "FATAL ERROR aborting: "s, ## args); \
+						exit(1); \
+					} while(0)
+
+#define CALCULATE_HASH(start)	(start & 0xffff)
+
+/* default cache sizes in Mbytes, as unsquashfs 4.2 */
+#define DATA_BUFFER_DEFAULT	256
+#define FRAGMENT_BUFFER_DEFAULT	256
+
+/*
+ * file descriptors left free of the open file limit for stdin, stdout,
+ * stderr, the filesystem and the caller's own use
+ */
+#define OPEN_FILE_MARGIN	10
+
+struct unsquash_cache_entry {
+	struct unsquash_cache *cache;
+	long long block;
+	int c_byte;
+	int compressed;
+	int bytes;
+	int used;
+	int error;
+	int pending;
+	struct unsquash_cache_entry *hash_next;
+	struct unsquash_cache_entry *hash_prev;
+	struct unsquash_cache_entry *free_next;
+	struct unsquash_cache_entry *free_prev;
+	char *data;
+};
+
+struct unsquash_block {
+	struct unsquash_cache_entry *buffer;
+	int offset;
+	int size;
+};
+
+struct unsquash_cache {
+	int max_buffers;
+	int count;
+	int wait_free;
+	int wait_pending;
+	pthread_mutex_t mutex;
+	pthread_cond_t wait_for_free;
+	pthread_cond_t wait_for_pending;
+	struct unsquash_cache_entry *free_list;
+	struct unsquash_cache_entry *hash_table[65536];
+};
+
+struct queue {
+	int size;
+	int readp;
+	int writep;
+	pthread_mutex_t mutex;
+	pthread_cond_t empty;
+	pthread_cond_t full;
+	void **data;
+};
+
+static struct queue *to_reader, *to_deflate, *to_writer, *from_writer;
+static struct unsquash_cache *data_cache, *fragment_cache;
+static struct unsquash_decoder *decoder;
+static void (*file_done)(struct unsquash_file *);
+static int fd, block_size, lseek_broken = FALSE;
+static char *zero_data;
+
+/* files opened by unsquash_file_open() and not yet closed by the writer */
+static pthread_mutex_t open_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t open_empty = PTHREAD_COND_INITIALIZER;
+static int open_unlimited = TRUE, open_count;
+
+
+static struct queue *queue_init(int size)
+{
+	struct queue *queue = malloc(sizeof(struct queue));
+
+	if(queue == NULL)
+		EXIT_UNSQUASH("Out of memory in queue_init\n");
+
+	queue->data = malloc(sizeof(void *) * (size + 1));
+	if(queue->data == NULL)
+		EXIT_UNSQUASH("Out of memory in queue_init\n");
+
+	queue->size = size + 1;
+	queue->readp = queue->writep = 0;
+	pthread_mutex_init(&queue->mutex, NULL);
+	pthread_cond_init(&queue->empty, NULL);
+	pthread_cond_init(&queue->full, NULL);
+
+	return queue;
+}
+
+
+static void queue_put(struct queue *queue, void *data)
+{
+	int nextp;
+
+	pthread_mutex_lock(&queue->mutex);
+
+	while((nextp = (queue->writep + 1) % queue->size) == queue->readp)
+		pthread_cond_wait(&queue->full, &queue->mutex);
+
+	queue->data[queue->writep] = data;
+	queue->writep = nextp;
+	pthread_cond_signal(&queue->empty);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+
+static void *queue_get(struct queue *queue)
+{
+	void *data;
+
+	pthread_mutex_lock(&queue->mutex);
+
+	while(queue->readp == queue->writep)
+		pthread_cond_wait(&queue->empty, &queue->mutex);
+
+	data = queue->data[queue->readp];
+	queue->readp = (queue->readp + 1) % queue->size;
+	pthread_cond_signal(&queue->full);
+	pthread_mutex_unlock(&queue->mutex);
+
+	return data;
+}
+
+
+/* Called with the cache mutex held */
+static void insert_hash_table(struct unsquash_cache *cache,
+	struct unsquash_cache_entry *entry)
+{
+	int hash = CALCULATE_HASH(entry->block);
+
+	entry->hash_next = cache->hash_table[hash];
+	cache->hash_table[hash] = entry;
+	entry->hash_prev = NULL;
+	if(entry->hash_next)
+		entry->hash_next->hash_prev = entry;
+}
+
+
+/* Called with the cache mutex held */
+static void remove_hash_table(struct unsquash_cache *cache,
+	struct unsquash_cache_entry *entry)
+{
+	if(entry->hash_prev)
+		entry->hash_prev->hash_next = entry->hash_next;
+	else
+		cache->hash_table[CALCULATE_HASH(entry->block)] =
+			entry->hash_next;
+	if(entry->hash_next)
+		entry->hash_next->hash_prev = entry->hash_prev;
+
+	entry->hash_prev = entry->hash_next = NULL;
+}
+
+
+/* Called with the cache mutex held */
+static void insert_free_list(struct unsquash_cache *cache,
+	struct unsquash_cache_entry *entry)
+{
+	if(cache->free_list) {
+		entry->free_next = cache->free_list;
+		entry->free_prev = cache->free_list->free_prev;
+		cache->free_list->free_prev->free_next = entry;
+		cache->free_list->free_prev = entry;
+	} else {
+		cache->free_list = entry;
+		entry->free_prev = entry->free_next = entry;
+	}
+}
+
+
+/* Called with the cache mutex held */
+static void remove_free_list(struct unsquash_cache *cache,
+	struct unsquash_cache_entry *entry)
+{
+	if(entry->free_prev == NULL && entry->free_next == NULL)
+		/* not in free list */
+		return;
+	else if(entry->free_prev == entry && entry->free_next == entry) {
+		/* only this entry in the free list */
+		cache->free_list = NULL;
+	} else {
+		/* more than one entry in the free list */
+		entry->free_next->free_prev = entry->free_prev;
+		entry->free_prev->free_next = entry->free_next;
+		if(cache->free_list == entry)
+			cache->free_list = entry->free_next;
+	}
+
+	entry->free_prev = entry->free_next = NULL;
+}
+
+
+static struct unsquash_cache *cache_init(int max_buffers)
+{
+	struct unsquash_cache *cache = malloc(sizeof(struct unsquash_cache));
+
+	if(cache == NULL)
+		EXIT_UNSQUASH("Out of memory in cache_init\n");
+
+	cache->max_buffers = max_buffers;
+	cache->count = 0;
+	cache->free_list = NULL;
+	cache->wait_free = FALSE;
+	cache->wait_pending = FALSE;
+	memset(cache->hash_table, 0, sizeof(cache->hash_table));
+	pthread_mutex_init(&cache->mutex, NULL);
+	pthread_cond_init(&cache->wait_for_free, NULL);
+	pthread_cond_init(&cache->wait_for_pending, NULL);
+
+	return cache;
+}
+
+
+/*
+ * Get a block out of the cache.  If the block isn't in the cache it is added
+ * and queued to the reader and deflator threads.  The cache grows until
+ * max_buffers is reached, after that discarded blocks on the free list are
+ * reused, so a fragment shared by many small files is usually only
+ * decompressed once
+ */
+static struct unsquash_cache_entry *cache_get(struct unsquash_cache *cache,
+	long long block, int c_byte, int compressed)
+{
+	int hash = CALCULATE_HASH(block);
+	struct unsquash_cache_entry *entry;
+
+	pthread_mutex_lock(&cache->mutex);
+
+	for(entry = cache->hash_table[hash]; entry; entry = entry->hash_next)
+		if(entry->block == block)
+			break;
+
+	if(entry) {
+		entry->used ++;
+		remove_free_list(cache, entry);
+		pthread_mutex_unlock(&cache->mutex);
+		return entry;
+	}
+
+	if(cache->count < cache->max_buffers) {
+		entry = malloc(sizeof(struct unsquash_cache_entry));
+		if(entry == NULL)
+			EXIT_UNSQUASH("Out of memory in cache_get\n");
+		entry->data = malloc(block_size);
+		if(entry->data == NULL)
+			EXIT_UNSQUASH("Out of memory in cache_get\n");
+		entry->cache = cache;
+		entry->free_prev = entry->free_next = NULL;
+		cache->count ++;
+	} else {
+		while(cache->free_list == NULL) {
+			cache->wait_free = TRUE;
+			pthread_cond_wait(&cache->wait_for_free, &cache->mutex);
+		}
+		entry = cache->free_list;
+		remove_free_list(cache, entry);
+		remove_hash_table(cache, entry);
+	}
+
+	entry->block = block;
+	entry->c_byte = c_byte;
+	entry->compressed = compressed;
+	entry->bytes = 0;
+	entry->used = 1;
+	entry->error = FALSE;
+	entry->pending = TRUE;
+	insert_hash_table(cache, entry);
+
+	pthread_mutex_unlock(&cache->mutex);
+	queue_put(to_reader, entry);
+
+	return entry;
+}
+
+
+static void cache_block_ready(struct unsquash_cache_entry *entry, int error)
+{
+	struct unsquash_cache *cache = entry->cache;
+
+	pthread_mutex_lock(&cache->mutex);
+	entry->pending = FALSE;
+	entry->error = error;
+
+	if(cache->wait_pending) {
+		cache->wait_pending = FALSE;
+		pthread_cond_broadcast(&cache->wait_for_pending);
+	}
+
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+
+static void cache_block_wait(struct unsquash_cache_entry *entry)
+{
+	struct unsquash_cache *cache = entry->cache;
+
+	pthread_mutex_lock(&cache->mutex);
+
+	while(entry->pending) {
+		cache->wait_pending = TRUE;
+		pthread_cond_wait(&cache->wait_for_pending, &cache->mutex);
+	}
+
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+
+static void cache_block_put(struct unsquash_cache_entry *entry)
+{
+	struct unsquash_cache *cache = entry->cache;
+
+	pthread_mutex_lock(&cache->mutex);
+
+	entry->used --;
+	if(entry->used == 0) {
+		insert_free_list(cache, entry);
+
+		if(cache->wait_free) {
+			cache->wait_free = FALSE;
+			pthread_cond_broadcast(&cache->wait_for_free);
+		}
+	}
+
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+
+static int read_fs_bytes(long long byte, int bytes, char *buff)
+{
+	int res, count;
+
+	for(count = 0; count < bytes; count += res) {
+		res = pread(fd, buff + count, bytes - count, byte + count);
+		if(res < 1) {
+			if(res == 0) {
+				ERROR("Read on filesystem failed because EOF"
+					"\n");
+				return FALSE;
+			} else if(errno != EINTR) {
+				ERROR("Read on filesystem failed because %s\n",
+					strerror(errno));
+				return FALSE;
+			} else
+				res = 0;
+		}
+	}
+
+	return TRUE;
+}
+
+
+static int write_bytes(int file_fd, char *buff, int bytes)
+{
+	int res, count;
+
+	for(count = 0; count < bytes; count += res) {
+		res = write(file_fd, buff + count, bytes - count);
+		if(res == -1) {
+			if(errno != EINTR) {
+				ERROR("Write on output file failed because "
+					"%s\n", strerror(errno));
+				return -1;
+			}
+			res = 0;
+		}
+	}
+
+	return 0;
+}
+
+
+static int write_block(int file_fd, char *buffer, int size, long long hole)
+{
+	off_t off = hole;
+
+	if(hole) {
+		if(lseek_broken == FALSE && lseek(file_fd, off, SEEK_CUR) == -1)
+			/* failed to seek beyond end of file */
+			lseek_broken = TRUE;
+
+		if(lseek_broken) {
+			int blocks = (hole + block_size - 1) / block_size;
+			int avail_bytes, i;
+			for(i = 0; i < blocks; i++, hole -= avail_bytes) {
+				avail_bytes = hole > block_size ? block_size :
+					hole;
+				if(write_bytes(file_fd, zero_data, avail_bytes)
+						== -1)
+					return FALSE;
+			}
+		}
+	}
+
+	return write_bytes(file_fd, buffer, size) == -1 ? FALSE : TRUE;
+}
+
+
+/*
+ * reader thread.  This reads the compressed blocks queued by cache_get() and
+ * passes them on to the deflator threads
+ */
+static void *reader(void *arg)
+{
+	while(1) {
+		struct unsquash_cache_entry *entry = queue_get(to_reader);
+		int res = entry->c_byte <= block_size &&
+			read_fs_bytes(entry->block, entry->c_byte, entry->data);
+
+		if(res && entry->compressed)
+			queue_put(to_deflate, entry);
+		else {
+			entry->bytes = entry->c_byte;
+			cache_block_ready(entry, !res);
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * deflator thread.  One per processor, each with its own decoder state
+ */
+static void *deflator(void *arg)
+{
+	void *strm = NULL;
+	char *tmp = malloc(block_size);
+
+	if(tmp == NULL)
+		EXIT_UNSQUASH("Out of memory in deflator\n");
+
+	if(decoder->init && decoder->init(&strm))
+		EXIT_UNSQUASH("deflator: failed to initialise decoder\n");
+
+	while(1) {
+		struct unsquash_cache_entry *entry = queue_get(to_deflate);
+		int error, res;
+
+		res = decoder->decode(strm, tmp, entry->data, entry->c_byte,
+			block_size, &error);
+
+		if(res == -1)
+			ERROR("deflator: failed to decompress block 0x%llx, "
+				"error %d\n", entry->block, error);
+		else {
+			memcpy(entry->data, tmp, res);
+			entry->bytes = res;
+		}
+
+		cache_block_ready(entry, res == -1);
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Limit the number of files queued to the writer while still open, as
+ * unsquashfs 4.3 does.  The writer queue holds thousands of small files,
+ * each of which would otherwise hold a descriptor until it is written
+ */
+static void open_init(void)
+{
+	struct rlimit rlim;
+
+	if(getrlimit(RLIMIT_NOFILE, &rlim) == -1) {
+		ERROR("unsquash_init: getrlimit failed, no limit on open "
+			"files\n");
+		return;
+	}
+
+	if(rlim.rlim_cur == RLIM_INFINITY)
+		return;
+
+	if(rlim.rlim_cur <= OPEN_FILE_MARGIN)
+		EXIT_UNSQUASH("File descriptor limit too low (%lld), needs "
+			"to be more than %d\n", (long long) rlim.rlim_cur,
+			OPEN_FILE_MARGIN);
+
+	open_count = rlim.rlim_cur - OPEN_FILE_MARGIN;
+	open_unlimited = FALSE;
+}
+
+
+static void open_wait(void)
+{
+	if(open_unlimited)
+		return;
+
+	pthread_mutex_lock(&open_mutex);
+	while(open_count == 0)
+		pthread_cond_wait(&open_empty, &open_mutex);
+	open_count --;
+	pthread_mutex_unlock(&open_mutex);
+}
+
+
+static void open_close(void)
+{
+	if(open_unlimited)
+		return;
+
+	pthread_mutex_lock(&open_mutex);
+	open_count ++;
+	pthread_cond_signal(&open_empty);
+	pthread_mutex_unlock(&open_mutex);
+}
+
+
+/*
+ * writer thread.  This writes out the files queued by unsquash_file_open()
+ * in order, taking each of their blocks off the queue until the file itself
+ * is queued again by unsquash_file_close()
+ */
+static void *writer(void *arg)
+{
+	int i;
+
+	while(1) {
+		struct unsquash_file *file = queue_get(to_writer);
+		long long hole = 0;
+
+		if(file == NULL) {
+			queue_put(from_writer, NULL);
+			continue;
+		}
+
+		for(i = 0; ; i++) {
+			struct unsquash_block *block = queue_get(to_writer);
+
+			if(block == (struct unsquash_block *) file)
+				break;
+
+			if(block->buffer == NULL) { /* sparse file */
+				hole += block->size;
+				free(block);
+				continue;
+			}
+
+			cache_block_wait(block->buffer);
+
+			if(block->buffer->error || block->offset + block->size >
+					block->buffer->bytes) {
+				ERROR("writer: failed to read data block %d of "
+					"%s\n", i, file->pathname);
+				file->failed = TRUE;
+			}
+
+			if(file->failed == FALSE && write_block(file->fd,
+					block->buffer->data + block->offset,
+					block->size, hole) == FALSE) {
+				ERROR("writer: failed to write data block %d "
+					"of %s\n", i, file->pathname);
+				file->failed = TRUE;
+			}
+
+			hole = 0;
+			cache_block_put(block->buffer);
+			free(block);
+		}
+
+		if(hole && file->failed == FALSE) {
+			/*
+			 * corner case for hole extending to end of file
+			 */
+			if(lseek(file->fd, hole, SEEK_CUR) == -1) {
+				/*
+				 * for broken lseeks which cannot seek beyond
+				 * end of file, write_block will do the right
+				 * thing
+				 */
+				hole --;
+				if(write_block(file->fd, "\0", 1, hole) ==
+						FALSE)
+					file->failed = TRUE;
+			} else if(ftruncate(file->fd, file->file_size) == -1)
+				file->failed = TRUE;
+
+			if(file->failed)
+				ERROR("writer: failed to write sparse data "
+					"block of %s\n", file->pathname);
+		}
+
+		close(file->fd);
+		open_close();
+		file_done(file);
+		free(file->pathname);
+		free(file);
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Start the reader, deflator and writer threads for the filesystem on
+ * filesystem_fd.  Processors of 0 means one deflator per online processor,
+ * data_buffer_size and fragment_buffer_size are the size of the two caches
+ * in Mbytes (0 for the 4.2 default of 256 Mbytes), and done is called from
+ * the writer thread once each file has been written
+ */
+void unsquash_init(int filesystem_fd, int block, int processors,
+	int data_buffer_size, int fragment_buffer_size,
+	struct unsquash_decoder *block_decoder,
+	void (*done)(struct unsquash_file *))
+{
+	pthread_t thread;
+	int data_buffers, fragment_buffers, i;
+
+	fd = filesystem_fd;
+	block_size = block;
+	decoder = block_decoder;
+	file_done = done;
+
+	if(data_buffer_size < 1)
+		data_buffer_size = DATA_BUFFER_DEFAULT;
+	if(fragment_buffer_size < 1)
+		fragment_buffer_size = FRAGMENT_BUFFER_DEFAULT;
+	data_buffers = ((long long) data_buffer_size << 20) / block_size;
+	fragment_buffers = ((long long) fragment_buffer_size << 20) / block_size;
+	if(data_buffers < 1)
+		data_buffers = 1;
+	if(fragment_buffers < 1)
+		fragment_buffers = 1;
+
+	if(processors < 1)
+		processors = sysconf(_SC_NPROCESSORS_ONLN);
+	if(processors < 1)
+		processors = 1;
+
+	zero_data = calloc(1, block_size);
+	if(zero_data == NULL)
+		EXIT_UNSQUASH("Out of memory allocating zero data block\n");
+
+	open_init();
+
+	to_reader = queue_init(data_buffers + fragment_buffers);
+	to_deflate = queue_init(data_buffers + fragment_buffers);
+	to_writer = queue_init(data_buffers + fragment_buffers);
+	from_writer = queue_init(1);
+	data_cache = cache_init(data_buffers);
+	fragment_cache = cache_init(fragment_buffers);
+
+	if(pthread_create(&thread, NULL, reader, NULL) != 0 ||
+			pthread_create(&thread, NULL, writer, NULL) != 0)
+		EXIT_UNSQUASH("Failed to create thread\n");
+
+	for(i = 0; i < processors; i++)
+		if(pthread_create(&thread, NULL, deflator, NULL) != 0)
+			EXIT_UNSQUASH("Failed to create thread\n");
+
+	printf("Parallel unsquashfs: Using %d processor%s\n", processors,
+		processors == 1 ? "" : "s");
+}
+
+
+/*
+ * Create pathname and queue it to the writer thread, its data follows as
+ * the blocks and fragment added with unsquash_file_block() and
+ * unsquash_file_fragment().  Waits for the writer to close an earlier file
+ * if the open file limit has been reached.  Returns NULL with errno set if
+ * the file can't be created
+ */
+struct unsquash_file *unsquash_file_open(char *pathname, int flags, int mode,
+	long long file_size)
+{
+	struct unsquash_file *file;
+	int file_fd, err;
+
+	open_wait();
+	file_fd = open(pathname, O_CREAT | O_WRONLY | flags, (mode_t) mode);
+	if(file_fd == -1) {
+		err = errno;
+		open_close();
+		errno = err;
+		return NULL;
+	}
+
+	file = calloc(1, sizeof(struct unsquash_file));
+	if(file == NULL || (file->pathname = strdup(pathname)) == NULL)
+		EXIT_UNSQUASH("unsquash_file_open: unable to malloc file\n");
+
+	file->fd = file_fd;
+	file->file_size = file_size;
+	queue_put(to_writer, file);
+
+	return file;
+}
+
+
+static void queue_block(struct unsquash_cache_entry *buffer, int offset,
+	int size)
+{
+	struct unsquash_block *block = malloc(sizeof(struct unsquash_block));
+
+	if(block == NULL)
+		EXIT_UNSQUASH("queue_block: unable to malloc block\n");
+
+	block->buffer = buffer;
+	block->offset = offset;
+	block->size = size;
+	queue_put(to_writer, block);
+}
+
+
+/*
+ * Add the next data block of the file, c_byte bytes at start which
+ * decompress to size bytes.  A c_byte of 0 is a sparse block of size bytes
+ */
+void unsquash_file_block(struct unsquash_file *file, long long start,
+	int c_byte, int compressed, int size)
+{
+	queue_block(c_byte ? cache_get(data_cache, start, c_byte, compressed) :
+		NULL, 0, size);
+}
+
+
+/*
+ * Add the file's tail, size bytes at offset in the fragment block of c_byte
+ * bytes at start
+ */
+void unsquash_file_fragment(struct unsquash_file *file, long long start,
+	int c_byte, int compressed, int offset, int size)
+{
+	queue_block(cache_get(fragment_cache, start, c_byte, compressed),
+		offset, size);
+}
+
+
+/*
+ * Mark the end of the file's data.  The writer thread calls the done
+ * callback and frees the file once it has been written
+ */
+void unsquash_file_close(struct unsquash_file *file)
+{
+	queue_put(to_writer, file);
+}
+
+
+/* Wait for the writer thread to write every queued file */
+void unsquash_finish()
+{
+	queue_put(to_writer, NULL);
+	queue_get(from_writer);
+}
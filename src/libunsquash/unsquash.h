@@ -0,0 +1,66 @@
+#ifndef UNSQUASH_H
+#define UNSQUASH_H
+/*
+ * Parallel data block pipeline for the single threaded unsquashfs variants.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * unsquash.h
+ */
+
+#include <sys/types.h>
+#include <time.h>
+
+/*
+ * Block decoder for one squashfs variant.  init allocates the per-thread
+ * state passed to decode (it may be NULL if decode needs none), decode
+ * decompresses size bytes of src into at most outsize bytes of dest and
+ * returns the decompressed size, or -1 with a decoder specific code in
+ * *error
+ */
+struct unsquash_decoder {
+	int (*init)(void **);
+	int (*decode)(void *, void *, void *, int, int, int *);
+};
+
+struct unsquash_cache_entry;
+
+/*
+ * A regular file being written by the writer thread.  The caller fills in
+ * the attributes before unsquash_file_close(), they are only used by its
+ * done callback once the data has been written.  failed is set if any
+ * block couldn't be read or written
+ */
+struct unsquash_file {
+	char *pathname;
+	int fd;
+	long long file_size;
+	unsigned int mode;
+	unsigned int uid;
+	unsigned int guid;
+	time_t mtime;
+	int failed;
+};
+
+extern void unsquash_init(int, int, int, int, int, struct unsquash_decoder *,
+	void (*)(struct unsquash_file *));
+extern struct unsquash_file *unsquash_file_open(char *, int, int, long long);
+extern void unsquash_file_block(struct unsquash_file *, long long, int, int,
+	int);
+extern void unsquash_file_fragment(struct unsquash_file *, long long, int,
+	int, int, int);
+extern void unsquash_file_close(struct unsquash_file *);
+extern void unsquash_finish();
+#endif
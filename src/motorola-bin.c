@@ -36,32 +36,11 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <netinet/in.h>
-
-unsigned long *crc32;
-
-void init_crc32()
-{
-    unsigned long crc;
-    unsigned long poly = ntohl(0x2083b8ed);
-    int n, bit;
-    if ((crc32 = (unsigned long *) malloc(256 * sizeof(unsigned long))) == (void *)-1) {
-       perror("malloc");
-       exit(1);
-    }
-    for (n = 0; n < 256; n++) {
-        crc = (unsigned long) n;
-        for (bit = 0; bit < 8; bit++)
-            crc = (crc & 1) ? (poly ^ (crc >> 1)) : (crc >> 1);
-        crc32[n] = crc;
-    }
-}
+#include "libcrc32.h"
 
 unsigned int crc32buf(char *buf, size_t len)
 {
-    unsigned int crc = 0xFFFFFFFF;
-    for (; len; len--, buf++)
-        crc = crc32[(crc ^ *buf) & 0xff] ^ (crc >> 8);
-    return crc;
+    return crc32_update(0xFFFFFFFF, buf, len);
 }
 
 struct motorola {
@@ -110,7 +89,6 @@ int main(int argc, char **argv)
 	munmap(trx,len);
 
 	// setup the motorola headers
-	init_crc32();
 
 	// setup the firmware magic
 
@@ -48,6 +48,7 @@
 #include "global.h"
 #include "sqlzma.h"
 #include "sqmagic.h"
+#include "unsquash.h"
 
 #include <stdlib.h>
 
@@ -75,7 +76,7 @@ struct hash_table_entry {
 
 typedef struct squashfs_operations {
 	struct dir	*(*squashfs_opendir)(unsigned int block_start, unsigned int offset);
-	char 		*(*read_fragment)(unsigned int fragment);
+	void		(*read_fragment)(unsigned int fragment, long long *start_block, int *size);
 	void		(*read_fragment_table)();
 	int		(*create_inode)(char *pathname, unsigned int start_block, unsigned int offset);
 } squashfs_operations;
@@ -91,12 +92,8 @@ int fd;
 squashfs_fragment_entry *fragment_table;
 squashfs_fragment_entry_2 *fragment_table_2;
 unsigned int *uid_table, *guid_table;
-unsigned int cached_frag = SQUASHFS_INVALID_FRAG;
-char *fragment_data;
-char *file_data;
-char *data;
 unsigned int block_size;
-int lsonly = FALSE, info = FALSE, force = FALSE;
+int lsonly = FALSE, info = FALSE, force = FALSE, processors = 0;
 char **created_inode;
 int root_process;
 struct sqlzma_un un;
@@ -211,38 +208,41 @@ failed:
 }
 
 
-int read_data_block(long long start, unsigned int size, char *block)
+/*
+ * Data block decoder for the parallel pipeline.  Each deflator thread has
+ * its own sqlzma state, set up for the compression found by read_super()
+ */
+int init_data_block(void **strm)
 {
-	int res;
-	unsigned long bytes = block_size;
-	int c_byte = SQUASHFS_COMPRESSED_SIZE_BLOCK(size);
+	struct sqlzma_un *thread_un = malloc(sizeof(struct sqlzma_un));
 
-	TRACE("read_data_block: block @0x%llx, %d %s bytes\n", start, SQUASHFS_COMPRESSED_SIZE_BLOCK(c_byte), SQUASHFS_COMPRESSED_BLOCK(c_byte) ? "compressed" : "uncompressed");
+	if(thread_un == NULL || sqlzma_init(thread_un, un.un_lzma, 0) != Z_OK)
+		return -1;
 
-	if(SQUASHFS_COMPRESSED_BLOCK(size)) {
-		enum {Src, Dst};
-		struct sized_buf sbuf[] = {
-			{.buf = data, .sz = c_byte},
-			{.buf = block, .sz = bytes}
-		};
+	*strm = thread_un;
+	return 0;
+}
 
-		if(read_bytes(start, c_byte, data) == FALSE)
-			return 0;
 
-		res = sqlzma_un(&un, sbuf + Src, sbuf + Dst);
-		if (res)
-			abort();
-		bytes = un.un_reslen;
-		return bytes;
-	} else {
-		if(read_bytes(start, c_byte, block) == FALSE)
-			return 0;
+int decode_data_block(void *strm, void *dest, void *src, int size, int outsize, int *error)
+{
+	struct sqlzma_un *thread_un = strm;
+	enum {Src, Dst};
+	struct sized_buf sbuf[] = {
+		{.buf = src, .sz = size},
+		{.buf = dest, .sz = outsize}
+	};
 
-		return c_byte;
-	}
+	if((*error = sqlzma_un(thread_un, sbuf + Src, sbuf + Dst)) != 0)
+		return -1;
+
+	return thread_un->un_reslen;
 }
 
 
+struct unsquash_decoder decoder = { init_data_block, decode_data_block };
+
+
 void uncompress_inode_table(long long start, long long end)
 {
 	int size = 0, bytes = 0, res;
@@ -394,48 +394,32 @@ void read_fragment_table_2()
 }
 
 
-char *read_fragment(unsigned int fragment)
+void read_fragment(unsigned int fragment, long long *start_block, int *size)
 {
 	TRACE("read_fragment: reading fragment %d\n", fragment);
 
-	if(cached_frag == SQUASHFS_INVALID_FRAG || fragment != cached_frag) {
-		squashfs_fragment_entry *fragment_entry = &fragment_table[fragment];
-		if(read_data_block(fragment_entry->start_block, fragment_entry->size, fragment_data) == 0) {
-			ERROR("read_fragment: failed to read fragment %d\n", fragment);
-			cached_frag = SQUASHFS_INVALID_FRAG;
-			return NULL;
-		}
-		cached_frag = fragment;
-	}
-
-	return fragment_data;
+	*start_block = fragment_table[fragment].start_block;
+	*size = fragment_table[fragment].size;
 }
 
 
-char *read_fragment_2(unsigned int fragment)
+void read_fragment_2(unsigned int fragment, long long *start_block, int *size)
 {
 	TRACE("read_fragment: reading fragment %d\n", fragment);
 
-	if(cached_frag == SQUASHFS_INVALID_FRAG || fragment != cached_frag) {
-		squashfs_fragment_entry_2 *fragment_entry = &fragment_table_2[fragment];
-		if(read_data_block(fragment_entry->start_block, fragment_entry->size, fragment_data) == 0) {
-			ERROR("read_fragment: failed to read fragment %d\n", fragment);
-			cached_frag = SQUASHFS_INVALID_FRAG;
-			return NULL;
-		}
-		cached_frag = fragment;
-	}
-
-	return fragment_data;
+	*start_block = fragment_table_2[fragment].start_block;
+	*size = fragment_table_2[fragment].size;
 }
 
 
 int write_file(char *pathname, unsigned int fragment, unsigned int frag_bytes,
 unsigned int offset, unsigned int blocks, long long start, char *block_ptr,
-unsigned int mode)
+long long file_size, unsigned int mode, unsigned int uid, unsigned int guid,
+unsigned int mtime)
 {
-	unsigned int file_fd, bytes, i;
+	unsigned int i;
 	unsigned int *block_list;
+	struct unsquash_file *file;
 
 	TRACE("write_file: regular file, blocks %d\n", blocks);
 
@@ -451,46 +435,53 @@ unsigned int mode)
 	} else
 		memcpy(block_list, block_ptr, blocks * sizeof(unsigned int));
 
-	if((file_fd = open(pathname, O_CREAT | O_WRONLY | (force ? O_TRUNC : 0), (mode_t) mode & 0777)) == -1) {
+	if((file = unsquash_file_open(pathname, force ? O_TRUNC : 0, mode & 0777, file_size)) == NULL) {
 		ERROR("write_file: failed to create file %s, because %s\n", pathname,
 			strerror(errno));
 		free(block_list);
 		return FALSE;
 	}
 
-	for(i = 0; i < blocks; i++) {
-		if((bytes = read_data_block(start, block_list[i], file_data)) == 0) {
-			ERROR("write_file: failed to read data block 0x%llx\n", start);
-			goto failure;
-		}
+	file->mode = mode;
+	file->uid = uid;
+	file->guid = guid;
+	file->mtime = mtime;
 
-		if(write(file_fd, file_data, bytes) < bytes) {
-			ERROR("write_file: failed to write data block 0x%llx\n", start);
-			goto failure;
-		}
+	/*
+	 * The blocks are read, decompressed and written by the reader,
+	 * deflator and writer threads, which call file_done() once the file
+	 * is complete
+	 */
+	for(i = 0; i < blocks; i++) {
+		int c_byte = SQUASHFS_COMPRESSED_SIZE_BLOCK(block_list[i]);
 
-		start += SQUASHFS_COMPRESSED_SIZE_BLOCK(block_list[i]);
+		unsquash_file_block(file, start, c_byte, SQUASHFS_COMPRESSED_BLOCK(block_list[i]),
+			i == blocks - 1 && frag_bytes == 0 ? file_size - (long long) i * block_size : block_size);
+		start += c_byte;
 	}
 
 	if(frag_bytes != 0) {
-		char *fragment_data = s_ops.read_fragment(fragment);
-
-		if(fragment_data == NULL)
-			goto failure;
+		long long frag_start;
+		int size;
 
-		if(write(file_fd, fragment_data + offset, frag_bytes) < frag_bytes) {
-			ERROR("write_file: failed to write fragment %d\n", fragment);
-			goto failure;
-		}
+		s_ops.read_fragment(fragment, &frag_start, &size);
+		unsquash_file_fragment(file, frag_start, SQUASHFS_COMPRESSED_SIZE_BLOCK(size),
+			SQUASHFS_COMPRESSED_BLOCK(size), offset, frag_bytes);
 	}
 
-	close(file_fd);
+	unsquash_file_close(file);
+	free(block_list);
 	return TRUE;
+}
 
-failure:
-	close(file_fd);
-	free(block_list);
-	return FALSE;
+
+void file_done(struct unsquash_file *file)
+{
+	if(file->failed)
+		return;
+
+	set_attributes(file->pathname, file->mode, file->uid, file->guid, file->mtime, force);
+	file_count ++;
 }
 		
 
@@ -555,12 +546,10 @@ int create_inode(char *pathname, unsigned int start_block, unsigned int offset)
 
 			TRACE("create_inode: regular file, file_size %lld, blocks %d\n", inode->file_size, blocks);
 
-			if(write_file(pathname, inode->fragment, frag_bytes,
-					offset, blocks, start, block_ptr +
-					sizeof(*inode), inode->mode)) {
-				set_attributes(pathname, inode->mode, inode->uid, inode->guid, inode->mtime, force);
-				file_count ++;
-			}
+			write_file(pathname, inode->fragment, frag_bytes,
+				offset, blocks, start, block_ptr +
+				sizeof(*inode), inode->file_size, inode->mode,
+				inode->uid, inode->guid, inode->mtime);
 			break;
 		}	
 		case SQUASHFS_LREG_TYPE: {
@@ -588,12 +577,10 @@ int create_inode(char *pathname, unsigned int start_block, unsigned int offset)
 
 			TRACE("create_inode: regular file, file_size %lld, blocks %d\n", inode->file_size, blocks);
 
-			if(write_file(pathname, inode->fragment, frag_bytes,
-					offset, blocks, start, block_ptr +
-					sizeof(*inode), inode->mode)) {
-				set_attributes(pathname, inode->mode, inode->uid, inode->guid, inode->mtime, force);
-				file_count ++;
-			}
+			write_file(pathname, inode->fragment, frag_bytes,
+				offset, blocks, start, block_ptr +
+				sizeof(*inode), inode->file_size, inode->mode,
+				inode->uid, inode->guid, inode->mtime);
 			break;
 		}	
 		case SQUASHFS_SYMLINK_TYPE: {
@@ -746,12 +733,10 @@ int create_inode_2(char *pathname, unsigned int start_block, unsigned int offset
 
 			TRACE("create_inode: regular file, file_size %lld, blocks %d\n", inode->file_size, blocks);
 
-			if(write_file(pathname, inode->fragment, frag_bytes,
-					offset, blocks, start, block_ptr +
-					sizeof(*inode), inode->mode)) {
-				set_attributes(pathname, inode->mode, inode->uid, inode->guid, inode->mtime, force);
-				file_count ++;
-			}
+			write_file(pathname, inode->fragment, frag_bytes,
+				offset, blocks, start, block_ptr +
+				sizeof(*inode), inode->file_size, inode->mode,
+				inode->uid, inode->guid, inode->mtime);
 			break;
 		}	
 		case SQUASHFS_SYMLINK_TYPE: {
@@ -1343,6 +1328,10 @@ int main(int argc, char *argv[])
 			dest = argv[i];
 		} else if(strcmp(argv[i], "-force") == 0 || strcmp(argv[i], "-f") == 0)
 			force = TRUE;
+		else if(strcmp(argv[i], "-processors") == 0 || strcmp(argv[i], "-p") == 0) {
+			if(++i == argc || (processors = atoi(argv[i])) < 1)
+				goto options;
+		}
 	}
 
 	if(i == argc) {
@@ -1354,6 +1343,7 @@ options:
 			ERROR("\t-l[s]\t\t\tlist filesystem only\n");
 			ERROR("\t-d[est] <pathname>\tunsquash to <pathname>, default \"squashfs-root\"\n");
 			ERROR("\t-f[orce]\t\tif file already exists then overwrite\n");
+			ERROR("\t-p[rocessors] <number>\tuse <number> processors to decompress, by\n\t\t\t\tdefault as many as are online\n");
 		}
 		exit(1);
 	}
@@ -1370,14 +1360,6 @@ options:
 		exit(1);
 
 	block_size = sBlk.block_size;
-	if((fragment_data = malloc(block_size)) == NULL)
-		EXIT_UNSQUASH("failed to allocate fragment_data\n");
-
-	if((file_data = malloc(block_size)) == NULL)
-		EXIT_UNSQUASH("failed to allocate file_data");
-
-	if((data = malloc(block_size)) == NULL)
-		EXIT_UNSQUASH("failed to allocate datan\n");
 
 	if((created_inode = malloc(sBlk.inodes * sizeof(char *))) == NULL)
 		EXIT_UNSQUASH("failed to allocate created_inode\n");
@@ -1394,9 +1376,14 @@ options:
 	uncompress_inode_table(sBlk.inode_table_start, sBlk.directory_table_start);
 	uncompress_directory_table(sBlk.directory_table_start, sBlk.fragment_table_start);
 
+	if(!lsonly)
+		unsquash_init(fd, block_size, processors, 0, 0, &decoder, file_done);
+
 	dir_scan(dest, SQUASHFS_INODE_BLK(sBlk.root_inode), SQUASHFS_INODE_OFFSET(sBlk.root_inode), target);
 
 	if(!lsonly) {
+		unsquash_finish();
+
 		printf("\n");
 		printf("created %d files\n", file_count);
 		printf("created %d directories\n", dir_count);
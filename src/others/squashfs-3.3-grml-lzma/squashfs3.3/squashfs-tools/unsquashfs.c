@@ -54,6 +54,7 @@
 #include "global.h"
 #include "sqlzma.h"
 #include "sqmagic.h"
+#include "unsquash.h"
 
 #include <stdlib.h>
 #include <time.h>
@@ -83,7 +84,7 @@ struct hash_table_entry {
 
 typedef struct squashfs_operations {
 	struct dir *(*squashfs_opendir)(char *pathname, unsigned int block_start, unsigned int offset);
-	char *(*read_fragment)(unsigned int fragment);
+	void (*read_fragment)(unsigned int fragment, long long *start_block, int *size);
 	void (*read_fragment_table)();
 	void (*read_block_list)(unsigned int *block_list, unsigned char *block_ptr, int blocks);
 	struct inode *(*read_inode)(unsigned int start_block, unsigned int offset);
@@ -125,12 +126,9 @@ int fd;
 squashfs_fragment_entry *fragment_table;
 squashfs_fragment_entry_2 *fragment_table_2;
 unsigned int *uid_table, *guid_table;
-unsigned int cached_frag = SQUASHFS_INVALID_FRAG;
-char *fragment_data;
-char *file_data;
-char *data;
 unsigned int block_size;
 int lsonly = FALSE, info = FALSE, force = FALSE, short_ls = TRUE, use_regex = FALSE;
+int processors = 0;
 char **created_inode;
 int root_process;
 struct sqlzma_un un;
@@ -355,38 +353,41 @@ failed:
 }
 
 
-int read_data_block(long long start, unsigned int size, char *block)
+/*
+ * Data block decoder for the parallel pipeline.  Each deflator thread has
+ * its own sqlzma state, set up for the compression found by read_super()
+ */
+int init_data_block(void **strm)
 {
-	int res;
-	unsigned long bytes = block_size;
-	int c_byte = SQUASHFS_COMPRESSED_SIZE_BLOCK(size);
+	struct sqlzma_un *thread_un = malloc(sizeof(struct sqlzma_un));
 
-	TRACE("read_data_block: block @0x%llx, %d %s bytes\n", start, SQUASHFS_COMPRESSED_SIZE_BLOCK(c_byte), SQUASHFS_COMPRESSED_BLOCK(c_byte) ? "compressed" : "uncompressed");
+	if(thread_un == NULL || sqlzma_init(thread_un, un.un_lzma, 0) != Z_OK)
+		return -1;
 
-	if(SQUASHFS_COMPRESSED_BLOCK(size)) {
-		enum {Src, Dst};
-		struct sized_buf sbuf[] = {
-			{.buf = (void *)data, .sz = c_byte},
-			{.buf = (void *)block, .sz = bytes}
-		};
+	*strm = thread_un;
+	return 0;
+}
 
-		if(read_bytes(start, c_byte, data) == FALSE)
-			return 0;
 
-		res = sqlzma_un(&un, sbuf + Src, sbuf + Dst);
-		if (res)
-			abort();
-		bytes = un.un_reslen;
-		return bytes;
-	} else {
-		if(read_bytes(start, c_byte, block) == FALSE)
-			return 0;
+int decode_data_block(void *strm, void *dest, void *src, int size, int outsize, int *error)
+{
+	struct sqlzma_un *thread_un = strm;
+	enum {Src, Dst};
+	struct sized_buf sbuf[] = {
+		{.buf = (void *)src, .sz = size},
+		{.buf = (void *)dest, .sz = outsize}
+	};
 
-		return c_byte;
-	}
+	if((*error = sqlzma_un(thread_un, sbuf + Src, sbuf + Dst)) != 0)
+		return -1;
+
+	return thread_un->un_reslen;
 }
 
 
+struct unsquash_decoder decoder = { init_data_block, decode_data_block };
+
+
 void read_block_list(unsigned int *block_list, unsigned char *block_ptr, int blocks)
 {
 	if(swap) {
@@ -567,91 +568,35 @@ void read_fragment_table_1()
 }
 
 
-char *read_fragment(unsigned int fragment)
+void read_fragment(unsigned int fragment, long long *start_block, int *size)
 {
 	TRACE("read_fragment: reading fragment %d\n", fragment);
 
-	if(cached_frag == SQUASHFS_INVALID_FRAG || fragment != cached_frag) {
-		squashfs_fragment_entry *fragment_entry = &fragment_table[fragment];
-		if(read_data_block(fragment_entry->start_block, fragment_entry->size, fragment_data) == 0) {
-			ERROR("read_fragment: failed to read fragment %d\n", fragment);
-			cached_frag = SQUASHFS_INVALID_FRAG;
-			return NULL;
-		}
-		cached_frag = fragment;
-	}
-
-	return fragment_data;
+	*start_block = fragment_table[fragment].start_block;
+	*size = fragment_table[fragment].size;
 }
 
 
-char *read_fragment_2(unsigned int fragment)
+void read_fragment_2(unsigned int fragment, long long *start_block, int *size)
 {
 	TRACE("read_fragment: reading fragment %d\n", fragment);
 
-	if(cached_frag == SQUASHFS_INVALID_FRAG || fragment != cached_frag) {
-		squashfs_fragment_entry_2 *fragment_entry = &fragment_table_2[fragment];
-		if(read_data_block(fragment_entry->start_block, fragment_entry->size, fragment_data) == 0) {
-			ERROR("read_fragment: failed to read fragment %d\n", fragment);
-			cached_frag = SQUASHFS_INVALID_FRAG;
-			return NULL;
-		}
-		cached_frag = fragment;
-	}
-
-	return fragment_data;
+	*start_block = fragment_table_2[fragment].start_block;
+	*size = fragment_table_2[fragment].size;
 }
 
 
-int lseek_broken = FALSE;
-char *zero_data;
-long long hole;
-
-int write_block(int file_fd, char *buffer, int size)
-{
-	off_t off = hole;
-
-	if(hole) {
-		if(lseek_broken == FALSE && lseek(file_fd, off, SEEK_CUR) == -1) {
-			/* failed to seek beyond end of file */
-			if((zero_data = malloc(block_size)) == NULL)
-				EXIT_UNSQUASH("write_block: failed to alloc zero data block\n");
-			memset(zero_data, 0, block_size);
-			lseek_broken = TRUE;
-		}
-		if(lseek_broken) {
-			int blocks = (hole + block_size -1) / block_size;
-			int avail_bytes, i;
-			for(i = 0; i < blocks; i++, hole -= avail_bytes) {
-				avail_bytes = hole > block_size ? block_size : hole;
-				if(write(file_fd, zero_data, avail_bytes) < avail_bytes)
-					goto failure;
-			}
-		}
-		hole = 0;
-	}
-
-	if(write(file_fd, buffer, size) < size)
-		goto failure;
-
-	return TRUE;
-
-failure:
-	return FALSE;
-}
-
-	
 int write_file(long long file_size, char *pathname, unsigned int fragment, unsigned int frag_bytes,
-unsigned int offset, unsigned int blocks, long long start, char *block_ptr,
-unsigned int mode)
+unsigned int offset, int blocks, long long start, char *block_ptr,
+unsigned int mode, uid_t uid, gid_t guid, time_t time)
 {
-	unsigned int file_fd, bytes, i;
+	unsigned int i;
 	unsigned int *block_list;
 	int file_end = file_size / block_size;
+	struct unsquash_file *file;
 
 	TRACE("write_file: regular file, blocks %d\n", blocks);
 
-	hole = 0;
 	if((block_list = malloc(blocks * sizeof(unsigned int))) == NULL) {
 		ERROR("write_file: unable to malloc block list\n");
 		return FALSE;
@@ -659,60 +604,53 @@ unsigned int mode)
 
 	s_ops.read_block_list(block_list, block_ptr, blocks);
 
-	if((file_fd = open(pathname, O_CREAT | O_WRONLY | (force ? O_TRUNC : 0), (mode_t) mode & 0777)) == -1) {
+	if((file = unsquash_file_open(pathname, force ? O_TRUNC : 0, mode & 0777, file_size)) == NULL) {
 		ERROR("write_file: failed to create file %s, because %s\n", pathname,
 			strerror(errno));
 		free(block_list);
 		return FALSE;
 	}
 
-	for(i = 0; i < blocks; i++) {
-		if(block_list[i] == 0) { /* sparse file */
-			hole += i == file_end ? file_size & (block_size - 1) : block_size;
-			continue;
-		}
-		if((bytes = read_data_block(start, block_list[i], file_data)) == 0) {
-			ERROR("write_file: failed to read data block 0x%llx\n", start);
-			goto failure;
-		}
+	file->mode = mode;
+	file->uid = uid;
+	file->guid = guid;
+	file->mtime = time;
 
-		if(write_block(file_fd, file_data, bytes) == FALSE) {
-			ERROR("write_file: failed to write data block 0x%llx\n", start);
-			goto failure;
-		}
+	/*
+	 * The blocks are read, decompressed and written by the reader,
+	 * deflator and writer threads, which call file_done() once the file
+	 * is complete.  A block_list entry of 0 is a sparse block
+	 */
+	for(i = 0; i < blocks; i++) {
+		int c_byte = SQUASHFS_COMPRESSED_SIZE_BLOCK(block_list[i]);
 
-		start += SQUASHFS_COMPRESSED_SIZE_BLOCK(block_list[i]);
+		unsquash_file_block(file, start, c_byte, SQUASHFS_COMPRESSED_BLOCK(block_list[i]),
+			i == file_end ? file_size & (block_size - 1) : block_size);
+		start += c_byte;
 	}
 
 	if(frag_bytes != 0) {
-		char *fragment_data = s_ops.read_fragment(fragment);
-
-		if(fragment_data == NULL)
-			goto failure;
-
-		if(write_block(file_fd, fragment_data + offset, frag_bytes) == FALSE) {
-			ERROR("write_file: failed to write fragment %d\n", fragment);
-			goto failure;
-		}
-	}
+		long long frag_start;
+		int size;
 
-	if(hole) {
-		/* corner case for hole extending to end of file */
-		hole --;
-		if(write_block(file_fd, "\0", 1) == FALSE) {
-			ERROR("write_file: failed to write sparse data block\n");
-			goto failure;
-		}
+		s_ops.read_fragment(fragment, &frag_start, &size);
+		unsquash_file_fragment(file, frag_start, SQUASHFS_COMPRESSED_SIZE_BLOCK(size),
+			SQUASHFS_COMPRESSED_BLOCK(size), offset, frag_bytes);
 	}
 
-	close(file_fd);
+	unsquash_file_close(file);
 	free(block_list);
 	return TRUE;
+}
 
-failure:
-	close(file_fd);
-	free(block_list);
-	return FALSE;
+
+void file_done(struct unsquash_file *file)
+{
+	if(file->failed)
+		return;
+
+	set_attributes(file->pathname, file->mode, file->uid, file->guid, file->mtime, force);
+	file_count ++;
 }
 
 
@@ -882,11 +820,8 @@ int create_inode(char *pathname, struct inode *i)
 		case SQUASHFS_LREG_TYPE:
 			TRACE("create_inode: regular file, file_size %lld, blocks %d\n", i->data, i->blocks);
 
-			if(write_file(i->data, pathname, i->fragment, i->frag_bytes,
-					i->offset, i->blocks, i->start, i->block_ptr, i->mode)) {
-				set_attributes(pathname, i->mode, i->uid, i->gid, i->time, force);
-				file_count ++;
-			}
+			write_file(i->data, pathname, i->fragment, i->frag_bytes, i->offset, i->blocks,
+				i->start, i->block_ptr, i->mode, i->uid, i->gid, i->time);
 			break;
 		case SQUASHFS_SYMLINK_TYPE:
 			TRACE("create_inode: symlink, symlink_size %d\n", i->data);
@@ -1917,6 +1852,12 @@ int main(int argc, char *argv[])
 			path = process_extract_files(path, argv[i]);
 		} else if(strcmp(argv[i], "-regex") == 0 || strcmp(argv[i], "-r") == 0)
 			use_regex = TRUE;
+		else if(strcmp(argv[i], "-processors") == 0 || strcmp(argv[i], "-p") == 0) {
+			if(++i == argc || (processors = atoi(argv[i])) < 1) {
+				fprintf(stderr, "%s: -processors should be 1 or more\n", argv[0]);
+				exit(1);
+			}
+		}
 		else
 			goto options;
 	}
@@ -1935,6 +1876,7 @@ options:
 			ERROR("\t-s[tat]\t\t\tdisplay filesystem superblock information\n");
 			ERROR("\t-e[f] <extract file>\tlist of directories or files to extract.\n\t\t\t\tOne per line\n");
 			ERROR("\t-r[egex]\t\ttreat extract names as POSIX regular expressions\n\t\t\t\trather than use the default shell wildcard\n\t\t\t\texpansion (globbing)\n");
+			ERROR("\t-p[rocessors] <number>\tuse <number> processors to decompress, by\n\t\t\t\tdefault as many as are online\n");
 		}
 		exit(1);
 	}
@@ -1957,15 +1899,6 @@ options:
 
 	block_size = sBlk.block_size;
 
-	if((fragment_data = malloc(block_size)) == NULL)
-		EXIT_UNSQUASH("failed to allocate fragment_data\n");
-
-	if((file_data = malloc(block_size)) == NULL)
-		EXIT_UNSQUASH("failed to allocate file_data");
-
-	if((data = malloc(block_size)) == NULL)
-		EXIT_UNSQUASH("failed to allocate datan\n");
-
 	if((created_inode = malloc(sBlk.inodes * sizeof(char *))) == NULL)
 		EXIT_UNSQUASH("failed to allocate created_inode\n");
 
@@ -1989,9 +1922,14 @@ options:
 		paths = add_subdir(paths, path);
 	}
 
+	if(!lsonly)
+		unsquash_init(fd, block_size, processors, 0, 0, &decoder, file_done);
+
 	dir_scan(dest, SQUASHFS_INODE_BLK(sBlk.root_inode), SQUASHFS_INODE_OFFSET(sBlk.root_inode), paths);
 
 	if(!lsonly) {
+		unsquash_finish();
+
 		printf("\n");
 		printf("created %d files\n", file_count);
 		printf("created %d directories\n", dir_count);
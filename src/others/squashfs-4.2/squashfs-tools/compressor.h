@@ -32,6 +32,8 @@ struct compressor {
 	int id;
 	char *name;
 	int supported;
+	void (*file_block)(void *, long long, long long);
+	void (*display_stats)();
 };
 
 extern struct compressor *lookup_compressor(char *);
@@ -55,6 +57,18 @@ static inline int compressor_compress(struct compressor *comp, void *strm,
 }
 
 
+/*
+ * Tell the compressor which file and block within it the next data block
+ * passed to compressor_compress() on this stream comes from
+ */
+static inline void compressor_file_block(struct compressor *comp, void *strm,
+	long long file, long long block)
+{
+	if(comp->file_block)
+		comp->file_block(strm, file, block);
+}
+
+
 static inline int compressor_uncompress(struct compressor *comp, void *dest,
 	void *src, int size, int block_size, int *error)
 {
@@ -96,3 +110,10 @@ static inline int compressor_extract_options(struct compressor *comp,
 		return size ? -1 : 0;
 	return comp->extract_options(block_size, buffer, size);
 }
+
+
+static inline void compressor_display_stats(struct compressor *comp)
+{
+	if(comp->display_stats)
+		comp->display_stats();
+}
@@ -0,0 +1,193 @@
+/*
+ * Benchmark for the lzma and xz encoder setup cost per block.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * lzma_bench.c
+ *
+ * Compresses a file block by block the way the lzma and xz wrappers do, once
+ * building a fresh encoder for every block (init, code, end) and once
+ * re-initialising a single per-thread encoder, and reports the average time
+ * per block spent setting the encoder up against the time spent encoding.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <lzma.h>
+
+#define BENCH_BLOCK_SIZE	(128 * 1024)
+
+struct bench_result {
+	double		setup;
+	double		encode;
+	long long	bytes;
+};
+
+static lzma_options_lzma opt;
+static lzma_filter filters[2];
+
+
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static int encoder_init(lzma_stream *strm, int xz)
+{
+	if(xz)
+		return lzma_stream_encoder(strm, filters, LZMA_CHECK_CRC32);
+	else
+		return lzma_alone_encoder(strm, &opt);
+}
+
+
+static int bench(int xz, int reuse, unsigned char *data, long long length,
+	int block_size, unsigned char *out, struct bench_result *result)
+{
+	lzma_stream strm = LZMA_STREAM_INIT;
+	long long offset;
+	double start, setup, encode;
+	int res;
+
+	memset(result, 0, sizeof(*result));
+
+	for(offset = 0; offset < length; offset += block_size) {
+		int size = length - offset < block_size ? length - offset :
+			block_size;
+
+		start = now();
+		if(encoder_init(&strm, xz) != LZMA_OK) {
+			lzma_end(&strm);
+			return -1;
+		}
+		setup = now();
+
+		strm.next_in = data + offset;
+		strm.avail_in = size;
+		strm.next_out = out;
+		strm.avail_out = block_size;
+		res = lzma_code(&strm, LZMA_FINISH);
+		if(res != LZMA_STREAM_END && res != LZMA_OK) {
+			lzma_end(&strm);
+			return -1;
+		}
+		encode = now();
+
+		/*
+		 * Tearing the encoder down is part of its setup cost
+		 */
+		if(!reuse)
+			lzma_end(&strm);
+
+		result->setup += (setup - start) + (now() - encode);
+		result->encode += encode - setup;
+
+		result->bytes += res == LZMA_STREAM_END ? strm.total_out : size;
+	}
+
+	lzma_end(&strm);
+	return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	int block_size = BENCH_BLOCK_SIZE, preset = 6, i, xz, reuse;
+	unsigned int dict_size = 0;
+	unsigned char *data, *out;
+	long long length, blocks;
+	FILE *file;
+
+	for(i = 1; i < argc - 1; i++) {
+		if(strcmp(argv[i], "-b") == 0 && i + 2 < argc)
+			block_size = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-d") == 0 && i + 2 < argc)
+			dict_size = strtoul(argv[++i], NULL, 0);
+		else if(strcmp(argv[i], "-p") == 0 && i + 2 < argc)
+			preset = atoi(argv[++i]);
+		else
+			break;
+	}
+
+	if(i != argc - 1 || block_size < 4096) {
+		fprintf(stderr, "Usage: %s [-b block_size] [-d dict_size] "
+			"[-p preset] file\n", argv[0]);
+		exit(1);
+	}
+
+	file = fopen(argv[i], "rb");
+	if(file == NULL) {
+		perror(argv[i]);
+		exit(1);
+	}
+	fseek(file, 0, SEEK_END);
+	length = ftell(file);
+	rewind(file);
+
+	data = malloc(length ? length : 1);
+	out = malloc(block_size);
+	if(data == NULL || out == NULL || fread(data, 1, length, file) !=
+			length) {
+		fprintf(stderr, "%s: failed to read %s\n", argv[0], argv[i]);
+		exit(1);
+	}
+	fclose(file);
+
+	if(lzma_lzma_preset(&opt, preset)) {
+		fprintf(stderr, "%s: bad preset %d\n", argv[0], preset);
+		exit(1);
+	}
+	opt.dict_size = dict_size ? dict_size : block_size;
+	filters[0].id = LZMA_FILTER_LZMA2;
+	filters[0].options = &opt;
+	filters[1].id = LZMA_VLI_UNKNOWN;
+
+	blocks = (length + block_size - 1) / block_size;
+	printf("%lld blocks of %d bytes, preset %d, dictionary %u\n", blocks,
+		block_size, preset, opt.dict_size);
+	printf("%-4s %-7s %12s %12s %8s %10s %8s\n", "", "encoder",
+		"setup us/blk", "encode us/blk", "setup %", "MB/s", "ratio");
+
+	for(xz = 0; xz < 2; xz++) {
+		for(reuse = 0; reuse < 2; reuse++) {
+			struct bench_result result;
+			double total;
+
+			if(bench(xz, reuse, data, length, block_size, out,
+					&result)) {
+				fprintf(stderr, "%s: %s encoder failed\n",
+					argv[0], xz ? "xz" : "lzma");
+				exit(1);
+			}
+
+			total = result.setup + result.encode;
+			printf("%-4s %-7s %12.1f %12.1f %8.1f %10.2f %8.3f\n",
+				xz ? "xz" : "lzma", reuse ? "reused" : "fresh",
+				blocks ? result.setup * 1e6 / blocks : 0,
+				blocks ? result.encode * 1e6 / blocks : 0,
+				total ? result.setup * 100 / total : 0,
+				total ? length / total / 1e6 : 0,
+				length ? (double) result.bytes / length : 0);
+		}
+	}
+
+	return 0;
+}
@@ -23,6 +23,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include <lzma.h>
 
 #include "squashfs_fs.h"
@@ -36,44 +37,79 @@
 #define LZMA_OPTIONS 5
 #define MEMLIMIT (32 * 1024 * 1024)
 
-static int lzma_compress(void *dummy, void *dest, void *src,  int size,
-	int block_size, int *error)
+/*
+ * Per-thread encoder state.  Re-initialising an encoder on an lzma_stream
+ * which already has one of the same type reuses its dictionary buffer and
+ * match-finder hash, rather than allocating them afresh for every block
+ */
+struct lzma_xz_stream {
+	lzma_stream		strm;
+	lzma_options_lzma	opt;
+};
+
+
+static void lzma_set_options(lzma_options_lzma *opt)
 {
-	uint32_t preset;
-	unsigned char *d = (unsigned char *) dest;
 	struct lzma_xz_options *opts = lzma_xz_get_options();
 
-	lzma_options_lzma opt;
-	lzma_stream strm = LZMA_STREAM_INIT;
-	int res;
+	lzma_lzma_preset(opt, opts->preset);
+	opt->lc = opts->lc;
+	opt->lp = opts->lp;
+	opt->pb = opts->pb;
+	if (opts->fb)
+		opt->nice_len = opts->fb;
 
-	preset = opts->preset;
+	opt->dict_size = opts->dict_size;
+}
 
-	if (opts->extreme)
-		preset |= LZMA_PRESET_EXTREME;
 
-	lzma_lzma_preset(&opt, opts->preset);
-	opt.lc = opts->lc;
-	opt.lp = opts->lp;
-	opt.pb = opts->pb;
-	if (opts->fb)
-		opt.nice_len = opts->fb;
+static int lzma_init(void **strm, int block_size, int datablock)
+{
+	lzma_stream init = LZMA_STREAM_INIT;
+	struct lzma_xz_stream *stream;
+
+	stream = *strm = malloc(sizeof(struct lzma_xz_stream));
+	if(stream == NULL)
+		return -1;
+
+	stream->strm = init;
+	lzma_set_options(&stream->opt);
 
-	opt.dict_size = opts->dict_size;
+	return 0;
+}
+
+
+static int lzma_compress(void *strm, void *dest, void *src,  int size,
+	int block_size, int *error)
+{
+	unsigned char *d = (unsigned char *) dest;
+	struct lzma_xz_stream *stream = strm, oneshot;
+	lzma_stream init = LZMA_STREAM_INIT;
+	int res;
 
-	res = lzma_alone_encoder(&strm, &opt);
+	if(stream == NULL) {
+		/*
+		 * No per-thread state, use a throwaway encoder
+		 */
+		stream = &oneshot;
+		stream->strm = init;
+		lzma_set_options(&stream->opt);
+	}
+
+	res = lzma_alone_encoder(&stream->strm, &stream->opt);
 	if(res != LZMA_OK) {
-		lzma_end(&strm);
+		lzma_end(&stream->strm);
 		goto failed;
 	}
 
-	strm.next_out = dest;
-	strm.avail_out = block_size;
-	strm.next_in = src;
-	strm.avail_in = size;
+	stream->strm.next_out = dest;
+	stream->strm.avail_out = block_size;
+	stream->strm.next_in = src;
+	stream->strm.avail_in = size;
 
-	res = lzma_code(&strm, LZMA_FINISH);
-	lzma_end(&strm);
+	res = lzma_code(&stream->strm, LZMA_FINISH);
+	if(stream == &oneshot)
+		lzma_end(&stream->strm);
 
 	if(res == LZMA_STREAM_END) {
 		/*
@@ -92,7 +128,7 @@ static int lzma_compress(void *dummy, void *dest, void *src,  int size,
 		d[LZMA_PROPS_SIZE + 6] = 0;
 		d[LZMA_PROPS_SIZE + 7] = 0;
 
-		return (int) strm.total_out;
+		return (int) stream->strm.total_out;
 	}
 
 	if(res == LZMA_OK)
@@ -189,7 +225,7 @@ void lzma_usage()
 
 
 struct compressor lzma_comp_ops = {
-	.init = NULL,
+	.init = lzma_init,
 	.compress = lzma_compress,
 	.uncompress = lzma_uncompress,
 	.options = lzma_options,
@@ -123,6 +123,7 @@
 #include "pseudo.h"
 #include "compressor.h"
 #include "xattr.h"
+#include "xxhash.h"
 
 int delete = FALSE;
 int fd;
@@ -204,6 +205,35 @@ struct inode_info *inode_info[INODE_HASH_SIZE];
 struct file_info *dupl[65536];
 int dup_files = 0;
 
+/*
+ * index of files by the hash of their uncompressed contents, computed by
+ * the reader thread, which finds duplicates without reading back and
+ * checksumming the compressed blocks already written
+ */
+struct file_info *dupl_hash[65536];
+int dup_hash_hits = 0, dup_hash_collisions = 0;
+
+/*
+ * cache of compressed data blocks indexed by the hash of their
+ * uncompressed contents (-block-dedup), used by the deflator threads to
+ * reuse the compressed copy of a block that has been seen before.  The
+ * uncompressed contents are kept too, so a hash collision is never
+ * mistaken for a repeated block
+ */
+struct block_dedup {
+	unsigned long long	hash;
+	int			size;
+	int			c_byte;
+	char			*data;
+	char			*uncompressed;
+	struct block_dedup	*next;
+};
+
+struct block_dedup *block_dedup_table[65536];
+pthread_mutex_t block_dedup_mutex = PTHREAD_MUTEX_INITIALIZER;
+int block_dedup_mbytes = 0, block_dedup_hits = 0;
+long long block_dedup_bytes = 0;
+
 /* exclude file handling */
 /* list of exclude dirs/files */
 struct exclude_info {
@@ -282,7 +312,10 @@ struct file_info {
 	unsigned int		*block_list;
 	struct file_info	*next;
 	struct fragment		*fragment;
+	unsigned long long	hash;
+	struct file_info	*hash_next;
 	char			checksum_flag;
+	char			hash_flag;
 };
 
 /* count of how many times SIGINT or SIGQUIT has been sent */
@@ -373,7 +406,9 @@ unsigned int sid_count = 0, suid_count = 0, sguid_count = 0;
 struct cache *reader_buffer, *writer_buffer, *fragment_buffer;
 struct queue *to_reader, *from_reader, *to_writer, *from_writer, *from_deflate,
 	*to_frag;
-pthread_t *thread, *deflator_thread, *frag_deflator_thread, progress_thread;
+pthread_t *thread, *reader_thread, *scanner_thread, *deflator_thread,
+	*frag_deflator_thread, progress_thread;
+int thread_count;
 pthread_mutex_t	fragment_mutex;
 pthread_cond_t fragment_waiting;
 pthread_mutex_t	pos_mutex;
@@ -424,7 +459,7 @@ extern void sort_files_and_write(struct dir_info *dir);
 struct file_info *duplicate(long long file_size, long long bytes,
 	unsigned int **block_list, long long *start, struct fragment **fragment,
 	struct file_buffer *file_buffer, int blocks, unsigned short checksum,
-	unsigned short fragment_checksum, int checksum_flag);
+	unsigned short fragment_checksum, int checksum_flag, int hashed);
 struct dir_info *dir_scan1(char *, struct pathnames *, int (_readdir)(char *,
 	char *, struct dir_info *));
 struct dir_info *dir_scan2(struct dir_info *dir, struct pseudo *pseudo);
@@ -773,10 +808,10 @@ void restorefs()
 
 	ERROR("Exiting - restoring original filesystem!\n\n");
 
-	for(i = 0; i < 2 + processors * 2; i++)
+	for(i = 0; i < thread_count; i++)
 		if(thread[i])
 			pthread_kill(thread[i], SIGUSR1);
-	for(i = 0; i < 2 + processors * 2; i++)
+	for(i = 0; i < thread_count; i++)
 		waitforthread(i);
 	TRACE("All threads in signal handler\n");
 	bytes = sbytes;
@@ -833,7 +868,7 @@ void sigusr1_handler()
 	sigset_t sigmask;
 	pthread_t thread_id = pthread_self();
 
-	for(i = 0; i < (2 + processors * 2) && thread[i] != thread_id; i++);
+	for(i = 0; i < thread_count && thread[i] != thread_id; i++);
 	thread[i] = (pthread_t) 0;
 
 	TRACE("Thread %d(%p) in sigusr1_handler\n", i, &thread_id);
@@ -896,6 +931,75 @@ int mangle2(void *strm, char *d, char *s, int size,
 }
 
 
+/*
+ * compress a data block, reusing the result if a block with the same
+ * contents has been compressed before.  Blocks which don't compress are
+ * remembered without data, so they're not tried again
+ */
+int mangle_dedup(void *strm, char *d, char *s, int size)
+{
+	unsigned long long hash = xxh64(s, size, 0);
+	struct block_dedup *entry;
+	int c_byte, bytes;
+
+	pthread_mutex_lock(&block_dedup_mutex);
+	for(entry = block_dedup_table[hash & 0xffff]; entry;
+			entry = entry->next)
+		if(entry->hash == hash && entry->size == size &&
+				memcmp(entry->uncompressed, s, size) == 0)
+			break;
+
+	if(entry) {
+		block_dedup_hits ++;
+		c_byte = entry->c_byte;
+		pthread_mutex_unlock(&block_dedup_mutex);
+
+		memcpy(d, entry->data ? entry->data : s,
+			SQUASHFS_COMPRESSED_SIZE_BLOCK(c_byte));
+		return c_byte;
+	}
+	pthread_mutex_unlock(&block_dedup_mutex);
+
+	c_byte = mangle2(strm, d, s, size, block_size, noD, 1);
+	bytes = SQUASHFS_COMPRESSED_BLOCK(c_byte) ?
+		SQUASHFS_COMPRESSED_SIZE_BLOCK(c_byte) : 0;
+
+	if(block_dedup_bytes + bytes + size > (long long) block_dedup_mbytes
+			<< 20)
+		return c_byte;
+
+	entry = malloc(sizeof(struct block_dedup));
+	if(entry == NULL)
+		BAD_ERROR("Out of memory in block dedup allocation\n");
+	entry->data = NULL;
+	if(bytes) {
+		entry->data = malloc(bytes);
+		if(entry->data == NULL)
+			BAD_ERROR("Out of memory in block dedup allocation\n");
+		memcpy(entry->data, d, bytes);
+	}
+	entry->uncompressed = malloc(size);
+	if(entry->uncompressed == NULL)
+		BAD_ERROR("Out of memory in block dedup allocation\n");
+	memcpy(entry->uncompressed, s, size);
+	entry->hash = hash;
+	entry->size = size;
+	entry->c_byte = c_byte;
+
+	/*
+	 * another deflator may have added the same block meanwhile, the
+	 * duplicate entry is harmless
+	 */
+	pthread_mutex_lock(&block_dedup_mutex);
+	entry->next = block_dedup_table[hash & 0xffff];
+	block_dedup_table[hash & 0xffff] = entry;
+	block_dedup_bytes += bytes + size;
+	pthread_mutex_unlock(&block_dedup_mutex);
+
+	return c_byte;
+}
+
+
 int mangle(char *d, char *s, int size, int block_size,
 	int uncompressed, int data_block)
 {
@@ -2110,13 +2214,15 @@ int pre_duplicate(long long file_size)
 }
 
 
-int pre_duplicate_frag(long long file_size, unsigned short checksum)
+int pre_duplicate_frag(long long file_size, unsigned short checksum,
+	int hashed)
 {
 	struct file_info *dupl_ptr = dupl[DUP_HASH(file_size)];
 
 	for(; dupl_ptr; dupl_ptr = dupl_ptr->next)
 		if(file_size == dupl_ptr->file_size && file_size ==
-				dupl_ptr->fragment->size) {
+				dupl_ptr->fragment->size &&
+				!(hashed && dupl_ptr->hash_flag)) {
 			if(dupl_ptr->checksum_flag == FALSE) {
 				struct file_buffer *frag_buffer =
 					get_fragment(dupl_ptr->fragment);
@@ -2156,6 +2262,7 @@ struct file_info *add_non_dup(long long file_size, long long bytes,
 	dupl_ptr->checksum = checksum;
 	dupl_ptr->fragment_checksum = fragment_checksum;
 	dupl_ptr->checksum_flag = checksum_flag;
+	dupl_ptr->hash_flag = FALSE;
 	dupl_ptr->next = dupl[DUP_HASH(file_size)];
 	dupl[DUP_HASH(file_size)] = dupl_ptr;
 	dup_files ++;
@@ -2164,17 +2271,56 @@ struct file_info *add_non_dup(long long file_size, long long bytes,
 }
 
 
+void add_hash(struct file_info *dupl_ptr, unsigned long long hash)
+{
+	dupl_ptr->hash = hash;
+	dupl_ptr->hash_flag = TRUE;
+	dupl_ptr->hash_next = dupl_hash[DUP_HASH(hash)];
+	dupl_hash[DUP_HASH(hash)] = dupl_ptr;
+}
+
+
+/*
+ * look up a file with the same content hash in the hash index.  The
+ * compressed size and fragment size are also compared, as a cheap guard
+ * against hash collisions
+ */
+struct file_info *lookup_hash(long long file_size, long long bytes,
+	int frag_bytes, unsigned long long hash)
+{
+	struct file_info *dupl_ptr = dupl_hash[DUP_HASH(hash)];
+
+	for(; dupl_ptr; dupl_ptr = dupl_ptr->hash_next) {
+		if(hash == dupl_ptr->hash && file_size == dupl_ptr->file_size
+				&& bytes == dupl_ptr->bytes &&
+				frag_bytes == dupl_ptr->fragment->size) {
+			dup_hash_hits ++;
+			return dupl_ptr;
+		}
+		dup_hash_collisions ++;
+	}
+
+	return NULL;
+}
+
+
 struct file_info *duplicate(long long file_size, long long bytes,
 	unsigned int **block_list, long long *start, struct fragment **fragment,
 	struct file_buffer *file_buffer, int blocks, unsigned short checksum,
-	unsigned short fragment_checksum, int checksum_flag)
+	unsigned short fragment_checksum, int checksum_flag, int hashed)
 {
 	struct file_info *dupl_ptr = dupl[DUP_HASH(file_size)];
 	int frag_bytes = file_buffer ? file_buffer->size : 0;
 
+	/*
+	 * if the file has a content hash, the files with one have already
+	 * been checked by lookup_hash(), only compare it against those
+	 * without (read from the filesystem being appended to)
+	 */
 	for(; dupl_ptr; dupl_ptr = dupl_ptr->next)
 		if(file_size == dupl_ptr->file_size && bytes == dupl_ptr->bytes
-				 && frag_bytes == dupl_ptr->fragment->size) {
+				 && frag_bytes == dupl_ptr->fragment->size &&
+				 !(hashed && dupl_ptr->hash_flag)) {
 			long long target_start, dup_start = dupl_ptr->start;
 			int block;
 
@@ -2280,7 +2426,107 @@ struct file_info *duplicate(long long file_size, long long bytes,
 }
 
 
+/*
+ * The reader thread walks the tree handing each file, with a ticket giving
+ * its position in the walk, to a pool of reader threads.  A reader only
+ * queues blocks (and so numbers them) while it holds the turn for its
+ * ticket, before then it reads up to reader_ahead blocks of its file into
+ * a pending list, so the from_reader stream is in the same order as with
+ * a single reader
+ */
+struct read_job {
+	struct dir_ent *dir_ent;
+	int ticket;
+};
+
+struct read_state {
+	int ticket;
+	int turn;
+	int pending;
+	struct file_buffer *head;
+	struct file_buffer *tail;
+};
+
+struct queue *to_readers;
+int readers = -1, reader_ahead;
+int reader_tickets = 0, reader_turn = 0;
+pthread_mutex_t reader_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t reader_wait = PTHREAD_COND_INITIALIZER;
+
+
+void wait_reader_turn(int ticket)
+{
+	pthread_mutex_lock(&reader_mutex);
+	while(reader_turn != ticket)
+		pthread_cond_wait(&reader_wait, &reader_mutex);
+	pthread_mutex_unlock(&reader_mutex);
+}
+
+
+void next_reader_turn()
+{
+	pthread_mutex_lock(&reader_mutex);
+	reader_turn ++;
+	pthread_cond_broadcast(&reader_wait);
+	pthread_mutex_unlock(&reader_mutex);
+}
+
+
 static int seq = 0;
+void reader_take_turn(struct read_state *state)
+{
+	struct file_buffer *file_buffer;
+
+	if(state->turn)
+		return;
+
+	wait_reader_turn(state->ticket);
+	state->turn = TRUE;
+
+	while(state->head) {
+		file_buffer = state->head;
+		state->head = file_buffer->next;
+		file_buffer->sequence = seq ++;
+		queue_put(from_reader, file_buffer);
+	}
+	state->tail = NULL;
+	state->pending = 0;
+}
+
+
+void reader_queue(struct read_state *state, struct file_buffer *file_buffer)
+{
+	if(!state->turn && state->pending == reader_ahead)
+		reader_take_turn(state);
+
+	if(state->turn) {
+		file_buffer->sequence = seq ++;
+		queue_put(from_reader, file_buffer);
+		return;
+	}
+
+	file_buffer->next = NULL;
+	if(state->tail)
+		state->tail->next = file_buffer;
+	else
+		state->head = file_buffer;
+	state->tail = file_buffer;
+	state->pending ++;
+}
+
+
+/*
+ * Pass a block which failed to read, or which found the file changed size,
+ * straight to the main thread.  Everything read before it must go first
+ */
+void reader_error(struct read_state *state, struct file_buffer *file_buffer)
+{
+	reader_take_turn(state);
+	file_buffer->sequence = seq ++;
+	queue_put(from_deflate, file_buffer);
+}
+
+
 void reader_read_process(struct dir_ent *dir_ent)
 {
 	struct file_buffer *prev_buffer = NULL, *file_buffer;
@@ -2355,18 +2601,21 @@ read_err:
 }
 
 
-void reader_read_file(struct dir_ent *dir_ent)
+void reader_read_file(struct dir_ent *dir_ent, int ticket)
 {
 	struct stat *buf = &dir_ent->inode->buf, buf2;
 	struct file_buffer *file_buffer;
 	int blocks, byte, count, expected, file, frag_block;
 	long long bytes, read_size;
+	struct xxh64_state hash;
+	struct read_state state;
 
-	if(dir_ent->inode->read)
-		return;
-
-	dir_ent->inode->read = TRUE;
+	state.ticket = ticket;
+	state.turn = FALSE;
+	state.pending = 0;
+	state.head = state.tail = NULL;
 again:
+	xxh64_reset(&hash, 0);
 	bytes = 0;
 	count = 0;
 	file_buffer = NULL;
@@ -2378,19 +2627,27 @@ again:
 	file = open(dir_ent->pathname, O_RDONLY);
 	if(file == -1) {
 		file_buffer = cache_get(reader_buffer, 0, 0);
-		file_buffer->sequence = seq ++;
 		goto read_err;
 	}
 
+#ifdef POSIX_FADV_WILLNEED
+	/*
+	 * Files are read front to back, and a reader waiting for its turn
+	 * can only get reader_ahead blocks in, so ask for those now
+	 */
+	posix_fadvise(file, 0, 0, POSIX_FADV_SEQUENTIAL);
+	posix_fadvise(file, 0, (off_t) reader_ahead * block_size,
+		POSIX_FADV_WILLNEED);
+#endif
+
 	do {
 		expected = read_size - ((long long) count * block_size) >
 			block_size ? block_size :
 			read_size - ((long long) count * block_size);
 
 		if(file_buffer)
-			queue_put(from_reader, file_buffer);
+			reader_queue(&state, file_buffer);
 		file_buffer = cache_get(reader_buffer, 0, 0);
-		file_buffer->sequence = seq ++;
 
 		/*
 		 * Always try to read block_size bytes from the file rather
@@ -2416,6 +2673,9 @@ again:
 		file_buffer->error = FALSE;
 		file_buffer->fragment = (file_buffer->block == frag_block);
 
+		if(duplicate_checking)
+			xxh64_update(&hash, file_buffer->data, byte);
+
 		bytes += byte;
 		count ++;
 	} while(count < blocks);
@@ -2440,7 +2700,17 @@ again:
 			goto restat;
 	}
 
-	queue_put(from_reader, file_buffer);
+	/*
+	 * the hash must be stored before the last block is queued, the
+	 * main thread only looks at it once it has the whole file
+	 */
+	if(duplicate_checking) {
+		dir_ent->inode->hash = xxh64_digest(&hash);
+		dir_ent->inode->hashed = TRUE;
+	}
+
+	reader_take_turn(&state);
+	reader_queue(&state, file_buffer);
 
 	close(file);
 
@@ -2450,14 +2720,67 @@ restat:
 	fstat(file, &buf2);
 	close(file);
 	if(read_size != buf2.st_size) {
+		/*
+		 * Take the turn before updating the stat, the main thread
+		 * may still be writing the earlier files
+		 */
+		reader_take_turn(&state);
 		memcpy(buf, &buf2, sizeof(struct stat));
 		file_buffer->error = 2;
-		queue_put(from_deflate, file_buffer);
+		reader_error(&state, file_buffer);
 		goto again;
 	}
 read_err:
 	file_buffer->error = TRUE;
-	queue_put(from_deflate, file_buffer);
+	reader_error(&state, file_buffer);
+}
+
+
+void *reader_thrd(void *arg)
+{
+	int oldstate;
+
+	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &oldstate);
+	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldstate);
+
+	while(1) {
+		struct read_job *job = queue_get(to_readers);
+
+		if(IS_PSEUDO_PROCESS(job->dir_ent->inode)) {
+			/*
+			 * The size of a process's output isn't known up
+			 * front, so it is read entirely in turn
+			 */
+			wait_reader_turn(job->ticket);
+			reader_read_process(job->dir_ent);
+		} else
+			reader_read_file(job->dir_ent, job->ticket);
+
+		next_reader_turn();
+		free(job);
+	}
+
+	return NULL;
+}
+
+
+void reader_dispatch(struct dir_ent *dir_ent)
+{
+	struct read_job *job;
+
+	if(!IS_PSEUDO_PROCESS(dir_ent->inode)) {
+		if(dir_ent->inode->read)
+			return;
+		dir_ent->inode->read = TRUE;
+	}
+
+	job = malloc(sizeof(struct read_job));
+	if(job == NULL)
+		BAD_ERROR("Out of memory in reader_dispatch\n");
+
+	job->dir_ent = dir_ent;
+	job->ticket = reader_tickets ++;
+	queue_put(to_readers, job);
 }
 
 
@@ -2471,13 +2794,13 @@ void reader_scan(struct dir_info *dir) {
 			continue;
 
 		if(IS_PSEUDO_PROCESS(dir_ent->inode)) {
-			reader_read_process(dir_ent);
+			reader_dispatch(dir_ent);
 			continue;
 		}
 
 		switch(buf->st_mode & S_IFMT) {
 			case S_IFREG:
-				reader_read_file(dir_ent);
+				reader_dispatch(dir_ent);
 				break;
 			case S_IFDIR:
 				reader_scan(dir_ent->dir);
@@ -2504,9 +2827,14 @@ void *reader(void *arg)
 		for(i = 65535; i >= 0; i--)
 			for(entry = priority_list[i]; entry;
 							entry = entry->next)
-				reader_read_file(entry->dir);
+				reader_dispatch(entry->dir);
 	}
 
+	/*
+	 * Reading is finished once every file handed out has had its turn
+	 */
+	wait_reader_turn(reader_tickets);
+
 	thread[0] = 0;
 
 	pthread_exit(NULL);
@@ -2598,9 +2926,20 @@ void *deflator(void *arg)
 			queue_put(from_deflate, file_buffer);
 		} else {
 			write_buffer = cache_get(writer_buffer, 0, 0);
-			write_buffer->c_byte = mangle2(stream,
-				write_buffer->data, file_buffer->data,
-				file_buffer->size, block_size, noD, 1);
+			/*
+			 * the blocks of a file have consecutive sequence
+			 * numbers, so the first block's identifies the file
+			 */
+			compressor_file_block(comp, stream, file_buffer->sequence
+				- file_buffer->block, file_buffer->block);
+			if(block_dedup_mbytes)
+				write_buffer->c_byte = mangle_dedup(stream,
+					write_buffer->data, file_buffer->data,
+					file_buffer->size);
+			else
+				write_buffer->c_byte = mangle2(stream,
+					write_buffer->data, file_buffer->data,
+					file_buffer->size, block_size, noD, 1);
 			write_buffer->sequence = file_buffer->sequence;
 			write_buffer->file_size = file_buffer->file_size;
 			write_buffer->block = file_buffer->block;
@@ -2660,41 +2999,89 @@ void *frag_deflator(void *arg)
 }
 
 
-#define HASH_ENTRIES		256
-#define BLOCK_HASH(a)		(a % HASH_ENTRIES)
-struct file_buffer		*block_hash[HASH_ENTRIES];
+/*
+ * Blocks arrive from the deflators out of order, and are held in a ring
+ * indexed by sequence number until get_file_buffer() wants them.  The
+ * sequence numbers outstanding are bounded by the number of read and write
+ * buffers, so the ring is sized from those and only grows if that bound
+ * is ever exceeded
+ */
+struct file_buffer **reorder_ring;
+unsigned int reorder_size, reorder_held = 0;
+static long long sequence = 0;
+
+/* reorder statistics, reported in the filesystem summary */
+unsigned int reorder_max_depth = 0, reorder_stalls = 0;
+long long reorder_depth_total = 0, reorder_gets = 0;
+double reorder_stall_time = 0;
+
+void reorder_init(int buffers)
+{
+	for(reorder_size = 1; reorder_size < buffers; reorder_size <<= 1);
+
+	reorder_ring = calloc(reorder_size, sizeof(struct file_buffer *));
+	if(reorder_ring == NULL)
+		BAD_ERROR("Out of memory allocating reorder buffer\n");
+}
+
+
+void reorder_grow()
+{
+	struct file_buffer **ring;
+	unsigned int i, size = reorder_size << 1;
+
+	ring = calloc(size, sizeof(struct file_buffer *));
+	if(ring == NULL)
+		BAD_ERROR("Out of memory growing reorder buffer\n");
+
+	for(i = 0; i < reorder_size; i++)
+		if(reorder_ring[i])
+			ring[reorder_ring[i]->sequence & (size - 1)] =
+				reorder_ring[i];
+
+	free(reorder_ring);
+	reorder_ring = ring;
+	reorder_size = size;
+}
+
 
 void push_buffer(struct file_buffer *file_buffer)
 {
-	int hash = BLOCK_HASH(file_buffer->sequence);
+	while(file_buffer->sequence - sequence >= reorder_size)
+		reorder_grow();
 
-	file_buffer->next = block_hash[hash];
-	block_hash[hash] = file_buffer;
+	reorder_ring[file_buffer->sequence & (reorder_size - 1)] = file_buffer;
+	if(++ reorder_held > reorder_max_depth)
+		reorder_max_depth = reorder_held;
 }
 
 
 struct file_buffer *get_file_buffer(struct queue *queue)
 {
-	static unsigned int sequence = 0;
-	int hash = BLOCK_HASH(sequence);
-	struct file_buffer *file_buffer = block_hash[hash], *prev = NULL;
+	int slot = sequence & (reorder_size - 1);
+	struct file_buffer *file_buffer = reorder_ring[slot];
 
-	for(;file_buffer; prev = file_buffer, file_buffer = file_buffer->next)
-		if(file_buffer->sequence == sequence)
-			break;
+	reorder_depth_total += reorder_held;
+	reorder_gets ++;
 
 	if(file_buffer) {
-		if(prev)
-			prev->next = file_buffer->next;
-		else
-			block_hash[hash] = file_buffer->next;
+		reorder_ring[slot] = NULL;
+		reorder_held --;
 	} else {
+		struct timeval start, end;
+
+		gettimeofday(&start, NULL);
 		while(1) {
 			file_buffer = queue_get(queue);
 			if(file_buffer->sequence == sequence)
 				break;
 			push_buffer(file_buffer);
 		}
+		gettimeofday(&end, NULL);
+
+		reorder_stalls ++;
+		reorder_stall_time += (end.tv_sec - start.tv_sec) +
+			(end.tv_usec - start.tv_usec) / 1000000.0;
 	}
 
 	sequence ++;
@@ -2830,12 +3217,14 @@ void write_file_frag_dup(squashfs_inode *inode, struct dir_ent *dir_ent,
 	long long start = 0;
 
 	dupl_ptr = duplicate(size, 0, &block_listp, &start, &fragment,
-		file_buffer, 0, 0, checksum, TRUE);
+		file_buffer, 0, 0, checksum, TRUE, dir_ent->inode->hashed);
 
 	if(dupl_ptr) {
 		*duplicate_file = FALSE;
 		fragment = get_and_fill_fragment(file_buffer);
 		dupl_ptr->fragment = fragment;
+		if(dir_ent->inode->hashed)
+			add_hash(dupl_ptr, dir_ent->inode->hash);
 	} else
 		*duplicate_file = TRUE;
 
@@ -2855,11 +3244,23 @@ void write_file_frag(squashfs_inode *inode, struct dir_ent *dir_ent, int size,
 	struct file_buffer *file_buffer, int *duplicate_file)
 {
 	struct fragment *fragment;
+	struct file_info *dupl_ptr;
 	unsigned short checksum;
+	int hashed = dir_ent->inode->hashed;
+
+	if(hashed) {
+		dupl_ptr = lookup_hash(size, 0, size, dir_ent->inode->hash);
+		if(dupl_ptr) {
+			fragment = dupl_ptr->fragment;
+			cache_block_put(file_buffer);
+			*duplicate_file = TRUE;
+			goto done;
+		}
+	}
 
 	checksum = get_checksum_mem_buffer(file_buffer);
 
-	if(pre_duplicate_frag(size, checksum)) {
+	if(pre_duplicate_frag(size, checksum, hashed)) {
 		write_file_frag_dup(inode, dir_ent, size, duplicate_file,
 			file_buffer, checksum);
 		return;
@@ -2869,14 +3270,19 @@ void write_file_frag(squashfs_inode *inode, struct dir_ent *dir_ent, int size,
 
 	cache_block_put(file_buffer);
 
-	if(duplicate_checking)
-		add_non_dup(size, 0, NULL, 0, fragment, 0, checksum, TRUE);
+	*duplicate_file = FALSE;
+
+	if(duplicate_checking) {
+		dupl_ptr = add_non_dup(size, 0, NULL, 0, fragment, 0, checksum,
+			TRUE);
+		if(hashed)
+			add_hash(dupl_ptr, dir_ent->inode->hash);
+	}
 
+done:
 	total_bytes += size;
 	file_count ++;
 
-	*duplicate_file = FALSE;
-
 	inc_progress_bar();
 
 	create_inode(inode, NULL, dir_ent, SQUASHFS_FILE_TYPE, size, 0,
@@ -3026,9 +3432,13 @@ int write_file_blocks(squashfs_inode *inode, struct dir_ent *dir_ent,
 	fragment = get_and_fill_fragment(fragment_buffer);
 	cache_block_put(fragment_buffer);
 
-	if(duplicate_checking)
-		add_non_dup(read_size, file_bytes, block_list, start, fragment,
-			0, 0, FALSE);
+	if(duplicate_checking) {
+		struct file_info *dupl_ptr = add_non_dup(read_size, file_bytes,
+			block_list, start, fragment, 0, 0, FALSE);
+
+		if(dir_ent->inode->hashed)
+			add_hash(dupl_ptr, dir_ent->inode->hash);
+	}
 	file_count ++;
 	total_bytes += read_size;
 
@@ -3080,7 +3490,7 @@ int write_file_blocks_dup(squashfs_inode *inode, struct dir_ent *dir_ent,
 	int block, thresh;
 	long long file_bytes, dup_start, start;
 	struct fragment *fragment;
-	struct file_info *dupl_ptr;
+	struct file_info *dupl_ptr, *hash_ptr;
 	int blocks = (read_size + block_size - 1) >> block_log;
 	unsigned int *block_list, *block_listp;
 	struct file_buffer **buffer_list;
@@ -3136,8 +3546,27 @@ int write_file_blocks_dup(squashfs_inode *inode, struct dir_ent *dir_ent,
 		}
 	}
 
-	dupl_ptr = duplicate(read_size, file_bytes, &block_listp, &dup_start,
-		&fragment, fragment_buffer, blocks, 0, 0, FALSE);
+	/*
+	 * if the file has a content hash, look it up in the hash index
+	 * rather than comparing the compressed blocks against those of every
+	 * file with the same size
+	 */
+	hash_ptr = dir_ent->inode->hashed ? lookup_hash(read_size, file_bytes,
+		fragment_buffer ? fragment_buffer->size : 0,
+		dir_ent->inode->hash) : NULL;
+
+	if(hash_ptr) {
+		block_listp = hash_ptr->block_list;
+		dup_start = hash_ptr->start;
+		fragment = hash_ptr->fragment;
+		dupl_ptr = NULL;
+	} else {
+		dupl_ptr = duplicate(read_size, file_bytes, &block_listp,
+			&dup_start, &fragment, fragment_buffer, blocks, 0, 0,
+			FALSE, dir_ent->inode->hashed);
+		if(dupl_ptr && dir_ent->inode->hashed)
+			add_hash(dupl_ptr, dir_ent->inode->hash);
+	}
 
 	if(dupl_ptr) {
 		*duplicate_file = FALSE;
@@ -3334,6 +3763,7 @@ struct inode_info *lookup_inode(struct stat *buf)
 
 	memcpy(&inode->buf, buf, sizeof(struct stat));
 	inode->read = FALSE;
+	inode->hashed = FALSE;
 	inode->root_entry = FALSE;
 	inode->pseudo_file = FALSE;
 	inode->inode = SQUASHFS_INVALID_BLK;
@@ -3399,6 +3829,372 @@ void sort_directory(struct dir_info *dir)
 }
 
 
+/*
+ * Directory listings are read ahead of dir_scan1() by the scanner threads.
+ * They walk the source trees depth first in the same order dir_scan1()
+ * does, listing and lstating each directory and queueing its
+ * subdirectories, and leave the listing in a table for scan1_opendir() to
+ * pick up.  dir_scan1() still builds the tree in order, so the inode
+ * numbering doesn't depend on the scanners
+ */
+struct scan_ent {
+	char			*name;
+	struct stat		buf;
+	int			error;
+};
+
+#define SCAN_QUEUED	0
+#define SCAN_BUSY	1
+#define SCAN_DONE	2
+#define SCAN_FREED	3
+#define SCAN_DROPPED	4
+
+struct scan_dir {
+	char			*pathname;
+	int			state;
+	int			stacked;
+	int			error;
+	int			count;
+	struct scan_ent		*list;
+	struct scan_dir		*hash_next;
+	struct scan_dir		*stack_next;
+};
+
+#define SCAN_HASH_SIZE	65536
+struct scan_dir *scan_table[SCAN_HASH_SIZE];
+struct scan_dir *scan_stack = NULL;
+pthread_mutex_t scan_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t scan_work = PTHREAD_COND_INITIALIZER;
+pthread_cond_t scan_done = PTHREAD_COND_INITIALIZER;
+
+
+static unsigned int scan_hash(char *pathname)
+{
+	unsigned int hash = 5381;
+
+	while(*pathname)
+		hash = hash * 33 + (unsigned char) *pathname++;
+
+	return hash & (SCAN_HASH_SIZE - 1);
+}
+
+
+/* called with scan_mutex held */
+static struct scan_dir *scan_lookup(char *pathname)
+{
+	struct scan_dir *scan = scan_table[scan_hash(pathname)];
+
+	while(scan && strcmp(scan->pathname, pathname) != 0)
+		scan = scan->hash_next;
+
+	return scan;
+}
+
+
+/* called with scan_mutex held */
+static struct scan_dir *scan_add(char *pathname, int state)
+{
+	unsigned int hash = scan_hash(pathname);
+	struct scan_dir *scan = malloc(sizeof(struct scan_dir));
+
+	if(scan == NULL || (scan->pathname = strdup(pathname)) == NULL)
+		BAD_ERROR("Out of memory in scan_add\n");
+
+	scan->state = state;
+	scan->stacked = FALSE;
+	scan->error = 0;
+	scan->count = 0;
+	scan->list = NULL;
+	scan->hash_next = scan_table[hash];
+	scan_table[hash] = scan;
+
+	return scan;
+}
+
+
+/* called with scan_mutex held */
+static void scan_unhash(struct scan_dir *scan)
+{
+	struct scan_dir **prev;
+
+	for(prev = &scan_table[scan_hash(scan->pathname)]; *prev != scan;
+			prev = &(*prev)->hash_next);
+	*prev = scan->hash_next;
+}
+
+
+/* called with scan_mutex held */
+static void scan_push(struct scan_dir *scan)
+{
+	scan->stacked = TRUE;
+	scan->stack_next = scan_stack;
+	scan_stack = scan;
+	pthread_cond_signal(&scan_work);
+}
+
+
+static void scan_free(struct scan_dir *scan)
+{
+	int i;
+
+	for(i = 0; i < scan->count; i++)
+		free(scan->list[i].name);
+	free(scan->list);
+	free(scan->pathname);
+	free(scan);
+}
+
+
+/*
+ * Free an unhashed scan_dir.  A scanner still holding it on the stack frees
+ * it when popped.  Called with scan_mutex held
+ */
+static void scan_dispose(struct scan_dir *scan)
+{
+	if(scan->stacked)
+		scan->state = SCAN_FREED;
+	else
+		scan_free(scan);
+}
+
+
+/*
+ * Forget a listing dir_scan1() won't ask for, and everything the scanners
+ * have read ahead below it.  Called with scan_mutex held
+ */
+static void scan_drop(struct scan_dir *scan)
+{
+	char filename[8192];
+	struct scan_dir *sub;
+	int i;
+
+	scan_unhash(scan);
+
+	if(scan->state == SCAN_BUSY) {
+		/* scan_list() frees it once the listing is done */
+		scan->state = SCAN_DROPPED;
+		return;
+	}
+
+	if(scan->state == SCAN_DONE)
+		for(i = 0; i < scan->count; i++)
+			if(scan->list[i].error == 0 &&
+					S_ISDIR(scan->list[i].buf.st_mode)) {
+				strcat(strcat(strcpy(filename, scan->pathname),
+					"/"), scan->list[i].name);
+				sub = scan_lookup(filename);
+				if(sub)
+					scan_drop(sub);
+			}
+
+	scan_dispose(scan);
+}
+
+
+void scan_queue(char *pathname)
+{
+	pthread_mutex_lock(&scan_mutex);
+	if(scan_lookup(pathname) == NULL)
+		scan_push(scan_add(pathname, SCAN_QUEUED));
+	pthread_mutex_unlock(&scan_mutex);
+}
+
+
+/*
+ * List and lstat a directory whose state the caller has set to SCAN_BUSY,
+ * and queue its subdirectories so that the first is listed next
+ */
+void scan_list(struct scan_dir *scan)
+{
+	struct scan_ent *list = NULL;
+	struct dirent *d_name;
+	char filename[8192];
+	int count = 0, size = 0, error = 0, i;
+	DIR *linuxdir = opendir(scan->pathname);
+
+	if(linuxdir == NULL)
+		error = errno ? errno : ENOENT;
+	else {
+		while((d_name = readdir(linuxdir)) != NULL) {
+			if(strcmp(d_name->d_name, ".") == 0 ||
+					strcmp(d_name->d_name, "..") == 0)
+				continue;
+
+			if(count == size) {
+				size = size ? size * 2 : 16;
+				list = realloc(list, size *
+					sizeof(struct scan_ent));
+				if(list == NULL)
+					BAD_ERROR("Out of memory in "
+						"scan_list\n");
+			}
+
+			list[count].name = strdup(d_name->d_name);
+			if(list[count].name == NULL)
+				BAD_ERROR("Out of memory in scan_list\n");
+			strcat(strcat(strcpy(filename, scan->pathname), "/"),
+				d_name->d_name);
+			list[count].error = lstat(filename, &list[count].buf)
+				== -1 ? errno : 0;
+			count ++;
+		}
+		closedir(linuxdir);
+	}
+
+	pthread_mutex_lock(&scan_mutex);
+	scan->list = list;
+	scan->count = count;
+	scan->error = error;
+	if(scan->state == SCAN_DROPPED) {
+		/* excluded while being listed, so don't read ahead below it */
+		scan_dispose(scan);
+		pthread_mutex_unlock(&scan_mutex);
+		return;
+	}
+	scan->state = SCAN_DONE;
+	for(i = count - 1; i >= 0; i--)
+		if(list[i].error == 0 && S_ISDIR(list[i].buf.st_mode)) {
+			strcat(strcat(strcpy(filename, scan->pathname), "/"),
+				list[i].name);
+			if(scan_lookup(filename) == NULL)
+				scan_push(scan_add(filename, SCAN_QUEUED));
+		}
+	pthread_cond_broadcast(&scan_done);
+	pthread_mutex_unlock(&scan_mutex);
+}
+
+
+void *scanner(void *arg)
+{
+	struct scan_dir *scan;
+	int oldstate;
+
+	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &oldstate);
+	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldstate);
+
+	while(1) {
+		pthread_mutex_lock(&scan_mutex);
+		while(scan_stack == NULL)
+			pthread_cond_wait(&scan_work, &scan_mutex);
+		scan = scan_stack;
+		scan_stack = scan->stack_next;
+		scan->stacked = FALSE;
+
+		if(scan->state != SCAN_QUEUED) {
+			if(scan->state == SCAN_FREED)
+				scan_free(scan);
+			pthread_mutex_unlock(&scan_mutex);
+			continue;
+		}
+
+		scan->state = SCAN_BUSY;
+		pthread_mutex_unlock(&scan_mutex);
+
+		scan_list(scan);
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Get the listing of pathname, waiting for a scanner already listing it,
+ * or listing it here if no scanner has got to it yet
+ */
+struct scan_dir *scan_get(char *pathname)
+{
+	struct scan_dir *scan;
+
+	pthread_mutex_lock(&scan_mutex);
+	scan = scan_lookup(pathname);
+	if(scan == NULL)
+		scan = scan_add(pathname, SCAN_BUSY);
+	else if(scan->state == SCAN_QUEUED)
+		scan->state = SCAN_BUSY;
+	else {
+		while(scan->state == SCAN_BUSY)
+			pthread_cond_wait(&scan_done, &scan_mutex);
+		pthread_mutex_unlock(&scan_mutex);
+		return scan;
+	}
+	pthread_mutex_unlock(&scan_mutex);
+
+	scan_list(scan);
+	return scan;
+}
+
+
+void scan_release(struct scan_dir *scan)
+{
+	pthread_mutex_lock(&scan_mutex);
+	scan_unhash(scan);
+	scan_dispose(scan);
+	pthread_mutex_unlock(&scan_mutex);
+}
+
+
+/*
+ * Called by dir_scan1() for each entry it excludes, so the scanners stop
+ * reading ahead into an excluded directory and its listings are freed
+ */
+void scan_exclude(char *pathname)
+{
+	struct scan_dir *scan;
+
+	pthread_mutex_lock(&scan_mutex);
+	scan = scan_lookup(pathname);
+	if(scan)
+		scan_drop(scan);
+	pthread_mutex_unlock(&scan_mutex);
+}
+
+
+/*
+ * Free whatever was read ahead but never used once dir_scan1() is done,
+ * such as a source that turned out not to be a directory
+ */
+void scan_flush()
+{
+	int i;
+
+	pthread_mutex_lock(&scan_mutex);
+	for(i = 0; i < SCAN_HASH_SIZE; i++)
+		while(scan_table[i])
+			scan_drop(scan_table[i]);
+	pthread_mutex_unlock(&scan_mutex);
+}
+
+
+struct scan_ent *scan1_next(struct dir_info *dir)
+{
+	if(dir->scan_index == dir->scan->count)
+		dir->scan_ent = NULL;
+	else
+		dir->scan_ent = &dir->scan->list[dir->scan_index ++];
+
+	return dir->scan_ent;
+}
+
+
+/*
+ * lstat the entry last returned by scan1_readdir() or
+ * scan1_single_readdir(), using the listing if it came from one
+ */
+int scan1_stat(struct dir_info *dir, char *filename, struct stat *buf)
+{
+	if(dir->scan_ent == NULL)
+		return lstat(filename, buf);
+
+	if(dir->scan_ent->error) {
+		errno = dir->scan_ent->error;
+		return -1;
+	}
+
+	memcpy(buf, &dir->scan_ent->buf, sizeof(struct stat));
+	return 0;
+}
+
+
 struct dir_info *scan1_opendir(char *pathname)
 {
 	struct dir_info *dir;
@@ -3407,9 +4203,17 @@ struct dir_info *scan1_opendir(char *pathname)
 	if(dir == NULL)
 		BAD_ERROR("Out of memory in scan1_opendir\n");
 
-	if(pathname[0] != '\0' && (dir->linuxdir = opendir(pathname)) == NULL) {
-		free(dir);
-		return NULL;
+	dir->scan = NULL;
+	dir->scan_index = 0;
+	dir->scan_ent = NULL;
+	if(pathname[0] != '\0') {
+		dir->scan = scan_get(pathname);
+		if(dir->scan->error) {
+			errno = dir->scan->error;
+			scan_release(dir->scan);
+			free(dir);
+			return NULL;
+		}
 	}
 	dir->pathname = strdup(pathname);
 	dir->count = dir->directory_count = dir->current_count = dir->byte_count
@@ -3466,7 +4270,7 @@ int scan1_encomp_readdir(char *pathname, char *dir_name, struct dir_info *dir)
 
 int scan1_single_readdir(char *pathname, char *dir_name, struct dir_info *dir)
 {
-	struct dirent *d_name;
+	struct scan_ent *d_name;
 	int i;
 
 	if(dir->count < old_root_entries) {
@@ -3478,10 +4282,10 @@ int scan1_single_readdir(char *pathname, char *dir_name, struct dir_info *dir)
 		}
 	}
 
-	if((d_name = readdir(dir->linuxdir)) != NULL) {
+	if((d_name = scan1_next(dir)) != NULL) {
 		int pass = 1;
 
-		strcpy(dir_name, d_name->d_name);
+		strcpy(dir_name, d_name->name);
 		for(;;) {
 			for(i = 0; i < dir->count &&
 				strcmp(dir->list[i]->name, dir_name) != 0; i++);
@@ -3489,11 +4293,11 @@ int scan1_single_readdir(char *pathname, char *dir_name, struct dir_info *dir)
 				break;
 			ERROR("Source directory entry %s already used! - trying"
 				" ", dir_name);
-			sprintf(dir_name, "%s_%d", d_name->d_name, pass++);
+			sprintf(dir_name, "%s_%d", d_name->name, pass++);
 			ERROR("%s\n", dir_name);
 		}
 		strcat(strcat(strcpy(pathname, dir->pathname), "/"),
-			d_name->d_name);
+			d_name->name);
 		return 1;
 	}
 
@@ -3503,12 +4307,12 @@ int scan1_single_readdir(char *pathname, char *dir_name, struct dir_info *dir)
 
 int scan1_readdir(char *pathname, char *dir_name, struct dir_info *dir)
 {
-	struct dirent *d_name = readdir(dir->linuxdir);
+	struct scan_ent *d_name = scan1_next(dir);
 
 	if(d_name != NULL) {
-		strcpy(dir_name, d_name->d_name);
+		strcpy(dir_name, d_name->name);
 		strcat(strcat(strcpy(pathname, dir->pathname), "/"),
-			d_name->d_name);
+			d_name->name);
 		return 1;
 	}
 
@@ -3559,8 +4363,10 @@ struct dir_ent *scan3_readdir(struct directory *dir, struct dir_info *dir_info)
 
 void scan1_freedir(struct dir_info *dir)
 {
-	if(dir->pathname[0] != '\0')
-		closedir(dir->linuxdir);
+	if(dir->scan)
+		scan_release(dir->scan);
+	dir->scan = NULL;
+	dir->scan_ent = NULL;
 	free(dir->pathname);
 	dir->pathname = NULL;
 }
@@ -3588,9 +4394,21 @@ void dir_scan(squashfs_inode *inode, char *pathname,
 	int (_readdir)(char *, char *, struct dir_info *))
 {
 	struct stat buf;
-	struct dir_info *dir_info = dir_scan1(pathname, paths, _readdir);
+	struct dir_info *dir_info;
 	struct dir_ent *dir_ent;
-	
+	int i;
+
+	/*
+	 * Start the scanners on the source directories
+	 */
+	if(pathname[0] != '\0')
+		scan_queue(pathname);
+	else
+		for(i = 0; i < source; i++)
+			scan_queue(source_path[i]);
+
+	dir_info = dir_scan1(pathname, paths, _readdir);
+	scan_flush();
 	if(dir_info == NULL)
 		return;
 
@@ -3669,7 +4487,7 @@ struct dir_info *dir_scan1(char *pathname, struct pathnames *paths,
 		if(strcmp(dir_name, ".") == 0 || strcmp(dir_name, "..") == 0)
 			continue;
 
-		if(lstat(filename, &buf) == -1) {
+		if(scan1_stat(dir, filename, &buf) == -1) {
 			ERROR("Cannot stat dir/file %s because %s, ignoring",
 				filename, strerror(errno));
 			continue;
@@ -3688,11 +4506,15 @@ struct dir_info *dir_scan1(char *pathname, struct pathnames *paths,
 		}
 
 		if(old_exclude) {
-			if(old_excluded(filename, &buf))
+			if(old_excluded(filename, &buf)) {
+				scan_exclude(filename);
 				continue;
+			}
 		} else {
-			if(excluded(paths, dir_name, &new))
+			if(excluded(paths, dir_name, &new)) {
+				scan_exclude(filename);
 				continue;
+			}
 		}
 
 		if((buf.st_mode & S_IFMT) == S_IFDIR) {
@@ -4103,13 +4925,30 @@ void initialise_threads(int readb_mbytes, int writeb_mbytes,
 	}
 #endif /* __CYGWIN__ */
 
-	thread = malloc((2 + processors * 2) * sizeof(pthread_t));
+	if(readers == -1)
+		readers = processors;
+	if(readers > reader_buffer_size / 2)
+		readers = reader_buffer_size / 2 ? reader_buffer_size / 2 : 1;
+
+	/*
+	 * Readers waiting for their turn between them hold at most half the
+	 * read buffer, leaving the rest for the reader whose turn it is
+	 */
+	reader_ahead = reader_buffer_size / (2 * readers);
+	if(reader_ahead < 1)
+		reader_ahead = 1;
+
+	thread_count = 2 + readers * 2 + processors * 2;
+	thread = malloc(thread_count * sizeof(pthread_t));
 	if(thread == NULL)
 		BAD_ERROR("Out of memory allocating thread descriptors\n");
-	deflator_thread = &thread[2];
+	reader_thread = &thread[2];
+	scanner_thread = &reader_thread[readers];
+	deflator_thread = &scanner_thread[readers];
 	frag_deflator_thread = &deflator_thread[processors];
 
 	to_reader = queue_init(1);
+	to_readers = queue_init(readers);
 	from_reader = queue_init(reader_buffer_size);
 	to_writer = queue_init(writer_buffer_size);
 	from_writer = queue_init(1);
@@ -4117,6 +4956,7 @@ void initialise_threads(int readb_mbytes, int writeb_mbytes,
 	to_frag = queue_init(fragment_buffer_size);
 	reader_buffer = cache_init(block_size, reader_buffer_size);
 	writer_buffer = cache_init(block_size, writer_buffer_size);
+	reorder_init(reader_buffer_size + writer_buffer_size);
 	fragment_buffer = cache_init(block_size, fragment_buffer_size);
 	pthread_create(&thread[0], NULL, reader, NULL);
 	pthread_create(&thread[1], NULL, writer, NULL);
@@ -4124,6 +4964,14 @@ void initialise_threads(int readb_mbytes, int writeb_mbytes,
 	pthread_mutex_init(&fragment_mutex, NULL);
 	pthread_cond_init(&fragment_waiting, NULL);
 
+	for(i = 0; i < readers; i++) {
+		if(pthread_create(&reader_thread[i], NULL, reader_thrd, NULL)
+				!= 0)
+			BAD_ERROR("Failed to create thread\n");
+		if(pthread_create(&scanner_thread[i], NULL, scanner, NULL) != 0)
+			BAD_ERROR("Failed to create thread\n");
+	}
+
 	for(i = 0; i < processors; i++) {
 		if(pthread_create(&deflator_thread[i], NULL, deflator, NULL) !=
 				 0)
@@ -4133,8 +4981,9 @@ void initialise_threads(int readb_mbytes, int writeb_mbytes,
 			BAD_ERROR("Failed to create thread\n");
 	}
 
-	printf("Parallel mksquashfs: Using %d processor%s\n", processors,
-			processors == 1 ? "" : "s");
+	printf("Parallel mksquashfs: Using %d processor%s, %d reader%s\n",
+			processors, processors == 1 ? "" : "s", readers,
+			readers == 1 ? "" : "s");
 
 	if(sigprocmask(SIG_SETMASK, &old_mask, NULL) == -1)
 		BAD_ERROR("Failed to set signal mask in intialise_threads\n");
@@ -4683,6 +5532,18 @@ int main(int argc, char *argv[])
 					argv[0]);
 				exit(1);
 			}
+		} else if(strcmp(argv[i], "-readers") == 0) {
+			if((++i == argc) || (readers =
+					strtol(argv[i], &b, 10), *b != '\0')) {
+				ERROR("%s: -readers missing or invalid "
+					"reader number\n", argv[0]);
+				exit(1);
+			}
+			if(readers < 1) {
+				ERROR("%s: -readers should be 1 or larger\n",
+					argv[0]);
+				exit(1);
+			}
 		} else if(strcmp(argv[i], "-read-queue") == 0) {
 			if((++i == argc) || (readb_mbytes =
 					strtol(argv[i], &b, 10), *b != '\0')) {
@@ -4748,6 +5609,20 @@ int main(int argc, char *argv[])
 		} else if(strcmp(argv[i], "-no-duplicates") == 0)
 			duplicate_checking = FALSE;
 
+		else if(strcmp(argv[i], "-block-dedup") == 0) {
+			if((++i == argc) || (block_dedup_mbytes =
+					strtol(argv[i], &b, 10), *b != '\0')) {
+				ERROR("%s: -block-dedup missing or invalid "
+					"cache size\n", argv[0]);
+				exit(1);
+			}
+			if(block_dedup_mbytes < 1) {
+				ERROR("%s: -block-dedup should be 1 megabyte "
+					"or larger\n", argv[0]);
+				exit(1);
+			}
+		}
+
 		else if(strcmp(argv[i], "-no-fragments") == 0)
 			no_fragments = TRUE;
 
@@ -4886,6 +5761,9 @@ printOptions:
 				"files larger than block size\n");
 			ERROR("-no-duplicates\t\tdo not perform duplicate "
 				"checking\n");
+			ERROR("-block-dedup <size>\tdon't recompress repeated "
+				"data blocks, caching up to\n\t\t\t<size> Mbytes "
+				"of blocks\n");
 			ERROR("-all-root\t\tmake all files owned by root\n");
 			ERROR("-force-uid uid\t\tset all file uids to uid\n");
 			ERROR("-force-gid gid\t\tset all file gids to gid\n");
@@ -4936,6 +5814,9 @@ printOptions:
 			ERROR("-processors <number>\tUse <number> processors."
 				"  By default will use number of\n");
 			ERROR("\t\t\tprocessors available\n");
+			ERROR("-readers <number>\tUse <number> threads to scan "
+				"directories and read files.\n");
+			ERROR("\t\t\tBy default will use one per processor\n");
 			ERROR("-read-queue <size>\tSet input queue to <size> "
 				"Mbytes.  Default %d Mbytes\n",
 				READER_BUFFER_DEFAULT);
@@ -5404,11 +6285,22 @@ restore_filesystem:
 			((float) xattr_bytes / total_xattr_bytes) * 100.0,
 			total_xattr_bytes);
 	}
-	if(duplicate_checking)
+	if(duplicate_checking) {
 		printf("Number of duplicate files found %d\n", file_count -
 			dup_files);
-	else
+		printf("\tcontent hash index hits %d, collisions %d\n",
+			dup_hash_hits, dup_hash_collisions);
+	} else
 		printf("No duplicate files removed\n");
+	if(block_dedup_mbytes)
+		printf("Number of repeated data blocks not recompressed %d\n",
+			block_dedup_hits);
+	printf("Block reorder buffer %d entries, max depth %d, average "
+		"depth %.2f\n", reorder_size, reorder_max_depth, reorder_gets ?
+		(double) reorder_depth_total / reorder_gets : 0.0);
+	printf("\tmain thread waited for %d of %lld blocks, %.3f seconds\n",
+		reorder_stalls, reorder_gets, reorder_stall_time);
+	compressor_display_stats(comp);
 	printf("Number of inodes %d\n", inode_count);
 	printf("Number of files %d\n", file_count);
 	if(!no_fragments)
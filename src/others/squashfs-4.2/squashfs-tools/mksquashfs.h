@@ -49,7 +49,9 @@ struct dir_info {
 	char			dir_is_ldir;
 	struct dir_ent		*dir_ent;
 	struct dir_ent		**list;
-	DIR			*linuxdir;
+	struct scan_dir		*scan;
+	int			scan_index;
+	struct scan_ent		*scan_ent;
 };
 
 struct dir_ent {
@@ -67,8 +69,10 @@ struct inode_info {
 	unsigned int		inode_number;
 	unsigned int		nlink;
 	int			pseudo_id;
+	unsigned long long	hash;
 	char			type;
 	char			read;
+	char			hashed;
 	char			root_entry;
 	char			pseudo_file;
 };
@@ -0,0 +1,157 @@
+/*
+ * Benchmark for the unsquashfs reader/deflator/writer queues and caches.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * queue_bench.c
+ *
+ * Drives blocks through the same cache_get() -> to_reader -> to_deflate ->
+ * cache_block_ready() / to_writer -> cache_block_wait() -> cache_block_put()
+ * path as unsquashfs, without any I/O, and reports blocks per second for
+ * the locked and lock-free implementations at each deflator thread count.
+ */
+
+#include "unsquashfs.h"
+
+#define BENCH_BLOCK_SIZE	4096
+#define BENCH_BUFFERS		256
+
+pthread_mutex_t screen_mutex;
+int progress_enabled = FALSE;
+struct queue *to_reader;
+
+static struct queue *to_deflate, *to_writer;
+static int deflators, work;
+
+static void *bench_reader(void *arg)
+{
+	int i;
+
+	while(1) {
+		struct cache_entry *entry = queue_get(to_reader);
+
+		if(entry == NULL) {
+			for(i = 0; i < deflators; i++)
+				queue_put(to_deflate, NULL);
+			return NULL;
+		}
+
+		queue_put(to_deflate, entry);
+	}
+}
+
+
+static void *bench_deflator(void *arg)
+{
+	volatile unsigned int sum = 0;
+	int i;
+
+	while(1) {
+		struct cache_entry *entry = queue_get(to_deflate);
+
+		if(entry == NULL)
+			return NULL;
+
+		/* stand-in for compressor_uncompress() */
+		for(i = 0; i < work; i++)
+			sum += entry->data[i & (BENCH_BLOCK_SIZE - 1)];
+
+		cache_block_ready(entry, FALSE);
+	}
+}
+
+
+static void *bench_writer(void *arg)
+{
+	while(1) {
+		struct cache_entry *entry = queue_get(to_writer);
+
+		if(entry == NULL)
+			return NULL;
+
+		cache_block_wait(entry);
+		cache_block_put(entry);
+	}
+}
+
+
+static double run(int lock_free, int threads, long long blocks)
+{
+	pthread_t reader_thread, writer_thread, deflator_thread[threads];
+	struct cache *cache;
+	struct timeval start, end;
+	long long i;
+
+	deflators = threads;
+	to_reader = queue_init(BENCH_BUFFERS, lock_free);
+	to_deflate = queue_init(BENCH_BUFFERS, lock_free);
+	to_writer = queue_init(1000, lock_free);
+	cache = cache_init(BENCH_BLOCK_SIZE, BENCH_BUFFERS,
+		lock_free ? threads : 1);
+
+	gettimeofday(&start, NULL);
+
+	pthread_create(&reader_thread, NULL, bench_reader, NULL);
+	pthread_create(&writer_thread, NULL, bench_writer, NULL);
+	for(i = 0; i < threads; i++)
+		pthread_create(&deflator_thread[i], NULL, bench_deflator, NULL);
+
+	/* odd stride so block numbers spread over the hash table */
+	for(i = 0; i < blocks; i++)
+		queue_put(to_writer, cache_get(cache, i * 4099, BENCH_BLOCK_SIZE));
+
+	queue_put(to_writer, NULL);
+	queue_put(to_reader, NULL);
+
+	pthread_join(writer_thread, NULL);
+	pthread_join(reader_thread, NULL);
+	for(i = 0; i < threads; i++)
+		pthread_join(deflator_thread[i], NULL);
+
+	gettimeofday(&end, NULL);
+
+	/* the bench leaks its queues and caches, as unsquashfs does */
+	return blocks / ((end.tv_sec - start.tv_sec) +
+		(end.tv_usec - start.tv_usec) / 1000000.0);
+}
+
+
+int main(int argc, char *argv[])
+{
+	int threads, max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	long long blocks = 1000000;
+
+	if(argc > 1)
+		max_threads = atoi(argv[1]);
+	if(argc > 2)
+		blocks = atoll(argv[2]);
+	if(argc > 3)
+		work = atoi(argv[3]);
+
+	if(max_threads < 1 || blocks < 1) {
+		fprintf(stderr, "SYNTAX: %s [max deflator threads] [blocks] "
+			"[work per block]\n", argv[0]);
+		exit(1);
+	}
+
+	pthread_mutex_init(&screen_mutex, NULL);
+
+	printf("%8s %16s %16s\n", "threads", "locked blk/s", "lock-free blk/s");
+	for(threads = 1; threads <= max_threads; threads <<= 1)
+		printf("%8d %16.0f %16.0f\n", threads, run(FALSE, threads,
+			blocks), run(TRUE, threads, blocks));
+
+	return 0;
+}
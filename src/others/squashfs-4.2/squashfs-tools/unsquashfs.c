@@ -33,11 +33,20 @@
 
 struct cache *fragment_cache, *data_cache;
 struct queue *to_reader, *to_deflate, *to_writer, *from_writer;
-pthread_t *thread, *deflator_thread;
+pthread_t *thread, *deflator_thread, *writer_thread;
 pthread_mutex_t	fragment_mutex;
 
+/* -lock-free: lock-free block queues and a cache shard per processor */
+int lock_free = FALSE;
+
 /* user options that control parallelisation */
 int processors = -1;
+int writers = 1;
+
+/* filesystem image mapped into memory, NULL if reading with read() */
+int use_mmap = TRUE;
+char *fs_map = NULL;
+long long fs_map_size;
 
 struct super_block sBlk;
 squashfs_operations s_ops;
@@ -139,295 +148,6 @@ void sigalrm_handler()
 }
 
 
-struct queue *queue_init(int size)
-{
-	struct queue *queue = malloc(sizeof(struct queue));
-
-	if(queue == NULL)
-		EXIT_UNSQUASH("Out of memory in queue_init\n");
-
-	queue->data = malloc(sizeof(void *) * (size + 1));
-	if(queue->data == NULL)
-		EXIT_UNSQUASH("Out of memory in queue_init\n");
-
-	queue->size = size + 1;
-	queue->readp = queue->writep = 0;
-	pthread_mutex_init(&queue->mutex, NULL);
-	pthread_cond_init(&queue->empty, NULL);
-	pthread_cond_init(&queue->full, NULL);
-
-	return queue;
-}
-
-
-void queue_put(struct queue *queue, void *data)
-{
-	int nextp;
-
-	pthread_mutex_lock(&queue->mutex);
-
-	while((nextp = (queue->writep + 1) % queue->size) == queue->readp)
-		pthread_cond_wait(&queue->full, &queue->mutex);
-
-	queue->data[queue->writep] = data;
-	queue->writep = nextp;
-	pthread_cond_signal(&queue->empty);
-	pthread_mutex_unlock(&queue->mutex);
-}
-
-
-void *queue_get(struct queue *queue)
-{
-	void *data;
-	pthread_mutex_lock(&queue->mutex);
-
-	while(queue->readp == queue->writep)
-		pthread_cond_wait(&queue->empty, &queue->mutex);
-
-	data = queue->data[queue->readp];
-	queue->readp = (queue->readp + 1) % queue->size;
-	pthread_cond_signal(&queue->full);
-	pthread_mutex_unlock(&queue->mutex);
-
-	return data;
-}
-
-
-/* Called with the cache mutex held */
-void insert_hash_table(struct cache *cache, struct cache_entry *entry)
-{
-	int hash = CALCULATE_HASH(entry->block);
-
-	entry->hash_next = cache->hash_table[hash];
-	cache->hash_table[hash] = entry;
-	entry->hash_prev = NULL;
-	if(entry->hash_next)
-		entry->hash_next->hash_prev = entry;
-}
-
-
-/* Called with the cache mutex held */
-void remove_hash_table(struct cache *cache, struct cache_entry *entry)
-{
-	if(entry->hash_prev)
-		entry->hash_prev->hash_next = entry->hash_next;
-	else
-		cache->hash_table[CALCULATE_HASH(entry->block)] =
-			entry->hash_next;
-	if(entry->hash_next)
-		entry->hash_next->hash_prev = entry->hash_prev;
-
-	entry->hash_prev = entry->hash_next = NULL;
-}
-
-
-/* Called with the cache mutex held */
-void insert_free_list(struct cache *cache, struct cache_entry *entry)
-{
-	if(cache->free_list) {
-		entry->free_next = cache->free_list;
-		entry->free_prev = cache->free_list->free_prev;
-		cache->free_list->free_prev->free_next = entry;
-		cache->free_list->free_prev = entry;
-	} else {
-		cache->free_list = entry;
-		entry->free_prev = entry->free_next = entry;
-	}
-}
-
-
-/* Called with the cache mutex held */
-void remove_free_list(struct cache *cache, struct cache_entry *entry)
-{
-	if(entry->free_prev == NULL && entry->free_next == NULL)
-		/* not in free list */
-		return;
-	else if(entry->free_prev == entry && entry->free_next == entry) {
-		/* only this entry in the free list */
-		cache->free_list = NULL;
-	} else {
-		/* more than one entry in the free list */
-		entry->free_next->free_prev = entry->free_prev;
-		entry->free_prev->free_next = entry->free_next;
-		if(cache->free_list == entry)
-			cache->free_list = entry->free_next;
-	}
-
-	entry->free_prev = entry->free_next = NULL;
-}
-
-
-struct cache *cache_init(int buffer_size, int max_buffers)
-{
-	struct cache *cache = malloc(sizeof(struct cache));
-
-	if(cache == NULL)
-		EXIT_UNSQUASH("Out of memory in cache_init\n");
-
-	cache->max_buffers = max_buffers;
-	cache->buffer_size = buffer_size;
-	cache->count = 0;
-	cache->free_list = NULL;
-	memset(cache->hash_table, 0, sizeof(struct cache_entry *) * 65536);
-	cache->wait_free = FALSE;
-	cache->wait_pending = FALSE;
-	pthread_mutex_init(&cache->mutex, NULL);
-	pthread_cond_init(&cache->wait_for_free, NULL);
-	pthread_cond_init(&cache->wait_for_pending, NULL);
-
-	return cache;
-}
-
-
-struct cache_entry *cache_get(struct cache *cache, long long block, int size)
-{
-	/*
-	 * Get a block out of the cache.  If the block isn't in the cache
- 	 * it is added and queued to the reader() and deflate() threads for
- 	 * reading off disk and decompression.  The cache grows until max_blocks
- 	 * is reached, once this occurs existing discarded blocks on the free
- 	 * list are reused
- 	 */
-	int hash = CALCULATE_HASH(block);
-	struct cache_entry *entry;
-
-	pthread_mutex_lock(&cache->mutex);
-
-	for(entry = cache->hash_table[hash]; entry; entry = entry->hash_next)
-		if(entry->block == block)
-			break;
-
-	if(entry) {
-		/*
- 		 * found the block in the cache, increment used count and
- 		 * if necessary remove from free list so it won't disappear
- 		 */
-		entry->used ++;
-		remove_free_list(cache, entry);
-		pthread_mutex_unlock(&cache->mutex);
-	} else {
-		/*
- 		 * not in the cache
-		 *
-		 * first try to allocate new block
-		 */
-		if(cache->count < cache->max_buffers) {
-			entry = malloc(sizeof(struct cache_entry));
-			if(entry == NULL)
-				EXIT_UNSQUASH("Out of memory in cache_get\n");
-			entry->data = malloc(cache->buffer_size);
-			if(entry->data == NULL)
-				EXIT_UNSQUASH("Out of memory in cache_get\n");
-			entry->cache = cache;
-			entry->free_prev = entry->free_next = NULL;
-			cache->count ++;
-		} else {
-			/*
-			 * try to get from free list
-			 */
-			while(cache->free_list == NULL) {
-				cache->wait_free = TRUE;
-				pthread_cond_wait(&cache->wait_for_free,
-					&cache->mutex);
-			}
-			entry = cache->free_list;
-			remove_free_list(cache, entry);
-			remove_hash_table(cache, entry);
-		}
-
-		/*
-		 * initialise block and insert into the hash table
-		 */
-		entry->block = block;
-		entry->size = size;
-		entry->used = 1;
-		entry->error = FALSE;
-		entry->pending = TRUE;
-		insert_hash_table(cache, entry);
-
-		/*
-		 * queue to read thread to read and ultimately (via the
-		 * decompress threads) decompress the buffer
- 		 */
-		pthread_mutex_unlock(&cache->mutex);
-		queue_put(to_reader, entry);
-	}
-
-	return entry;
-}
-
-	
-void cache_block_ready(struct cache_entry *entry, int error)
-{
-	/*
-	 * mark cache entry as being complete, reading and (if necessary)
- 	 * decompression has taken place, and the buffer is valid for use.
- 	 * If an error occurs reading or decompressing, the buffer also 
- 	 * becomes ready but with an error...
- 	 */
-	pthread_mutex_lock(&entry->cache->mutex);
-	entry->pending = FALSE;
-	entry->error = error;
-
-	/*
-	 * if the wait_pending flag is set, one or more threads may be waiting
-	 * on this buffer
-	 */
-	if(entry->cache->wait_pending) {
-		entry->cache->wait_pending = FALSE;
-		pthread_cond_broadcast(&entry->cache->wait_for_pending);
-	}
-
-	pthread_mutex_unlock(&entry->cache->mutex);
-}
-
-
-void cache_block_wait(struct cache_entry *entry)
-{
-	/*
-	 * wait for this cache entry to become ready, when reading and (if
-	 * necessary) decompression has taken place
-	 */
-	pthread_mutex_lock(&entry->cache->mutex);
-
-	while(entry->pending) {
-		entry->cache->wait_pending = TRUE;
-		pthread_cond_wait(&entry->cache->wait_for_pending,
-			&entry->cache->mutex);
-	}
-
-	pthread_mutex_unlock(&entry->cache->mutex);
-}
-
-
-void cache_block_put(struct cache_entry *entry)
-{
-	/*
-	 * finished with this cache entry, once the usage count reaches zero it
- 	 * can be reused and is put onto the free list.  As it remains
- 	 * accessible via the hash table it can be found getting a new lease of
- 	 * life before it is reused.
- 	 */
-	pthread_mutex_lock(&entry->cache->mutex);
-
-	entry->used --;
-	if(entry->used == 0) {
-		insert_free_list(entry->cache, entry);
-
-		/*
-		 * if the wait_free flag is set, one or more threads may be
-		 * waiting on this buffer
-		 */
-		if(entry->cache->wait_free) {
-			entry->cache->wait_free = FALSE;
-			pthread_cond_broadcast(&entry->cache->wait_for_free);
-		}
-	}
-
-	pthread_mutex_unlock(&entry->cache->mutex);
-}
-
-
 char *modestr(char *str, int mode)
 {
 	int i;
@@ -540,6 +260,46 @@ int lookup_entry(struct hash_table_entry *hash_table[], long long start)
 }
 
 
+/*
+ * map the filesystem image, if it is a regular file, so blocks can be
+ * decompressed straight from the page cache.  Failure isn't fatal, the
+ * image is then read with read()
+ */
+void map_filesystem(int fd)
+{
+	struct stat buf;
+
+	if(fstat(fd, &buf) == -1 || !S_ISREG(buf.st_mode) ||
+			buf.st_size == 0 || buf.st_size != (size_t) buf.st_size)
+		return;
+
+	fs_map = mmap(NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(fs_map == MAP_FAILED) {
+		TRACE("map_filesystem: mmap failed because %s\n",
+			strerror(errno));
+		fs_map = NULL;
+		return;
+	}
+
+	fs_map_size = buf.st_size;
+}
+
+
+/*
+ * return a pointer to bytes in the mapped filesystem, or NULL if they
+ * lie outside the image
+ */
+char *map_fs_bytes(long long byte, int bytes)
+{
+	if(byte < 0 || bytes < 0 || byte + bytes > fs_map_size) {
+		ERROR("Read on filesystem failed because EOF\n");
+		return NULL;
+	}
+
+	return fs_map + byte;
+}
+
+
 int read_fs_bytes(int fd, long long byte, int bytes, void *buff)
 {
 	off_t off = byte;
@@ -548,6 +308,15 @@ int read_fs_bytes(int fd, long long byte, int bytes, void *buff)
 	TRACE("read_bytes: reading from position 0x%llx, bytes %d\n", byte,
 		bytes);
 
+	if(fs_map) {
+		char *src = map_fs_bytes(byte, bytes);
+
+		if(src == NULL)
+			return FALSE;
+		memcpy(buff, src, bytes);
+		return TRUE;
+	}
+
 	if(lseek(fd, off, SEEK_SET) == -1) {
 		ERROR("Lseek failed because %s\n", strerror(errno));
 		return FALSE;
@@ -593,14 +362,20 @@ int read_block(int fd, long long start, long long *next, void *block)
 	if(SQUASHFS_CHECK_DATA(sBlk.s.flags))
 		offset = 3;
 	if(SQUASHFS_COMPRESSED(c_byte)) {
-		char buffer[SQUASHFS_METADATA_SIZE];
+		char buffer[SQUASHFS_METADATA_SIZE], *src = buffer;
 		int error, res;
 
 		c_byte = SQUASHFS_COMPRESSED_SIZE(c_byte);
-		if(read_fs_bytes(fd, start + offset, c_byte, buffer) == FALSE)
+		if(fs_map) {
+			/* decompress straight from the mapped filesystem */
+			src = map_fs_bytes(start + offset, c_byte);
+			if(src == NULL)
+				goto failed;
+		} else if(read_fs_bytes(fd, start + offset, c_byte, buffer) ==
+				FALSE)
 			goto failed;
 
-		res = compressor_uncompress(comp, block, buffer, c_byte,
+		res = compressor_uncompress(comp, block, src, c_byte,
 			SQUASHFS_METADATA_SIZE, &error);
 
 		if(res == -1) {
@@ -757,13 +532,6 @@ int write_block(int file_fd, char *buffer, int size, long long hole, int sparse)
 				lseek_broken = TRUE;
 		}
 
-		if((sparse == FALSE || lseek_broken) && zero_data == NULL) {
-			if((zero_data = malloc(block_size)) == NULL)
-				EXIT_UNSQUASH("write_block: failed to alloc "
-					"zero data block\n");
-			memset(zero_data, 0, block_size);
-		}
-
 		if(sparse == FALSE || lseek_broken) {
 			int blocks = (hole + block_size -1) / block_size;
 			int avail_bytes, i;
@@ -816,9 +584,11 @@ int write_file(struct inode *inode, char *pathname)
 		EXIT_UNSQUASH("write_file: unable to malloc file\n");
 
 	/*
-	 * the writer thread is queued a squashfs_file structure describing the
- 	 * file.  If the file has one or more blocks or a fragments they are
- 	 * queued separately (references to blocks in the cache).
+	 * the writer threads are queued a squashfs_file structure describing
+ 	 * the file first, then the file's blocks and fragment (references
+ 	 * to blocks in the cache) follow on the file's own queue as they are
+ 	 * obtained, so the whole file goes to one writer, and a file larger
+ 	 * than the cache streams through it
  	 */
 	file->fd = file_fd;
 	file->file_size = inode->data;
@@ -830,14 +600,18 @@ int write_file(struct inode *inode, char *pathname)
 	file->blocks = inode->blocks + (inode->frag_bytes > 0);
 	file->sparse = inode->sparse;
 	file->xattr = inode->xattr;
+	file->block = malloc(file->blocks * sizeof(struct file_entry));
+	if(file->block == NULL && file->blocks)
+		EXIT_UNSQUASH("write_file: unable to malloc file\n");
+	file->queue = queue_init(file->blocks < FILE_QUEUE_SIZE ?
+		file->blocks : FILE_QUEUE_SIZE, FALSE);
+
 	queue_put(to_writer, file);
 
 	for(i = 0; i < inode->blocks; i++) {
 		int c_byte = SQUASHFS_COMPRESSED_SIZE_BLOCK(block_list[i]);
-		struct file_entry *block = malloc(sizeof(struct file_entry));
+		struct file_entry *block = &file->block[i];
 
-		if(block == NULL)
-			EXIT_UNSQUASH("write_file: unable to malloc file\n");
 		block->offset = 0;
 		block->size = i == file_end ? inode->data & (block_size - 1) :
 			block_size;
@@ -848,21 +622,19 @@ int write_file(struct inode *inode, char *pathname)
 				block_list[i]);
 			start += c_byte;
 		}
-		queue_put(to_writer, block);
+		queue_put(file->queue, block);
 	}
 
 	if(inode->frag_bytes) {
 		int size;
 		long long start;
-		struct file_entry *block = malloc(sizeof(struct file_entry));
+		struct file_entry *block = &file->block[inode->blocks];
 
-		if(block == NULL)
-			EXIT_UNSQUASH("write_file: unable to malloc file\n");
 		s_ops.read_fragment(inode->fragment, &start, &size);
 		block->buffer = cache_get(fragment_cache, start, size);
 		block->offset = inode->offset;
 		block->size = inode->frag_bytes;
-		queue_put(to_writer, block);
+		queue_put(file->queue, block);
 	}
 
 	free(block_list);
@@ -1619,7 +1391,28 @@ void *reader(void *arg)
 {
 	while(1) {
 		struct cache_entry *entry = queue_get(to_reader);
-		int res = read_fs_bytes(fd, entry->block,
+		int res;
+
+		if(fs_map) {
+			/*
+			 * the deflators decompress straight from the mapped
+			 * filesystem, and an uncompressed block is used in
+			 * place, without copying it into the cache buffer
+			 */
+			char *src = map_fs_bytes(entry->block,
+				SQUASHFS_COMPRESSED_SIZE_BLOCK(entry->size));
+
+			if(src && SQUASHFS_COMPRESSED_BLOCK(entry->size))
+				queue_put(to_deflate, entry);
+			else {
+				if(src)
+					entry->data = src;
+				cache_block_ready(entry, src == NULL);
+			}
+			continue;
+		}
+
+		res = read_fs_bytes(fd, entry->block,
 			SQUASHFS_COMPRESSED_SIZE_BLOCK(entry->size),
 			entry->data);
 
@@ -1643,7 +1436,9 @@ void *reader(void *arg)
 
 /*
  * writer thread.  This processes file write requests queued by the
- * write_file() routine.
+ * write_file() routine.  There can be several writer threads, each file
+ * and all its blocks are written by the one writer which dequeues it,
+ * taking the blocks from the file's queue as write_file() obtains them.
  */
 void *writer(void *arg)
 {
@@ -1656,21 +1451,26 @@ void *writer(void *arg)
 		int failed = FALSE;
 		int error;
 
+		/*
+		 * each writer exits on its end marker, so once every writer
+		 * has answered on from_writer all files have been written
+		 */
 		if(file == NULL) {
 			queue_put(from_writer, NULL);
-			continue;
+			return NULL;
 		}
 
 		TRACE("writer: regular file, blocks %d\n", file->blocks);
 
 		file_fd = file->fd;
 
-		for(i = 0; i < file->blocks; i++, cur_blocks ++) {
-			struct file_entry *block = queue_get(to_writer);
+		for(i = 0; i < file->blocks; i++) {
+			struct file_entry *block = queue_get(file->queue);
+
+			__atomic_add_fetch(&cur_blocks, 1, __ATOMIC_RELAXED);
 
 			if(block->buffer == 0) { /* sparse file */
 				hole += block->size;
-				free(block);
 				continue;
 			}
 
@@ -1679,21 +1479,20 @@ void *writer(void *arg)
 			if(block->buffer->error)
 				failed = TRUE;
 
-			if(failed)
-				continue;
+			if(failed == FALSE) {
+				error = write_block(file_fd,
+					block->buffer->data + block->offset,
+					block->size, hole, file->sparse);
 
-			error = write_block(file_fd, block->buffer->data +
-				block->offset, block->size, hole, file->sparse);
-
-			if(error == FALSE) {
-				ERROR("writer: failed to write data block %d\n",
-					i);
-				failed = TRUE;
+				if(error == FALSE) {
+					ERROR("writer: failed to write data "
+						"block %d\n", i);
+					failed = TRUE;
+				}
 			}
 
 			hole = 0;
 			cache_block_put(block->buffer);
-			free(block);
 		}
 
 		if(hole && failed == FALSE) {
@@ -1730,7 +1529,9 @@ void *writer(void *arg)
 			ERROR("Failed to write %s, skipping\n", file->pathname);
 			unlink(file->pathname);
 		}
+		queue_delete(file->queue);
 		free(file->pathname);
+		free(file->block);
 		free(file);
 
 	}
@@ -1746,16 +1547,37 @@ void *deflator(void *arg)
 
 	while(1) {
 		struct cache_entry *entry = queue_get(to_deflate);
-		int error, res;
+		int error, res = -1;
+		int c_byte = SQUASHFS_COMPRESSED_SIZE_BLOCK(entry->size);
+		unsigned long long hash = 0;
 
-		res = compressor_uncompress(comp, tmp, entry->data,
-			SQUASHFS_COMPRESSED_SIZE_BLOCK(entry->size), block_size,
-			&error);
+		/*
+		 * with the filesystem mapped, decompress straight from the
+		 * map into the cache buffer, otherwise the compressed data
+		 * is in the cache buffer, so decompress via tmp
+		 */
+		char *src = fs_map ? fs_map + entry->block : entry->data;
+		char *dest = fs_map ? entry->data : tmp;
 
-		if(res == -1)
-			ERROR("%s uncompress failed with error code %d\n",
-				comp->name, error);
-		else
+		if(block_cache_dir) {
+			hash = block_cache_hash(src, c_byte);
+			res = block_cache_lookup(hash, src, c_byte, dest,
+				block_size);
+		}
+
+		if(res == -1) {
+			res = compressor_uncompress(comp, dest, src, c_byte,
+				block_size, &error);
+
+			if(res == -1)
+				ERROR("%s uncompress failed with error code "
+					"%d\n", comp->name, error);
+			else if(block_cache_dir)
+				block_cache_store(hash, src, c_byte, dest,
+					res);
+		}
+
+		if(res != -1 && dest == tmp)
 			memcpy(entry->data, tmp, res);
 
 		/*
@@ -1813,7 +1635,7 @@ void *progress_thread(void *arg)
 
 void initialise_threads(int fragment_buffer_size, int data_buffer_size)
 {
-	int i;
+	int i, shards;
 	sigset_t sigmask, old_mask;
 	int all_buffers_size = fragment_buffer_size + data_buffer_size;
 
@@ -1849,20 +1671,32 @@ void initialise_threads(int fragment_buffer_size, int data_buffer_size)
 	}
 #endif /* __CYGWIN__ */
 
-	thread = malloc((3 + processors) * sizeof(pthread_t));
+	thread = malloc((2 + processors + writers) * sizeof(pthread_t));
 	if(thread == NULL)
 		EXIT_UNSQUASH("Out of memory allocating thread descriptors\n");
-	deflator_thread = &thread[3];
-
-	to_reader = queue_init(all_buffers_size);
-	to_deflate = queue_init(all_buffers_size);
-	to_writer = queue_init(1000);
-	from_writer = queue_init(1);
-	fragment_cache = cache_init(block_size, fragment_buffer_size);
-	data_cache = cache_init(block_size, data_buffer_size);
+	deflator_thread = &thread[2];
+	writer_thread = &thread[2 + processors];
+
+	zero_data = malloc(block_size);
+	if(zero_data == NULL)
+		EXIT_UNSQUASH("Out of memory allocating zero data block\n");
+	memset(zero_data, 0, block_size);
+
+	/*
+	 * with -lock-free the block queues don't take a lock unless a thread
+	 * has to sleep, and the caches are split into one shard per
+	 * processor (rounded down to a power of two)
+	 */
+	shards = lock_free ? processors : 1;
+
+	to_reader = queue_init(all_buffers_size, lock_free);
+	to_deflate = queue_init(all_buffers_size, lock_free);
+	to_writer = queue_init(1000, lock_free);
+	from_writer = queue_init(1, FALSE);
+	fragment_cache = cache_init(block_size, fragment_buffer_size, shards);
+	data_cache = cache_init(block_size, data_buffer_size, shards);
 	pthread_create(&thread[0], NULL, reader, NULL);
-	pthread_create(&thread[1], NULL, writer, NULL);
-	pthread_create(&thread[2], NULL, progress_thread, NULL);
+	pthread_create(&thread[1], NULL, progress_thread, NULL);
 	pthread_mutex_init(&fragment_mutex, NULL);
 
 	for(i = 0; i < processors; i++) {
@@ -1871,8 +1705,15 @@ void initialise_threads(int fragment_buffer_size, int data_buffer_size)
 			EXIT_UNSQUASH("Failed to create thread\n");
 	}
 
-	printf("Parallel unsquashfs: Using %d processor%s\n", processors,
-			processors == 1 ? "" : "s");
+	for(i = 0; i < writers; i++) {
+		if(pthread_create(&writer_thread[i], NULL, writer, NULL) != 0)
+			EXIT_UNSQUASH("Failed to create thread\n");
+	}
+
+	printf("Parallel unsquashfs: Using %d processor%s, %d writer%s%s\n",
+			processors, processors == 1 ? "" : "s", writers,
+			writers == 1 ? "" : "s", lock_free ?
+			" (lock-free queues)" : "");
 
 	if(sigprocmask(SIG_SETMASK, &old_mask, NULL) == -1)
 		EXIT_UNSQUASH("Failed to set signal mask in intialise_threads"
@@ -1974,7 +1815,7 @@ void progress_bar(long long current, long long max, int columns)
 	printf("GNU General Public License for more details.\n");
 int main(int argc, char *argv[])
 {
-	char *dest = "squashfs-root";
+	char *dest = "squashfs-root", *cache_dir = NULL;
 	int i, stat_sys = FALSE, version = FALSE;
 	int n;
 	struct pathnames *paths = NULL;
@@ -2032,7 +1873,47 @@ int main(int argc, char *argv[])
 					argv[0]);
 				exit(1);
 			}
-		} else if(strcmp(argv[i], "-data-queue") == 0 ||
+		} else if(strcmp(argv[i], "-writers") == 0 ||
+				strcmp(argv[i], "-w") == 0) {
+			if((++i == argc) ||
+					(writers = strtol(argv[i], &b, 10),
+					*b != '\0')) {
+				ERROR("%s: -writers missing or invalid "
+					"writer number\n", argv[0]);
+				exit(1);
+			}
+			if(writers < 1) {
+				ERROR("%s: -writers should be 1 or larger\n",
+					argv[0]);
+				exit(1);
+			}
+		} else if(strcmp(argv[i], "-no-mmap") == 0 ||
+				strcmp(argv[i], "-nm") == 0)
+			use_mmap = FALSE;
+		else if(strcmp(argv[i], "-cache") == 0) {
+			if(++i == argc) {
+				ERROR("%s: -cache missing directory\n",
+					argv[0]);
+				exit(1);
+			}
+			cache_dir = argv[i];
+		} else if(strcmp(argv[i], "-cache-size") == 0) {
+			if((++i == argc) ||
+					(block_cache_mbytes = strtol(argv[i],
+					&b, 10), *b != '\0')) {
+				ERROR("%s: -cache-size missing or invalid "
+					"cache size\n", argv[0]);
+				exit(1);
+			}
+			if(block_cache_mbytes < 1) {
+				ERROR("%s: -cache-size should be 1 Mbyte or "
+					"larger\n", argv[0]);
+				exit(1);
+			}
+		} else if(strcmp(argv[i], "-lock-free") == 0 ||
+				strcmp(argv[i], "-lo") == 0)
+			lock_free = TRUE;
+		else if(strcmp(argv[i], "-data-queue") == 0 ||
 					 strcmp(argv[i], "-da") == 0) {
 			if((++i == argc) ||
 					(data_buffer_size = strtol(argv[i], &b,
@@ -2114,6 +1995,13 @@ options:
 			ERROR("\t-p[rocessors] <number>\tuse <number> "
 				"processors.  By default will use\n");
 			ERROR("\t\t\t\tnumber of processors available\n");
+			ERROR("\t-w[riters] <number>\tuse <number> writer "
+				"threads.  Default 1\n");
+			ERROR("\t-lo[ck-free]\t\tuse lock-free queues and "
+				"sharded caches\n\t\t\t\tbetween threads\n");
+			ERROR("\t-n[o-]m[map]\t\tread the filesystem with "
+				"read() rather than\n\t\t\t\tmapping it into "
+				"memory\n");
 			ERROR("\t-i[nfo]\t\t\tprint files as they are "
 				"unsquashed\n");
 			ERROR("\t-li[nfo]\t\tprint files as they are "
@@ -2136,6 +2024,11 @@ options:
 			ERROR("\t-fr[ag-queue] <size>\tSet fragment queue to "
 				"<size> Mbytes.  Default\n\t\t\t\t%d Mbytes\n",
 				FRAGMENT_BUFFER_DEFAULT);
+			ERROR("\t-cache <dir>\t\tcache decompressed data blocks "
+				"in <dir>, shared\n\t\t\t\tbetween runs\n");
+			ERROR("\t-cache-size <size>\tlimit the -cache directory "
+				"to <size> Mbytes.\n\t\t\t\tDefault %d Mbytes\n",
+				BLOCK_CACHE_DEFAULT);
 			ERROR("\t-r[egex]\t\ttreat extract names as POSIX "
 				"regular expressions\n");
 			ERROR("\t\t\t\trather than use the default shell "
@@ -2155,6 +2048,12 @@ options:
 		exit(1);
 	}
 
+	if(use_mmap)
+		map_filesystem(fd);
+
+	if(cache_dir && block_cache_init(cache_dir) == FALSE)
+		exit(1);
+
 	if(read_super(argv[i]) == FALSE)
 		exit(1);
 
@@ -2234,8 +2133,11 @@ options:
 	dir_scan(dest, SQUASHFS_INODE_BLK(sBlk.s.root_inode),
 		SQUASHFS_INODE_OFFSET(sBlk.s.root_inode), paths);
 
-	queue_put(to_writer, NULL);
-	queue_get(from_writer);
+	/* wait for every writer to finish its files */
+	for(i = 0; i < writers; i++)
+		queue_put(to_writer, NULL);
+	for(i = 0; i < writers; i++)
+		queue_get(from_writer);
 
 	if(progress) {
 		disable_progress_bar();
@@ -2252,5 +2154,12 @@ options:
 		printf("created %d fifos\n", fifo_count);
 	}
 
+	if(block_cache_dir) {
+		if(!lsonly)
+			printf("block cache %d hits, %d misses\n",
+				block_cache_hits, block_cache_misses);
+		block_cache_trim();
+	}
+
 	return 0;
 }
@@ -159,23 +159,34 @@ struct test {
 
 
 /* Cache status struct.  Caches are used to keep
-  track of memory buffers passed between different threads */
-struct cache {
+  track of memory buffers passed between different threads.  The cache
+  is split into shards, each hash chain belonging to exactly one shard,
+  so that threads working on different blocks take different locks */
+#define QUEUE_CACHE_LINE 64
+
+struct cache_shard {
 	int	max_buffers;
 	int	count;
-	int	buffer_size;
 	int	wait_free;
 	int	wait_pending;
 	pthread_mutex_t	mutex;
 	pthread_cond_t wait_for_free;
 	pthread_cond_t wait_for_pending;
 	struct cache_entry *free_list;
+} __attribute__ ((aligned (QUEUE_CACHE_LINE)));
+
+struct cache {
+	int	max_buffers;
+	int	buffer_size;
+	int	shards;
+	struct cache_shard *shard;
 	struct cache_entry *hash_table[65536];
 };
 
 /* struct describing a cache entry passed between threads */
 struct cache_entry {
 	struct cache *cache;
+	struct cache_shard *shard;
 	long long block;
 	int	size;
 	int	used;
@@ -186,6 +197,13 @@ struct cache_entry {
 	struct cache_entry *free_next;
 	struct cache_entry *free_prev;
 	char *data;
+	char *buffer;
+};
+
+/* slot in a lock-free queue */
+struct queue_cell {
+	unsigned long seq;
+	void *data;
 };
 
 /* struct describing queues used to pass data between threads */
@@ -197,6 +215,15 @@ struct queue {
 	pthread_cond_t empty;
 	pthread_cond_t full;
 	void **data;
+
+	/* lock-free mode, the mutex above is only used to sleep */
+	int	lock_free;
+	int	wait_get;
+	int	wait_put;
+	unsigned long mask;
+	struct queue_cell *cells;
+	unsigned long head __attribute__ ((aligned (QUEUE_CACHE_LINE)));
+	unsigned long tail __attribute__ ((aligned (QUEUE_CACHE_LINE)));
 };
 
 /* default size of fragment buffer in Mbytes */
@@ -204,6 +231,12 @@ struct queue {
 /* default size of data buffer in Mbytes */
 #define DATA_BUFFER_DEFAULT 256
 
+/* blocks of a file waiting for its writer, the cache bounds the rest */
+#define FILE_QUEUE_SIZE 64
+
+/* default size limit of the -cache block cache in Mbytes */
+#define BLOCK_CACHE_DEFAULT 512
+
 #define DIR_ENT_SIZE	16
 
 struct dir_ent	{
@@ -231,9 +264,16 @@ struct file_entry {
 };
 
 
+/*
+ * a regular file queued to a writer thread.  Its blocks follow on the
+ * file's own queue as they are obtained, so that one writer writes the
+ * whole file without the file having to fit in the cache
+ */
 struct squashfs_file {
 	int fd;
 	int blocks;
+	struct file_entry *block;
+	struct queue *queue;
 	long long file_size;
 	int mode;
 	uid_t uid;
@@ -274,12 +314,34 @@ extern int progress_enabled;
 extern int inode_number;
 extern int lookup_type[];
 extern int fd;
+extern struct compressor *comp;
 
 /* unsquashfs.c */
+extern struct queue *to_reader;
 extern int lookup_entry(struct hash_table_entry **, long long);
 extern int read_fs_bytes(int fd, long long, int, void *);
 extern int read_block(int, long long, long long *, void *);
 
+/* unsquashfs_queue.c */
+extern struct queue *queue_init(int, int);
+extern void queue_put(struct queue *, void *);
+extern void *queue_get(struct queue *);
+extern void queue_delete(struct queue *);
+extern struct cache *cache_init(int, int, int);
+extern struct cache_entry *cache_get(struct cache *, long long, int);
+extern void cache_block_ready(struct cache_entry *, int);
+extern void cache_block_wait(struct cache_entry *);
+extern void cache_block_put(struct cache_entry *);
+
+/* unsquashfs_cache.c */
+extern char *block_cache_dir;
+extern int block_cache_mbytes, block_cache_hits, block_cache_misses;
+extern int block_cache_init(char *);
+extern unsigned long long block_cache_hash(void *, int);
+extern int block_cache_lookup(unsigned long long, void *, int, void *, int);
+extern void block_cache_store(unsigned long long, void *, int, void *, int);
+extern void block_cache_trim();
+
 /* unsquash-1.c */
 extern void read_block_list_1(unsigned int *, char *, int);
 extern int read_fragment_table_1();
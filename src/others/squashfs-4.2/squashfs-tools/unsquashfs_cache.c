@@ -0,0 +1,316 @@
+/*
+ * Unsquash a squashfs filesystem.  This is a highly compressed read only
+ * filesystem.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * unsquashfs_cache.c
+ *
+ * On-disk cache of decompressed data blocks shared between unsquashfs
+ * runs (-cache <dir>).  Blocks are keyed by a hash of their compressed
+ * bytes, so identical blocks in successive releases of a firmware are
+ * only decompressed once.  Each block is a file <dir>/<xx>/<hash>-<size>,
+ * written to a temporary name and renamed so concurrent runs can share
+ * the directory.  The file holds a small header, the compressed bytes and
+ * then the decompressed block, and a lookup only hits if all of them
+ * match, so a hash collision or a truncated file can never return the
+ * wrong data.  Hits refresh the file's mtime, and the cache is trimmed
+ * back to its size limit, oldest first, when unsquashfs finishes.
+ */
+
+#include "unsquashfs.h"
+#include "compressor.h"
+#include "xxhash.h"
+
+#include <dirent.h>
+
+char *block_cache_dir = NULL;
+int block_cache_mbytes = BLOCK_CACHE_DEFAULT;
+int block_cache_hits = 0, block_cache_misses = 0;
+
+#define BLOCK_CACHE_MAGIC	0x31636273	/* "sbc1" */
+
+struct block_cache_header {
+	unsigned int	magic;
+	int		c_byte;
+	int		size;
+	int		unused;
+};
+
+struct block_cache_file {
+	time_t	mtime;
+	off_t	size;
+	char	*pathname;
+};
+
+
+int block_cache_init(char *dir)
+{
+	if(mkdir(dir, 0755) == -1 && errno != EEXIST) {
+		ERROR("Failed to create block cache directory %s, because "
+			"%s\n", dir, strerror(errno));
+		return FALSE;
+	}
+
+	block_cache_dir = dir;
+	return TRUE;
+}
+
+
+unsigned long long block_cache_hash(void *block, int c_byte)
+{
+	/* seeded with the compressor so different compressors never match */
+	return xxh64(block, c_byte, comp->id);
+}
+
+
+static void block_cache_name(char *pathname, unsigned long long hash,
+	int c_byte)
+{
+	sprintf(pathname, "%s/%02x/%016llx-%x", block_cache_dir,
+		(unsigned int) (hash >> 56), hash, c_byte);
+}
+
+
+/*
+ * read or write up to len bytes, retrying on EINTR, and return the number
+ * transferred (less than len on EOF or error)
+ */
+static int block_cache_read(int file, void *buf, int len)
+{
+	int res, count;
+
+	for(count = 0; count < len; count += res) {
+		res = read(file, buf + count, len - count);
+		if(res == 0)
+			break;
+		if(res == -1) {
+			if(errno == EINTR) {
+				res = 0;
+				continue;
+			}
+			break;
+		}
+	}
+
+	return count;
+}
+
+
+static int block_cache_write(int file, void *buf, int len)
+{
+	int res, count;
+
+	for(count = 0; count < len; count += res) {
+		res = write(file, buf + count, len - count);
+		if(res == -1) {
+			if(errno == EINTR) {
+				res = 0;
+				continue;
+			}
+			break;
+		}
+	}
+
+	return count;
+}
+
+
+/*
+ * look up a block in the cache, returning the decompressed size, or -1 if
+ * the block isn't cached.  A file that doesn't hold exactly this block is
+ * removed
+ */
+int block_cache_lookup(unsigned long long hash, void *src, int c_byte,
+	void *block, int outsize)
+{
+	char pathname[strlen(block_cache_dir) + 32];
+	struct block_cache_header header;
+	char *compressed = NULL;
+	char extra;
+	int file;
+
+	block_cache_name(pathname, hash, c_byte);
+
+	file = open(pathname, O_RDONLY);
+	if(file == -1)
+		goto miss;
+
+	if(block_cache_read(file, &header, sizeof(header)) != sizeof(header) ||
+			header.magic != BLOCK_CACHE_MAGIC ||
+			header.c_byte != c_byte || header.size < 1 ||
+			header.size > outsize)
+		goto invalid;
+
+	compressed = malloc(c_byte);
+	if(compressed == NULL)
+		EXIT_UNSQUASH("Out of memory in block_cache_lookup\n");
+
+	if(block_cache_read(file, compressed, c_byte) != c_byte ||
+			memcmp(compressed, src, c_byte) != 0 ||
+			block_cache_read(file, block, header.size) !=
+			header.size || block_cache_read(file, &extra, 1) != 0)
+		goto invalid;
+
+	free(compressed);
+	close(file);
+
+	/* refresh the mtime, which the trim uses as the last use time */
+	utime(pathname, NULL);
+
+	__atomic_add_fetch(&block_cache_hits, 1, __ATOMIC_RELAXED);
+	return header.size;
+
+invalid:
+	free(compressed);
+	close(file);
+	unlink(pathname);
+miss:
+	__atomic_add_fetch(&block_cache_misses, 1, __ATOMIC_RELAXED);
+	return -1;
+}
+
+
+void block_cache_store(unsigned long long hash, void *src, int c_byte,
+	void *block, int size)
+{
+	char pathname[strlen(block_cache_dir) + 32];
+	char tmpname[strlen(block_cache_dir) + 40];
+	struct block_cache_header header;
+	int file, res;
+
+	block_cache_name(pathname, hash, c_byte);
+	sprintf(tmpname, "%s.XXXXXX", pathname);
+
+	file = mkstemp(tmpname);
+	if(file == -1 && errno == ENOENT) {
+		/* first block in this subdirectory */
+		char *slash = strrchr(pathname, '/');
+
+		*slash = '\0';
+		mkdir(pathname, 0755);
+		*slash = '/';
+
+		/* a failed mkstemp() may have overwritten the XXXXXX */
+		sprintf(tmpname, "%s.XXXXXX", pathname);
+		file = mkstemp(tmpname);
+	}
+
+	/* the cache is an optimisation, failing to store isn't an error */
+	if(file == -1)
+		return;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = BLOCK_CACHE_MAGIC;
+	header.c_byte = c_byte;
+	header.size = size;
+
+	res = block_cache_write(file, &header, sizeof(header)) ==
+		sizeof(header) &&
+		block_cache_write(file, src, c_byte) == c_byte &&
+		block_cache_write(file, block, size) == size;
+
+	if(close(file) == -1 || !res || rename(tmpname, pathname) == -1)
+		unlink(tmpname);
+}
+
+
+static int block_cache_compare(const void *a, const void *b)
+{
+	const struct block_cache_file *fa = a, *fb = b;
+
+	return fa->mtime < fb->mtime ? -1 : fa->mtime > fb->mtime;
+}
+
+
+/*
+ * evict the least recently used blocks until the cache is within its size
+ * limit
+ */
+void block_cache_trim()
+{
+	struct block_cache_file *files = NULL;
+	long long total = 0, limit = (long long) block_cache_mbytes << 20;
+	int i, count = 0, size = 0;
+	DIR *dir, *subdir;
+	struct dirent *d, *sd;
+
+	dir = opendir(block_cache_dir);
+	if(dir == NULL)
+		return;
+
+	while((d = readdir(dir)) != NULL) {
+		char subname[strlen(block_cache_dir) + strlen(d->d_name) + 2];
+
+		if(d->d_name[0] == '.')
+			continue;
+
+		sprintf(subname, "%s/%s", block_cache_dir, d->d_name);
+		subdir = opendir(subname);
+		if(subdir == NULL)
+			continue;
+
+		while((sd = readdir(subdir)) != NULL) {
+			struct stat buf;
+			char *pathname;
+
+			if(sd->d_name[0] == '.')
+				continue;
+
+			pathname = malloc(strlen(subname) +
+				strlen(sd->d_name) + 2);
+			if(pathname == NULL)
+				EXIT_UNSQUASH("Out of memory in "
+					"block_cache_trim\n");
+			sprintf(pathname, "%s/%s", subname, sd->d_name);
+			if(lstat(pathname, &buf) == -1 ||
+					!S_ISREG(buf.st_mode)) {
+				free(pathname);
+				continue;
+			}
+
+			if(count == size) {
+				size = size ? size << 1 : 1024;
+				files = realloc(files, size *
+					sizeof(struct block_cache_file));
+				if(files == NULL)
+					EXIT_UNSQUASH("Out of memory in "
+						"block_cache_trim\n");
+			}
+
+			files[count].mtime = buf.st_mtime;
+			files[count].size = buf.st_size;
+			files[count++].pathname = pathname;
+			total += buf.st_size;
+		}
+
+		closedir(subdir);
+	}
+
+	closedir(dir);
+
+	if(total > limit) {
+		qsort(files, count, sizeof(struct block_cache_file),
+			block_cache_compare);
+
+		for(i = 0; i < count && total > limit; i++)
+			if(unlink(files[i].pathname) == 0)
+				total -= files[i].size;
+	}
+
+	for(i = 0; i < count; i++)
+		free(files[i].pathname);
+	free(files);
+}
@@ -0,0 +1,547 @@
+/*
+ * Unsquash a squashfs filesystem.  This is a highly compressed read only
+ * filesystem.
+ *
+ * Copyright (c) 2002, 2003, 2004, 2005, 2006, 2007, 2008, 2009, 2010
+ * Phillip Lougher <phillip@lougher.demon.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * unsquashfs_queue.c
+ *
+ * Queues and caches used to pass blocks between the reader, deflator and
+ * writer threads.  Queues are either the original mutex/condvar ring, or
+ * a bounded lock-free MPMC ring (selected with -lock-free) which only falls
+ * back to the mutex when a thread has to sleep.  Caches are split into
+ * shards, each with its own mutex, so threads working on different blocks
+ * don't serialise on one lock.  One shard gives the original behaviour.
+ */
+
+#include "unsquashfs.h"
+
+#include <sched.h>
+
+/*
+ * number of times to retry a full/empty lock-free queue before sleeping,
+ * there's no point spinning on a uniprocessor
+ */
+#define QUEUE_SPIN	100
+
+static int queue_spin = -1;
+
+static inline void cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__asm__ __volatile__("pause");
+#endif
+}
+
+
+struct queue *queue_init(int size, int lock_free)
+{
+	struct queue *queue;
+	unsigned long i, cells = 2;
+
+	if(posix_memalign((void **) &queue, QUEUE_CACHE_LINE,
+			sizeof(struct queue)) != 0)
+		EXIT_UNSQUASH("Out of memory in queue_init\n");
+
+	memset(queue, 0, sizeof(struct queue));
+	queue->lock_free = lock_free;
+	pthread_mutex_init(&queue->mutex, NULL);
+	pthread_cond_init(&queue->empty, NULL);
+	pthread_cond_init(&queue->full, NULL);
+
+	if(lock_free) {
+		if(queue_spin == -1)
+			queue_spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ?
+				QUEUE_SPIN : 0;
+
+		/* cell sequence numbers need a power of two ring */
+		while(cells < size)
+			cells <<= 1;
+
+		queue->cells = malloc(sizeof(struct queue_cell) * cells);
+		if(queue->cells == NULL)
+			EXIT_UNSQUASH("Out of memory in queue_init\n");
+
+		for(i = 0; i < cells; i++)
+			queue->cells[i].seq = i;
+		queue->mask = cells - 1;
+		queue->size = cells;
+		return queue;
+	}
+
+	queue->data = malloc(sizeof(void *) * (size + 1));
+	if(queue->data == NULL)
+		EXIT_UNSQUASH("Out of memory in queue_init\n");
+
+	queue->size = size + 1;
+	queue->readp = queue->writep = 0;
+
+	return queue;
+}
+
+
+void queue_delete(struct queue *queue)
+{
+	pthread_mutex_destroy(&queue->mutex);
+	pthread_cond_destroy(&queue->empty);
+	pthread_cond_destroy(&queue->full);
+	free(queue->data);
+	free(queue->cells);
+	free(queue);
+}
+
+
+static int lf_queue_try_put(struct queue *queue, void *data)
+{
+	struct queue_cell *cell;
+	unsigned long pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+	long diff;
+
+	while(1) {
+		cell = &queue->cells[pos & queue->mask];
+		diff = (long) __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) -
+			(long) pos;
+
+		if(diff == 0) {
+			if(__atomic_compare_exchange_n(&queue->head, &pos,
+					pos + 1, TRUE, __ATOMIC_RELAXED,
+					__ATOMIC_RELAXED))
+				break;
+		} else if(diff < 0)
+			/* full */
+			return FALSE;
+		else
+			pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+	}
+
+	cell->data = data;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return TRUE;
+}
+
+
+static int lf_queue_try_get(struct queue *queue, void **data)
+{
+	struct queue_cell *cell;
+	unsigned long pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+	long diff;
+
+	while(1) {
+		cell = &queue->cells[pos & queue->mask];
+		diff = (long) __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) -
+			(long) (pos + 1);
+
+		if(diff == 0) {
+			if(__atomic_compare_exchange_n(&queue->tail, &pos,
+					pos + 1, TRUE, __ATOMIC_RELAXED,
+					__ATOMIC_RELAXED))
+				break;
+		} else if(diff < 0)
+			/* empty */
+			return FALSE;
+		else
+			pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+	}
+
+	*data = cell->data;
+	__atomic_store_n(&cell->seq, pos + queue->mask + 1, __ATOMIC_RELEASE);
+
+	return TRUE;
+}
+
+
+/*
+ * Wake a thread sleeping on the other side of a lock-free queue.  The
+ * sleeper registers itself (seq_cst) before its final retry, and we check
+ * for sleepers after a full fence, so either the sleeper sees our update
+ * or we see the sleeper.  Taking the mutex orders the signal after the
+ * sleeper's pthread_cond_wait().
+ */
+static void lf_queue_wake(struct queue *queue, int *waiting,
+	pthread_cond_t *cond)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if(__atomic_load_n(waiting, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&queue->mutex);
+		pthread_cond_signal(cond);
+		pthread_mutex_unlock(&queue->mutex);
+	}
+}
+
+
+static void lf_queue_put(struct queue *queue, void *data)
+{
+	int i;
+
+	for(i = 0; i < queue_spin; i++) {
+		if(lf_queue_try_put(queue, data))
+			goto done;
+		cpu_relax();
+	}
+
+	if(queue_spin == 0 && lf_queue_try_put(queue, data))
+		goto done;
+
+	pthread_mutex_lock(&queue->mutex);
+	__atomic_add_fetch(&queue->wait_put, 1, __ATOMIC_SEQ_CST);
+	while(lf_queue_try_put(queue, data) == FALSE)
+		pthread_cond_wait(&queue->full, &queue->mutex);
+	__atomic_sub_fetch(&queue->wait_put, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&queue->mutex);
+
+done:
+	lf_queue_wake(queue, &queue->wait_get, &queue->empty);
+}
+
+
+static void *lf_queue_get(struct queue *queue)
+{
+	void *data;
+	int i;
+
+	for(i = 0; i < queue_spin; i++) {
+		if(lf_queue_try_get(queue, &data))
+			goto done;
+		if(i > queue_spin / 2)
+			sched_yield();
+		else
+			cpu_relax();
+	}
+
+	if(queue_spin == 0 && lf_queue_try_get(queue, &data))
+		goto done;
+
+	pthread_mutex_lock(&queue->mutex);
+	__atomic_add_fetch(&queue->wait_get, 1, __ATOMIC_SEQ_CST);
+	while(lf_queue_try_get(queue, &data) == FALSE)
+		pthread_cond_wait(&queue->empty, &queue->mutex);
+	__atomic_sub_fetch(&queue->wait_get, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&queue->mutex);
+
+done:
+	lf_queue_wake(queue, &queue->wait_put, &queue->full);
+	return data;
+}
+
+
+void queue_put(struct queue *queue, void *data)
+{
+	int nextp;
+
+	if(queue->lock_free) {
+		lf_queue_put(queue, data);
+		return;
+	}
+
+	pthread_mutex_lock(&queue->mutex);
+
+	while((nextp = (queue->writep + 1) % queue->size) == queue->readp)
+		pthread_cond_wait(&queue->full, &queue->mutex);
+
+	queue->data[queue->writep] = data;
+	queue->writep = nextp;
+	pthread_cond_signal(&queue->empty);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+
+void *queue_get(struct queue *queue)
+{
+	void *data;
+
+	if(queue->lock_free)
+		return lf_queue_get(queue);
+
+	pthread_mutex_lock(&queue->mutex);
+
+	while(queue->readp == queue->writep)
+		pthread_cond_wait(&queue->empty, &queue->mutex);
+
+	data = queue->data[queue->readp];
+	queue->readp = (queue->readp + 1) % queue->size;
+	pthread_cond_signal(&queue->full);
+	pthread_mutex_unlock(&queue->mutex);
+
+	return data;
+}
+
+
+/* Called with the shard mutex held */
+void insert_hash_table(struct cache *cache, struct cache_entry *entry)
+{
+	int hash = CALCULATE_HASH(entry->block);
+
+	entry->hash_next = cache->hash_table[hash];
+	cache->hash_table[hash] = entry;
+	entry->hash_prev = NULL;
+	if(entry->hash_next)
+		entry->hash_next->hash_prev = entry;
+}
+
+
+/* Called with the shard mutex held */
+void remove_hash_table(struct cache *cache, struct cache_entry *entry)
+{
+	if(entry->hash_prev)
+		entry->hash_prev->hash_next = entry->hash_next;
+	else
+		cache->hash_table[CALCULATE_HASH(entry->block)] =
+			entry->hash_next;
+	if(entry->hash_next)
+		entry->hash_next->hash_prev = entry->hash_prev;
+
+	entry->hash_prev = entry->hash_next = NULL;
+}
+
+
+/* Called with the shard mutex held */
+void insert_free_list(struct cache_shard *shard, struct cache_entry *entry)
+{
+	if(shard->free_list) {
+		entry->free_next = shard->free_list;
+		entry->free_prev = shard->free_list->free_prev;
+		shard->free_list->free_prev->free_next = entry;
+		shard->free_list->free_prev = entry;
+	} else {
+		shard->free_list = entry;
+		entry->free_prev = entry->free_next = entry;
+	}
+}
+
+
+/* Called with the shard mutex held */
+void remove_free_list(struct cache_shard *shard, struct cache_entry *entry)
+{
+	if(entry->free_prev == NULL && entry->free_next == NULL)
+		/* not in free list */
+		return;
+	else if(entry->free_prev == entry && entry->free_next == entry) {
+		/* only this entry in the free list */
+		shard->free_list = NULL;
+	} else {
+		/* more than one entry in the free list */
+		entry->free_next->free_prev = entry->free_prev;
+		entry->free_prev->free_next = entry->free_next;
+		if(shard->free_list == entry)
+			shard->free_list = entry->free_next;
+	}
+
+	entry->free_prev = entry->free_next = NULL;
+}
+
+
+struct cache *cache_init(int buffer_size, int max_buffers, int shards)
+{
+	struct cache *cache = malloc(sizeof(struct cache));
+	int i;
+
+	if(cache == NULL)
+		EXIT_UNSQUASH("Out of memory in cache_init\n");
+
+	/*
+	 * each hash chain is owned by exactly one shard, so shard count must
+	 * divide the hash table size, and every shard needs a buffer
+	 */
+	if(shards < 1)
+		shards = 1;
+	if(shards > max_buffers)
+		shards = max_buffers;
+	while(shards & (shards - 1))
+		shards &= shards - 1;
+
+	if(posix_memalign((void **) &cache->shard, QUEUE_CACHE_LINE,
+			shards * sizeof(struct cache_shard)) != 0)
+		EXIT_UNSQUASH("Out of memory in cache_init\n");
+
+	cache->max_buffers = max_buffers;
+	cache->buffer_size = buffer_size;
+	cache->shards = shards;
+	memset(cache->hash_table, 0, sizeof(struct cache_entry *) * 65536);
+
+	for(i = 0; i < shards; i++) {
+		struct cache_shard *shard = &cache->shard[i];
+
+		shard->max_buffers = max_buffers / shards +
+			(i < max_buffers % shards);
+		shard->count = 0;
+		shard->free_list = NULL;
+		shard->wait_free = FALSE;
+		shard->wait_pending = FALSE;
+		pthread_mutex_init(&shard->mutex, NULL);
+		pthread_cond_init(&shard->wait_for_free, NULL);
+		pthread_cond_init(&shard->wait_for_pending, NULL);
+	}
+
+	return cache;
+}
+
+
+struct cache_entry *cache_get(struct cache *cache, long long block, int size)
+{
+	/*
+	 * Get a block out of the cache.  If the block isn't in the cache
+ 	 * it is added and queued to the reader() and deflate() threads for
+ 	 * reading off disk and decompression.  The cache grows until max_blocks
+ 	 * is reached, once this occurs existing discarded blocks on the free
+ 	 * list are reused
+ 	 */
+	int hash = CALCULATE_HASH(block);
+	struct cache_shard *shard = &cache->shard[hash & (cache->shards - 1)];
+	struct cache_entry *entry;
+
+	pthread_mutex_lock(&shard->mutex);
+
+	for(entry = cache->hash_table[hash]; entry; entry = entry->hash_next)
+		if(entry->block == block)
+			break;
+
+	if(entry) {
+		/*
+ 		 * found the block in the cache, increment used count and
+ 		 * if necessary remove from free list so it won't disappear
+ 		 */
+		entry->used ++;
+		remove_free_list(shard, entry);
+		pthread_mutex_unlock(&shard->mutex);
+	} else {
+		/*
+ 		 * not in the cache
+		 *
+		 * first try to allocate new block
+		 */
+		if(shard->count < shard->max_buffers) {
+			entry = malloc(sizeof(struct cache_entry));
+			if(entry == NULL)
+				EXIT_UNSQUASH("Out of memory in cache_get\n");
+			entry->buffer = malloc(cache->buffer_size);
+			if(entry->buffer == NULL)
+				EXIT_UNSQUASH("Out of memory in cache_get\n");
+			entry->cache = cache;
+			entry->shard = shard;
+			entry->free_prev = entry->free_next = NULL;
+			shard->count ++;
+		} else {
+			/*
+			 * try to get from free list
+			 */
+			while(shard->free_list == NULL) {
+				shard->wait_free = TRUE;
+				pthread_cond_wait(&shard->wait_for_free,
+					&shard->mutex);
+			}
+			entry = shard->free_list;
+			remove_free_list(shard, entry);
+			remove_hash_table(cache, entry);
+		}
+
+		/*
+		 * initialise block and insert into the hash table.  The
+		 * reader may point data into the mapped filesystem, so reset
+		 * it to the entry's own buffer
+		 */
+		entry->data = entry->buffer;
+		entry->block = block;
+		entry->size = size;
+		entry->used = 1;
+		entry->error = FALSE;
+		entry->pending = TRUE;
+		insert_hash_table(cache, entry);
+
+		/*
+		 * queue to read thread to read and ultimately (via the
+		 * decompress threads) decompress the buffer
+ 		 */
+		pthread_mutex_unlock(&shard->mutex);
+		queue_put(to_reader, entry);
+	}
+
+	return entry;
+}
+
+
+void cache_block_ready(struct cache_entry *entry, int error)
+{
+	/*
+	 * mark cache entry as being complete, reading and (if necessary)
+ 	 * decompression has taken place, and the buffer is valid for use.
+ 	 * If an error occurs reading or decompressing, the buffer also
+ 	 * becomes ready but with an error...
+ 	 */
+	pthread_mutex_lock(&entry->shard->mutex);
+	entry->pending = FALSE;
+	entry->error = error;
+
+	/*
+	 * if the wait_pending flag is set, one or more threads may be waiting
+	 * on this buffer
+	 */
+	if(entry->shard->wait_pending) {
+		entry->shard->wait_pending = FALSE;
+		pthread_cond_broadcast(&entry->shard->wait_for_pending);
+	}
+
+	pthread_mutex_unlock(&entry->shard->mutex);
+}
+
+
+void cache_block_wait(struct cache_entry *entry)
+{
+	/*
+	 * wait for this cache entry to become ready, when reading and (if
+	 * necessary) decompression has taken place
+	 */
+	pthread_mutex_lock(&entry->shard->mutex);
+
+	while(entry->pending) {
+		entry->shard->wait_pending = TRUE;
+		pthread_cond_wait(&entry->shard->wait_for_pending,
+			&entry->shard->mutex);
+	}
+
+	pthread_mutex_unlock(&entry->shard->mutex);
+}
+
+
+void cache_block_put(struct cache_entry *entry)
+{
+	/*
+	 * finished with this cache entry, once the usage count reaches zero it
+ 	 * can be reused and is put onto the free list.  As it remains
+ 	 * accessible via the hash table it can be found getting a new lease of
+ 	 * life before it is reused.
+ 	 */
+	pthread_mutex_lock(&entry->shard->mutex);
+
+	entry->used --;
+	if(entry->used == 0) {
+		insert_free_list(entry->shard, entry);
+
+		/*
+		 * if the wait_free flag is set, one or more threads may be
+		 * waiting on this buffer
+		 */
+		if(entry->shard->wait_free) {
+			entry->shard->wait_free = FALSE;
+			pthread_cond_broadcast(&entry->shard->wait_for_free);
+		}
+	}
+
+	pthread_mutex_unlock(&entry->shard->mutex);
+}
@@ -0,0 +1,183 @@
+/*
+ * Squashfs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * xxhash.c
+ *
+ * Streaming XXH64 (Yann Collet's xxHash, 64 bit variant), used by
+ * mksquashfs to hash file contents for duplicate detection.  Input words
+ * are loaded in host byte order, the hashes are only compared within one
+ * run so they needn't match the reference on big endian hosts.
+ */
+
+#include <string.h>
+
+#include "xxhash.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline unsigned long long read64(const unsigned char *p)
+{
+	unsigned long long val;
+
+	memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+
+static inline unsigned int read32(const unsigned char *p)
+{
+	unsigned int val;
+
+	memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+
+static inline unsigned long long xxh64_round(unsigned long long acc,
+	unsigned long long input)
+{
+	acc += input * PRIME64_2;
+	acc = ROTL64(acc, 31);
+	return acc * PRIME64_1;
+}
+
+
+static inline unsigned long long xxh64_merge_round(unsigned long long acc,
+	unsigned long long val)
+{
+	acc ^= xxh64_round(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+
+void xxh64_reset(struct xxh64_state *state, unsigned long long seed)
+{
+	state->total_len = 0;
+	state->v[0] = seed + PRIME64_1 + PRIME64_2;
+	state->v[1] = seed + PRIME64_2;
+	state->v[2] = seed;
+	state->v[3] = seed - PRIME64_1;
+	state->memsize = 0;
+}
+
+
+void xxh64_update(struct xxh64_state *state, const void *input, int len)
+{
+	const unsigned char *p = input, *end = p + len;
+
+	state->total_len += len;
+
+	if(state->memsize + len < 32) {
+		memcpy(state->mem + state->memsize, p, len);
+		state->memsize += len;
+		return;
+	}
+
+	if(state->memsize) {
+		int fill = 32 - state->memsize;
+
+		memcpy(state->mem + state->memsize, p, fill);
+		state->v[0] = xxh64_round(state->v[0], read64(state->mem));
+		state->v[1] = xxh64_round(state->v[1], read64(state->mem + 8));
+		state->v[2] = xxh64_round(state->v[2], read64(state->mem + 16));
+		state->v[3] = xxh64_round(state->v[3], read64(state->mem + 24));
+		p += fill;
+		state->memsize = 0;
+	}
+
+	if(end - p >= 32) {
+		unsigned long long v1 = state->v[0], v2 = state->v[1],
+			v3 = state->v[2], v4 = state->v[3];
+
+		do {
+			v1 = xxh64_round(v1, read64(p));
+			v2 = xxh64_round(v2, read64(p + 8));
+			v3 = xxh64_round(v3, read64(p + 16));
+			v4 = xxh64_round(v4, read64(p + 24));
+			p += 32;
+		} while(end - p >= 32);
+
+		state->v[0] = v1;
+		state->v[1] = v2;
+		state->v[2] = v3;
+		state->v[3] = v4;
+	}
+
+	if(p < end) {
+		memcpy(state->mem, p, end - p);
+		state->memsize = end - p;
+	}
+}
+
+
+unsigned long long xxh64_digest(struct xxh64_state *state)
+{
+	const unsigned char *p = state->mem, *end = p + state->memsize;
+	unsigned long long h;
+
+	if(state->total_len >= 32) {
+		h = ROTL64(state->v[0], 1) + ROTL64(state->v[1], 7) +
+			ROTL64(state->v[2], 12) + ROTL64(state->v[3], 18);
+		h = xxh64_merge_round(h, state->v[0]);
+		h = xxh64_merge_round(h, state->v[1]);
+		h = xxh64_merge_round(h, state->v[2]);
+		h = xxh64_merge_round(h, state->v[3]);
+	} else
+		h = state->v[2] + PRIME64_5;
+
+	h += state->total_len;
+
+	for(; p + 8 <= end; p += 8) {
+		h ^= xxh64_round(0, read64(p));
+		h = ROTL64(h, 27) * PRIME64_1 + PRIME64_4;
+	}
+
+	if(p + 4 <= end) {
+		h ^= (unsigned long long) read32(p) * PRIME64_1;
+		h = ROTL64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+
+	for(; p < end; p++) {
+		h ^= *p * PRIME64_5;
+		h = ROTL64(h, 11) * PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+
+unsigned long long xxh64(const void *input, int len, unsigned long long seed)
+{
+	struct xxh64_state state;
+
+	xxh64_reset(&state, seed);
+	xxh64_update(&state, input, len);
+	return xxh64_digest(&state);
+}
@@ -0,0 +1,34 @@
+#ifndef XXHASH_H
+#define XXHASH_H
+/*
+ * Squashfs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * xxhash.h
+ */
+
+struct xxh64_state {
+	unsigned long long	total_len;
+	unsigned long long	v[4];
+	unsigned char		mem[32];
+	int			memsize;
+};
+
+extern void xxh64_reset(struct xxh64_state *, unsigned long long);
+extern void xxh64_update(struct xxh64_state *, const void *, int);
+extern unsigned long long xxh64_digest(struct xxh64_state *);
+extern unsigned long long xxh64(const void *, int, unsigned long long);
+#endif
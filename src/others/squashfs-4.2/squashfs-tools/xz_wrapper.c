@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include <lzma.h>
 
 #include "squashfs_fs.h"
@@ -44,6 +45,20 @@ static struct bcj bcj[] = {
 
 static int filter_count = 1;
 
+/*
+ * With -Xbcj-sample the filters are tried on the first bcj_sample blocks of
+ * each file, and the filter which won most often is then used for the rest
+ * of the file.  Files are identified by the sequence number of their first
+ * block, passed in by xz_file_block()
+ */
+static int bcj_sample = 0;
+static struct bcj_file bcj_file[BCJ_FILES];
+static pthread_mutex_t bcj_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* data blocks compressed with no filter, and with each bcj[] filter */
+static long long bcj_blocks[8];
+static long long bcj_abandoned = 0;
+
 
 static int xz_options(char *argv[], int argc)
 {
@@ -78,6 +93,25 @@ static int xz_options(char *argv[], int argc)
 			}
 		}
 		return 1;
+	} else if(strcmp(argv[0], "-Xbcj-sample") == 0) {
+		int i;
+
+		if(argc < 2) {
+			fprintf(stderr, "xz: -Xbcj-sample missing number of "
+				"blocks\n");
+			return -2;
+		}
+
+		bcj_sample = atoi(argv[1]);
+		if(bcj_sample < 1) {
+			fprintf(stderr, "xz: -Xbcj-sample should be 1 or "
+				"more\n");
+			return -2;
+		}
+
+		for(i = 0; i < BCJ_FILES; i++)
+			bcj_file[i].file = -1;
+		return 1;
 	} else {
 		return lzma_xz_options(argv, argc, LZMA_OPT_XZ);
 	}
@@ -120,6 +154,30 @@ static int xz_extract_options(int block_size, void *buffer, int size)
 }
 
 
+static int xz_set_options(struct xz_stream *stream)
+{
+	uint32_t preset;
+	struct lzma_xz_options *opts = lzma_xz_get_options();
+
+	preset = opts->preset;
+	if (opts->extreme)
+		preset |= LZMA_PRESET_EXTREME;
+
+	if(lzma_lzma_preset(&stream->opt, preset))
+		return -1;
+
+	stream->opt.lc = opts->lc;
+	stream->opt.lp = opts->lp;
+	stream->opt.pb = opts->pb;
+	if (opts->fb)
+		stream->opt.nice_len = opts->fb;
+
+	stream->opt.dict_size = stream->dictionary_size;
+
+	return 0;
+}
+
+
 static int xz_init(void **strm, int block_size, int datablock)
 {
 	int i, j, filters = datablock ? filter_count : 1;
@@ -136,15 +194,24 @@ static int xz_init(void **strm, int block_size, int datablock)
 
 	stream->filter = filter;
 	stream->filters = filters;
+	stream->file = stream->block = -1;
 
+	/*
+	 * Zeroing the filters also sets their lzma_streams to LZMA_STREAM_INIT.
+	 * Each keeps its encoder, dictionary and match-finder between blocks
+	 */
 	memset(filter, 0, filters * sizeof(struct filter));
 
 	stream->dictionary_size = datablock ? opts->dict_size :
 		SQUASHFS_METADATA_SIZE;
 
+	if(xz_set_options(stream))
+		goto failed2;
+
 	filter[0].filter[0].id = LZMA_FILTER_LZMA2;
 	filter[0].filter[0].options = &stream->opt;
 	filter[0].filter[1].id = LZMA_VLI_UNKNOWN;
+	filter[0].bcj = -1;
 
 	for(i = 0, j = 1; datablock && bcj[i].name; i++) {
 		if(bcj[i].selected) {
@@ -155,6 +222,7 @@ static int xz_init(void **strm, int block_size, int datablock)
 			filter[j].filter[1].id = LZMA_FILTER_LZMA2;
 			filter[j].filter[1].options = &stream->opt;
 			filter[j].filter[2].id = LZMA_VLI_UNKNOWN;
+			filter[j].bcj = i;
 			j++;
 		}
 	}
@@ -164,9 +232,9 @@ static int xz_init(void **strm, int block_size, int datablock)
 failed3:
 	for(i = 1; i < filters; i++)
 		free(filter[i].buffer);
-	free(stream);
 
 failed2:
+	free(stream);
 	free(filter);
 
 failed:
@@ -174,54 +242,198 @@ failed:
 }
 
 
+static void xz_file_block(void *strm, long long file, long long block)
+{
+	struct xz_stream *stream = strm;
+
+	stream->file = file;
+	stream->block = block;
+}
+
+
+/*
+ * Return the BCJ filter for the machine of the ELF file starting at src,
+ * LZMA_VLI_UNKNOWN if there's no BCJ filter for its machine (i.e. MIPS), or 0
+ * if it isn't an ELF file or its code could suit more than one filter
+ */
+static lzma_vli elf_filter(unsigned char *src, int size)
+{
+	int machine;
+
+	if(size < 20 || memcmp(src, "\177ELF", 4) != 0)
+		return 0;
+
+	/* e_ident[EI_DATA] gives the byte order of e_machine */
+	if(src[5] == 1)
+		machine = src[18] | (src[19] << 8);
+	else if(src[5] == 2)
+		machine = (src[18] << 8) | src[19];
+	else
+		return 0;
+
+	switch(machine) {
+	case 3:		/* EM_386 */
+	case 62:	/* EM_X86_64 */
+		return LZMA_FILTER_X86;
+	case 20:	/* EM_PPC */
+	case 21:	/* EM_PPC64 */
+		return LZMA_FILTER_POWERPC;
+	case 50:	/* EM_IA_64 */
+		return LZMA_FILTER_IA64;
+	case 2:		/* EM_SPARC */
+	case 18:	/* EM_SPARC32PLUS */
+	case 43:	/* EM_SPARCV9 */
+		return LZMA_FILTER_SPARC;
+	case 40:	/* EM_ARM, may be ARM or Thumb code */
+		return 0;
+	default:
+		return LZMA_VLI_UNKNOWN;
+	}
+}
+
+
+/*
+ * Find the entry for stream->file in the choice table, taking over the slot
+ * if another file has it.  Called with bcj_mutex held
+ */
+static struct bcj_file *bcj_lookup(struct xz_stream *stream)
+{
+	struct bcj_file *entry = &bcj_file[stream->file & (BCJ_FILES - 1)];
+
+	if(entry->file != stream->file) {
+		memset(entry, 0, sizeof(struct bcj_file));
+		entry->file = stream->file;
+		entry->choice = -1;
+	}
+
+	return entry;
+}
+
+
+/*
+ * Return the index of the filter to use for this block, or -1 if all the
+ * filters should be tried
+ */
+static int bcj_choice(struct xz_stream *stream, void *src, int size)
+{
+	struct bcj_file *entry;
+	int i, choice;
+
+	if(bcj_sample == 0 || stream->filters == 1 || stream->file == -1)
+		return -1;
+
+	pthread_mutex_lock(&bcj_mutex);
+	entry = bcj_lookup(stream);
+	if(entry->choice == -1 && stream->block == 0) {
+		lzma_vli id = elf_filter(src, size);
+
+		if(id == LZMA_VLI_UNKNOWN)
+			entry->choice = 0;
+		else if(id)
+			for(i = entry->choice = 0; i < stream->filters; i++)
+				if(stream->filter[i].filter[0].id == id)
+					entry->choice = i;
+	}
+	choice = entry->choice;
+	pthread_mutex_unlock(&bcj_mutex);
+
+	return choice;
+}
+
+
+/*
+ * Record the filter which won a trial of a sampled block, and once enough
+ * blocks have been sampled fix the most successful one for the file
+ */
+static void bcj_vote(struct xz_stream *stream, int winner)
+{
+	struct bcj_file *entry;
+	int i;
+
+	if(bcj_sample == 0 || stream->filters == 1 || stream->file == -1)
+		return;
+
+	pthread_mutex_lock(&bcj_mutex);
+	entry = bcj_lookup(stream);
+	if(entry->choice == -1) {
+		entry->wins[winner] ++;
+		if(++ entry->samples >= bcj_sample)
+			for(i = entry->choice = 0; i < stream->filters; i++)
+				if(entry->wins[i] > entry->wins[entry->choice])
+					entry->choice = i;
+	}
+	pthread_mutex_unlock(&bcj_mutex);
+}
+
+
 static int xz_compress(void *strm, void *dest, void *src,  int size,
 	int block_size, int *error)
 {
-	int i;
-        lzma_ret res = 0;
+	int i, choice, abandoned = 0;
+	lzma_ret res = 0;
 	struct xz_stream *stream = strm;
 	struct filter *selected = NULL;
-	struct lzma_xz_options *opts = lzma_xz_get_options();
 
 	stream->filter[0].buffer = dest;
+	choice = bcj_choice(stream, src, size);
 
 	for(i = 0; i < stream->filters; i++) {
-		uint32_t preset = opts->preset;
 		struct filter *filter = &stream->filter[i];
 
-		if (opts->extreme)
-			preset |= LZMA_PRESET_EXTREME;
-
-        if(lzma_lzma_preset(&stream->opt, preset))
-               	goto failed;
-
-        stream->opt.lc = opts->lc;
-    	stream->opt.lp = opts->lp;
-    	stream->opt.pb = opts->pb;
-    	if (opts->fb)
-    		stream->opt.nice_len = opts->fb;
-
-		stream->opt.dict_size = stream->dictionary_size;
-
-		filter->length = 0;
-		res = lzma_stream_buffer_encode(filter->filter,
-			LZMA_CHECK_CRC32, NULL, src, size, filter->buffer,
-			&filter->length, block_size);
-	
-		if(res == LZMA_OK) {
-			if(!selected || selected->length > filter->length)
-				selected = filter;
-		} else if(res != LZMA_BUF_ERROR)
+		if(choice != -1 && i != choice)
+			continue;
+
+		/*
+		 * Re-initialising the encoder on the filter's own lzma_stream
+		 * reuses the buffers it allocated for the previous block
+		 */
+		res = lzma_stream_encoder(&filter->strm, filter->filter,
+			LZMA_CHECK_CRC32);
+		if(res != LZMA_OK)
+			goto failed;
+
+		/*
+		 * A trial only needs to finish if it beats the smallest result
+		 * so far, so give it one byte less than that to write into.
+		 * The filter chosen for a file writes straight into dest
+		 */
+		filter->strm.next_out = choice == -1 ? filter->buffer : dest;
+		filter->strm.avail_out = selected ? selected->length - 1 :
+			block_size;
+		filter->strm.next_in = src;
+		filter->strm.avail_in = size;
+
+		res = lzma_code(&filter->strm, LZMA_FINISH);
+
+		if(res == LZMA_STREAM_END) {
+			filter->length = filter->strm.total_out;
+			selected = filter;
+		} else if(res != LZMA_OK)
+			/*
+			 * LZMA_OK means the output buffer is full
+			 */
 			goto failed;
+		else if(selected)
+			abandoned ++;
 	}
 
+	if(choice == -1)
+		bcj_vote(stream, selected ? selected - stream->filter : 0);
+
 	if(!selected)
 		/*
 	 	 * Output buffer overflow.  Return out of buffer space
 	 	 */
 		return 0;
 
-	if(selected->buffer != dest)
+	if(stream->filters > 1) {
+		pthread_mutex_lock(&bcj_mutex);
+		bcj_blocks[selected->bcj + 1] ++;
+		bcj_abandoned += abandoned;
+		pthread_mutex_unlock(&bcj_mutex);
+	}
+
+	if(choice == -1 && selected->buffer != dest)
 		memcpy(dest, selected->buffer, selected->length);
 
 	return (int) selected->length;
@@ -260,6 +472,27 @@ void xz_usage()
 	fprintf(stderr, " the best compression.\n");
 	fprintf(stderr, "\t\tAvailable filters: x86, arm, armthumb,");
 	fprintf(stderr, " powerpc, sparc, ia64\n");
+	fprintf(stderr, "\t  -Xbcj-sample <blocks>\n");
+	fprintf(stderr, "\t\tOnly try the -Xbcj filters on the first <blocks>");
+	fprintf(stderr, " blocks of\n\t\teach file, and use the one which");
+	fprintf(stderr, " won most often for the\n\t\trest of it.  ELF");
+	fprintf(stderr, " files use the filter for their machine\n");
+}
+
+
+static void xz_display_stats()
+{
+	int i;
+
+	if(filter_count == 1)
+		return;
+
+	printf("XZ BCJ filter used for data blocks:\n");
+	printf("\tnone %lld\n", bcj_blocks[0]);
+	for(i = 0; bcj[i].name; i++)
+		if(bcj[i].selected)
+			printf("\t%s %lld\n", bcj[i].name, bcj_blocks[i + 1]);
+	printf("\ttrial encodes abandoned early %lld\n", bcj_abandoned);
 }
 
 
@@ -274,5 +507,7 @@ struct compressor xz_comp_ops = {
 	.usage = xz_usage,
 	.id = XZ_COMPRESSION,
 	.name = "xz",
-	.supported = 1
+	.supported = 1,
+	.file_block = xz_file_block,
+	.display_stats = xz_display_stats
 };
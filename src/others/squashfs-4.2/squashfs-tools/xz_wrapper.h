@@ -26,6 +26,9 @@
 
 #define MEMLIMIT (32 * 1024 * 1024)
 
+/* size of the table of per-file BCJ filter choices, must be a power of 2 */
+#define BCJ_FILES 1024
+
 struct bcj {
 	char	 	*name;
 	lzma_vli	id;
@@ -36,6 +39,8 @@ struct filter {
 	void		*buffer;
 	lzma_filter	filter[3];
 	size_t		length;
+	lzma_stream	strm;
+	int		bcj;
 };
 
 struct xz_stream {
@@ -43,6 +48,19 @@ struct xz_stream {
 	int		filters;
 	int		dictionary_size;
 	lzma_options_lzma opt;
+	long long	file;
+	long long	block;
+};
+
+/*
+ * Filter choice for a file being sampled with -Xbcj-sample.  Choice is the
+ * index into the xz_stream filters, or -1 while the file is still sampled
+ */
+struct bcj_file {
+	long long	file;
+	int		choice;
+	int		samples;
+	int		wins[8];
 };
 
 struct comp_opts {
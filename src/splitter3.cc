@@ -31,6 +31,8 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/sysmacros.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <endian.h>
 #include <byteswap.h>
@@ -38,62 +40,6 @@
 
 #include "untrx.h"
 
-/*************************************************************************
-* IdentifySegment
-*
-* identifies segments (i.e. squashfs, cramfs) and their version numbers
-*
-**************************************************************************/
-SEGMENT_TYPE IdentifySegment(unsigned char *pData, unsigned int nLength)
-{
-	squashfs_super_block *sqblock=(squashfs_super_block *)pData;
-	cramfs_super *crblock=(cramfs_super *)pData;
-	
-	if(sqblock->s_magic==SQUASHFS_MAGIC 
-		|| sqblock->s_magic==SQUASHFS_MAGIC_SWAP
-		|| sqblock->s_magic==SQUASHFS_MAGIC_ALT
-		|| sqblock->s_magic==SQUASHFS_MAGIC_ALT_SWAP)
-	{		
-		fprintf(stderr, " SQUASHFS magic: 0x%x\n", sqblock->s_magic);
-		short major = READ16_LE(sqblock->s_major);
-		short minor = READ16_LE(sqblock->s_minor);
-		fprintf(stderr, " SQUASHFS version: %d.%d\n", major, minor);
-	
-		switch(major)
-		{
-			case 3:
-				switch (minor)
-				{
-					case 0:						
-						return SEGMENT_TYPE_SQUASHFS_3_0;
-					case 1:						
-						return SEGMENT_TYPE_SQUASHFS_3_1;			
-					case 2:
-						return SEGMENT_TYPE_SQUASHFS_3_2;
-					default:
-						return SEGMENT_TYPE_SQUASHFS_3_x;						
-				}
-			case 2:
-				switch (minor)
-				{
-					case 0:
-						return SEGMENT_TYPE_SQUASHFS_2_0;
-					case 1:
-						return SEGMENT_TYPE_SQUASHFS_2_1;
-					default:
-						return SEGMENT_TYPE_SQUASHFS_2_x;						
-				}
-			default:
-				return SEGMENT_TYPE_SQUASHFS_OTHER;				
-		}
-	}	
-	else if(crblock->magic==CRAMFS_MAGIC || crblock->magic==CRAMFS_MAGIC_SWAP)
-	{
-		return SEGMENT_TYPE_CRAMFS_x_x;	
-	}	
-	return SEGMENT_TYPE_UNTYPED;
-}
-
 /*************************************************************************
 * EmitSquashfsMagic
 *
@@ -143,8 +89,9 @@ int main(int argc, char **argv)
 	}
 	
 	fprintf(stderr, " Opening %s\n", argv[1]);
-	FILE *fIn=fopen(argv[1],"rb");
-	if(!fIn)
+	int fdIn=open(argv[1],O_RDONLY);
+	struct stat st;
+	if(fdIn<0 || fstat(fdIn,&st)!=0)
 	{
 		fprintf(stderr, " ERROR opening %s\n", argv[1]);
 		exit(1);
@@ -157,30 +104,39 @@ int main(int argc, char **argv)
 		pszOutFolder[strlen(pszOutFolder)-1]=0;		
 	}	
 	
-	fseek(fIn,0,SEEK_END);
-	size_t nFilesize=ftell(fIn);
-	fseek(fIn,0,SEEK_SET);		
-	unsigned char *pData=(unsigned char *)malloc(nFilesize);	
-	unsigned char *pDataOrg=pData;
-	if(fread(pData,1,nFilesize,fIn)!=nFilesize)
+	// map rather than read the image, so memory use doesn't grow with its size
+	size_t nFilesize=st.st_size;
+	unsigned char *pDataOrg=(unsigned char *)(nFilesize>4 ? 
+		mmap(NULL,nFilesize,PROT_READ,MAP_SHARED,fdIn,0) : MAP_FAILED);
+	if(pDataOrg==MAP_FAILED)
 	{
 		fprintf(stderr," ERROR reading %s\n", argv[1]);		
-		fclose(fIn);	
-		free(pDataOrg);
+		close(fdIn);	
 		free(pszOutFolder);	
 		exit(1);
 	}	
-	fclose(fIn);	
-	fprintf(stderr, " read %ld bytes\n", nFilesize);
+	madvise(pDataOrg,nFilesize,MADV_SEQUENTIAL);
+	fprintf(stderr, " mapped %ld bytes\n", nFilesize);
 	
 	/* Extract the segments */
-	unsigned int nKernelLength=0;
-	// do stupid linear search for 'sqsh' (yes, I'm that lazy)
-	for(unsigned int nI=0;nI<(nFilesize-4);nI++)
+	size_t nKernelLength=0;
+	// linear search for the first file system, skipping bytes that can't start a signature
+	bool bFirstByte[256]={ false };
+	for(const SEGMENT_SIGNATURE *pSig=g_Signatures;pSig->pMagic;pSig++)
+	{
+		if(g_SegmentInfo[pSig->type].bFilesystem)
+		{
+			bFirstByte[(unsigned char)pSig->pMagic[0]]=true;
+		}
+	}
+	for(size_t nI=0;nI<(nFilesize-4);nI++)
 	{		
-		// TODO: add extra bounds check to IdentifySegment
-		SEGMENT_TYPE segType=IdentifySegment(pDataOrg+nI,4);
-		if(segType!=SEGMENT_TYPE_UNTYPED)
+		if(!bFirstByte[pDataOrg[nI]])
+		{
+			continue;
+		}
+		SEGMENT_TYPE segType=IdentifySegment(pDataOrg+nI,nFilesize-nI);
+		if(g_SegmentInfo[segType].bFilesystem)
 		{
 			fprintf(stderr, " Found segment type 0x%x", segType);
 			nKernelLength=nI;
@@ -190,17 +146,22 @@ int main(int argc, char **argv)
 	if(!nKernelLength)
 	{
 		fprintf(stderr, " ERROR: Could not locate any file system in image. Perhaps obfuscated or unknown FS");
-		free(pDataOrg);
+		munmap(pDataOrg,nFilesize);
+		close(fdIn);
 		exit(2);
 	}	
 
 	// now go to last 4096 block of file, as the FS will end on this and trailer begin
 	// alternate way nTrailerOffset&0xfffff000 but may not be great for platform compatibility
-	unsigned int nTrailerOffset=(nFilesize/4096)*4096;	// do safe method, 32-bit, 64-bit, any size ints
-	unsigned int nTrailerLength=nFilesize-nTrailerOffset;
-	unsigned int nFilesystemLength=nTrailerOffset-nKernelLength;
+	size_t nTrailerOffset=(nFilesize/4096)*4096;	// do safe method, 32-bit, 64-bit, any size ints
+	if(nTrailerOffset<nKernelLength)
+	{
+		nTrailerOffset=nKernelLength;
+	}
+	size_t nTrailerLength=nFilesize-nTrailerOffset;
+	size_t nFilesystemLength=nTrailerOffset-nKernelLength;
 	fprintf(stderr, 
-		" Kernel length is %x\n File system length is %x\n Trailer is %x bytes\n", 
+		" Kernel length is %lx\n File system length is %lx\n Trailer is %lx bytes\n", 
 		nKernelLength, nFilesystemLength, nTrailerLength);
 
 	// allocate filename buffer
@@ -209,9 +170,7 @@ int main(int argc, char **argv)
 
 	for(unsigned int nI=0;nI<3;nI++)
 	{
-		FILE *fOut;	
-
-		unsigned int nOffset,nLength;
+		size_t nOffset=0,nLength=0;
 		switch(nI)
 		{
 			case 0:
@@ -232,97 +191,59 @@ int main(int argc, char **argv)
 			
 		}
 			
-		switch(IdentifySegment(pDataOrg+nOffset,nLength))
+		SEGMENT_TYPE type=IdentifySegment(pDataOrg+nOffset,nLength);
+		if(g_SegmentInfo[type].pszDescription)
 		{
-			case SEGMENT_TYPE_SQUASHFS_3_0:
-				fprintf(stderr, "  SQUASHFS v3.0 image detected\n");	
-				sprintf(pszTemp,"%s/squashfs_magic",pszOutFolder);								
-				if(!EmitSquashfsMagic((squashfs_super_block *)pData,pszTemp))
-				{
-					fprintf(stderr,"  ERROR - writing %s\n", pszTemp);
-					free(pDataOrg);
-					free(pszOutFolder);	
-					free(pszTemp);
-					exit(3);		
-				}				
-				sprintf(pszTemp,"%s/squashfs-lzma-image-3_0",pszOutFolder);				
-				break;
-			case SEGMENT_TYPE_SQUASHFS_3_1:
-				fprintf(stderr, "  SQUASHFS v3.1 image detected\n");
-				sprintf(pszTemp,"%s/squashfs-lzma-image-3_1",pszOutFolder);
-				break;
-			case SEGMENT_TYPE_SQUASHFS_3_2:
-				fprintf(stderr, "  SQUASHFS v3.2 image detected\n");
-				sprintf(pszTemp,"%s/squashfs-lzma-image-3_2",pszOutFolder);
-				break;
-			case SEGMENT_TYPE_SQUASHFS_3_x:
-				fprintf(stderr, "  SQUASHFS v3.x (>3.2) image detected\n");
-				sprintf(pszTemp,"%s/squashfs-lzma-image-3_x",pszOutFolder);
-				break;
-			case SEGMENT_TYPE_SQUASHFS_2_0:
-				fprintf(stderr, "  SQUASHFS v2.0 image detected\n");
-				sprintf(pszTemp,"%s/squashfs-lzma-image-2_0",pszOutFolder);
-				break;
-			case SEGMENT_TYPE_SQUASHFS_2_1:
-				fprintf(stderr, "  SQUASHFS v2.1 image detected\n");
-				sprintf(pszTemp,"%s/squashfs-lzma-image-2_1",pszOutFolder);
-				break;
-			case SEGMENT_TYPE_SQUASHFS_2_x:
-				fprintf(stderr, "  SQUASHFS v2.x image detected\n");
-				sprintf(pszTemp,"%s/squashfs-lzma-image-2_x",pszOutFolder);
-				break;
-			case SEGMENT_TYPE_SQUASHFS_OTHER:
-				fprintf(stderr, "  ! WARNING: Unknown squashfs version.\n");
-				sprintf(pszTemp,"%s/squashfs-lzma-image-x_x",pszOutFolder);
-				break;
-			case SEGMENT_TYPE_CRAMFS_x_x:
-				fprintf(stderr, "  CRAMFS v? image detected\n");
-				sprintf(pszTemp,"%s/cramfs-image-x_x",pszOutFolder);
-				break;				
-			default:
-				if(!nI)
-				{
-					sprintf(pszTemp,"%s/vmlinuz",pszOutFolder);
-				}
-				else if(nI==2)
-				{
-					sprintf(pszTemp,"%s/hwid.txt",pszOutFolder);
-				}
-				else
-				{
-					// should add assertion
-					sprintf(pszTemp,"%s/part%d.bin",pszOutFolder,nI);
-				}
-				break;			
-		}		
-		fprintf(stderr,"  Writing %s\n    size %u from offset %ld ...\n", 
+			fprintf(stderr, "  %s\n", g_SegmentInfo[type].pszDescription);
+		}
+		if(type==SEGMENT_TYPE_SQUASHFS_3_0)
+		{
+			sprintf(pszTemp,"%s/squashfs_magic",pszOutFolder);								
+			if(!EmitSquashfsMagic((squashfs_super_block *)(pDataOrg+nOffset),pszTemp))
+			{
+				fprintf(stderr,"  ERROR - writing %s\n", pszTemp);
+				munmap(pDataOrg,nFilesize);
+				close(fdIn);
+				free(pszOutFolder);	
+				free(pszTemp);
+				exit(3);		
+			}				
+		}
+		if(g_SegmentInfo[type].pszImageName)
+		{
+			sprintf(pszTemp,"%s/%s",pszOutFolder,g_SegmentInfo[type].pszImageName);
+		}
+		else if(!nI)
+		{
+			sprintf(pszTemp,"%s/vmlinuz",pszOutFolder);
+		}
+		else if(nI==2)
+		{
+			sprintf(pszTemp,"%s/hwid.txt",pszOutFolder);
+		}
+		else
+		{
+			// should add assertion
+			sprintf(pszTemp,"%s/part%d.bin",pszOutFolder,nI);
+		}
+		fprintf(stderr,"  Writing %s\n    size %lu from offset %lu ...\n", 
 			pszTemp, 
 			nLength,
-			pData-pDataOrg);		
+			nOffset);		
 
-		fOut=fopen(pszTemp,"wb");
-		if(!fOut)
-		{
-			fprintf(stderr,"  ERROR could not open %s\n", pszTemp);
-			free(pDataOrg);
-			free(pszOutFolder);	
-			free(pszTemp);
-			exit(3);		
-		}				
-		if(!fwrite(pData,1,nLength,fOut))
+		if(!EmitSegment(fdIn,pDataOrg,nOffset,nLength,pszTemp))
 		{
 			fprintf(stderr," ERROR could not write %s\n", pszTemp);
-			fclose(fOut);
-			free(pDataOrg);
+			munmap(pDataOrg,nFilesize);
+			close(fdIn);
 			free(pszOutFolder);	
 			free(pszTemp);
 			exit(4);				
 		}
-		fclose(fOut);	
-		pData+=nLength;
 	}
 	
-	free(pDataOrg);
+	munmap(pDataOrg,nFilesize);
+	close(fdIn);
 	free(pszOutFolder);	
 	free(pszTemp);
 	printf("  Done!\n");
@@ -0,0 +1,616 @@
+/*
+ * Single pass squashfs superblock and compressor probe.
+ *
+ * Reads the superblock, the first metadata block and the first fragment block
+ * of a squashfs image once, works out which block codec the image was built
+ * with, and picks the unsquashfs builds in src/ that are able to decode it.
+ * This replaces running every unsquashfs variant against the image in turn.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <zlib.h>
+#include <lzma.h>
+#include "sqprobe.h"
+
+/* Superblock field offsets; 1.x - 3.x share the packed 2.x layout, 4.x has its own */
+#define SB3_MAJOR		28
+#define SB3_MINOR		30
+#define SB3_BLOCK_SIZE_1	32
+#define SB3_FLAGS		36
+#define SB3_BLOCK_SIZE		51
+#define SB3_FRAGMENTS		55
+#define SB2_INODE_TABLE_START	20
+#define SB2_FRAGMENT_TABLE	59
+#define SB3_INODE_TABLE_START	87
+#define SB3_FRAGMENT_TABLE	103
+#define SB4_BLOCK_SIZE		12
+#define SB4_FRAGMENTS		16
+#define SB4_COMPRESSION		20
+#define SB4_MAJOR		28
+#define SB4_MINOR		30
+#define SB4_INODE_TABLE_START	64
+#define SB4_FRAGMENT_TABLE	80
+#define SB_READ_SIZE		128
+
+#define SQP_COMPRESSED_BIT	(1 << 15)
+#define SQP_COMPRESSED_BIT_BLOCK (1 << 24)
+#define SQP_CHECK_BIT		2
+
+#define LZMA_PROPS_SIZE		5
+#define LZMA_ALONE_HEADER_SIZE	(LZMA_PROPS_SIZE + 8)
+#define LZMA_7Z_HEADER_SIZE	(LZMA_PROPS_SIZE + 4)
+#define LZMA_7ZIP_TAG		"7zip"
+#define LZMA_7ZIP_TAG_SIZE	4
+#define LZMA_NOHDR_LP		0
+#define LZMA_NOHDR_PB		2
+#define LZMA_NOHDR_DICT		(1 << 23)
+
+struct sqp_variant
+{
+	const char *path;
+	int major;
+	int max_minor;
+	unsigned int magics;
+	unsigned int codecs;
+};
+
+/*
+ * Extractors in src/, relative to the src directory, in the order that
+ * unsquashfs_all.sh has always tried them. A variant is a candidate when it
+ * supports the image's major version (up to max_minor, -1 for any) and
+ * superblock magic, and its codec mask includes the codec the probe detected.
+ */
+static const struct sqp_variant variants[] = {
+	{ "squashfs-2.1-r2/unsquashfs", 2, -1, SQP_MAGIC_STD, SQP_CODEC_ZLIB | SQP_CODEC_NONE },
+	{ "squashfs-2.1-r2/unsquashfs-lzma", 2, -1, SQP_MAGIC_STD, SQP_CODEC_LZMA_NOHDR },
+	{ "others/squashfs-2.0-nb4/unsquashfs", 2, -1, SQP_MAGIC_STD, SQP_CODEC_LZMA_ALONE | SQP_CODEC_LZMA_RAW | SQP_CODEC_UNKNOWN },
+	{ "others/squashfs-2.2-r2-7z/unsquashfs", 2, -1, SQP_MAGIC_STD, SQP_CODEC_LZMA_7Z },
+
+	{ "squashfs-3.0/unsquashfs", 3, 0, SQP_MAGIC_STD, SQP_CODEC_ZLIB | SQP_CODEC_NONE },
+	{ "squashfs-3.0/unsquashfs-lzma", 3, 0, SQP_MAGIC_STD, SQP_CODEC_LZMA_NOHDR },
+	{ "squashfs-3.0-lzma-damn-small-variant/unsquashfs-lzma", 3, 0, SQP_MAGIC_DAMNSMALL, ~0U },
+	{ "others/squashfs-3.0-e2100/unsquashfs-lzma", 3, 0, SQP_MAGIC_STD, SQP_CODEC_LZMA_NOHDR_LC0 },
+	{ "others/squashfs-3.2-r2/unsquashfs", 3, 0, SQP_MAGIC_STD, SQP_CODEC_ZLIB | SQP_CODEC_NONE },
+	{ "others/squashfs-3.2-r2-lzma/squashfs3.2-r2/squashfs-tools/unsquashfs", 3, 0, SQP_MAGIC_STD | SQP_MAGIC_SQLZMA, SQP_CODEC_LZMA_ALONE | SQP_CODEC_ZLIB },
+	{ "others/squashfs-3.2-r2-hg612-lzma/unsquashfs", 3, 0, SQP_MAGIC_STD | SQP_MAGIC_SQLZMA, SQP_CODEC_LZMA_ALONE | SQP_CODEC_LZMA_RAW | SQP_CODEC_UNKNOWN },
+	{ "others/squashfs-3.2-r2-wnr1000/unsquashfs", 3, 0, SQP_MAGIC_STD | SQP_MAGIC_SQLZMA, SQP_CODEC_LZMA_ALONE | SQP_CODEC_UNKNOWN },
+	{ "others/squashfs-3.2-r2-rtn12/unsquashfs", 3, 0, SQP_MAGIC_STD | SQP_MAGIC_SQLZMA, SQP_CODEC_LZMA_ALONE | SQP_CODEC_UNKNOWN },
+	{ "others/squashfs-3.3/unsquashfs", 3, -1, SQP_MAGIC_STD, SQP_CODEC_ZLIB | SQP_CODEC_NONE },
+	{ "others/squashfs-3.3-lzma/squashfs3.3/squashfs-tools/unsquashfs", 3, -1, SQP_MAGIC_STD | SQP_MAGIC_SQLZMA, SQP_CODEC_LZMA_ALONE | SQP_CODEC_ZLIB },
+	{ "others/squashfs-3.3-grml-lzma/squashfs3.3/squashfs-tools/unsquashfs", 3, -1, SQP_MAGIC_STD | SQP_MAGIC_SQLZMA, SQP_CODEC_LZMA_ALONE | SQP_CODEC_ZLIB },
+	{ "others/squashfs-3.4-cisco/unsquashfs", 3, -1, SQP_MAGIC_STD | SQP_MAGIC_SQLZMA, SQP_CODEC_LZMA_ALONE | SQP_CODEC_ZLIB | SQP_CODEC_UNKNOWN },
+	{ "others/squashfs-3.4-nb4/unsquashfs-lzma", 3, -1, SQP_MAGIC_STD | SQP_MAGIC_SQLZMA, SQP_CODEC_LZMA_ALONE | SQP_CODEC_UNKNOWN },
+	{ "others/squashfs-3.4-nb4/unsquashfs", 3, -1, SQP_MAGIC_STD, SQP_CODEC_ZLIB | SQP_CODEC_NONE },
+
+	{ "others/squashfs-4.2/unsquashfs", 4, -1, SQP_MAGIC_STD | SQP_MAGIC_SQLZMA, SQP_CODEC_ZLIB | SQP_CODEC_LZMA_ALONE | SQP_CODEC_XZ | SQP_CODEC_LZO | SQP_CODEC_NONE },
+	{ "others/squashfs-4.2-official/unsquashfs", 4, -1, SQP_MAGIC_STD, SQP_CODEC_ZLIB | SQP_CODEC_LZMA_ALONE | SQP_CODEC_XZ | SQP_CODEC_LZO | SQP_CODEC_NONE },
+	{ "others/squashfs-4.0-lzma/unsquashfs-lzma", 4, -1, SQP_MAGIC_STD, SQP_CODEC_LZMA_RAW | SQP_CODEC_ZLIB },
+	{ "others/squashfs-4.0-realtek/unsquashfs", 4, -1, SQP_MAGIC_STD, SQP_CODEC_LZMA_ALONE | SQP_CODEC_ZLIB | SQP_CODEC_UNKNOWN },
+	{ "others/squashfs-hg55x-bin/unsquashfs", 4, -1, SQP_MAGIC_STD, SQP_CODEC_UNKNOWN },
+	{ NULL, 0, 0, 0, 0 }
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + ((double) ts.tv_nsec / 1000000000.0);
+}
+
+static uint16_t get16(const unsigned char *p, int be)
+{
+	return be ? (uint16_t) ((p[0] << 8) | p[1]) : (uint16_t) ((p[1] << 8) | p[0]);
+}
+
+static uint32_t get32(const unsigned char *p, int be)
+{
+	if(be)
+	{
+		return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+	}
+
+	return ((uint32_t) p[3] << 24) | ((uint32_t) p[2] << 16) | ((uint32_t) p[1] << 8) | p[0];
+}
+
+static uint64_t get64(const unsigned char *p, int be)
+{
+	if(be)
+	{
+		return ((uint64_t) get32(p, be) << 32) | get32(p + 4, be);
+	}
+
+	return ((uint64_t) get32(p + 4, be) << 32) | get32(p, be);
+}
+
+static int read_at(int fd, off_t offset, void *buf, size_t size)
+{
+	ssize_t n = 0;
+	size_t total = 0;
+
+	while(total < size)
+	{
+		n = pread(fd, (char *) buf + total, size - total, offset + total);
+		if(n <= 0)
+		{
+			return 0;
+		}
+		total += n;
+	}
+
+	return 1;
+}
+
+static int try_zlib(const unsigned char *in, size_t in_len, unsigned char *out, size_t out_len)
+{
+	uLongf bytes = out_len;
+
+	/* zlib streams carry a header check and an adler32 trailer, so a clean decode is conclusive */
+	if(in_len < 2 || (in[0] & 0x0F) != Z_DEFLATED || ((in[0] << 8) | in[1]) % 31)
+	{
+		return 0;
+	}
+
+	return uncompress(out, &bytes, in, in_len) == Z_OK && bytes > 0;
+}
+
+static int try_xz(const unsigned char *in, size_t in_len, unsigned char *out, size_t out_len)
+{
+	uint64_t memlimit = SQP_MEMLIMIT;
+	size_t in_pos = 0, out_pos = 0;
+
+	return lzma_stream_buffer_decode(&memlimit, 0, NULL, in, &in_pos, in_len, out, &out_pos, out_len) == LZMA_OK && out_pos > 0;
+}
+
+static int lzma_run(lzma_stream *strm, const unsigned char *in, size_t in_len, unsigned char *out, size_t out_len, size_t *produced)
+{
+	lzma_ret ret;
+
+	strm->next_in = in;
+	strm->avail_in = in_len;
+	strm->next_out = out;
+	strm->avail_out = out_len;
+
+	ret = lzma_code(strm, LZMA_RUN);
+	*produced = out_len - strm->avail_out;
+	lzma_end(strm);
+
+	return ret;
+}
+
+static int try_lzma_alone(const unsigned char *in, size_t in_len, unsigned char *out, size_t out_len)
+{
+	lzma_stream strm = LZMA_STREAM_INIT;
+	uint64_t expected = 0;
+	size_t produced = 0;
+	lzma_ret ret;
+
+	if(in_len <= LZMA_ALONE_HEADER_SIZE || in[0] >= (9 * 5 * 5))
+	{
+		return 0;
+	}
+
+	/* The size field must either be unknown or fit in the output block */
+	expected = get64(in + LZMA_PROPS_SIZE, 0);
+	if(expected != UINT64_MAX && (expected == 0 || expected > out_len))
+	{
+		return 0;
+	}
+
+	if(lzma_alone_decoder(&strm, SQP_MEMLIMIT) != LZMA_OK)
+	{
+		return 0;
+	}
+
+	ret = lzma_run(&strm, in, in_len, out, out_len, &produced);
+
+	if(expected != UINT64_MAX)
+	{
+		return ret == LZMA_STREAM_END && produced == expected;
+	}
+
+	return (ret == LZMA_STREAM_END || ret == LZMA_OK) && produced > 0;
+}
+
+static int lzma_raw(const unsigned char *in, size_t in_len, unsigned int props, uint32_t dict_size, unsigned char *out, size_t out_len)
+{
+	lzma_stream strm = LZMA_STREAM_INIT;
+	lzma_options_lzma opt;
+	lzma_filter filters[2];
+	size_t produced = 0;
+	lzma_ret ret;
+
+	if(in_len == 0 || props >= (9 * 5 * 5))
+	{
+		return 0;
+	}
+
+	memset(&opt, 0, sizeof(opt));
+	opt.lc = props % 9;
+	props /= 9;
+	opt.lp = props % 5;
+	opt.pb = props / 5;
+	opt.dict_size = (dict_size < LZMA_DICT_SIZE_MIN) ? LZMA_DICT_SIZE_MIN : dict_size;
+
+	filters[0].id = LZMA_FILTER_LZMA1;
+	filters[0].options = &opt;
+	filters[1].id = LZMA_VLI_UNKNOWN;
+	filters[1].options = NULL;
+
+	if(lzma_raw_decoder(&strm, filters) != LZMA_OK)
+	{
+		return 0;
+	}
+
+	/* Raw streams have no end marker; everything in the block must decode without error */
+	ret = lzma_run(&strm, in, in_len, out, out_len, &produced);
+
+	return (ret == LZMA_OK || ret == LZMA_STREAM_END) && strm.avail_in == 0 && produced > 0;
+}
+
+/* 5 byte LZMA properties followed by the raw stream */
+static int try_lzma_raw(const unsigned char *in, size_t in_len, unsigned char *out, size_t out_len)
+{
+	if(in_len <= LZMA_PROPS_SIZE)
+	{
+		return 0;
+	}
+
+	return lzma_raw(in + LZMA_PROPS_SIZE, in_len - LZMA_PROPS_SIZE, in[0], get32(in + 1, 0), out, out_len);
+}
+
+/* squashfs-2.2-r2-7z: 4 byte tag, 5 byte LZMA properties, then the raw stream */
+static int try_lzma_7z(const unsigned char *in, size_t in_len, unsigned char *out, size_t out_len)
+{
+	if(in_len <= LZMA_7Z_HEADER_SIZE)
+	{
+		return 0;
+	}
+
+	return lzma_raw(in + LZMA_7Z_HEADER_SIZE, in_len - LZMA_7Z_HEADER_SIZE, in[4], get32(in + 5, 0), out, out_len);
+}
+
+/*
+ * The LZMA_Lib zlib replacement used by the squashfs-2.1/3.0 unsquashfs-lzma
+ * builds: no header at all (other than an optional "7zip" tag), with the
+ * properties compiled into the decoder.
+ */
+static int try_lzma_noheader(const unsigned char *in, size_t in_len, unsigned int lc, unsigned char *out, size_t out_len)
+{
+	if(in_len > LZMA_7ZIP_TAG_SIZE && memcmp(in, LZMA_7ZIP_TAG, LZMA_7ZIP_TAG_SIZE) == 0)
+	{
+		in += LZMA_7ZIP_TAG_SIZE;
+		in_len -= LZMA_7ZIP_TAG_SIZE;
+	}
+
+	return lzma_raw(in, in_len, (LZMA_NOHDR_PB * 5 + LZMA_NOHDR_LP) * 9 + lc, LZMA_NOHDR_DICT, out, out_len);
+}
+
+/*
+ * Identify the codec of a single block. Codecs are tried strongest check
+ * first so that a weaker LZMA heuristic never shadows a verified zlib/xz hit.
+ */
+static enum sqp_codec identify_block(const unsigned char *in, size_t in_len, int compressed, unsigned char *out, size_t out_len)
+{
+	if(!compressed)
+	{
+		return SQP_CODEC_NONE;
+	}
+	if(try_zlib(in, in_len, out, out_len))
+	{
+		return SQP_CODEC_ZLIB;
+	}
+	if(try_xz(in, in_len, out, out_len))
+	{
+		return SQP_CODEC_XZ;
+	}
+	if(try_lzma_alone(in, in_len, out, out_len))
+	{
+		return SQP_CODEC_LZMA_ALONE;
+	}
+	if(try_lzma_7z(in, in_len, out, out_len))
+	{
+		return SQP_CODEC_LZMA_7Z;
+	}
+	if(try_lzma_raw(in, in_len, out, out_len))
+	{
+		return SQP_CODEC_LZMA_RAW;
+	}
+	if(try_lzma_noheader(in, in_len, 3, out, out_len))
+	{
+		return SQP_CODEC_LZMA_NOHDR;
+	}
+	if(try_lzma_noheader(in, in_len, 0, out, out_len))
+	{
+		return SQP_CODEC_LZMA_NOHDR_LC0;
+	}
+
+	return SQP_CODEC_UNKNOWN;
+}
+
+/* Read and identify the metadata block at start; the decoded bytes are left in out */
+static enum sqp_codec probe_metadata(int fd, off_t base, uint64_t start, struct sqp_result *res, int be, int check, unsigned char *out)
+{
+	unsigned char hdr[2] = { 0 };
+	unsigned char in[SQP_METADATA_SIZE];
+	unsigned int c_byte = 0, size = 0;
+
+	if(!read_at(fd, base + start, hdr, sizeof(hdr)))
+	{
+		return SQP_CODEC_UNKNOWN;
+	}
+
+	c_byte = get16(hdr, be);
+	size = c_byte & ~SQP_COMPRESSED_BIT;
+
+	if(size == 0 || size > SQP_METADATA_SIZE)
+	{
+		return SQP_CODEC_UNKNOWN;
+	}
+
+	/* Pre-4.0 images built with check data carry a marker byte after the length */
+	start += sizeof(hdr) + (check ? 1 : 0);
+
+	if(!read_at(fd, base + start, in, size))
+	{
+		return SQP_CODEC_UNKNOWN;
+	}
+
+	if(!(c_byte & SQP_COMPRESSED_BIT) && res->compression == SQP_LZO_COMPRESSION)
+	{
+		/* There's no lzo decoder to verify against; trust the superblock */
+		return SQP_CODEC_LZO;
+	}
+
+	if(c_byte & SQP_COMPRESSED_BIT)
+	{
+		memcpy(out, in, size);
+	}
+
+	return identify_block(in, size, !(c_byte & SQP_COMPRESSED_BIT), out, SQP_METADATA_SIZE);
+}
+
+/* Locate the first fragment block through the fragment index table and identify its codec */
+static enum sqp_codec probe_fragment(int fd, off_t base, struct sqp_result *res, int be, int check)
+{
+	unsigned char index[8] = { 0 };
+	unsigned char *meta = NULL, *in = NULL, *out = NULL;
+	uint64_t table = 0, start = 0;
+	uint32_t size = 0;
+	enum sqp_codec codec = SQP_CODEC_UNKNOWN;
+	int index_size = (res->major < 3) ? 4 : 8;
+
+	if(!read_at(fd, base + res->fragment_table_start, index, index_size))
+	{
+		return SQP_CODEC_UNKNOWN;
+	}
+
+	table = (index_size == 4) ? get32(index, be) : get64(index, be);
+
+	meta = malloc(SQP_METADATA_SIZE);
+	in = malloc(res->block_size);
+	out = malloc(res->block_size);
+
+	if(!meta || !in || !out)
+	{
+		goto end;
+	}
+
+	/* The fragment entries live in a metadata block, so decode that first */
+	if(probe_metadata(fd, base, table, res, be, check, meta) == SQP_CODEC_UNKNOWN)
+	{
+		goto end;
+	}
+
+	if(res->major < 3)
+	{
+		start = get32(meta, be);
+		size = get32(meta + 4, be);
+	}
+	else
+	{
+		start = get64(meta, be);
+		size = get32(meta + 8, be);
+	}
+
+	if((size & ~SQP_COMPRESSED_BIT_BLOCK) == 0 || (size & ~SQP_COMPRESSED_BIT_BLOCK) > res->block_size)
+	{
+		goto end;
+	}
+
+	if(read_at(fd, base + start, in, size & ~SQP_COMPRESSED_BIT_BLOCK))
+	{
+		res->fragment_checked = 1;
+		codec = identify_block(in, size & ~SQP_COMPRESSED_BIT_BLOCK, !(size & SQP_COMPRESSED_BIT_BLOCK), out, res->block_size);
+	}
+
+end:
+	if(meta) free(meta);
+	if(in) free(in);
+	if(out) free(out);
+	return codec;
+}
+
+static int parse_superblock(const unsigned char *sb, struct sqp_result *res, int *be)
+{
+	uint32_t magic = get32(sb, 0);
+
+	*be = 0;
+
+	switch(magic)
+	{
+		case SQP_MAGIC_SWAP:
+			*be = 1;
+			/* FALLTHROUGH */
+		case SQP_MAGIC:
+			res->magic_type = SQP_MAGIC_STD;
+			break;
+		case SQP_MAGIC_LZMA_SWAP:
+			*be = 1;
+			/* FALLTHROUGH */
+		case SQP_MAGIC_LZMA:
+			res->magic_type = SQP_MAGIC_SQLZMA;
+			break;
+		case SQP_MAGIC_DSL_SWAP:
+			*be = 1;
+			/* FALLTHROUGH */
+		case SQP_MAGIC_DSL:
+			res->magic_type = SQP_MAGIC_DAMNSMALL;
+			break;
+		default:
+			return 0;
+	}
+
+	res->magic = get32(sb, *be);
+	res->big_endian = *be;
+	res->major = get16(sb + SB3_MAJOR, *be);
+	res->minor = get16(sb + SB3_MINOR, *be);
+
+	if(res->major >= 4)
+	{
+		res->compression = get16(sb + SB4_COMPRESSION, *be);
+		res->block_size = get32(sb + SB4_BLOCK_SIZE, *be);
+		res->fragments = get32(sb + SB4_FRAGMENTS, *be);
+		res->inode_table_start = get64(sb + SB4_INODE_TABLE_START, *be);
+		res->fragment_table_start = get64(sb + SB4_FRAGMENT_TABLE, *be);
+	}
+	else if(res->major == 3)
+	{
+		res->block_size = get32(sb + SB3_BLOCK_SIZE, *be);
+		res->fragments = get32(sb + SB3_FRAGMENTS, *be);
+		res->inode_table_start = get64(sb + SB3_INODE_TABLE_START, *be);
+		res->fragment_table_start = get64(sb + SB3_FRAGMENT_TABLE, *be);
+	}
+	else
+	{
+		/* 1.x images have no fragments; the 2.x tools read both */
+		res->major = 2;
+		res->block_size = (res->minor > 0) ? get32(sb + SB3_BLOCK_SIZE, *be) : get16(sb + SB3_BLOCK_SIZE_1, *be);
+		res->fragments = (res->minor > 0) ? get32(sb + SB3_FRAGMENTS, *be) : 0;
+		res->inode_table_start = get32(sb + SB2_INODE_TABLE_START, *be);
+		res->fragment_table_start = get32(sb + SB2_FRAGMENT_TABLE, *be);
+	}
+
+	if(res->block_size == 0 || res->block_size > SQP_MAX_BLOCK_SIZE)
+	{
+		return 0;
+	}
+
+	return 1;
+}
+
+static void pick_candidates(struct sqp_result *res)
+{
+	unsigned int codec = res->metadata_codec;
+	int i = 0;
+
+	/* Stored metadata says nothing about the codec; the fragment block may */
+	if(codec == SQP_CODEC_NONE && res->fragment_checked && res->fragment_codec != SQP_CODEC_NONE)
+	{
+		codec = res->fragment_codec;
+	}
+
+	for(i=0; variants[i].path != NULL && res->ncandidates < SQP_MAX_CANDIDATES; i++)
+	{
+		if(variants[i].major == res->major &&
+		   (variants[i].max_minor < 0 || res->minor <= variants[i].max_minor) &&
+		   (variants[i].magics & res->magic_type) &&
+		   (variants[i].codecs & codec))
+		{
+			res->candidates[res->ncandidates++] = variants[i].path;
+		}
+	}
+}
+
+const char *sqprobe_codec_name(enum sqp_codec codec)
+{
+	switch(codec)
+	{
+		case SQP_CODEC_NONE:
+			return "none";
+		case SQP_CODEC_ZLIB:
+			return "zlib";
+		case SQP_CODEC_LZMA_ALONE:
+			return "lzma-alone";
+		case SQP_CODEC_LZMA_RAW:
+			return "lzma-raw";
+		case SQP_CODEC_LZMA_7Z:
+			return "lzma-7z";
+		case SQP_CODEC_LZMA_NOHDR:
+			return "lzma-noheader";
+		case SQP_CODEC_LZMA_NOHDR_LC0:
+			return "lzma-noheader-lc0";
+		case SQP_CODEC_XZ:
+			return "xz";
+		case SQP_CODEC_LZO:
+			return "lzo";
+		default:
+			break;
+	}
+
+	return "unknown";
+}
+
+/*
+ * Probe the squashfs image that starts at offset in fd. Returns 1 if a
+ * squashfs superblock was found; res->candidates then lists the extractors
+ * able to decode the image, best first (possibly none).
+ */
+int sqprobe_fd(int fd, off_t offset, struct sqp_result *res)
+{
+	unsigned char sb[SB_READ_SIZE] = { 0 };
+	unsigned char meta[SQP_METADATA_SIZE];
+	double start = now(), t = start;
+	int be = 0, check = 0;
+
+	memset(res, 0, sizeof(struct sqp_result));
+	res->metadata_codec = SQP_CODEC_UNKNOWN;
+	res->fragment_codec = SQP_CODEC_UNKNOWN;
+
+	if(!read_at(fd, offset, sb, sizeof(sb)) || !parse_superblock(sb, res, &be))
+	{
+		res->timing.superblock = res->timing.total = now() - start;
+		return 0;
+	}
+
+	check = (res->major < 4) && ((sb[SB3_FLAGS] >> SQP_CHECK_BIT) & 1);
+	res->timing.superblock = now() - t;
+
+	t = now();
+	res->metadata_codec = probe_metadata(fd, offset, res->inode_table_start, res, be, check, meta);
+	res->timing.metadata = now() - t;
+
+	t = now();
+	if(res->fragments > 0)
+	{
+		res->fragment_codec = probe_fragment(fd, offset, res, be, check);
+	}
+	res->timing.fragment = now() - t;
+
+	pick_candidates(res);
+	res->timing.total = now() - start;
+
+	return 1;
+}
+
+int sqprobe_file(const char *file, off_t offset, struct sqp_result *res)
+{
+	int fd = 0, retval = 0;
+
+	fd = open(file, O_RDONLY);
+	if(fd == -1)
+	{
+		perror(file);
+		return 0;
+	}
+
+	retval = sqprobe_fd(fd, offset, res);
+	close(fd);
+
+	return retval;
+}
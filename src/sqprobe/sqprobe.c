@@ -0,0 +1,93 @@
+/*
+ * Identifies the squashfs variant of an image and lists the unsquashfs
+ * builds in src/ that can extract it, so that unsquashfs_all.sh can go
+ * straight to the right extractor instead of trying all of them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sqprobe.h"
+
+#define USAGE "\n\
+sqprobe - identify the SquashFS variant of a file system image\n\
+\n\
+Usage: %s [-o offset] [-q] <squashfs image>\n\
+\n\
+\t-o <offset>    Offset of the superblock in the image [0]\n\
+\t-q             Don't print probe timings to stderr\n\
+\n\
+Prints shell variable assignments to stdout. UNSQUASHFS lists the candidate\n\
+extractors, relative to the src directory, best match first.\n\
+\n"
+
+int main(int argc, char *argv[])
+{
+	struct sqp_result res;
+	char *file = NULL;
+	off_t offset = 0;
+	int i = 0, quiet = 0, retval = EXIT_FAILURE;
+
+	for(i=1; i<argc; i++)
+	{
+		if(strcmp(argv[i], "-o") == 0 && i+1 < argc)
+		{
+			offset = strtoll(argv[++i], NULL, 0);
+		}
+		else if(strcmp(argv[i], "-q") == 0)
+		{
+			quiet = 1;
+		}
+		else if(argv[i][0] != '-' && file == NULL)
+		{
+			file = argv[i];
+		}
+		else
+		{
+			file = NULL;
+			break;
+		}
+	}
+
+	if(file == NULL)
+	{
+		fprintf(stderr, USAGE, argv[0]);
+		goto end;
+	}
+
+	if(!sqprobe_file(file, offset, &res))
+	{
+		fprintf(stderr, "No SquashFS superblock found in %s\n", file);
+		goto end;
+	}
+
+	printf("SQUASHFS_MAJOR=%d\n", res.major);
+	printf("SQUASHFS_MINOR=%d\n", res.minor);
+	printf("SQUASHFS_ENDIAN=\"%s\"\n", res.big_endian ? "big" : "little");
+	printf("SQUASHFS_BLOCK_SIZE=%u\n", res.block_size);
+	printf("SQUASHFS_COMPRESSION=%d\n", res.compression);
+	printf("SQUASHFS_CODEC=\"%s\"\n", sqprobe_codec_name(res.metadata_codec));
+	printf("SQUASHFS_FRAGMENT_CODEC=\"%s\"\n", res.fragment_checked ? sqprobe_codec_name(res.fragment_codec) : "");
+	printf("UNSQUASHFS=\"");
+	for(i=0; i<res.ncandidates; i++)
+	{
+		printf("%s%s", (i > 0) ? " " : "", res.candidates[i]);
+	}
+	printf("\"\n");
+
+	if(!quiet)
+	{
+		fprintf(stderr, "superblock probe: %.6f sec\n", res.timing.superblock);
+		fprintf(stderr, "metadata probe:   %.6f sec\n", res.timing.metadata);
+		fprintf(stderr, "fragment probe:   %.6f sec\n", res.timing.fragment);
+		fprintf(stderr, "total:            %.6f sec\n", res.timing.total);
+	}
+
+	if(res.ncandidates > 0)
+	{
+		retval = EXIT_SUCCESS;
+	}
+
+end:
+	return retval;
+}
@@ -0,0 +1,81 @@
+#ifndef _SQPROBE_H_
+#define _SQPROBE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SQP_MAX_CANDIDATES	16
+#define SQP_METADATA_SIZE	8192
+#define SQP_MAX_BLOCK_SIZE	(1024 * 1024)
+#define SQP_MEMLIMIT		(64 * 1024 * 1024)
+
+/* On-disk superblock magic numbers used by the various squashfs trees in src/ */
+#define SQP_MAGIC		0x73717368	/* "hsqs", stock squashfs */
+#define SQP_MAGIC_SWAP		0x68737173
+#define SQP_MAGIC_LZMA		0x71736873	/* "shsq", sqlzma / cisco */
+#define SQP_MAGIC_LZMA_SWAP	0x73687371
+#define SQP_MAGIC_DSL		0x74717368	/* "hsqt", damn small linux variant */
+#define SQP_MAGIC_DSL_SWAP	0x68737174
+
+/* squashfs 4.x superblock compression ids */
+#define SQP_ZLIB_COMPRESSION	1
+#define SQP_LZMA_COMPRESSION	2
+#define SQP_LZO_COMPRESSION	3
+#define SQP_XZ_COMPRESSION	4
+
+enum sqp_magic
+{
+	SQP_MAGIC_NONE		= 0,
+	SQP_MAGIC_STD		= 1 << 0,
+	SQP_MAGIC_SQLZMA	= 1 << 1,
+	SQP_MAGIC_DAMNSMALL	= 1 << 2,
+};
+
+/* Block codecs that the probe knows how to recognize; used as bit masks in the variant table */
+enum sqp_codec
+{
+	SQP_CODEC_UNKNOWN	= 1 << 0,
+	SQP_CODEC_NONE		= 1 << 1,	/* block stored uncompressed */
+	SQP_CODEC_ZLIB		= 1 << 2,
+	SQP_CODEC_LZMA_ALONE	= 1 << 3,	/* 5 byte properties + 8 byte size (LZMA-Alone / sqlzma) */
+	SQP_CODEC_LZMA_RAW	= 1 << 4,	/* 5 byte properties, no size field (squashfs-4.0-lzma) */
+	SQP_CODEC_LZMA_7Z	= 1 << 5,	/* 4 byte tag + 5 byte properties (squashfs-2.2-r2-7z) */
+	SQP_CODEC_LZMA_NOHDR	= 1 << 6,	/* no header, lc=3 lp=0 pb=2 (LZMA_Lib zlib replacement) */
+	SQP_CODEC_LZMA_NOHDR_LC0 = 1 << 7,	/* no header, lc=0 lp=0 pb=2 (squashfs-3.0-e2100) */
+	SQP_CODEC_XZ		= 1 << 8,
+	SQP_CODEC_LZO		= 1 << 9,
+};
+
+struct sqp_timing
+{
+	double superblock;
+	double metadata;
+	double fragment;
+	double total;
+};
+
+struct sqp_result
+{
+	uint32_t magic;
+	enum sqp_magic magic_type;
+	int big_endian;
+	int major;
+	int minor;
+	int compression;
+	uint32_t block_size;
+	uint32_t fragments;
+	uint64_t inode_table_start;
+	uint64_t fragment_table_start;
+	enum sqp_codec metadata_codec;
+	enum sqp_codec fragment_codec;
+	int fragment_checked;
+	int ncandidates;
+	const char *candidates[SQP_MAX_CANDIDATES];
+	struct sqp_timing timing;
+};
+
+int sqprobe_fd(int fd, off_t offset, struct sqp_result *res);
+int sqprobe_file(const char *file, off_t offset, struct sqp_result *res);
+const char *sqprobe_codec_name(enum sqp_codec codec);
+
+#endif
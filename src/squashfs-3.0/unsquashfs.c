@@ -47,6 +47,7 @@
 #include <squashfs_fs.h>
 #include "read_fs.h"
 #include "global.h"
+#include "unsquash.h"
 
 #include <stdlib.h>
 
@@ -78,12 +79,8 @@ struct hash_table_entry *inode_table_hash[65536], *directory_table_hash[65536];
 int fd;
 squashfs_fragment_entry *fragment_table;
 unsigned int *uid_table, *guid_table;
-unsigned int cached_frag = SQUASHFS_INVALID_FRAG;
-char *fragment_data;
-char *file_data;
-char *data;
 unsigned int block_size;
-int lsonly = FALSE, info = FALSE;
+int lsonly = FALSE, info = FALSE, processors = 0;
 char **created_inode;
 
 #define CALCULATE_HASH(start)	(start & 0xffff)
@@ -195,38 +192,25 @@ failed:
 }
 
 
-int read_data_block(long long start, unsigned int size, char *block)
+/*
+ * Data block decoder for the parallel pipeline, zlib's uncompress() or the
+ * LZMA library's drop in replacement keep no state between calls
+ */
+int decode_data_block(void *strm, void *dest, void *src, int size, int outsize, int *error)
 {
+	unsigned long bytes = outsize;
 	int res;
-	unsigned long bytes = block_size;
-	int c_byte = SQUASHFS_COMPRESSED_SIZE_BLOCK(size);
 
-	TRACE("read_data_block: block @0x%llx, %d %s bytes\n", start, SQUASHFS_COMPRESSED_SIZE_BLOCK(c_byte), SQUASHFS_COMPRESSED_BLOCK(c_byte) ? "compressed" : "uncompressed");
+	if((res = uncompress((unsigned char *) dest, &bytes, (const unsigned char *) src, size)) != Z_OK) {
+		*error = res;
+		return -1;
+	}
 
-	if(SQUASHFS_COMPRESSED_BLOCK(size)) {
-		if(read_bytes(start, c_byte, data) == FALSE)
-			return 0;
+	return bytes;
+}
 
-		if((res = uncompress((unsigned char *) block, &bytes, (const unsigned char *) data, c_byte)) != Z_OK) {
-			if(res == Z_MEM_ERROR)
-				ERROR("zlib::uncompress failed, not enough memory\n");
-			else if(res == Z_BUF_ERROR)
-				ERROR("zlib::uncompress failed, not enough room in output buffer\n");
-			else {
-				ERROR("zlib::uncompress failed, unknown error %d\n", res);
-				exit(1);
-			}
-			return 0;
-		}
 
-		return bytes;
-	} else {
-		if(read_bytes(start, c_byte, block) == FALSE)
-			return 0;
-
-		return c_byte;
-	}
-}
+struct unsquash_decoder decoder = { NULL, decode_data_block };
 
 
 void uncompress_inode_table(long long start, long long end, squashfs_super_block *sBlk)
@@ -325,29 +309,13 @@ void read_fragment_table(squashfs_super_block *sBlk)
 }
 
 
-char *read_fragment(unsigned int fragment)
-{
-	TRACE("read_fragment: reading fragment %d\n", fragment);
-
-	if(cached_frag == SQUASHFS_INVALID_FRAG || fragment != cached_frag) {
-		squashfs_fragment_entry *fragment_entry = &fragment_table[fragment];
-		if(read_data_block(fragment_entry->start_block, fragment_entry->size, fragment_data) == 0) {
-			ERROR("read_fragment: failed to read fragment %d\n", fragment);
-			cached_frag = SQUASHFS_INVALID_FRAG;
-			return NULL;
-		}
-		cached_frag = fragment;
-	}
-
-	return fragment_data;
-}
-
-
 int write_file(char *pathname, unsigned int fragment, unsigned int frag_bytes, unsigned int offset,
-unsigned int blocks, long long start, char *block_ptr, unsigned int mode)
+unsigned int blocks, long long start, char *block_ptr, long long file_size, unsigned int mode,
+unsigned int uid, unsigned int guid, unsigned int mtime)
 {
-	unsigned int file_fd, bytes, i;
+	unsigned int i;
 	unsigned int *block_list;
+	struct unsquash_file *file;
 
 	TRACE("write_file: regular file, blocks %d\n", blocks);
 
@@ -363,46 +331,52 @@ unsigned int blocks, long long start, char *block_ptr, unsigned int mode)
 	} else
 		memcpy(block_list, block_ptr, blocks * sizeof(unsigned int));
 
-	if((file_fd = open(pathname, O_CREAT | O_WRONLY, (mode_t) mode)) == -1) {
+	if((file = unsquash_file_open(pathname, 0, mode, file_size)) == NULL) {
 		ERROR("write_file: failed to create file %s, because %s\n", pathname,
 			strerror(errno));
 		free(block_list);
 		return FALSE;
 	}
 
-	for(i = 0; i < blocks; i++) {
-		if((bytes = read_data_block(start, block_list[i], file_data)) == 0) {
-			ERROR("write_file: failed to read data block 0x%llx\n", start);
-			goto failure;
-		}
+	file->mode = mode;
+	file->uid = uid;
+	file->guid = guid;
+	file->mtime = mtime;
 
-		if(write(file_fd, file_data, bytes) < bytes) {
-			ERROR("write_file: failed to write data block 0x%llx\n", start);
-			goto failure;
-		}
+	/*
+	 * The blocks are read, decompressed and written by the reader,
+	 * deflator and writer threads, which call file_done() once the file
+	 * is complete
+	 */
+	for(i = 0; i < blocks; i++) {
+		unsigned int c_byte = SQUASHFS_COMPRESSED_SIZE_BLOCK(block_list[i]);
 
-		start += SQUASHFS_COMPRESSED_SIZE_BLOCK(block_list[i]);
+		unsquash_file_block(file, start, c_byte, SQUASHFS_COMPRESSED_BLOCK(block_list[i]),
+			i == blocks - 1 && frag_bytes == 0 ? file_size - (long long) i * block_size : block_size);
+		start += c_byte;
 	}
 
 	if(frag_bytes != 0) {
-		char *fragment_data = read_fragment(fragment);
-
-		if(fragment_data == NULL)
-			goto failure;
+		squashfs_fragment_entry *fragment_entry = &fragment_table[fragment];
 
-		if(write(file_fd, fragment_data + offset, frag_bytes) < frag_bytes) {
-			ERROR("write_file: failed to write fragment %d\n", fragment);
-			goto failure;
-		}
+		unsquash_file_fragment(file, fragment_entry->start_block,
+			SQUASHFS_COMPRESSED_SIZE_BLOCK(fragment_entry->size),
+			SQUASHFS_COMPRESSED_BLOCK(fragment_entry->size), offset, frag_bytes);
 	}
 
-	close(file_fd);
+	unsquash_file_close(file);
+	free(block_list);
 	return TRUE;
+}
 
-failure:
-	close(file_fd);
-	free(block_list);
-	return FALSE;
+
+void file_done(struct unsquash_file *file)
+{
+	if(file->failed)
+		return;
+
+	set_attributes(file->pathname, file->mode, file->uid, file->guid, file->mtime, FALSE);
+	file_count ++;
 }
 		
 
@@ -462,11 +436,9 @@ int create_inode(char *pathname, unsigned int start_block, unsigned int offset,
 
 			TRACE("create_inode: regular file, file_size %lld, blocks %d\n", inode->file_size, blocks);
 
-			if(write_file(pathname, inode->fragment, frag_bytes, offset, blocks, start,
-					block_ptr + sizeof(*inode), inode->mode)) {
-				set_attributes(pathname, inode->mode, inode->uid, inode->guid, inode->mtime, FALSE);
-				file_count ++;
-			}
+			write_file(pathname, inode->fragment, frag_bytes, offset, blocks, start,
+				block_ptr + sizeof(*inode), inode->file_size, inode->mode, inode->uid,
+				inode->guid, inode->mtime);
 			break;
 		}	
 		case SQUASHFS_LREG_TYPE: {
@@ -492,11 +464,9 @@ int create_inode(char *pathname, unsigned int start_block, unsigned int offset,
 
 			TRACE("create_inode: regular file, file_size %lld, blocks %d\n", inode->file_size, blocks);
 
-			if(write_file(pathname, inode->fragment, frag_bytes, offset, blocks, start,
-					block_ptr + sizeof(*inode), inode->mode)) {
-				set_attributes(pathname, inode->mode, inode->uid, inode->guid, inode->mtime, FALSE);
-				file_count ++;
-			}
+			write_file(pathname, inode->fragment, frag_bytes, offset, blocks, start,
+				block_ptr + sizeof(*inode), inode->file_size, inode->mode, inode->uid,
+				inode->guid, inode->mtime);
 			break;
 		}	
 		case SQUASHFS_SYMLINK_TYPE: {
@@ -895,6 +865,12 @@ int main(int argc, char *argv[])
 			info = TRUE;
 		else if(strcmp(argv[i], "-ls") == 0)
 			lsonly = TRUE;
+		else if(strcmp(argv[i], "-processors") == 0) {
+			if(++i == argc || (processors = atoi(argv[i])) < 1) {
+				ERROR("%s: -processors should be 1 or more\n", argv[0]);
+				exit(1);
+			}
+		}
 		else if(strcmp(argv[i], "-dest") == 0) {
 			if(++i == argc)
 				goto options;
@@ -909,6 +885,8 @@ options:
 			ERROR("\t-version\t\tprint version, licence and copyright information\n");
 			ERROR("\t-info\t\t\tprint files as they are unsquashed\n");
 			ERROR("\t-ls\t\t\tlist filesystem only\n");
+			ERROR("\t-processors <number>\tuse <number> processors to decompress, by default\n");
+			ERROR("\t\t\t\tas many as are online\n");
 			ERROR("\t-dest <pathname>\tunsquash to <pathname>, default \"squashfs-root\"\n");
 		}
 		exit(1);
@@ -923,14 +901,6 @@ options:
 		exit(1);
 
 	block_size = sBlk.block_size;
-	if((fragment_data = malloc(block_size)) == NULL)
-		EXIT_UNSQUASH("failed to allocate fragment_data\n");
-
-	if((file_data = malloc(block_size)) == NULL)
-		EXIT_UNSQUASH("failed to allocate file_data");
-
-	if((data = malloc(block_size)) == NULL)
-		EXIT_UNSQUASH("failed to allocate datan\n");
 
 	if((created_inode = malloc(sBlk.inodes * sizeof(char *))) == NULL)
 		EXIT_UNSQUASH("failed to allocate created_inode\n");
@@ -942,9 +912,14 @@ options:
 	uncompress_inode_table(sBlk.inode_table_start, sBlk.directory_table_start, &sBlk);
 	uncompress_directory_table(sBlk.directory_table_start, sBlk.fragment_table_start, &sBlk);
 
+	if(!lsonly)
+		unsquash_init(fd, block_size, processors, 0, 0, &decoder, file_done);
+
 	dir_scan(dest, SQUASHFS_INODE_BLK(sBlk.root_inode), SQUASHFS_INODE_OFFSET(sBlk.root_inode), &sBlk);
 
 	if(!lsonly) {
+		unsquash_finish();
+
 		printf("\n");
 		printf("created %d files\n", file_count);
 		printf("created %d directories\n", dir_count);
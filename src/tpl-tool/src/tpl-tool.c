@@ -20,7 +20,7 @@
 
 #include <netinet/in.h>		/* for network / host byte order conversions */
 
-#include "md5.h"
+#include "libhash.h"
 
 
 #define PROGRAM_NAME	"tpl-tool"
@@ -204,7 +204,6 @@ static struct device_info *get_device_info(uint32_t prod_id)
 
 static int checksum(char *buf, int len, int overwrite)
 {
-	MD5_CTX ctx;
 	struct image_header *hdr;
 	uint8_t old_checksum[MD5SUM_LEN];
 	int ret;
@@ -217,9 +216,7 @@ static int checksum(char *buf, int len, int overwrite)
 	else
 		memcpy(hdr->image_checksum, MD5Key_bootldr, MD5SUM_LEN);
 
-	MD5_Init(&ctx);
-	MD5_Update(&ctx, buf, len);
-	MD5_Final(hdr->image_checksum, &ctx);
+	hash_buffer(HASH_MD5, buf, len, hdr->image_checksum);
 
 	ret = memcmp(hdr->image_checksum, old_checksum, MD5SUM_LEN);
 
@@ -68,7 +68,11 @@ static void *lzma_internal_data = NULL;
 #define LZMA_FREE free
 #endif
 
-int lzma_decode(void *dst, int dstlen, void *src, int srclen)
+/* As lzma_decode, with the caller holding the decoder's internal buffer
+ * (initially NULL and 0) so that several threads can decode at once. The
+ * caller frees *internal_data when done. */
+int lzma_decode_r(void *dst, int dstlen, void *src, int srclen,
+    void **internal_data, u32 *internal_size)
 {
     u8 properties[5], prop0;
     u32 out_len = 0;
@@ -110,20 +114,20 @@ int lzma_decode(void *dst, int dstlen, void *src, int srclen)
    
     calc_internal_size = (LZMA_BASE_SIZE + (LZMA_LIT_SIZE << (lc + lp))) *
 	sizeof(CProb);
-    if (calc_internal_size > lzma_internal_size)
+    if (calc_internal_size > *internal_size)
     {
-	if (lzma_internal_data)
-	    LZMA_FREE(lzma_internal_data);
-	if (!(lzma_internal_data = LZMA_ALLOC(calc_internal_size)))
+	if (*internal_data)
+	    LZMA_FREE(*internal_data);
+	if (!(*internal_data = LZMA_ALLOC(calc_internal_size)))
 	{
-	    lzma_internal_size = 0;
+	    *internal_size = 0;
 	    LZMA_ERR("Error allocating internal data\n");
 	    return -2;
 	}
-	lzma_internal_size = calc_internal_size;
+	*internal_size = calc_internal_size;
     }
 
-    res = LzmaDecode((u8 *)lzma_internal_data, lzma_internal_size, lc, lp, pb,
+    res = LzmaDecode((u8 *)*internal_data, *internal_size, lc, lp, pb,
 	(u8 *)src, srclen, (u8 *)dst, out_len, &dstlen);
 
     if (res)
@@ -135,6 +139,12 @@ int lzma_decode(void *dst, int dstlen, void *src, int srclen)
     return dstlen;
 }
 
+int lzma_decode(void *dst, int dstlen, void *src, int srclen)
+{
+    return lzma_decode_r(dst, dstlen, src, srclen, &lzma_internal_data,
+	&lzma_internal_size);
+}
+
 void lzma_decode_uninit(void)
 {
    if (lzma_internal_data)
@@ -27,6 +27,8 @@
  */
 
 int lzma_decode(void *dst, int dstlen, void *src, int srclen);
+int lzma_decode_r(void *dst, int dstlen, void *src, int srclen,
+    void **internal_data, unsigned int *internal_size);
 void lzma_decode_uninit(void);
 
 
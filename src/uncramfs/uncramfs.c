@@ -21,6 +21,8 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/fcntl.h>
+#include <sys/time.h>
+#include <pthread.h>
 
 // Application libraries
 #include <zlib.h>
@@ -42,6 +44,7 @@ static const char* progname = "uncramfs";
 
 static char *opt_devfile = NULL;
 static char *opt_idsfile = NULL;
+static int opt_threads = 0;
 
 // Get version number from external file
 static const char*
@@ -66,9 +69,11 @@ static void usage(void)
 {
    printf(
      "%s v%s by Andrew Stitcher\n"
-     "Usage: '%s [-d devfilename] [-m modefilename] dirname infile'\n"
+     "Usage: '%s [-d devfilename] [-m modefilename] [-j threads] dirname infile'\n"
      " where <dirname> is the root for the\n"
-     " uncompressed (output) filesystem.\n", progname, VERSION, progname);
+     " uncompressed (output) filesystem.\n"
+     " -j sets the number of decompression threads (default: one per CPU).\n",
+     progname, VERSION, progname);
    exit(1);
 }
 
@@ -112,6 +117,183 @@ void uncompress_data(const u8* base, const u8* data, u32 size, u8* dstdata)
    }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//
+// File data is decoded in two passes. The tree walk creates every file at
+// its final size, maps it, and queues a job for each of its blocks; each
+// block is an independent stream located by the block pointer table.
+// decode_blocks() then decodes the jobs on a thread pool straight into the
+// mapped files. Every mapping counts against vm.max_map_count, so once
+// MAX_MAPPINGS files are queued the walk stops to decode and unmap them.
+
+struct job {
+   const u8* src;
+   u32 srclen;
+   u8* dst;
+   u32 dstlen;
+};
+
+struct mapping {
+   u8* data;
+   u32 size;
+};
+
+#define JOB_BATCH 16
+#define MAX_MAPPINGS 1024
+
+static struct job* jobs;
+static int njobs, jobs_size, next_job;
+static struct mapping* mappings;
+static int nmappings, mappings_size;
+static pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int stats_blocks;
+int stats_failed;
+double stats_bytes;
+double stats_seconds;
+int stats_threads;
+
+void decode_blocks();
+
+void queue_blocks(const u8* base, const u8* data, u32 size, u8* dstdata)
+{
+   const u32* buffs=(const u32*)(data);
+   int nblocks=(size-1)/blksize+1;
+   const u8* buff=(const u8*)(buffs+nblocks);
+   const u8* nbuff;
+   int block=0;
+   u32 len=size;
+
+   if (size == 0) {
+     return;
+   }
+
+   if (nmappings == MAX_MAPPINGS)
+     decode_blocks();
+
+   if (nmappings == mappings_size) {
+      mappings_size = mappings_size ? mappings_size*2 : 256;
+      mappings = realloc(mappings, mappings_size*sizeof(struct mapping));
+      if (!mappings) {
+	 perror("realloc");
+	 exit(1);
+      }
+   }
+   mappings[nmappings].data=dstdata;
+   mappings[nmappings].size=size;
+   ++nmappings;
+
+   for (;
+	block < nblocks;
+	++block, buff=nbuff, dstdata+=blksize, len-=blksize
+	) {
+      nbuff=base+*(buffs+block);
+
+      // A hole (mkcramfs -z) has no data, and the file is already zero
+      if (nbuff == buff)
+	continue;
+
+      if (njobs == jobs_size) {
+	 jobs_size = jobs_size ? jobs_size*2 : 1024;
+	 jobs = realloc(jobs, jobs_size*sizeof(struct job));
+	 if (!jobs) {
+	    perror("realloc");
+	    exit(1);
+	 }
+      }
+      jobs[njobs].src=buff;
+      jobs[njobs].srclen=nbuff-buff;
+      jobs[njobs].dst=dstdata;
+      jobs[njobs].dstlen=(len < blksize) ? len : blksize;
+      ++njobs;
+   }
+}
+
+void* decode_thread(void* arg)
+{
+   int blocks=0, failed=0;
+   double bytes=0;
+
+   while (1) {
+      int first, last;
+
+      pthread_mutex_lock(&job_mutex);
+      first=next_job;
+      last=(njobs-first < JOB_BATCH) ? njobs : first+JOB_BATCH;
+      next_job=last;
+      pthread_mutex_unlock(&job_mutex);
+
+      if (first == last)
+	break;
+
+      for (; first < last; ++first) {
+	 struct job* job=&jobs[first];
+	 uLongf tran=job->dstlen;
+
+	 if (uncompress(job->dst, &tran, job->src, job->srclen) != Z_OK) {
+	    fprintf(stderr,"Uncompression failed\n");
+	    ++failed;
+	 }
+	 ++blocks;
+	 bytes+=job->dstlen;
+      }
+   }
+
+   pthread_mutex_lock(&job_mutex);
+   stats_blocks+=blocks;
+   stats_failed+=failed;
+   stats_bytes+=bytes;
+   pthread_mutex_unlock(&job_mutex);
+   return NULL;
+}
+
+void decode_blocks()
+{
+   pthread_t* threads;
+   struct timeval start, end;
+   int i, count=opt_threads;
+
+   if (count > njobs)
+     count=njobs;
+   if (count < 1)
+     count=1;
+
+   threads=malloc(count*sizeof(pthread_t));
+   if (!threads) {
+      perror("malloc");
+      exit(1);
+   }
+
+   gettimeofday(&start, NULL);
+
+   // The main thread takes a share of the jobs too
+   for (i=1; i < count; ++i) {
+      if (pthread_create(&threads[i], NULL, decode_thread, NULL) != 0) {
+	 perror("pthread_create");
+	 exit(1);
+      }
+   }
+   decode_thread(NULL);
+   for (i=1; i < count; ++i)
+     pthread_join(threads[i], NULL);
+
+   gettimeofday(&end, NULL);
+   stats_seconds+=(end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)/1e6;
+   if (count > stats_threads)
+     stats_threads=count;
+
+   for (i=0; i < nmappings; ++i)
+     munmap(mappings[i].data, mappings[i].size);
+
+   free(threads);
+   free(jobs);
+   free(mappings);
+   jobs=NULL;
+   njobs=jobs_size=next_job=0;
+   mappings=NULL;
+   nmappings=mappings_size=0;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 int stats_totalsize;
@@ -150,6 +332,15 @@ void printstats()
    printf("[Number of entries:          %9d]\n", stats_count);
    printf("[Number of files compressed: %9d]\n", stats_compresses);
    printf("[Number of files expanded:   %9d]\n", stats_expands);
+   if (stats_blocks) {
+      printf("[Blocks decompressed:        %9d]\n", stats_blocks);
+      if (stats_failed)
+	printf("[Blocks failed:              %9d]\n", stats_failed);
+      printf("[Decompression threads:      %9d]\n", stats_threads);
+      printf("[Decompression time:         %9.3fs]\n", stats_seconds);
+      printf("[Decompression rate:         %9.2fMB/s]\n",
+	     stats_seconds > 0 ? stats_bytes/stats_seconds/1e6 : 0.0);
+   }
    printf("\n");
 }
 
@@ -253,6 +444,11 @@ void do_file(const u8* base, u32 offset, u32 size,
       close(fd);
       return;
    }
+
+   if (size == 0) {
+      close(fd);
+      return;
+   }
    
    file_data = mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
    if (file_data == MAP_FAILED) {
@@ -260,16 +456,16 @@ void do_file(const u8* base, u32 offset, u32 size,
       close(fd);
       return;
    }
+   // The mapping outlives the descriptor
+   close(fd);
 
    // Allow for uncompressed XIP executable
    if (mode & S_ISVTX) {
       memcpy(file_data, srcdata, size);
+      munmap(file_data, size);
    } else {
-      uncompress_data(base, base+offset, size, file_data);
+      queue_blocks(base, base+offset, size, file_data);
    }
-   
-   munmap(file_data, size);
-   close(fd);
 
 }
 
@@ -656,38 +852,26 @@ int main(int argc, char **argv)
    // Check the program usage
    if (argc)
      progname = argv[0];
-   if (argc != 3 && argc != 5 && argc != 7)
-     usage();
-
-   if (argc == 3) {
-      dirname=argv[1];
-      imagefile=argv[2];
-   } else if (argc == 5) {
-      if (strcmp(argv[1],"-d")==0) {
-         opt_devfile = argv[2];
-      } else if (strcmp(argv[1],"-m")==0) {
-         opt_idsfile = argv[2];
+   // The last two arguments are always the directory and the image, so
+   // that a listing-only directory name beginning with '-' still works
+   for (i=1; i+1 < argc-2; i+=2) {
+      if (strcmp(argv[i],"-d")==0 && !opt_devfile) {
+         opt_devfile = argv[i+1];
+      } else if (strcmp(argv[i],"-m")==0 && !opt_idsfile) {
+         opt_idsfile = argv[i+1];
+      } else if (strcmp(argv[i],"-j")==0 && !opt_threads) {
+         opt_threads = atoi(argv[i+1]);
+         if (opt_threads < 1)
+           usage();
       } else
          usage();
-      dirname=argv[3];
-      imagefile=argv[4];
-   } else {
-      if (strcmp(argv[1],"-d")==0) {
-         opt_devfile = argv[2];
-      } else if (strcmp(argv[1],"-m")==0) {
-         opt_idsfile = argv[2];
-      } else
-         usage();
-
-      if (strcmp(argv[3],"-d")==0 && !opt_devfile) {
-         opt_devfile = argv[4];
-      } else if (strcmp(argv[3],"-m")==0 && !opt_idsfile) {
-         opt_idsfile = argv[4];
-      } else
-         usage();
-      dirname=argv[5];
-      imagefile=argv[6];
    }
+   if (argc < 3 || i != argc-2)
+     usage();
+   dirname=argv[argc-2];
+   imagefile=argv[argc-1];
+   if (!opt_threads)
+     opt_threads = sysconf(_SC_NPROCESSORS_ONLN);
    
    // Check the directory
    if (access(dirname, W_OK) == -1) {
@@ -739,6 +923,8 @@ int main(int argc, char **argv)
    do_dir_entry(rom_image, dirname, "", "", 0, &sb->root);
    
    //process_directory(rom_image, dirname, sb->root.offset<<2, sb->root.size, ".");
+
+   decode_blocks();
    
    printstats();
    return 0;
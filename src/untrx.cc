@@ -30,6 +30,8 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/sysmacros.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <endian.h>
 #include <byteswap.h>
@@ -37,62 +39,6 @@
 
 #include "untrx.h"
 
-/*************************************************************************
-* IdentifySegment
-*
-* identifies segments (i.e. squashfs, cramfs) and their version numbers
-*
-**************************************************************************/
-SEGMENT_TYPE IdentifySegment(unsigned char *pData, unsigned long nLength)
-{
-	squashfs_super_block *sqblock=(squashfs_super_block *)pData;
-	cramfs_super *crblock=(cramfs_super *)pData;
-	
-	if(sqblock->s_magic==SQUASHFS_MAGIC 
-		|| sqblock->s_magic==SQUASHFS_MAGIC_SWAP
-		|| sqblock->s_magic==SQUASHFS_MAGIC_ALT
-		|| sqblock->s_magic==SQUASHFS_MAGIC_ALT_SWAP)
-	{		
-		fprintf(stderr, " SQUASHFS magic: 0x%x\n", sqblock->s_magic);
-		short major = READ16_LE(sqblock->s_major);
-		short minor = READ16_LE(sqblock->s_minor);
-		fprintf(stderr, " SQUASHFS version: %d.%d\n", major, minor);
-	
-		switch(major)
-		{
-			case 3:
-				switch (minor)
-				{
-					case 0:						
-						return SEGMENT_TYPE_SQUASHFS_3_0;
-					case 1:						
-						return SEGMENT_TYPE_SQUASHFS_3_1;			
-					case 2:
-						return SEGMENT_TYPE_SQUASHFS_3_2;
-					default:
-						return SEGMENT_TYPE_SQUASHFS_3_x;						
-				}
-			case 2:
-				switch (minor)
-				{
-					case 0:
-						return SEGMENT_TYPE_SQUASHFS_2_0;
-					case 1:
-						return SEGMENT_TYPE_SQUASHFS_2_1;
-					default:
-						return SEGMENT_TYPE_SQUASHFS_2_x;						
-				}
-			default:
-				return SEGMENT_TYPE_SQUASHFS_OTHER;				
-		}
-	}	
-	else if(crblock->magic==CRAMFS_MAGIC || crblock->magic==CRAMFS_MAGIC_SWAP)
-	{
-		return SEGMENT_TYPE_CRAMFS_x_x;	
-	}	
-	return SEGMENT_TYPE_UNTYPED;
-}
-
 /*************************************************************************
 * EmitSquashfsMagic
 *
@@ -142,8 +88,9 @@ int main(int argc, char **argv)
 	}
 	
 	fprintf(stderr, " Opening %s\n", argv[1]);
-	FILE *fIn=fopen(argv[1],"rb");
-	if(!fIn)
+	int fdIn=open(argv[1],O_RDONLY);
+	struct stat st;
+	if(fdIn<0 || fstat(fdIn,&st)!=0)
 	{
 		fprintf(stderr, " ERROR opening %s\n", argv[1]);
 		exit(1);
@@ -156,24 +103,21 @@ int main(int argc, char **argv)
 		pszOutFolder[strlen(pszOutFolder)-1]=0;		
 	}	
 	
-	fseek(fIn,0,SEEK_END);
-	size_t nFilesize=ftell(fIn);
-	fseek(fIn,0,SEEK_SET);		
-	unsigned char *pData=(unsigned char *)malloc(nFilesize);	
-	unsigned char *pDataOrg=pData;
-	if(fread(pData,1,nFilesize,fIn)!=nFilesize)
+	// map rather than read the image, so memory use doesn't grow with its size
+	size_t nFilesize=st.st_size;
+	unsigned char *pDataOrg=(unsigned char *)(nFilesize ? 
+		mmap(NULL,nFilesize,PROT_READ,MAP_SHARED,fdIn,0) : MAP_FAILED);
+	if(pDataOrg==MAP_FAILED || nFilesize<U2ND_HEADER_SIZE+HDR0_SIZE)
 	{
 		fprintf(stderr," ERROR reading %s\n", argv[1]);		
-		fclose(fIn);	
-		free(pDataOrg);
+		close(fdIn);	
 		free(pszOutFolder);	
 		exit(1);
 	}	
-	fclose(fIn);	
-	fprintf(stderr, " read %lu bytes\n", nFilesize);
+	unsigned char *pData=pDataOrg;
+	fprintf(stderr, " mapped %lu bytes\n", nFilesize);
 	
 	// uf U2ND header present, skip past it (pData is preserved above)
-	unsigned long nDataSkip=0;
 	trx_header *trx=(trx_header *)pData;
 	if(READ32_LE(trx->magic)!=TRX_MAGIC)
 	{
@@ -182,7 +126,8 @@ int main(int argc, char **argv)
 		if(READ32_LE(trx->magic)!=TRX_MAGIC)
 		{
 			fprintf(stderr," ERROR trx header not found\n");
-			free(pDataOrg);
+			munmap(pDataOrg,nFilesize);
+			close(fdIn);
 			free(pszOutFolder);	
 			exit(2);			
 		}
@@ -195,8 +140,7 @@ int main(int argc, char **argv)
 	/* Extract the segments */
 	for(int nI=0;nI<3 && READ32_LE(trx->offsets[nI]);nI++)
 	{
-		FILE *fOut;			
-		
+		unsigned long nStartOffset=READ32_LE(trx->offsets[nI]);
 		unsigned long nEndOffset=0;
 		if(nI<2)
 		{
@@ -204,90 +148,63 @@ int main(int argc, char **argv)
 		}
 		if(!nEndOffset)
 		{
-			nEndOffset=nFilesize;
+			// offsets are relative to the trx header, not any U2ND prefix
+			nEndOffset=nFilesize-(pData-pDataOrg);
 		}		
+		if(nStartOffset>=nEndOffset || nEndOffset>nFilesize-(pData-pDataOrg))
+		{
+			fprintf(stderr,"  ERROR segment %d is outside of the image\n", nI+1);
+			munmap(pDataOrg,nFilesize);
+			close(fdIn);
+			free(pszOutFolder);	
+			free(pszTemp);
+			exit(5);
+		}
 		
-		switch(IdentifySegment(pData+READ32_LE(trx->offsets[nI]),
-			nEndOffset-READ32_LE(trx->offsets[nI])))
+		SEGMENT_TYPE type=IdentifySegment(pData+nStartOffset,nEndOffset-nStartOffset);
+		if(g_SegmentInfo[type].pszDescription)
 		{
-			case SEGMENT_TYPE_SQUASHFS_3_0:
-				fprintf(stderr, "  SQUASHFS v3.0 image detected\n");	
-				sprintf(pszTemp,"%s/squashfs_magic",pszOutFolder);								
-				if(!EmitSquashfsMagic((squashfs_super_block *)((char *)pData
-					+READ32_LE(trx->offsets[nI])),pszTemp))
-				{
-					fprintf(stderr,"  ERROR - writing %s\n", pszTemp);
-					free(pDataOrg);
-					free(pszOutFolder);	
-					free(pszTemp);
-					exit(3);		
-				}				
-				sprintf(pszTemp,"%s/squashfs-lzma-image-3_0",pszOutFolder);				
-				break;
-			case SEGMENT_TYPE_SQUASHFS_3_1:
-				fprintf(stderr, "  SQUASHFS v3.1 image detected\n");
-				sprintf(pszTemp,"%s/squashfs-lzma-image-3_1",pszOutFolder);
-				break;
-			case SEGMENT_TYPE_SQUASHFS_3_2:
-				fprintf(stderr, "  SQUASHFS v3.2 image detected\n");
-				sprintf(pszTemp,"%s/squashfs-lzma-image-3_2",pszOutFolder);
-				break;
-			case SEGMENT_TYPE_SQUASHFS_3_x:
-				fprintf(stderr, "  SQUASHFS v3.x (>3.2) image detected\n");
-				sprintf(pszTemp,"%s/squashfs-lzma-image-3_x",pszOutFolder);
-				break;
-			case SEGMENT_TYPE_SQUASHFS_2_0:
-				fprintf(stderr, "  SQUASHFS v2.0 image detected\n");
-				sprintf(pszTemp,"%s/squashfs-lzma-image-2_0",pszOutFolder);
-				break;
-			case SEGMENT_TYPE_SQUASHFS_2_1:
-				fprintf(stderr, "  SQUASHFS v2.1 image detected\n");
-				sprintf(pszTemp,"%s/squashfs-lzma-image-2_1",pszOutFolder);
-				break;
-			case SEGMENT_TYPE_SQUASHFS_2_x:
-				fprintf(stderr, "  SQUASHFS v2.x image detected\n");
-				sprintf(pszTemp,"%s/squashfs-lzma-image-2_x",pszOutFolder);
-				break;
-			case SEGMENT_TYPE_SQUASHFS_OTHER:
-				fprintf(stderr, "  ! WARNING: Unknown squashfs version.\n");
-				sprintf(pszTemp,"%s/squashfs-lzma-image-x_x",pszOutFolder);
-				break;
-			case SEGMENT_TYPE_CRAMFS_x_x:
-				fprintf(stderr, "  CRAMFS v? image detected\n");
-				sprintf(pszTemp,"%s/cramfs-image-x_x",pszOutFolder);
-				break;				
-			default:
-				sprintf(pszTemp,"%s/segment%d",pszOutFolder,nI+1);
-				break;			
-		}		
-		fprintf(stderr,"  Writing %s\n    size %ld from offset %d ...\n", 
+			fprintf(stderr, "  %s\n", g_SegmentInfo[type].pszDescription);
+		}
+		if(type==SEGMENT_TYPE_SQUASHFS_3_0)
+		{
+			sprintf(pszTemp,"%s/squashfs_magic",pszOutFolder);								
+			if(!EmitSquashfsMagic((squashfs_super_block *)(pData+nStartOffset),pszTemp))
+			{
+				fprintf(stderr,"  ERROR - writing %s\n", pszTemp);
+				munmap(pDataOrg,nFilesize);
+				close(fdIn);
+				free(pszOutFolder);	
+				free(pszTemp);
+				exit(3);		
+			}				
+		}
+		if(g_SegmentInfo[type].pszImageName)
+		{
+			sprintf(pszTemp,"%s/%s",pszOutFolder,g_SegmentInfo[type].pszImageName);
+		}
+		else
+		{
+			sprintf(pszTemp,"%s/segment%d",pszOutFolder,nI+1);
+		}
+		fprintf(stderr,"  Writing %s\n    size %ld from offset %ld ...\n", 
 			pszTemp, 
-			nEndOffset-READ32_LE(trx->offsets[nI]),
-			READ32_LE(trx->offsets[nI]));		
+			nEndOffset-nStartOffset,
+			nStartOffset);		
 
-		fOut=fopen(pszTemp,"wb");
-		if(!fOut)
-		{
-			fprintf(stderr,"  ERROR could not open %s\n", pszTemp);
-			free(pDataOrg);
-			free(pszOutFolder);	
-			free(pszTemp);
-			exit(3);		
-		}				
-		if(!fwrite(pData+READ32_LE(trx->offsets[nI]),1,
-			nEndOffset-READ32_LE(trx->offsets[nI]),fOut))
+		if(!EmitSegment(fdIn,pDataOrg,(pData-pDataOrg)+nStartOffset,nEndOffset-nStartOffset,pszTemp))
 		{
 			fprintf(stderr," ERROR could not write %s\n", pszTemp);
-			fclose(fOut);
-			free(pDataOrg);
+			munmap(pDataOrg,nFilesize);
+			close(fdIn);
 			free(pszOutFolder);	
 			free(pszTemp);
 			exit(4);				
 		}
-		fclose(fOut);	
 	}
 	
-	free(pDataOrg);
+	munmap(pDataOrg,nFilesize);
+	close(fdIn);
 	free(pszOutFolder);	
 	free(pszTemp);
 	printf("  Done!\n");
@@ -125,7 +125,15 @@ typedef enum _SEGMENT_TYPE
 	SEGMENT_TYPE_SQUASHFS_3_x,
 	SEGMENT_TYPE_SQUASHFS_OTHER,
 	SEGMENT_TYPE_CRAMFS_x_x,
-	SEGMENT_TYPE_CRAMFS_OTHER	
+	SEGMENT_TYPE_CRAMFS_OTHER,
+	SEGMENT_TYPE_SQUASHFS_4_x,
+	SEGMENT_TYPE_JFFS2,
+	SEGMENT_TYPE_YAFFS2,
+	SEGMENT_TYPE_UBI,
+	SEGMENT_TYPE_UIMAGE,
+	SEGMENT_TYPE_LZMA,
+	SEGMENT_TYPE_GZIP,
+	SEGMENT_TYPE_COUNT
 } SEGMENT_TYPE, *PSEGMENT_TYPE;
 	
 /************************************************************
@@ -203,6 +211,265 @@ struct cramfs_super {
 	//struct cramfs_inode root;	/* Root inode data */
 };
 
+/************************************************************
+	segment identification, shared by untrx and splitter3
+************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include "libcrc32.h"
+
+typedef SEGMENT_TYPE (*SEGMENT_CHECK)(const unsigned char *pData, size_t nLength, SEGMENT_TYPE type);
+
+/* a magic number, optionally confirmed (and refined) by a check of the rest of the header */
+typedef struct _SEGMENT_SIGNATURE
+{
+	const char *pMagic;
+	unsigned int nMagicLength;
+	SEGMENT_TYPE type;
+	SEGMENT_CHECK pfnCheck;
+} SEGMENT_SIGNATURE;
+
+/* how each type is reported and named when it is written out */
+typedef struct _SEGMENT_INFO
+{
+	const char *pszDescription;
+	const char *pszImageName;	/* NULL keeps the tool's default segment name */
+	bool bFilesystem;
+} SEGMENT_INFO;
+
+static SEGMENT_TYPE CheckSquashfs(const unsigned char *pData, size_t nLength, SEGMENT_TYPE type)
+{
+	if(nLength<sizeof(squashfs_super_block))
+	{
+		return SEGMENT_TYPE_UNTYPED;
+	}
+
+	/* s_major and s_minor are 16 bits each at offset 28, in the image's byte order */
+	bool bBigEndian=(pData[0]=='s' || pData[0]=='t');
+	short major=bBigEndian ? (pData[28]<<8)|pData[29] : pData[28]|(pData[29]<<8);
+	short minor=bBigEndian ? (pData[30]<<8)|pData[31] : pData[30]|(pData[31]<<8);
+	fprintf(stderr, " SQUASHFS magic: 0x%x\n", READ32_LE(*(u_int32_t *)pData));
+	fprintf(stderr, " SQUASHFS version: %d.%d\n", major, minor);
+
+	switch(major)
+	{
+		case 4:
+			return SEGMENT_TYPE_SQUASHFS_4_x;
+		case 3:
+			switch (minor)
+			{
+				case 0:
+					return SEGMENT_TYPE_SQUASHFS_3_0;
+				case 1:
+					return SEGMENT_TYPE_SQUASHFS_3_1;
+				case 2:
+					return SEGMENT_TYPE_SQUASHFS_3_2;
+				default:
+					return SEGMENT_TYPE_SQUASHFS_3_x;
+			}
+		case 2:
+			switch (minor)
+			{
+				case 0:
+					return SEGMENT_TYPE_SQUASHFS_2_0;
+				case 1:
+					return SEGMENT_TYPE_SQUASHFS_2_1;
+				default:
+					return SEGMENT_TYPE_SQUASHFS_2_x;
+			}
+		default:
+			return SEGMENT_TYPE_SQUASHFS_OTHER;
+	}
+}
+
+static SEGMENT_TYPE CheckHeaderLength(const unsigned char *pData, size_t nLength, SEGMENT_TYPE type)
+{
+	switch(type)
+	{
+		case SEGMENT_TYPE_CRAMFS_x_x:
+			return nLength>=sizeof(cramfs_super) ? type : SEGMENT_TYPE_UNTYPED;
+		case SEGMENT_TYPE_UIMAGE:
+			return nLength>=64 ? type : SEGMENT_TYPE_UNTYPED;
+		case SEGMENT_TYPE_UBI:
+			/* erase counter header: magic, then a version of 1 */
+			return nLength>=64 && pData[4]==1 ? type : SEGMENT_TYPE_UNTYPED;
+		default:
+			return type;
+	}
+}
+
+/*
+ * the node type must be one the kernel knows, with the accurate bit set, and
+ * hdr_crc must match the common header (a raw crc32 register started at 0)
+ */
+static SEGMENT_TYPE CheckJffs2(const unsigned char *pData, size_t nLength, SEGMENT_TYPE type)
+{
+	if(nLength<12)
+	{
+		return SEGMENT_TYPE_UNTYPED;
+	}
+
+	bool bLittle=pData[0]==0x85;
+	unsigned int nNodeType=bLittle ? pData[2]|(pData[3]<<8) : (pData[2]<<8)|pData[3];
+	unsigned int nKind=nNodeType&0xff;
+	if(!((nNodeType>>8)==0xe0 || (nNodeType>>8)==0x20) || nKind<1 || nKind>9)
+	{
+		return SEGMENT_TYPE_UNTYPED;
+	}
+
+	u_int32_t nHdrCrc=bLittle ?
+		pData[8]|(pData[9]<<8)|(pData[10]<<16)|((u_int32_t)pData[11]<<24) :
+		((u_int32_t)pData[8]<<24)|(pData[9]<<16)|(pData[10]<<8)|pData[11];
+	return crc32_update(0,pData,8)==nHdrCrc ? type : SEGMENT_TYPE_UNTYPED;
+}
+
+/* lc/lp/pb of 0x5d, then a power of two dictionary of at least 64KB */
+static SEGMENT_TYPE CheckLzma(const unsigned char *pData, size_t nLength, SEGMENT_TYPE type)
+{
+	if(nLength<13)
+	{
+		return SEGMENT_TYPE_UNTYPED;
+	}
+
+	u_int32_t nDictionary=pData[1]|(pData[2]<<8)|(pData[3]<<16)|((u_int32_t)pData[4]<<24);
+	return nDictionary>=0x10000 && !(nDictionary&(nDictionary-1)) ? type : SEGMENT_TYPE_UNTYPED;
+}
+
+static const SEGMENT_SIGNATURE g_Signatures[]=
+{
+	{ "hsqs", 4, SEGMENT_TYPE_SQUASHFS_OTHER, CheckSquashfs },
+	{ "sqsh", 4, SEGMENT_TYPE_SQUASHFS_OTHER, CheckSquashfs },
+	{ "hsqt", 4, SEGMENT_TYPE_SQUASHFS_OTHER, CheckSquashfs },	/* dd-wrt */
+	{ "tqsh", 4, SEGMENT_TYPE_SQUASHFS_OTHER, CheckSquashfs },
+	{ "\x45\x3d\xcd\x28", 4, SEGMENT_TYPE_CRAMFS_x_x, CheckHeaderLength },
+	{ "\x28\xcd\x3d\x45", 4, SEGMENT_TYPE_CRAMFS_x_x, CheckHeaderLength },
+	{ "\x85\x19", 2, SEGMENT_TYPE_JFFS2, CheckJffs2 },
+	{ "\x19\x85", 2, SEGMENT_TYPE_JFFS2, CheckJffs2 },
+	/* the root directory object header: directory, parent object 1, checksum 0xffff */
+	{ "\x03\x00\x00\x00\x01\x00\x00\x00\xff\xff", 10, SEGMENT_TYPE_YAFFS2, NULL },
+	{ "\x00\x00\x00\x03\x00\x00\x00\x01\xff\xff", 10, SEGMENT_TYPE_YAFFS2, NULL },
+	{ "UBI#", 4, SEGMENT_TYPE_UBI, CheckHeaderLength },
+	{ "\x27\x05\x19\x56", 4, SEGMENT_TYPE_UIMAGE, CheckHeaderLength },
+	{ "\x5d\x00\x00", 3, SEGMENT_TYPE_LZMA, CheckLzma },
+	{ "\x1f\x8b\x08", 3, SEGMENT_TYPE_GZIP, NULL },
+	{ NULL, 0, SEGMENT_TYPE_UNTYPED, NULL }
+};
+
+static const SEGMENT_INFO g_SegmentInfo[SEGMENT_TYPE_COUNT]=
+{
+	/* SEGMENT_TYPE_UNTYPED */		{ NULL, NULL, false },
+	/* SEGMENT_TYPE_SQUASHFS_2_0 */		{ "SQUASHFS v2.0 image detected", "squashfs-lzma-image-2_0", true },
+	/* SEGMENT_TYPE_SQUASHFS_2_1 */		{ "SQUASHFS v2.1 image detected", "squashfs-lzma-image-2_1", true },
+	/* SEGMENT_TYPE_SQUASHFS_2_x */		{ "SQUASHFS v2.x image detected", "squashfs-lzma-image-2_x", true },
+	/* SEGMENT_TYPE_SQUASHFS_3_0 */		{ "SQUASHFS v3.0 image detected", "squashfs-lzma-image-3_0", true },
+	/* SEGMENT_TYPE_SQUASHFS_3_1 */		{ "SQUASHFS v3.1 image detected", "squashfs-lzma-image-3_1", true },
+	/* SEGMENT_TYPE_SQUASHFS_3_2 */		{ "SQUASHFS v3.2 image detected", "squashfs-lzma-image-3_2", true },
+	/* SEGMENT_TYPE_SQUASHFS_3_x */		{ "SQUASHFS v3.x (>3.2) image detected", "squashfs-lzma-image-3_x", true },
+	/* SEGMENT_TYPE_SQUASHFS_OTHER */	{ "! WARNING: Unknown squashfs version.", "squashfs-lzma-image-x_x", true },
+	/* SEGMENT_TYPE_CRAMFS_x_x */		{ "CRAMFS v? image detected", "cramfs-image-x_x", true },
+	/* SEGMENT_TYPE_CRAMFS_OTHER */		{ "CRAMFS v? image detected", "cramfs-image-x_x", true },
+	/* SEGMENT_TYPE_SQUASHFS_4_x */		{ "SQUASHFS v4.x image detected", "squashfs-image-4_x", true },
+	/* SEGMENT_TYPE_JFFS2 */		{ "JFFS2 image detected", "jffs2-image", true },
+	/* SEGMENT_TYPE_YAFFS2 */		{ "YAFFS2 image detected", "yaffs2-image", true },
+	/* SEGMENT_TYPE_UBI */			{ "UBI image detected", "ubi-image", true },
+	/* SEGMENT_TYPE_UIMAGE */		{ "uImage kernel detected", NULL, false },
+	/* SEGMENT_TYPE_LZMA */			{ "LZMA compressed kernel detected", NULL, false },
+	/* SEGMENT_TYPE_GZIP */			{ "gzip compressed kernel detected", NULL, false },
+};
+
+/*************************************************************************
+* IdentifySegment
+*
+* identifies segments (i.e. squashfs, cramfs, kernels) and their version
+* numbers by matching the signature table against the start of pData,
+* never reading past nLength bytes
+*
+**************************************************************************/
+SEGMENT_TYPE IdentifySegment(const unsigned char *pData, size_t nLength)
+{
+	for(const SEGMENT_SIGNATURE *pSig=g_Signatures;pSig->pMagic;pSig++)
+	{
+		if(nLength<pSig->nMagicLength || pData[0]!=(unsigned char)pSig->pMagic[0]
+			|| memcmp(pData,pSig->pMagic,pSig->nMagicLength))
+		{
+			continue;
+		}
+
+		SEGMENT_TYPE type=pSig->pfnCheck ? pSig->pfnCheck(pData,nLength,pSig->type) : pSig->type;
+		if(type!=SEGMENT_TYPE_UNTYPED)
+		{
+			return type;
+		}
+	}
+	return SEGMENT_TYPE_UNTYPED;
+}
+
+/*************************************************************************
+* EmitSegment
+*
+* writes nLength bytes at nOffset of the (mapped) input to a file. the
+* kernel copies the data with copy_file_range, or sendfile where that
+* isn't available, so it never passes through a user buffer; the mapping
+* is only written from as a last resort.
+*
+**************************************************************************/
+bool EmitSegment(int fdIn, const unsigned char *pMap, off_t nOffset, size_t nLength, const char *pszOutFile)
+{
+	int fdOut=open(pszOutFile, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if(fdOut<0)
+	{
+		return false;
+	}
+
+	bool bCopyRange=true, bSendfile=true;
+	while(nLength)
+	{
+		ssize_t nDone=-1;
+#ifdef SYS_copy_file_range
+		if(bCopyRange)
+		{
+			loff_t nIn=nOffset;
+			nDone=syscall(SYS_copy_file_range, fdIn, &nIn, fdOut, NULL, nLength, 0);
+			if(nDone<0 && (errno==ENOSYS || errno==EXDEV || errno==EINVAL || errno==EOPNOTSUPP))
+			{
+				bCopyRange=false;
+				continue;
+			}
+		}
+		else
+#endif
+		if(bSendfile)
+		{
+			off_t nIn=nOffset;
+			nDone=sendfile(fdOut, fdIn, &nIn, nLength);
+			if(nDone<0 && (errno==ENOSYS || errno==EINVAL))
+			{
+				bSendfile=false;
+				continue;
+			}
+		}
+		else
+		{
+			nDone=write(fdOut, pMap+nOffset, nLength);
+		}
+
+		if(nDone<=0)
+		{
+			close(fdOut);
+			return false;
+		}
+		nOffset+=nDone;
+		nLength-=nDone;
+	}
+
+	return close(fdOut)==0;
+}
+
 /*
 #ifdef __cplusplus
 }
@@ -56,6 +56,7 @@
 
 #define UNYAFFS2_OBJTABLE_SIZE	4096
 #define UNYAFFS2_HARDLINK_MAX	127
+#define UNYAFFS2_CHUNKS_MIN	16
 
 #define UNYAFFS2_FLAGS_NONROOT	(1 << 0)
 #define UNYAFFS2_FLAGS_SHOWBAR	(1 << 1)
@@ -128,9 +129,21 @@
 
 /*----------------------------------------------------------------------------*/
 
+/*
+ * where the live copy of a data chunk is in the image. NAND dumps of live
+ * devices have the chunks of a file scattered and rewritten, so the scan
+ * keeps the copy with the highest sequence number for each chunk.
+ */
+typedef struct unyaffs2_chunk {
+	off_t offset;			/* -1 if never seen */
+	unsigned seq;
+	unsigned n_bytes;
+} unyaffs2_chunk_t;
+
 typedef struct unyaffs2_file_var {
 	loff_t file_size;
-	off_t file_head;
+	unsigned nchunks;		/* entries allocated in chunks */
+	struct unyaffs2_chunk *chunks;	/* indexed by chunk_id - 1 */
 } unyaffs2_file_var_t;
 
 typedef struct unyaffs2_symlink_var {
@@ -157,6 +170,7 @@ typedef struct unyaffs2_obj {
 	unsigned char extracted:1;	/* 1 when extracted. */
 
 	off_t hdr_off;			/* header offset in the image */
+	unsigned hdr_seq;		/* sequence number of the header */
 
 	unsigned obj_id;
 	unsigned parent_id;
@@ -252,12 +266,24 @@ unyaffs2_obj_alloc (void)
 }
 
 static void
-unyaffs2_obj_free (struct unyaffs2_obj *obj)
+unyaffs2_obj_clear_variant (struct unyaffs2_obj *obj)
 {
 	if (obj->type == YAFFS_OBJECT_TYPE_SYMLINK &&
 	    obj->variant.symlink.alias != NULL)
 		free(obj->variant.symlink.alias);
 
+	if (obj->type == YAFFS_OBJECT_TYPE_FILE &&
+	    obj->variant.file.chunks != NULL)
+		free(obj->variant.file.chunks);
+
+	memset(&obj->variant, 0, sizeof(obj->variant));
+}
+
+static void
+unyaffs2_obj_free (struct unyaffs2_obj *obj)
+{
+	unyaffs2_obj_clear_variant(obj);
+
 	list_del(&obj->children);
 	list_del(&obj->siblings);
 	list_del(&obj->hashlist);
@@ -267,6 +293,58 @@ unyaffs2_obj_free (struct unyaffs2_obj *obj)
 
 /*----------------------------------------------------------------------------*/
 
+/*
+ * per-file chunk index
+ */
+
+static int
+unyaffs2_chunk_insert (struct unyaffs2_obj *obj, unsigned chunk_id,
+		       off_t offset, unsigned seq, unsigned n_bytes)
+{
+	unsigned n, i = chunk_id - 1;
+	struct unyaffs2_file_var *file = &obj->variant.file;
+	struct unyaffs2_chunk *chunks;
+
+	if (i >= file->nchunks) {
+		n = file->nchunks ? file->nchunks : UNYAFFS2_CHUNKS_MIN;
+		while (n <= i)
+			n <<= 1;
+
+		chunks = realloc(file->chunks,
+				 n * sizeof(struct unyaffs2_chunk));
+		if (chunks == NULL)
+			return -1;
+
+		memset(chunks + file->nchunks, 0xff,
+		       (n - file->nchunks) * sizeof(struct unyaffs2_chunk));
+		file->chunks = chunks;
+		file->nchunks = n;
+	}
+
+	/* a later copy in the same block supersedes an earlier one */
+	if (file->chunks[i].offset == -1 || seq >= file->chunks[i].seq) {
+		file->chunks[i].offset = offset;
+		file->chunks[i].seq = seq;
+		file->chunks[i].n_bytes = n_bytes;
+	}
+
+	return 0;
+}
+
+static inline struct unyaffs2_chunk *
+unyaffs2_chunk_find (struct unyaffs2_obj *obj, unsigned chunk_id)
+{
+	struct unyaffs2_file_var *file = &obj->variant.file;
+
+	if (chunk_id == 0 || chunk_id > file->nchunks ||
+	    file->chunks[chunk_id - 1].offset == -1)
+		return NULL;
+
+	return &file->chunks[chunk_id - 1];
+}
+
+/*----------------------------------------------------------------------------*/
+
 /*
  * hash table to look up objects
  */
@@ -636,6 +714,11 @@ unyaffs2_extract_oh_size (struct yaffs_obj_hdr *oh)
 static int
 unyaffs2_oh2obj (struct unyaffs2_obj *obj, struct yaffs_obj_hdr *oh)
 {
+	/* keep the chunk index of a file found before its header */
+	if (obj->type != YAFFS_OBJECT_TYPE_FILE ||
+	    oh->type != YAFFS_OBJECT_TYPE_FILE)
+		unyaffs2_obj_clear_variant(obj);
+
 	switch (oh->type) {
 	case YAFFS_OBJECT_TYPE_FILE:
 		obj->type = YAFFS_OBJECT_TYPE_FILE;
@@ -831,6 +914,7 @@ unyaffs2_scan_img_status (unsigned status)
 static int
 unyaffs2_scan_chunk (unsigned char *buffer, off_t offset)
 {
+	unsigned seq;
 	struct yaffs_obj_hdr oh;
 	struct yaffs_ext_tags tag;
 	struct unyaffs2_obj *obj;
@@ -849,6 +933,9 @@ unyaffs2_scan_chunk (unsigned char *buffer, off_t offset)
 		return 0;
 	}
 
+	/* yaffs1 has no sequence numbers, the image order decides */
+	seq = UNYAFFS2_ISYAFFS1 ? 0 : tag.seq_number;
+
 	if (tag.chunk_id == 0) {
 	/* a new object */
 		obj = unyaffs2_objtable_find_alloc(tag.obj_id);
@@ -859,9 +946,13 @@ unyaffs2_scan_chunk (unsigned char *buffer, off_t offset)
 		}
 
 		if (obj->valid) {
-			UNYAFFS2_DEBUG("skip duplicated object %u\n",
-				       tag.obj_id);
-			return -1;
+			if (seq < obj->hdr_seq) {
+				UNYAFFS2_DEBUG("skip stale header of object "
+					       "%u\n", tag.obj_id);
+				return 0;
+			}
+			/* a rewritten header, counted already */
+			unyaffs2_image_objs--;
 		}
 
 		memcpy(&oh, unyaffs2_databuf, sizeof(struct yaffs_obj_hdr));
@@ -872,12 +963,13 @@ unyaffs2_scan_chunk (unsigned char *buffer, off_t offset)
 		unyaffs2_oh2obj(obj, &oh);
 		obj->obj_id = tag.obj_id;
 		obj->hdr_off = offset;
+		obj->hdr_seq = seq;
 		obj->valid = 1;
 
 		unyaffs2_image_objs++;
 	}
-	else if (tag.chunk_id == 1) {
-	/* the first data chunk of a object */
+	else {
+	/* a data chunk, the header may not have been seen yet */
 		obj = unyaffs2_objtable_find_alloc(tag.obj_id);
 		if (obj == NULL) {
 			UNYAFFS2_ERROR("cannot allocate memory ");
@@ -885,8 +977,22 @@ unyaffs2_scan_chunk (unsigned char *buffer, off_t offset)
 			return -1;
 		}
 
-		obj->type = YAFFS_OBJECT_TYPE_FILE;
-		obj->variant.file.file_head = offset;
+		if (obj->type != YAFFS_OBJECT_TYPE_FILE) {
+			if (obj->valid) {
+				UNYAFFS2_DEBUG("data chunk of non-file object "
+					       "%u skipped\n", tag.obj_id);
+				return 0;
+			}
+			obj->type = YAFFS_OBJECT_TYPE_FILE;
+		}
+
+		if (unyaffs2_chunk_insert(obj, tag.chunk_id, offset, seq,
+					  tag.n_bytes) < 0) {
+			UNYAFFS2_ERROR("cannot allocate memory ");
+			UNYAFFS2_ERROR("for chunks of object %u\n",
+				       tag.obj_id);
+			return -1;
+		}
 	}
 
 	return 0;
@@ -1040,12 +1146,12 @@ static int
 unyaffs2_extract_file_mmap (unsigned char *addr, size_t size, const char *fpath,
 			    struct unyaffs2_obj *obj)
 {
-	int outfd;
-	unsigned char *outaddr, *curaddr, *endaddr = addr + size;
-	size_t bufsize = unyaffs2_chunksize + unyaffs2_sparesize;
-	size_t fsize = obj->variant.file.file_size, remains = 0, written = 0;
+	int outfd, retval = -1;
+	unsigned chunk_id, chunks;
+	unsigned char *outaddr;
+	size_t fsize = obj->variant.file.file_size, pos, written;
 
-	struct yaffs_ext_tags tag;
+	struct unyaffs2_chunk *chunk;
 
 	outfd = open(fpath, O_RDWR | O_CREAT | O_TRUNC, obj->mode);
 	if (outfd < 0) {
@@ -1054,8 +1160,10 @@ unyaffs2_extract_file_mmap (unsigned char *addr, size_t size, const char *fpath,
 		return -1;
 	}
 
-	if (fsize == 0)
+	if (fsize == 0) {
+		retval = 0;
 		goto out;
+	}
 
 	/* stretch the file */
 	if (lseek(outfd, fsize - 1, SEEK_SET) < 0 ||
@@ -1074,48 +1182,46 @@ unyaffs2_extract_file_mmap (unsigned char *addr, size_t size, const char *fpath,
 		goto out;
 	}
 
-	if (obj->variant.file.file_head == ~(off_t)0) {
-		UNYAFFS2_DEBUG("invalid head offset of file  '%s'\n", fpath);
-		goto out;
-	}
-
-	addr += obj->variant.file.file_head;
-	curaddr = outaddr;
-	remains = fsize;
-
-	while (addr < endaddr && remains > 0) {
-		unyaffs2_extract_ptags(&tag, addr + unyaffs2_chunksize,
-				       NULL, 0);
+	/* gather the chunks from the index, holes stay zero-filled */
+	retval = 0;
+	chunks = (fsize + unyaffs2_chunksize - 1) / unyaffs2_chunksize;
+	for (chunk_id = 1; chunk_id <= chunks; chunk_id++) {
+		chunk = unyaffs2_chunk_find(obj, chunk_id);
+		if (chunk == NULL) {
+			UNYAFFS2_DEBUG("chunk %u of '%s' not found\n",
+					chunk_id, fpath);
+			continue;
+		}
 
-		written = remains < tag.n_bytes ? remains : tag.n_bytes;
-		memcpy(curaddr, addr, written);
-		if (memcmp(curaddr, addr, written)) {
-			UNYAFFS2_DEBUG("copy file failed '%s': %s\n",
-					fpath, strerror(errno));
+		if (chunk->offset + unyaffs2_chunksize > size) {
+			UNYAFFS2_DEBUG("chunk %u of '%s' is out of image\n",
+					chunk_id, fpath);
+			retval = -1;
 			break;
 		}
 
-		remains -= written;
-		curaddr += written;
-		addr += bufsize;
+		pos = (size_t)(chunk_id - 1) * unyaffs2_chunksize;
+		written = MIN(fsize - pos, MIN(chunk->n_bytes,
+					       unyaffs2_chunksize));
+		memcpy(outaddr + pos, addr + chunk->offset, written);
 	}
 
 	munmap(outaddr, fsize);
 out:
 	close(outfd);
 
-	return !(remains == 0);
+	return retval;
 }
 #else
 static int
 unyaffs2_extract_file (const int fd, const char *fpath,
 		       struct unyaffs2_obj *obj)
 {
-	int outfd;
-	size_t written = 0, size = obj->variant.file.file_size;
-	ssize_t w, r;
+	int outfd, retval = 0;
+	unsigned chunk_id, chunks;
+	size_t size = obj->variant.file.file_size, pos, written;
 
-	struct yaffs_ext_tags tag;
+	struct unyaffs2_chunk *chunk;
 
 	if (obj->type != YAFFS_OBJECT_TYPE_FILE)
 		return 0;
@@ -1127,40 +1233,44 @@ unyaffs2_extract_file (const int fd, const char *fpath,
 		return -1;
 	}
 
-	if (obj->variant.file.file_head == ~(off_t)0) {
-		UNYAFFS2_DEBUG("invalid head offset of file  '%s'\n", fpath);
-		goto out;
-	}
-
-	lseek(fd, obj->variant.file.file_head, SEEK_SET);
+	/* gather the chunks from the index, holes stay zero-filled */
+	chunks = (size + unyaffs2_chunksize - 1) / unyaffs2_chunksize;
+	for (chunk_id = 1; chunk_id <= chunks; chunk_id++) {
+		chunk = unyaffs2_chunk_find(obj, chunk_id);
+		if (chunk == NULL) {
+			UNYAFFS2_DEBUG("chunk %u of '%s' not found\n",
+					chunk_id, fpath);
+			continue;
+		}
 
-	/* read image until the size is reached */
-	while (written < size &&
-	       (r = safe_read(fd, unyaffs2_databuf, unyaffs2_bufsize)) != 0)
-	{
-		if (r != unyaffs2_bufsize) {
+		if (lseek(fd, chunk->offset, SEEK_SET) < 0 ||
+		    safe_read(fd, unyaffs2_databuf, unyaffs2_chunksize) !=
+		    unyaffs2_chunksize) {
 			UNYAFFS2_DEBUG("read image failed '%s': %s\n",
 					fpath, strerror(errno));
+			retval = -1;
 			break;
 		}
 
-		unyaffs2_extract_ptags(&tag,
-				       unyaffs2_databuf + unyaffs2_chunksize,
-				       NULL, 0);
-
-		w = safe_write(outfd, unyaffs2_databuf, tag.n_bytes);
-		if (w != tag.n_bytes) {
+		pos = (size_t)(chunk_id - 1) * unyaffs2_chunksize;
+		written = MIN(size - pos, MIN(chunk->n_bytes,
+					      unyaffs2_chunksize));
+		if (lseek(outfd, pos, SEEK_SET) < 0 ||
+		    safe_write(outfd, unyaffs2_databuf, written) != written) {
 			UNYAFFS2_DEBUG("write file failed '%s': %s",
 					fpath, strerror(errno));
+			retval = -1;
 			break;
 		}
-
-		written += tag.n_bytes;
 	}
 
+	/* a trailing hole */
+	if (!retval && ftruncate(outfd, size) < 0)
+		retval = -1;
+
 	close(outfd);
 
-	return !(written == size);
+	return retval;
 }
 #endif
 
@@ -1173,7 +1283,7 @@ unyaffs2_extract_hardlink (const char *fpath, struct unyaffs2_obj *obj)
 	char *lnkfile;
 
 	struct unyaffs2_obj *equiv;
-	union unyaffs2_file_variant *variant;
+	union unyaffs2_file_variant variant;
 
 	equiv = unyaffs2_follow_hardlink(obj);
 	if (equiv == NULL) {
@@ -36,27 +36,71 @@ others/squashfs-4.0-realtek \
 others/squashfs-hg55x-bin"
 TIMEOUT="60"
 MKFS=""
+MAJOR=""
+UNSQUASHFS=""
 
 function wait_for_complete()
 {
 	I=0
-	PNAME="$1"
+	PID="$1"
 
 	while [ $I -lt $TIMEOUT ]
 	do
-		sleep 1
-
-		if [ "$(pgrep $PNAME)" == "" ]
+		if ! kill -0 $PID 2>/dev/null
 		then
 			break
 		fi
 
+		sleep 1
+
 		((I=$I+1))
 	done
 
 	if [ "$I" == "$TIMEOUT" ]
 	then
-		kill -9 $(pgrep $PNAME) 2>/dev/null
+		kill -9 $PID 2>/dev/null
+	fi
+
+	wait $PID 2>/dev/null
+}
+
+# Extract the image with unsquashfs $1; on success sets MKFS to the matching mksquashfs ($2)
+function try_unsquashfs()
+{
+	local UNSQUASHFS_BIN="$1"
+	local MKSQUASHFS_BIN="$2"
+
+	if [ "$MKFS" != "" ] || [ ! -e "$UNSQUASHFS_BIN" ]
+	then
+		return
+	fi
+
+	echo -ne "\nTrying $UNSQUASHFS_BIN... "
+
+	$UNSQUASHFS_BIN -dest "$DIR" "$IMG" 2>/dev/null &
+	#sleep $TIMEOUT && kill $! 1>&2 >/dev/null
+	wait_for_complete $!
+
+	if [ -d "$DIR" ]
+	then
+		if [ "$(ls "$DIR")" != "" ]
+		then
+			# Most systems will have busybox - make sure it's a non-zero file size
+			if [ -e "$DIR/bin/sh" ]
+			then
+				if [ "$(wc -c "$DIR/bin/sh" | cut -d' ' -f1)" != "0" ]
+				then
+					MKFS="$MKSQUASHFS_BIN"
+				fi
+			else
+				MKFS="$MKSQUASHFS_BIN"
+			fi
+		fi
+
+		if [ "$MKFS" == "" ]
+		then
+			rm -rf "$DIR"
+		fi
 	fi
 }
 
@@ -85,12 +129,36 @@ DIR=$(readlink -f "$DIR")
 # Make sure we're operating out of the FMK directory
 cd $(dirname $(readlink -f "$0"))
 
-MAJOR=$(./src/binwalk-2.1.1/src/scripts/binwalk -l 1024 "$IMG" | head -4 | tail -1 | sed -e 's/.*version //' | cut -d'.' -f1)
+# Identify the SquashFS variant and go straight to the matching extractor(s)
+if [ -x "$ROOT/sqprobe/sqprobe" ]
+then
+	eval $($ROOT/sqprobe/sqprobe "$IMG")
+	MAJOR="$SQUASHFS_MAJOR"
+fi
+
+if [ "$MAJOR" == "" ]
+then
+	MAJOR=$(./src/binwalk-2.1.1/src/scripts/binwalk -l 1024 "$IMG" | head -4 | tail -1 | sed -e 's/.*version //' | cut -d'.' -f1)
+fi
 
 echo -e "Attempting to extract SquashFS $MAJOR.X file system...\n"
 
+for CANDIDATE in $UNSQUASHFS
+do
+	unsquashfs="$ROOT/$CANDIDATE"
+	mksquashfs="$(dirname $unsquashfs)/$(basename $unsquashfs | sed -e 's/^un/mk/')"
+
+	try_unsquashfs $unsquashfs $mksquashfs
+done
+
+# Fall back to trying every extractor for this major version
 for SUBDIR in $SUBDIRS
 do
+	if [ "$MKFS" != "" ]
+	then
+		break
+	fi
+
 	if [ "$(echo $SUBDIR | grep "$MAJOR\.")" == "" ]
 	then
 		echo "Skipping $SUBDIR (wrong version)..."
@@ -100,72 +168,16 @@ do
 	unsquashfs="$ROOT/$SUBDIR/unsquashfs"
 	mksquashfs="$ROOT/$SUBDIR/mksquashfs"
 
-	if [ -e $unsquashfs-lzma ]; then
-		echo -ne "\nTrying $unsquashfs-lzma... "
-
-		$unsquashfs-lzma -dest "$DIR" "$IMG" 2>/dev/null &
-		#sleep $TIMEOUT && kill $! 1>&2 >/dev/null
-		wait_for_complete $unsquashfs-lzma
-		
-		if [ -d "$DIR" ]
-                then
-			if [ "$(ls "$DIR")" != "" ]
-			then
-				# Most systems will have busybox - make sure it's a non-zero file size
-				if [ -e "$DIR/bin/sh" ]
-				then
-					if [ "$(wc -c "$DIR/bin/sh" | cut -d' ' -f1)" != "0" ]
-					then
-						MKFS="$mksquashfs-lzma"
-					fi
-				else
-                        		MKFS="$mksquashfs-lzma"
-				fi
-			fi
-			
-			if [ "$MKFS" == "" ]
-			then
-				rm -rf "$DIR"
-			fi
-                fi
-	fi
-	if [ "$MKFS" == "" ] && [ -e $unsquashfs ]; then
-		echo -ne "\nTrying $unsquashfs... "
-
-		$unsquashfs -dest "$DIR" "$IMG" 2>/dev/null &
-		#sleep $TIMEOUT && kill $! 1>&2 >/dev/null
-		wait_for_complete $unsquashfs
-
-		if [ -d "$DIR" ]
-		then
-			if [ "$(ls "$DIR")" != "" ]
-			then
-				# Most systems will have busybox - make sure it's a non-zero file size
-				if [ -e "$DIR/bin/sh" ]
-				then
-					if [ "$(wc -c "$DIR/bin/sh" | cut -d' ' -f1)" != "0" ]
-					then
-						MKFS="$mksquashfs"
-					fi
-				else
-					MKFS="$mksquashfs"
-				fi
-			fi
-
-			if [ "$MKFS" == "" ]
-			then
-				rm -rf "$DIR"
-			fi
-		fi
-	fi	
-
-	if [ "$MKFS" != "" ]
-	then
-		echo "File system sucessfully extracted!"
-		echo "MKFS=\"$MKFS\""
-		exit 0
-	fi
+	try_unsquashfs $unsquashfs-lzma $mksquashfs-lzma
+	try_unsquashfs $unsquashfs $mksquashfs
 done
 
+if [ "$MKFS" != "" ]
+then
+	echo "File system sucessfully extracted!"
+	echo "MKFS=\"$MKFS\""
+	exit 0
+fi
+
 echo "File extraction failed!"
 exit 1